@@ -1,6 +1,7 @@
 #pragma once
 #include <vector>
 #include "mmath.h"
+#include "mmath_simd.h"
 #include <string>
 #include <cassert>
 
@@ -27,6 +28,47 @@ enum class interpolation_type
 	cubic
 };
 
+//keyframe i whose segment [frames[i].t, frames[i + 1].t) holds t, t already wrapped / clamped to the track.
+//cursor is the answer of the previous lookup on the same track: playback only moves a frame or two per update
+//so looking there first makes the lookup O(1) amortized, seeks and loop wraps fall back to a binary search
+template<class FRAME>
+inline int find_frame(const std::vector<FRAME>& frames, float t, int* cursor)
+{
+	const int last = (int)frames.size() - 2;
+	if (cursor && *cursor >= 0 && *cursor <= last && frames[*cursor].t <= t)
+	{
+		int c = *cursor;
+		for (int steps = 0; steps < 4; steps++, c++)
+		{
+			if (c == last || t < frames[size_t(c) + 1].t)
+			{
+				*cursor = c;
+				return c;
+			}
+		}
+	}
+
+	int lo = 0;
+	int hi = last;
+	while (lo < hi)
+	{
+		int mid = (lo + hi + 1) / 2;
+		if (frames[mid].t <= t)
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid - 1;
+		}
+	}
+	if (cursor)
+	{
+		*cursor = lo;
+	}
+	return lo;
+}
+
 struct float3_track
 {
 	float3_track() : type(interpolation_type::constant) {}
@@ -59,21 +101,22 @@ struct float3_track
 		return frames[frames.size() - 1].t;
 	}
 
-	float3 sample(float t, bool loop)
+	float3 sample(float t, bool loop, int* cursor = nullptr)
 	{
 		switch (type)
 		{
-		case interpolation_type::constant: return sample_constant(t, loop);
-		case interpolation_type::linear: return sample_linear(t, loop);
-		case interpolation_type::cubic: return sample_cubic(t, loop);
+		case interpolation_type::constant: return sample_constant(t, loop, cursor);
+		case interpolation_type::linear: return sample_linear(t, loop, cursor);
+		case interpolation_type::cubic: return sample_cubic(t, loop, cursor);
 		default:
 			break;
 		}
 		assert(false);
-		return sample_constant(t, loop);
+		return sample_constant(t, loop, cursor);
 	}
 
-	int frame_index(float t, bool loop)
+	//cursor is optional per instance state, see find_frame
+	int frame_index(float t, bool loop, int* cursor = nullptr)
 	{
 		const int size = (int)frames.size();
 
@@ -91,26 +134,8 @@ struct float3_track
 				t += endTime - startTime;
 			}
 			t = t + startTime;
-			return (int)t;
-		}
-		else
-		{
-			if (t <= frames[0].t) {
-				return 0;
-			}
-			if (t >= frames[size_t(size) - 2].t) {
-				return size - 2;
-			}
-
-			for (int i = (int)size - 1; i >= 0; --i)
-			{
-				if (t >= frames[i].t)
-				{
-					return i;
-				}
-			}
 		}
-		return -1;
+		return find_frame(frames, t, cursor);
 	}
 	float adjust_to_fit_track(float t, bool loop)
 	{
@@ -151,9 +176,9 @@ struct float3_track
 	}
 
 protected:
-	float3 sample_constant(float t, bool loop)
+	float3 sample_constant(float t, bool loop, int* cursor)
 	{
-		int f = frame_index(t, loop);
+		int f = frame_index(t, loop, cursor);
 
 		if (f == -1 || f >= frames.size())
 		{
@@ -161,9 +186,9 @@ protected:
 		}
 		return frames[f].value;
 	}
-	float3 sample_linear(float t, bool loop)
+	float3 sample_linear(float t, bool loop, int* cursor)
 	{
-		int this_frame = frame_index(t, loop);
+		int this_frame = frame_index(t, loop, cursor);
 		if (this_frame == -1 || this_frame >= frames.size() - 1)
 		{
 			return float3();
@@ -187,9 +212,9 @@ protected:
 		return math::lerp(start, end, time);
 	}
 
-	float3 sample_cubic(float t, bool loop)
+	float3 sample_cubic(float t, bool loop, int* cursor)
 	{
-		int this_frame = frame_index(t, loop);
+		int this_frame = frame_index(t, loop, cursor);
 		if (this_frame == -1 || this_frame >= frames.size() - 1)
 		{
 			return float3();
@@ -258,21 +283,22 @@ struct quaternion_track
 		return frames[frames.size() - 1].t;
 	}
 
-	quaternion sample(float t, bool loop)
+	quaternion sample(float t, bool loop, int* cursor = nullptr)
 	{
 		switch (type)
 		{
-		case interpolation_type::constant: return sample_constant(t, loop);
-		case interpolation_type::linear: return sample_linear(t, loop);
-		case interpolation_type::cubic: return sample_cubic(t, loop);
+		case interpolation_type::constant: return sample_constant(t, loop, cursor);
+		case interpolation_type::linear: return sample_linear(t, loop, cursor);
+		case interpolation_type::cubic: return sample_cubic(t, loop, cursor);
 		default:
 			break;
 		}
 		assert(false);
-		return sample_constant(t, loop);
+		return sample_constant(t, loop, cursor);
 	}
 
-	int frame_index(float t, bool loop)
+	//cursor is optional per instance state, see find_frame
+	int frame_index(float t, bool loop, int* cursor = nullptr)
 	{
 		const int size = (int)frames.size();
 
@@ -284,11 +310,6 @@ struct quaternion_track
 		if (loop) {
 			float start_time = frames[0].t;
 			float end_time = frames[size - 1].t;
-			float duration = end_time - start_time;
-
-			if (duration < 0.0f) {
-				duration = fabsf(duration);
-			}
 
 			t = fmodf(t - start_time, end_time - start_time);
 			if (t < 0.0f) {
@@ -296,21 +317,7 @@ struct quaternion_track
 			}
 			t = t + start_time;
 		}
-		else {
-			if (t <= frames[0].t) {
-				return 0;
-			}
-			if (t >= frames[size - 2].t) {
-				return (int)size - 2;
-			}
-		}
-
-		for (int i = (int)size - 1; i >= 0; --i) {
-			if (t >= frames[i].t) {
-				return i;
-			}
-		}
-		return -1;
+		return find_frame(frames, t, cursor);
 	}
 	float adjust_to_fit_track(float t, bool loop)
 	{
@@ -357,9 +364,9 @@ struct quaternion_track
 	}
 
 protected:
-	quaternion sample_constant(float t, bool loop) 
+	quaternion sample_constant(float t, bool loop, int* cursor) 
 	{
-		int f = frame_index(t, loop);
+		int f = frame_index(t, loop, cursor);
 
 		if (f == -1 || f >= frames.size())
 		{
@@ -367,9 +374,9 @@ protected:
 		}
 		return frames[f].value;
 	}
-	quaternion sample_linear(float t, bool loop)
+	quaternion sample_linear(float t, bool loop, int* cursor)
 	{
-		int this_frame = frame_index(t, loop);
+		int this_frame = frame_index(t, loop, cursor);
 		if (this_frame == -1 || this_frame >= frames.size() - 1)
 		{
 			return quaternion();
@@ -390,19 +397,12 @@ protected:
 		quaternion start = frames[this_frame].value;
 		quaternion end = frames[next_frame].value;
 
-		if (math::dot(start, end) < 0)  // Neighborhood
-		{
-			return math::normalize(math::mix(start, -end, time));
-		}
-		else
-		{
-			return math::normalize(math::mix(start, end, time)); //NLerp, not slerp
-		}
+		return math::nlerp(start, end, time); //NLerp, not slerp
 
 	}
-	quaternion sample_cubic(float t, bool loop)
+	quaternion sample_cubic(float t, bool loop, int* cursor)
 	{
-		int this_frame = frame_index(t, loop);
+		int this_frame = frame_index(t, loop, cursor);
 		if (this_frame == -1 || this_frame >= frames.size() - 1)
 		{
 			return quaternion();
@@ -446,6 +446,14 @@ protected:
 	}
 };
 
+//frames found by the last sample of each component track, owned by whoever plays the clip
+struct track_cursor
+{
+	int position = 0;
+	int rotation = 0;
+	int scale = 0;
+};
+
 struct transform_track
 {
 	quaternion_track rotation;
@@ -526,20 +534,20 @@ struct transform_track
 		return position.size() > 1 || rotation.size() > 1 || scale.size() > 1;
 	}
 
-	transform sample(const transform& tf, float t, bool loop)
+	transform sample(const transform& tf, float t, bool loop, track_cursor* cursor = nullptr)
 	{
 		transform res = tf;
 		if (position.size() > 1)
 		{
-			res.position = position.sample(t, loop);
+			res.position = position.sample(t, loop, cursor ? &cursor->position : nullptr);
 		}
 		if (rotation.size() > 1)
 		{
-			res.rotation = rotation.sample(t, loop);
+			res.rotation = rotation.sample(t, loop, cursor ? &cursor->rotation : nullptr);
 		}
 		if (scale.size() > 1)
 		{
-			res.scale = scale.sample(t, loop);
+			res.scale = scale.sample(t, loop, cursor ? &cursor->scale : nullptr);
 		}
 		return res;
 	}
@@ -687,7 +695,7 @@ struct pose
 			math::to_float4x4(joints[i], global);
 			if (parent >= 0) {
 
-				res[i] = res[parent] * global;
+				math::simd::mul(res[parent], global, res[i]);
 			}
 			else
 			{
@@ -696,6 +704,7 @@ struct pose
 	
 		}
 
+		//only poses built with children before their parents get here, glTF rigs are sorted at load (get_joint_remap)
 		for (; i < size; ++i) {
 			transform t = get_global_transform(i);
 			math::to_float4x4(t, res[i]);
@@ -767,7 +776,9 @@ struct clip
 		tracks[index].bone_index = id;
 	}
 
-	float sample(pose& out, float t)
+	//cursors, when given, holds one track_cursor per track and is kept up to date for the next call.
+	//joint_filter, when given, holds a byte per joint, tracks of joints with a 0 are skipped
+	float sample(pose& out, float t, track_cursor* cursors = nullptr, const uint8_t* joint_filter = nullptr)
 	{
 		if (get_duration() == 0.0f)
 		{
@@ -780,9 +791,13 @@ struct clip
 		for (size_t i = 0; i < s; ++i)
 		{
 			size_t j = tracks[i].bone_index;
+			if (joint_filter && !joint_filter[j])
+			{
+				continue;
+			}
 
 			transform local = out.get_local_transform(j);
-			transform animated = tracks[i].sample(local, t, loop);
+			transform animated = tracks[i].sample(local, t, loop, cursors ? &cursors[i] : nullptr);
 			out.set_local_transform(j, animated);
 		}
 		return t;
@@ -871,6 +886,8 @@ struct rig
 
 	std::vector<float4x4> inv_bind_pose;
 	std::vector<std::string> joint_names;
+	//joint index of every glTF node, see get_joint_remap. Empty for rigs not loaded from glTF
+	std::vector<int> joint_remap;
 };
 
 struct ik_bone
@@ -890,7 +907,8 @@ struct ik_chain
 
 namespace ik_solver
 {
-	//Fabrik IK solver - very rudimentary no support for constraints yet... 
+	//Fabrik IK solver - very rudimentary no support for constraints yet, single chain, one iteration.
+	//ik_system solves many chains at once with constraints
 	inline void solve_ik_chain(ik_chain& chain, transform target)
 	{
 		float3 start_pos = chain.start.position;
@@ -910,10 +928,12 @@ namespace ik_solver
 			chain.bones[i].t.position = next + offset;
 		}
 
-		for (int i = 1; i < chain.size; ++i)
+		//root back where it started, the rest follow it out
+		chain.bones[0].t.position = start_pos;
+		for (size_t i = 1; i < chain.size; ++i)
 		{
 			float3 current = chain.bones[i].t.position;
-			float3 prev = chain.bones[size_t(i) + 1].t.position;
+			float3 prev = chain.bones[i - 1].t.position;
 			float3 dir = current - prev;
 
 			dir = math::normalize(dir);
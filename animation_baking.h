@@ -0,0 +1,188 @@
+#pragma once
+#include "animation.h"
+#include "mmath_simd.h"
+#include <stdint.h>
+
+//Baked clips: every joint the source clip animates is resampled at a fixed rate and stored one block per sample,
+//each block a structure of arrays over the baked joints:
+//position x, y, z, scale x, y, z, rotation x, y, z, w, joint_count floats each.
+//Sampling is a direct index into the two blocks around t followed by one lerp over the positions and scales
+//and one nlerp over the rotations of all joints, no per track branches or key searches.
+//Costs 40 bytes per joint per sample, trades memory for the fastest playback of the clip formats.
+
+struct baked_clip
+{
+	baked_clip() :loop(true), start_time(0.0f), end_time(0.0f), sample_rate(30.0f), sample_count(0), name("no name") {}
+
+	//pose joint of every baked joint, in block order
+	std::vector<uint32_t> joints;
+	//sample_count blocks of block_size() floats
+	std::vector<float> samples;
+
+	bool loop;
+	float start_time;
+	float end_time;
+	float sample_rate;
+	uint32_t sample_count;
+	std::string name;
+
+	float get_duration() const
+	{
+		return end_time - start_time;
+	}
+
+	size_t joint_count() const
+	{
+		return joints.size();
+	}
+
+	size_t block_size() const
+	{
+		return joints.size() * 10;
+	}
+
+	//floats sample needs as scratch
+	size_t scratch_size() const
+	{
+		return block_size();
+	}
+
+	size_t memory_size() const
+	{
+		return sizeof(baked_clip) + joints.size() * sizeof(uint32_t) + samples.size() * sizeof(float);
+	}
+
+	//same time handling as clip::adjust_time_to_fit
+	float adjust_time_to_fit(float t) const
+	{
+		float duration = end_time - start_time;
+		if (duration <= 0.0f)
+		{
+			return start_time;
+		}
+		if (loop)
+		{
+			t = fmodf(t - start_time, duration);
+			if (t < 0.0f)
+			{
+				t += duration;
+			}
+			t = t + start_time;
+		}
+		else
+		{
+			if (t < start_time)
+			{
+				t = start_time;
+			}
+			if (t > end_time)
+			{
+				t = end_time;
+			}
+		}
+		return t;
+	}
+
+	//writes the local transforms of the baked joints of out, same contract as clip::sample.
+	//scratch holds at least scratch_size() floats
+	float sample(pose& out, float t, float* scratch) const
+	{
+		if (get_duration() == 0.0f || sample_count == 0)
+		{
+			return 0.0f;
+		}
+
+		t = adjust_time_to_fit(t);
+		const size_t n = joints.size();
+		const float* from = &samples[0];
+		if (sample_count == 1)
+		{
+			memcpy(scratch, from, block_size() * sizeof(float));
+		}
+		else
+		{
+			float frame = (t - start_time) * sample_rate;
+			uint32_t index = std::min((uint32_t)frame, sample_count - 2);
+			float alpha = math::clamp(frame - (float)index, 0.0f, 1.0f);
+			from = &samples[index * block_size()];
+			const float* to = from + block_size();
+
+			//positions and scales are contiguous
+			math::simd::lerp(from, to, alpha, scratch, n * 6);
+			//the kernels only read from the input streams
+			float* a = const_cast<float*>(from) + n * 6;
+			float* b = const_cast<float*>(to) + n * 6;
+			float* r = scratch + n * 6;
+			math::simd::nlerp(
+				math::simd::quaternion_soa{ a, a + n, a + n * 2, a + n * 3 },
+				math::simd::quaternion_soa{ b, b + n, b + n * 2, b + n * 3 },
+				alpha,
+				math::simd::quaternion_soa{ r, r + n, r + n * 2, r + n * 3 }, n);
+		}
+
+		const float* px = scratch;
+		const float* sx = scratch + n * 3;
+		const float* rx = scratch + n * 6;
+		for (size_t i = 0; i < n; i++)
+		{
+			transform& local = out.joints[joints[i]];
+			local.position = float3(px[i], px[i + n], px[i + n * 2]);
+			local.scale = float3(sx[i], sx[i + n], sx[i + n * 2]);
+			local.rotation = quaternion(rx[i], rx[i + n], rx[i + n * 2], rx[i + n * 3]);
+		}
+		return t;
+	}
+};
+
+//resamples source at sample_rate. Only the joints source has tracks for are baked, their channels
+//the source doesn't animate are baked with the rest pose value of r, which is what clip::sample leaves in a pose
+//that starts out as the rest pose
+inline baked_clip bake_clip(clip& source, const rig& r, float sample_rate = 30.0f)
+{
+	baked_clip out;
+	out.name = source.name;
+	out.loop = source.loop;
+	out.start_time = source.start_time;
+	out.end_time = source.end_time;
+
+	const float duration = source.get_duration();
+	out.sample_count = duration > 0.0f ? (uint32_t)ceilf(duration * sample_rate) + 1 : 1;
+	//rounded so the last sample lands exactly on end_time
+	out.sample_rate = duration > 0.0f ? (out.sample_count - 1) / duration : sample_rate;
+
+	out.joints.reserve(source.tracks.size());
+	for (auto& track : source.tracks)
+	{
+		out.joints.push_back(track.bone_index);
+	}
+
+	const size_t n = out.joints.size();
+	const size_t block = out.block_size();
+	out.samples.resize(out.sample_count * block);
+
+	pose sampled = r.rest_pose;
+	for (uint32_t s = 0; s < out.sample_count; s++)
+	{
+		//tracks are sampled without looping so the last sample is the last key
+		float t = std::min(source.start_time + s / out.sample_rate, source.end_time);
+		float* p = &out.samples[s * block];
+		for (size_t i = 0; i < n; i++)
+		{
+			const uint32_t j = out.joints[i];
+			transform local = source.tracks[i].sample(sampled.get_local_transform(j), t, false);
+			sampled.set_local_transform(j, local);
+
+			p[i] = local.position.x;
+			p[i + n] = local.position.y;
+			p[i + n * 2] = local.position.z;
+			p[i + n * 3] = local.scale.x;
+			p[i + n * 4] = local.scale.y;
+			p[i + n * 5] = local.scale.z;
+			p[i + n * 6] = local.rotation.x;
+			p[i + n * 7] = local.rotation.y;
+			p[i + n * 8] = local.rotation.z;
+			p[i + n * 9] = local.rotation.w;
+		}
+	}
+	return out;
+}
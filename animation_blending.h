@@ -0,0 +1,133 @@
+#pragma once
+#include "animation.h"
+#include "mmath_simd.h"
+
+//Pose blending. Poses are converted to a structure of arrays once, then every layer is one pass of the
+//blend kernels over all joints: lerp / nlerp for cross fades and masked layers, difference and add for additive layers.
+
+//local transforms of a pose as 10 float streams of joint_count each:
+//position x, y, z, rotation x, y, z, w, scale x, y, z
+struct pose_soa
+{
+	std::vector<float> data;
+	size_t joint_count = 0;
+
+	//keeps the memory when the size doesn't change
+	void resize(size_t count)
+	{
+		if (joint_count != count)
+		{
+			joint_count = count;
+			data.resize(count * 10);
+		}
+	}
+
+	math::simd::transform_soa view()
+	{
+		float* p = data.data();
+		const size_t n = joint_count;
+		return math::simd::transform_soa{
+			math::simd::float3_soa{ p, p + n, p + n * 2 },
+			math::simd::quaternion_soa{ p + n * 3, p + n * 4, p + n * 5, p + n * 6 },
+			math::simd::float3_soa{ p + n * 7, p + n * 8, p + n * 9 } };
+	}
+
+	//the kernels only read from their input streams
+	math::simd::transform_soa view() const
+	{
+		return const_cast<pose_soa*>(this)->view();
+	}
+};
+
+//per joint weight of a layer, indexed by joint
+struct joint_mask
+{
+	std::vector<float> weights;
+};
+
+namespace blending
+{
+	inline void to_soa(const pose& in, pose_soa& out)
+	{
+		const size_t n = in.size();
+		out.resize(n);
+		math::simd::transform_soa s = out.view();
+		for (size_t i = 0; i < n; i++)
+		{
+			const transform& t = in.joints[i];
+			s.position.x[i] = t.position.x;
+			s.position.y[i] = t.position.y;
+			s.position.z[i] = t.position.z;
+			s.rotation.x[i] = t.rotation.x;
+			s.rotation.y[i] = t.rotation.y;
+			s.rotation.z[i] = t.rotation.z;
+			s.rotation.w[i] = t.rotation.w;
+			s.scale.x[i] = t.scale.x;
+			s.scale.y[i] = t.scale.y;
+			s.scale.z[i] = t.scale.z;
+		}
+	}
+
+	//out must already have in.joint_count joints
+	inline void from_soa(const pose_soa& in, pose& out)
+	{
+		const size_t n = in.joint_count;
+		math::simd::transform_soa s = in.view();
+		for (size_t i = 0; i < n; i++)
+		{
+			transform& t = out.joints[i];
+			t.position = float3(s.position.x[i], s.position.y[i], s.position.z[i]);
+			t.rotation = quaternion(s.rotation.x[i], s.rotation.y[i], s.rotation.z[i], s.rotation.w[i]);
+			t.scale = float3(s.scale.x[i], s.scale.y[i], s.scale.z[i]);
+		}
+	}
+
+	//weight for root and every joint below it, 0 for the rest. Upper / lower body layers
+	inline joint_mask make_mask(const pose& p, int root, float weight = 1.0f)
+	{
+		joint_mask mask;
+		mask.weights.assign(p.size(), 0.0f);
+		for (size_t i = 0; i < p.size(); i++)
+		{
+			for (int j = (int)i; j >= 0; j = p.parents[j])
+			{
+				if (j == root)
+				{
+					mask.weights[i] = weight;
+					break;
+				}
+			}
+		}
+		return mask;
+	}
+
+	//out[i] = weight * mask[i], or weight for every joint without a mask
+	inline void layer_weights(float weight, const joint_mask* mask, float* out, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			out[i] = mask && i < mask->weights.size() ? weight * mask->weights[i] : (mask ? 0.0f : weight);
+		}
+	}
+
+	//out = a blended towards b by weights, out may be a or b
+	inline void blend(const pose_soa& a, const pose_soa& b, const float* weights, pose_soa& out)
+	{
+		out.resize(a.joint_count);
+		math::simd::blend(a.view(), b.view(), weights, out.view(), a.joint_count);
+	}
+
+	//additive pose of p against reference, out may be p
+	inline void difference(const pose_soa& p, const pose_soa& reference, pose_soa& out)
+	{
+		out.resize(p.joint_count);
+		math::simd::difference(p.view(), reference.view(), out.view(), p.joint_count);
+	}
+
+	//out = base with the additive pose applied by weights, out may be base
+	inline void add(const pose_soa& base, const pose_soa& additive, const float* weights, pose_soa& out)
+	{
+		out.resize(base.joint_count);
+		math::simd::add(base.view(), additive.view(), weights, out.view(), base.joint_count);
+	}
+}
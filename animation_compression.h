@@ -0,0 +1,584 @@
+#pragma once
+#include "animation.h"
+#include <stdint.h>
+
+//Compressed clips: every channel (position, rotation, scale of a joint) is resampled at a fixed rate,
+//quantized and reduced to the keys needed to stay within an error budget, then played back with linear
+//interpolation. A key is 8 bytes (16 bit frame + 48 bit value) instead of the 40 / 52 byte frames of clip.
+//rotations are stored smallest three: index of the largest component in 2 bits and the other three in 15, 15 and 16 bits.
+//positions and scales are stored as 16 bits per component within the range of the channel.
+
+//key frames are stored in 16 bits, a clip can't be compressed into more samples than this
+constexpr size_t MAX_COMPRESSED_SAMPLES = 65536;
+
+struct clip_compression_settings
+{
+	//keys per second the source tracks are resampled at before the reduction
+	float sample_rate = 30.0f;
+	//maximum distance in world units any skinned vertex may move compared to the source clip
+	float error_budget = 0.0001f;
+	//distance from a joint to the vertices it skins, added to the reach of the joint towards its children
+	float skin_radius = 0.1f;
+	//per joint override of error_budget, indexed by joint. Empty or <= 0 means error_budget
+	std::vector<float> joint_error_budget;
+};
+
+struct compressed_channel
+{
+	//0: the source track doesn't animate the channel, the pose value is kept
+	//1: constant over the whole clip
+	uint32_t key_count = 0;
+	uint32_t first_key = 0;
+	//dequantized value = range_min + range_extent * q / 65535, unused for rotations
+	float3 range_min;
+	float3 range_extent;
+};
+
+struct compressed_transform_track
+{
+	uint32_t bone_index = 0;
+	compressed_channel position;
+	compressed_channel rotation;
+	compressed_channel scale;
+};
+
+struct compressed_clip
+{
+	compressed_clip() :loop(true), start_time(0.0f), end_time(0.0f), sample_rate(30.0f), name("no name") {}
+
+	std::vector<compressed_transform_track> tracks;
+	//sample index of every key since start_time, indexed by first_key + i
+	std::vector<uint16_t> frames;
+	//3 words per key
+	std::vector<uint16_t> values;
+
+	bool loop;
+	float start_time;
+	float end_time;
+	float sample_rate;
+	std::string name;
+
+	float get_duration() const
+	{
+		return end_time - start_time;
+	}
+
+	size_t memory_size() const
+	{
+		return sizeof(compressed_clip) + tracks.size() * sizeof(compressed_transform_track) + frames.size() * sizeof(uint16_t) + values.size() * sizeof(uint16_t);
+	}
+
+	//same time handling as clip::adjust_time_to_fit
+	float adjust_time_to_fit(float t) const
+	{
+		float duration = end_time - start_time;
+		if (duration <= 0.0f)
+		{
+			return start_time;
+		}
+		if (loop)
+		{
+			t = fmodf(t - start_time, duration);
+			if (t < 0.0f)
+			{
+				t += duration;
+			}
+			t = t + start_time;
+		}
+		else
+		{
+			if (t < start_time)
+			{
+				t = start_time;
+			}
+			if (t > end_time)
+			{
+				t = end_time;
+			}
+		}
+		return t;
+	}
+
+	//decompresses straight into the local transforms of out, same contract as clip::sample
+	float sample(pose& out, float t, track_cursor* cursors = nullptr, const uint8_t* joint_filter = nullptr) const
+	{
+		if (get_duration() == 0.0f)
+		{
+			return 0.0f;
+		}
+
+		t = adjust_time_to_fit(t);
+		float frame = (t - start_time) * sample_rate;
+
+		const size_t s = tracks.size();
+		for (size_t i = 0; i < s; ++i)
+		{
+			const compressed_transform_track& track = tracks[i];
+			if (joint_filter && !joint_filter[track.bone_index])
+			{
+				continue;
+			}
+			transform& local = out.joints[track.bone_index];
+			if (track.position.key_count != 0)
+			{
+				local.position = sample_float3(track.position, frame, cursors ? &cursors[i].position : nullptr);
+			}
+			if (track.rotation.key_count != 0)
+			{
+				local.rotation = sample_rotation(track.rotation, frame, cursors ? &cursors[i].rotation : nullptr);
+			}
+			if (track.scale.key_count != 0)
+			{
+				local.scale = sample_float3(track.scale, frame, cursors ? &cursors[i].scale : nullptr);
+			}
+		}
+		return t;
+	}
+
+	static void quantize(const float3& v, const float3& range_min, const float3& range_extent, uint16_t* out)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			float extent = (&range_extent.x)[c];
+			float n = extent > 0.0f ? ((&v.x)[c] - (&range_min.x)[c]) / extent : 0.0f;
+			n = math::clamp(n, 0.0f, 1.0f);
+			out[c] = (uint16_t)(n * 65535.0f + 0.5f);
+		}
+	}
+
+	static float3 dequantize(const uint16_t* q, const float3& range_min, const float3& range_extent)
+	{
+		constexpr float scale = 1.0f / 65535.0f;
+		return float3(
+			range_min.x + range_extent.x * (q[0] * scale),
+			range_min.y + range_extent.y * (q[1] * scale),
+			range_min.z + range_extent.z * (q[2] * scale));
+	}
+
+	static void quantize(const quaternion& rotation, uint16_t* out)
+	{
+		quaternion q = math::normalize(rotation);
+		int largest = 0;
+		for (int c = 1; c < 4; c++)
+		{
+			if (fabsf(q.v[c]) > fabsf(q.v[largest]))
+			{
+				largest = c;
+			}
+		}
+		//q and -q are the same rotation, keep the dropped component positive so it can be rebuilt with a sqrt
+		if (q.v[largest] < 0.0f)
+		{
+			q = -q;
+		}
+
+		//the three smaller components are within +-1/sqrt(2)
+		constexpr float range = 0.70710678f;
+		float small[3];
+		for (int c = 0, k = 0; c < 4; c++)
+		{
+			if (c != largest)
+			{
+				small[k++] = math::clamp(q.v[c], -range, range) / (2.0f * range) + 0.5f;
+			}
+		}
+		out[0] = (uint16_t)(((largest >> 1) << 15) | (uint16_t)(small[0] * 32767.0f + 0.5f));
+		out[1] = (uint16_t)(((largest & 1) << 15) | (uint16_t)(small[1] * 32767.0f + 0.5f));
+		out[2] = (uint16_t)(small[2] * 65535.0f + 0.5f);
+	}
+
+	static quaternion dequantize_rotation(const uint16_t* in)
+	{
+		constexpr float range = 0.70710678f;
+		int largest = ((in[0] >> 15) << 1) | (in[1] >> 15);
+		float small[3] = {
+			((in[0] & 0x7fff) / 32767.0f - 0.5f) * 2.0f * range,
+			((in[1] & 0x7fff) / 32767.0f - 0.5f) * 2.0f * range,
+			(in[2] / 65535.0f - 0.5f) * 2.0f * range
+		};
+		float sum = small[0] * small[0] + small[1] * small[1] + small[2] * small[2];
+
+		quaternion q;
+		for (int c = 0, k = 0; c < 4; c++)
+		{
+			q.v[c] = c == largest ? sqrtf(std::max(0.0f, 1.0f - sum)) : small[k++];
+		}
+		return q;
+	}
+
+private:
+	//same search as find_frame, over the frame numbers of one channel
+	static int find_key(const uint16_t* keys, int count, float frame, int* cursor)
+	{
+		const int last = count - 2;
+		if (cursor && *cursor >= 0 && *cursor <= last && keys[*cursor] <= frame)
+		{
+			int c = *cursor;
+			for (int steps = 0; steps < 4; steps++, c++)
+			{
+				if (c == last || frame < keys[c + 1])
+				{
+					*cursor = c;
+					return c;
+				}
+			}
+		}
+
+		int lo = 0;
+		int hi = last;
+		while (lo < hi)
+		{
+			int mid = (lo + hi + 1) / 2;
+			if (keys[mid] <= frame)
+			{
+				lo = mid;
+			}
+			else
+			{
+				hi = mid - 1;
+			}
+		}
+		if (cursor)
+		{
+			*cursor = lo;
+		}
+		return lo;
+	}
+
+	float segment_alpha(const compressed_channel& channel, int key, float frame) const
+	{
+		float a = frames[channel.first_key + key];
+		float b = frames[channel.first_key + key + 1];
+		return math::clamp((frame - a) / (b - a), 0.0f, 1.0f);
+	}
+
+	float3 sample_float3(const compressed_channel& channel, float frame, int* cursor) const
+	{
+		const uint16_t* q = &values[size_t(channel.first_key) * 3];
+		if (channel.key_count == 1)
+		{
+			return dequantize(q, channel.range_min, channel.range_extent);
+		}
+		int key = find_key(&frames[channel.first_key], (int)channel.key_count, frame, cursor);
+		float3 a = dequantize(q + key * 3, channel.range_min, channel.range_extent);
+		float3 b = dequantize(q + key * 3 + 3, channel.range_min, channel.range_extent);
+		return math::lerp(a, b, segment_alpha(channel, key, frame));
+	}
+
+	quaternion sample_rotation(const compressed_channel& channel, float frame, int* cursor) const
+	{
+		const uint16_t* q = &values[size_t(channel.first_key) * 3];
+		if (channel.key_count == 1)
+		{
+			return dequantize_rotation(q);
+		}
+		int key = find_key(&frames[channel.first_key], (int)channel.key_count, frame, cursor);
+		return math::nlerp(dequantize_rotation(q + key * 3), dequantize_rotation(q + key * 3 + 3), segment_alpha(channel, key, frame));
+	}
+};
+
+namespace compression_detail
+{
+	inline float3 transform_point(const transform& t, const float3& p)
+	{
+		return t.position + t.rotation * (t.scale * p);
+	}
+
+	//how far vertices skinned by the joint (or by its descendants) reach, in the joint's local space
+	inline void joint_reach(const pose& bind, float skin_radius, std::vector<float>& reach)
+	{
+		const size_t n = bind.size();
+		std::vector<transform> world(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			world[i] = bind.get_global_transform(i);
+		}
+
+		reach.assign(n, 0.0f);
+		for (size_t i = 0; i < n; i++)
+		{
+			for (int p = bind.parents[i]; p >= 0; p = bind.parents[p])
+			{
+				float d = math::length(world[i].position - world[p].position);
+				reach[p] = std::max(reach[p], d);
+			}
+		}
+		for (size_t i = 0; i < n; i++)
+		{
+			float3 s = world[i].scale;
+			float max_scale = std::max(fabsf(s.x), std::max(fabsf(s.y), fabsf(s.z)));
+			reach[i] = (reach[i] + skin_radius) / (max_scale > math::epsilon ? max_scale : 1.0f);
+		}
+	}
+
+	//joints on the longest root to leaf chain through each joint. The error of every joint on a chain
+	//adds up at the leaf, so each one gets budget / chain length
+	inline void chain_length(const pose& p, std::vector<int>& length)
+	{
+		const size_t n = p.size();
+		std::vector<int> depth(n, 0);
+		std::vector<int> height(n, 0);
+		for (size_t i = 0; i < n; i++)
+		{
+			for (int parent = p.parents[i]; parent >= 0; parent = p.parents[parent])
+			{
+				depth[i]++;
+			}
+		}
+		for (size_t i = 0; i < n; i++)
+		{
+			for (int parent = p.parents[i]; parent >= 0; parent = p.parents[parent])
+			{
+				height[parent] = std::max(height[parent], depth[i] - depth[parent]);
+			}
+		}
+		length.resize(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			length[i] = depth[i] + height[i] + 1;
+		}
+	}
+
+	//world space distance between the joint's virtual vertices placed with local and with approximated
+	struct error_metric
+	{
+		//parent world transform of the joint for every sample
+		const transform* parent_world;
+		//source local transform of the joint for every sample
+		const transform* local;
+		float reach;
+
+		float error(size_t sample, const transform& approximated) const
+		{
+			const float3 vertices[3] = { float3(reach, 0, 0), float3(0, reach, 0), float3(0, 0, reach) };
+			transform exact = math::combine(parent_world[sample], local[sample]);
+			transform approx = math::combine(parent_world[sample], approximated);
+			//squared, math::length flushes anything below 1e-3 to 0
+			float e = math::sqr_length(exact.position - approx.position);
+			for (int v = 0; v < 3; v++)
+			{
+				e = std::max(e, math::sqr_length(transform_point(exact, vertices[v]) - transform_point(approx, vertices[v])));
+			}
+			return sqrtf(e);
+		}
+	};
+
+	//which part of the local transform a channel replaces
+	enum class channel_type
+	{
+		position,
+		rotation,
+		scale
+	};
+
+	inline transform with_channel(transform t, channel_type type, const float3& v, const quaternion& q)
+	{
+		switch (type)
+		{
+		case channel_type::position: t.position = v; break;
+		case channel_type::rotation: t.rotation = q; break;
+		case channel_type::scale: t.scale = v; break;
+		}
+		return t;
+	}
+
+	//quantizes samples (already resampled, one per frame) and keeps the fewest keys so that the linear
+	//interpolation between them stays within budget at every sample
+	inline void compress_channel(channel_type type, const std::vector<float3>& vectors, const std::vector<quaternion>& rotations,
+		const error_metric& metric, float budget, compressed_channel& channel, compressed_clip& out)
+	{
+		const bool is_rotation = type == channel_type::rotation;
+		const size_t n = is_rotation ? rotations.size() : vectors.size();
+
+		channel.first_key = (uint32_t)out.frames.size();
+		channel.range_min = float3();
+		channel.range_extent = float3();
+		if (!is_rotation)
+		{
+			float3 lo = vectors[0];
+			float3 hi = vectors[0];
+			for (const float3& v : vectors)
+			{
+				lo = float3(std::min(lo.x, v.x), std::min(lo.y, v.y), std::min(lo.z, v.z));
+				hi = float3(std::max(hi.x, v.x), std::max(hi.y, v.y), std::max(hi.z, v.z));
+			}
+			channel.range_min = lo;
+			channel.range_extent = hi - lo;
+		}
+
+		//the decoded value of every sample
+		std::vector<uint16_t> quantized(n * 3);
+		std::vector<float3> decoded_vectors(is_rotation ? 0 : n);
+		std::vector<quaternion> decoded_rotations(is_rotation ? n : 0);
+		for (size_t i = 0; i < n; i++)
+		{
+			if (is_rotation)
+			{
+				compressed_clip::quantize(rotations[i], &quantized[i * 3]);
+				decoded_rotations[i] = compressed_clip::dequantize_rotation(&quantized[i * 3]);
+			}
+			else
+			{
+				compressed_clip::quantize(vectors[i], channel.range_min, channel.range_extent, &quantized[i * 3]);
+				decoded_vectors[i] = compressed_clip::dequantize(&quantized[i * 3], channel.range_min, channel.range_extent);
+			}
+		}
+
+		auto approximated = [&](size_t a, size_t b, size_t i)
+		{
+			float alpha = b == a ? 0.0f : (float)(i - a) / (float)(b - a);
+			if (is_rotation)
+			{
+				return with_channel(metric.local[i], type, float3(), math::nlerp(decoded_rotations[a], decoded_rotations[b], alpha));
+			}
+			return with_channel(metric.local[i], type, math::lerp(decoded_vectors[a], decoded_vectors[b], alpha), quaternion());
+		};
+
+		auto push_key = [&](size_t i)
+		{
+			assert(i < MAX_COMPRESSED_SAMPLES);
+			out.frames.push_back((uint16_t)i);
+			out.values.push_back(quantized[i * 3]);
+			out.values.push_back(quantized[i * 3 + 1]);
+			out.values.push_back(quantized[i * 3 + 2]);
+		};
+
+		bool constant = true;
+		for (size_t i = 0; i < n && constant; i++)
+		{
+			constant = metric.error(i, approximated(0, 0, i)) <= budget;
+		}
+		if (constant)
+		{
+			channel.key_count = 1;
+			push_key(0);
+			return;
+		}
+
+		//greedy: from key a reach as far as possible while every sample in between is within budget
+		size_t a = 0;
+		push_key(a);
+		while (a < n - 1)
+		{
+			size_t b = a + 1;
+			while (b + 1 < n)
+			{
+				size_t candidate = b + 1;
+				bool fits = true;
+				for (size_t i = a + 1; i < candidate && fits; i++)
+				{
+					fits = metric.error(i, approximated(a, candidate, i)) <= budget;
+				}
+				if (!fits)
+				{
+					break;
+				}
+				b = candidate;
+			}
+			push_key(b);
+			a = b;
+		}
+		channel.key_count = (uint32_t)(out.frames.size() - channel.first_key);
+	}
+}
+
+//source is resampled at settings.sample_rate, r provides the hierarchy and the rest pose the error is measured against.
+//returns false and leaves out untouched when the clip is too long for MAX_COMPRESSED_SAMPLES at that rate
+inline bool compress_clip(clip& source, const rig& r, const clip_compression_settings& settings, compressed_clip& out)
+{
+	using namespace compression_detail;
+
+	const float duration = source.get_duration();
+	const size_t sample_count = duration > 0.0f ? (size_t)ceilf(duration * settings.sample_rate) + 1 : 1;
+	assert(sample_count <= MAX_COMPRESSED_SAMPLES);
+	if (sample_count > MAX_COMPRESSED_SAMPLES)
+	{
+		return false;
+	}
+
+	out = compressed_clip();
+	out.name = source.name;
+	out.loop = source.loop;
+	out.start_time = source.start_time;
+	out.end_time = source.end_time;
+
+	const size_t joint_count = r.rest_pose.size();
+	//rounded so the last sample lands exactly on end_time
+	out.sample_rate = duration > 0.0f ? (sample_count - 1) / duration : settings.sample_rate;
+
+	//source local and world poses for every sample, tracks are sampled without looping so the last sample is the last key
+	std::vector<transform> locals(sample_count * joint_count);
+	std::vector<transform> worlds(sample_count * joint_count);
+	pose sampled = r.rest_pose;
+	for (size_t s = 0; s < sample_count; s++)
+	{
+		float t = std::min(source.start_time + s / out.sample_rate, source.end_time);
+		for (auto& track : source.tracks)
+		{
+			transform local = sampled.get_local_transform(track.bone_index);
+			sampled.set_local_transform(track.bone_index, track.sample(local, t, false));
+		}
+		for (size_t j = 0; j < joint_count; j++)
+		{
+			locals[s * joint_count + j] = sampled.joints[j];
+			worlds[s * joint_count + j] = sampled.get_global_transform(j);
+		}
+	}
+
+	std::vector<float> reach;
+	joint_reach(r.bind_pose.size() == joint_count ? r.bind_pose : r.rest_pose, settings.skin_radius, reach);
+	std::vector<int> chain;
+	chain_length(r.rest_pose, chain);
+
+	//per joint streams of the metric input
+	std::vector<transform> parent_world(sample_count);
+	std::vector<transform> local(sample_count);
+	std::vector<float3> vectors(sample_count);
+	std::vector<quaternion> rotations(sample_count);
+
+	out.tracks.resize(source.tracks.size());
+	for (size_t i = 0; i < source.tracks.size(); i++)
+	{
+		transform_track& track = source.tracks[i];
+		compressed_transform_track& compressed = out.tracks[i];
+		const uint32_t j = track.bone_index;
+		compressed.bone_index = j;
+
+		const int parent = r.rest_pose.parents[j];
+		for (size_t s = 0; s < sample_count; s++)
+		{
+			parent_world[s] = parent >= 0 ? worlds[s * joint_count + parent] : transform();
+			local[s] = locals[s * joint_count + j];
+		}
+		error_metric metric{ parent_world.data(), local.data(), reach[j] };
+
+		float budget = settings.error_budget;
+		if (j < settings.joint_error_budget.size() && settings.joint_error_budget[j] > 0.0f)
+		{
+			budget = settings.joint_error_budget[j];
+		}
+		//the channels are reduced independently, their errors add up the same way as along the chain
+		int animated_channels = (track.position.size() > 1) + (track.rotation.size() > 1) + (track.scale.size() > 1);
+		budget /= (float)(std::max(animated_channels, 1) * chain[j]);
+
+		if (track.position.size() > 1)
+		{
+			for (size_t s = 0; s < sample_count; s++) vectors[s] = local[s].position;
+			compress_channel(channel_type::position, vectors, rotations, metric, budget, compressed.position, out);
+		}
+		if (track.rotation.size() > 1)
+		{
+			for (size_t s = 0; s < sample_count; s++) rotations[s] = local[s].rotation;
+			compress_channel(channel_type::rotation, vectors, rotations, metric, budget, compressed.rotation, out);
+		}
+		if (track.scale.size() > 1)
+		{
+			for (size_t s = 0; s < sample_count; s++) vectors[s] = local[s].scale;
+			compress_channel(channel_type::scale, vectors, rotations, metric, budget, compressed.scale, out);
+		}
+	}
+
+	out.frames.shrink_to_fit();
+	out.values.shrink_to_fit();
+	return true;
+}
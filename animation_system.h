@@ -2,48 +2,562 @@
 #include "ecs.h"
 #include "components.h"
 #include "animation.h"
+#include "animation_compression.h"
+#include "animation_baking.h"
+#include "animation_blending.h"
 #include "mesh_batch.h"
+#include "mmath_simd.h"
+#include "job_system.h"
 inline constexpr float4x4 correction = { 1, 0, 0, 0, 0, -1, 0, 0, 0, 0, 0.5f,0.5f,0, 0, 0,1 };
 
+enum class blend_mode : uint32_t
+{
+	//blends from the poses below towards the layer's pose
+	override,
+	//adds the layer's difference to its first frame on top of the poses below
+	additive
+};
+
+//a clip played on top of the entity's animation clip
+struct blend_layer
+{
+	uint32_t clip = 0;
+	clip_format format = clip_format::raw;
+	blend_mode mode = blend_mode::override;
+	float time = 0.0f;
+	float weight = 1.0f;
+	//index + 1 into animation_system::masks, 0 for every joint
+	uint32_t mask = 0;
+};
+
+struct layer_state
+{
+	blend_layer layer;
+	std::vector<track_cursor> cursors;
+	//first frame of the clip, what additive layers are relative to
+	pose_soa reference;
+};
+
+constexpr uint32_t ANIMATION_LOD_COUNT = 4;
+
+struct animation_lod_settings
+{
+	//camera distance each level after 0 starts at
+	float distances[ANIMATION_LOD_COUNT - 1] = { 15.0f, 30.0f, 60.0f };
+	//frames between evaluations, the frames in between interpolate the last two evaluated palettes
+	uint32_t update_interval[ANIMATION_LOD_COUNT] = { 1, 2, 4, 8 };
+	//joints less than this many levels above a leaf are not sampled and stay in the bind pose, 0 keeps every joint
+	uint32_t frozen_height[ANIMATION_LOD_COUNT] = { 0, 0, 1, 2 };
+	//most entities evaluated per update, the rest hold their pose until a later update. 0 means no limit
+	uint32_t max_evaluations = 0;
+};
+
+//joint sets of one rig for every lod level
+struct rig_lod
+{
+	//a byte per joint, 0 for frozen joints. Passed to the clips as joint_filter
+	std::vector<uint8_t> sampled[ANIMATION_LOD_COUNT];
+	std::vector<uint32_t> frozen[ANIMATION_LOD_COUNT];
+};
+
+//pose state owned by one animated entity
+struct animation_instance
+{
+	pose local;
+	uint32_t rig;
+	//keyframe cursors for the tracks of clip
+	std::vector<track_cursor> cursors;
+	uint32_t clip;
+	clip_format format;
+	//evaluated bottom to top over the entity's animation clip
+	std::vector<layer_state> layers;
+	uint32_t lod;
+	uint32_t frames_since_update;
+	//animation time passed since the last evaluation
+	float pending_time;
+	//local was sampled this update, pose modifiers only touch these
+	bool evaluated;
+	//palettes of the last two evaluations, the frames in between are interpolated
+	std::vector<float4x4> previous;
+	std::vector<float4x4> next;
+	//animation_system::frame of the last update that saw the entity, instances that miss one are released
+	uint32_t last_seen;
+	bool in_use;
+};
+
+struct animation_system;
+
+//runs between sampling the local poses and building the palettes, e.g. ik_system
+struct pose_modifier
+{
+	void (*run)(void* context, animation_system& animations);
+	void* context;
+};
+
+struct animation_work
+{
+	animation* a;
+	bool evaluate;
+};
+
+//where an entity's joints ended up in the skinning palette
+struct palette_range
+{
+	entity e;
+	uint32_t offset;
+	uint32_t count;
+};
+
+//per worker buffers, sized by the largest rig seen so layers don't allocate
+struct animation_scratch
+{
+	//global pose
+	std::vector<float4x4> matrices;
+	//one baked_clip block
+	std::vector<float> block;
+	pose sampled;
+	pose_soa accumulated;
+	pose_soa layer;
+	std::vector<float> weights;
+};
+
 struct animation_system
 {
 	std::vector<clip>* clips;
+	std::vector<compressed_clip>* compressed_clips;
+	std::vector<baked_clip>* baked_clips;
 	std::vector<rig>* rigs;
-	pose p;
-	void initialize(std::vector<clip>* clips, std::vector<rig>* rigs)
+	job_system* jobs;
+
+	std::vector<animation_instance> instances;
+	//released instances, handed out again before instances grows
+	std::vector<uint32_t> free_instances;
+	uint32_t frame = 0;
+	std::vector<joint_mask> masks;
+	animation_lod_settings lod_settings;
+	//indexed by rig
+	std::vector<rig_lod> rig_lods;
+	//rebuilt every update, kept around so a steady state frame doesn't allocate
+	std::vector<palette_range> palette_ranges;
+	std::vector<animation_work> work;
+	//indices into work of the entities competing for lod_settings.max_evaluations
+	std::vector<uint32_t> due;
+	std::vector<animation_scratch> scratch;
+	//in the order they were added
+	std::vector<pose_modifier> modifiers;
+
+	void initialize(std::vector<clip>* clips, std::vector<compressed_clip>* compressed_clips, std::vector<baked_clip>* baked_clips,
+		std::vector<rig>* rigs, job_system* jobs)
 	{
 		this->clips = clips;
+		this->compressed_clips = compressed_clips;
+		this->baked_clips = baked_clips;
 		this->rigs = rigs;
-		p  = rigs->operator[](0).rest_pose;
+		this->jobs = jobs;
+		scratch.resize(jobs->worker_count());
+	}
+
+	//returns the index + 1 blend_layer::mask refers to it by
+	uint32_t add_mask(const joint_mask& mask)
+	{
+		masks.push_back(mask);
+		return (uint32_t)masks.size();
 	}
 
-	component_id_array<animation> comps;
-	void update(entity_component_system* ecs, float dt, std::vector<float4x4>& poses)
+	//replaces the layers of a, weights and times can be changed afterwards through layer()
+	void set_layers(animation& a, const blend_layer* layers, size_t count)
 	{
-		poses.clear();
+		animation_instance& instance = get_instance(a);
+		instance.layers.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			layer_state& state = instance.layers[i];
+			state.layer = layers[i];
+			state.cursors.assign(track_count(layers[i].format, layers[i].clip), track_cursor());
+
+			pose first = rigs->operator[](instance.rig).rest_pose;
+			std::vector<float> block;
+			float start = 0.0f;
+			switch (layers[i].format)
+			{
+			case clip_format::compressed: start = compressed_clips->operator[](layers[i].clip).start_time; break;
+			case clip_format::baked: start = baked_clips->operator[](layers[i].clip).start_time; break;
+			default: start = clips->operator[](layers[i].clip).start_time; break;
+			}
+			sample_clip(layers[i].format, layers[i].clip, first, start, nullptr, block);
+			blending::to_soa(first, state.reference);
+		}
+	}
+
+	void add_modifier(const pose_modifier& modifier)
+	{
+		modifiers.push_back(modifier);
+	}
+
+	blend_layer& layer(animation& a, size_t index)
+	{
+		return instances[a.instance - 1].layers[index].layer;
+	}
+
+	component_id_array<position, animation> comps;
+	//poses is the palette for every animated entity, laid out as described by palette_ranges.
+	//entities further from camera_position update less often and with fewer joints, see animation_lod_settings
+	void update(entity_component_system* ecs, float dt, const float3& camera_position, std::vector<float4x4>& poses)
+	{
+		frame++;
+		palette_ranges.clear();
+		work.clear();
+		due.clear();
+
 		auto view = ecs->get_view(comps.arr, comps.size);
+		auto positions = ecs->get_component_array<position>();
 		auto animations = ecs->get_component_array<animation>();
 
+		uint32_t palette_size = 0;
+		uint32_t forced = 0;
 		for (auto g : *view)
 		{
+			auto position_offset = positions + g->get_offset(component_id<position>);
 			auto animation_offset = animations + g->get_offset(component_id<animation>);
 			for (auto i : *g)
 			{
 				auto& animation = animation_offset[i];
-			
-				std::vector<float4x4> matrices;
-				animation.time = clips->operator[](animation.animation_clip).sample(p, animation.time + dt * 0.1f);
- 				p.get_matrices(matrices);
+				auto& instance = get_instance(animation);
+				instance.last_seen = frame;
+				uint32_t joint_count = (uint32_t)instance.local.size();
+				animation.palette_offset = palette_size;
+				palette_ranges.push_back(palette_range{ g->em->dense[i], palette_size, joint_count });
+				palette_size += joint_count;
 
-				std::vector<float4x4>& inv_bind_pose = rigs->operator[](animation.rig).inv_bind_pose;
+				const position& p = position_offset[i];
+				instance.lod = lod_level(math::length(float3(p.x, p.y, p.z) - camera_position));
+				instance.frames_since_update++;
+				instance.pending_time += dt * 0.1f;
 
-				poses.resize(matrices.size());
-				for (int j = 0; j < matrices.size(); j++)
+				//an entity without a palette yet is evaluated regardless of the budget
+				bool now = instance.next.empty();
+				forced += now;
+				if (!now && instance.frames_since_update >= lod_settings.update_interval[instance.lod])
 				{
-					poses[j] = matrices[j] * inv_bind_pose[j];
+					now = lod_settings.max_evaluations == 0;
+					if (!now)
+					{
+						due.push_back((uint32_t)work.size());
+					}
 				}
+				work.push_back(animation_work{ &animation, now });
+				get_rig_lod(instance.rig);
 			}
 		}
+		release_unseen();
+		select_within_budget(forced);
+
+		if (poses.size() != palette_size)
+		{
+			poses.resize(palette_size);
+		}
+
+		auto sample = [this](size_t begin, size_t end, uint32_t worker)
+		{
+			for (size_t w = begin; w < end; w++)
+			{
+				auto& animation = *work[w].a;
+				auto& instance = instances[animation.instance - 1];
+				instance.evaluated = work[w].evaluate;
+				if (instance.evaluated)
+				{
+					sample_pose(animation, instance, scratch[worker]);
+				}
+			}
+		};
+		auto output = [this, &poses](size_t begin, size_t end, uint32_t worker)
+		{
+			animation_scratch& s = scratch[worker];
+			for (size_t w = begin; w < end; w++)
+			{
+				auto& animation = *work[w].a;
+				auto& instance = instances[animation.instance - 1];
+				if (work[w].evaluate)
+				{
+					build_palette(instance, s);
+				}
+
+				//frames_since_update is 0 on the update that evaluated, the last frame of the interval reaches next
+				const uint32_t interval = lod_settings.update_interval[instance.lod];
+				float alpha = std::min(1.0f, (float)(instance.frames_since_update + 1) / (float)std::max(interval, 1U));
+				float4x4* out = poses.data() + animation.palette_offset;
+				if (alpha >= 1.0f || instance.previous.size() != instance.next.size())
+				{
+					memcpy(out, instance.next.data(), instance.next.size() * sizeof(float4x4));
+				}
+				else
+				{
+					math::simd::lerp(instance.previous.data()->data(), instance.next.data()->data(), alpha, out->data(), instance.next.size() * 16);
+				}
+			}
+		};
+		if (modifiers.empty())
+		{
+			auto evaluate = [&sample, &output](size_t begin, size_t end, uint32_t worker)
+			{
+				sample(begin, end, worker);
+				output(begin, end, worker);
+			};
+			jobs->parallel_for(work.size(), 16, evaluate);
+			return;
+		}
+
+		jobs->parallel_for(work.size(), 16, sample);
+		for (const pose_modifier& modifier : modifiers)
+		{
+			modifier.run(modifier.context, *this);
+		}
+		jobs->parallel_for(work.size(), 16, output);
+	}
+
+	uint32_t lod_level(float distance) const
+	{
+		uint32_t lod = 0;
+		while (lod < ANIMATION_LOD_COUNT - 1 && distance >= lod_settings.distances[lod])
+		{
+			lod++;
+		}
+		return lod;
+	}
+
+	//marks the due entities that fit in lod_settings.max_evaluations, the most overdue and closest ones first
+	void select_within_budget(uint32_t forced)
+	{
+		if (due.empty())
+		{
+			return;
+		}
+		size_t budget = lod_settings.max_evaluations > forced ? lod_settings.max_evaluations - forced : 0;
+		if (due.size() > budget)
+		{
+			auto more_urgent = [this](uint32_t a, uint32_t b)
+			{
+				const animation_instance& ia = instances[work[a].a->instance - 1];
+				const animation_instance& ib = instances[work[b].a->instance - 1];
+				int overdue_a = (int)ia.frames_since_update - (int)lod_settings.update_interval[ia.lod];
+				int overdue_b = (int)ib.frames_since_update - (int)lod_settings.update_interval[ib.lod];
+				if (overdue_a != overdue_b)
+				{
+					return overdue_a > overdue_b;
+				}
+				return ia.lod < ib.lod;
+			};
+			std::nth_element(due.begin(), due.begin() + budget, due.end(), more_urgent);
+			due.resize(budget);
+		}
+		for (uint32_t w : due)
+		{
+			work[w].evaluate = true;
+		}
+	}
+
+	//samples the clip and the layers at the time passed since the last evaluation into instance.local
+	void sample_pose(animation& animation, animation_instance& instance, animation_scratch& s)
+	{
+		if (instance.clip != animation.animation_clip || instance.format != animation.format)
+		{
+			instance.clip = animation.animation_clip;
+			instance.format = animation.format;
+			instance.cursors.assign(track_count(animation.format, animation.animation_clip), track_cursor());
+		}
+
+		const rig& r = rigs->operator[](instance.rig);
+		const rig_lod& lods = rig_lods[instance.rig];
+		const uint8_t* filter = lod_settings.frozen_height[instance.lod] > 0 ? lods.sampled[instance.lod].data() : nullptr;
+
+		float t = animation.time + instance.pending_time;
+		animation.time = sample_clip(animation.format, animation.animation_clip, instance.local, t, instance.cursors.data(), s.block, filter);
+		if (!instance.layers.empty())
+		{
+			evaluate_layers(instance, instance.pending_time, s);
+		}
+		for (uint32_t j : lods.frozen[instance.lod])
+		{
+			instance.local.joints[j] = r.bind_pose.joints[j];
+		}
+	}
+
+	//stores the skinning palette of instance.local in instance.next
+	void build_palette(animation_instance& instance, animation_scratch& s)
+	{
+		const rig& r = rigs->operator[](instance.rig);
+		instance.local.get_matrices(s.matrices);
+
+		instance.previous.swap(instance.next);
+		if (instance.next.size() != s.matrices.size())
+		{
+			instance.next.resize(s.matrices.size());
+		}
+		math::simd::mul_batch(s.matrices.data(), r.inv_bind_pose.data(), instance.next.data(), s.matrices.size());
+		instance.frames_since_update = 0;
+		instance.pending_time = 0.0f;
+	}
+
+	//builds the joint sets of a rig the first time it is used
+	const rig_lod& get_rig_lod(uint32_t index)
+	{
+		if (rig_lods.size() <= index)
+		{
+			rig_lods.resize(index + 1);
+		}
+		rig_lod& lods = rig_lods[index];
+		const pose& p = rigs->operator[](index).rest_pose;
+		const size_t n = p.size();
+		if (lods.sampled[0].size() == n)
+		{
+			return lods;
+		}
+
+		//levels above the deepest leaf below each joint
+		std::vector<uint32_t> height(n, 0);
+		for (size_t i = 0; i < n; i++)
+		{
+			uint32_t h = 1;
+			for (int parent = p.parents[i]; parent >= 0; parent = p.parents[parent], h++)
+			{
+				height[parent] = std::max(height[parent], h);
+			}
+		}
+		for (uint32_t l = 0; l < ANIMATION_LOD_COUNT; l++)
+		{
+			lods.sampled[l].assign(n, 1);
+			lods.frozen[l].clear();
+			for (size_t i = 0; i < n; i++)
+			{
+				if (height[i] < lod_settings.frozen_height[l])
+				{
+					lods.sampled[l][i] = 0;
+					lods.frozen[l].push_back((uint32_t)i);
+				}
+			}
+		}
+		return lods;
+	}
+
+	//every layer samples into a copy of the rest pose and is blended into the accumulated pose in one kernel pass
+	void evaluate_layers(animation_instance& instance, float elapsed, animation_scratch& s)
+	{
+		const pose& rest = rigs->operator[](instance.rig).rest_pose;
+		const size_t joint_count = instance.local.size();
+		blending::to_soa(instance.local, s.accumulated);
+		if (s.weights.size() < joint_count)
+		{
+			s.weights.resize(joint_count);
+		}
+
+		for (layer_state& state : instance.layers)
+		{
+			blend_layer& layer = state.layer;
+			float t = layer.time + elapsed;
+			if (layer.weight <= 0.0f)
+			{
+				layer.time = t;
+				continue;
+			}
+
+			s.sampled = rest;
+			layer.time = sample_clip(layer.format, layer.clip, s.sampled, t, state.cursors.data(), s.block);
+			blending::to_soa(s.sampled, s.layer);
+			blending::layer_weights(layer.weight, layer.mask ? &masks[layer.mask - 1] : nullptr, s.weights.data(), joint_count);
+			if (layer.mode == blend_mode::additive)
+			{
+				blending::difference(s.layer, state.reference, s.layer);
+				blending::add(s.accumulated, s.layer, s.weights.data(), s.accumulated);
+			}
+			else
+			{
+				blending::blend(s.accumulated, s.layer, s.weights.data(), s.accumulated);
+			}
+		}
+
+		blending::from_soa(s.accumulated, instance.local);
+	}
+
+	//joint_filter is ignored by baked clips, their cost doesn't depend on the joints sampled
+	float sample_clip(clip_format format, uint32_t index, pose& out, float t, track_cursor* cursors, std::vector<float>& block,
+		const uint8_t* joint_filter = nullptr)
+	{
+		if (format == clip_format::compressed)
+		{
+			return compressed_clips->operator[](index).sample(out, t, cursors, joint_filter);
+		}
+		if (format == clip_format::baked)
+		{
+			const baked_clip& baked = baked_clips->operator[](index);
+			if (block.size() < baked.scratch_size())
+			{
+				block.resize(baked.scratch_size());
+			}
+			return baked.sample(out, t, block.data());
+		}
+		return clips->operator[](index).sample(out, t, cursors, joint_filter);
+	}
+
+	//creates the instance the first time the entity is seen
+	animation_instance& get_instance(animation& a)
+	{
+		if (a.instance == 0)
+		{
+			animation_instance instance;
+			instance.last_seen = frame;
+			instance.in_use = true;
+			instance.local = rigs->operator[](a.rig).rest_pose;
+			instance.rig = a.rig;
+			instance.clip = a.animation_clip;
+			instance.format = a.format;
+			instance.cursors.resize(track_count(a.format, a.animation_clip));
+			instance.lod = 0;
+			instance.frames_since_update = 0;
+			instance.pending_time = 0.0f;
+			instance.evaluated = false;
+			if (free_instances.empty())
+			{
+				instances.push_back(instance);
+				a.instance = (uint32_t)instances.size();
+			}
+			else
+			{
+				a.instance = free_instances.back() + 1;
+				free_instances.pop_back();
+				instances[a.instance - 1] = std::move(instance);
+			}
+		}
+		return instances[a.instance - 1];
+	}
+
+	//the ecs has no removal callbacks, an entity that was removed or lost its animation component
+	//simply isn't in the view anymore. Its instance is freed and handed to the next new entity
+	void release_unseen()
+	{
+		for (uint32_t id = 0; id < (uint32_t)instances.size(); id++)
+		{
+			animation_instance& instance = instances[id];
+			if (instance.in_use && instance.last_seen != frame)
+			{
+				//value initialized, in_use and evaluated are false
+				instance = animation_instance();
+				free_instances.push_back(id);
+			}
+		}
+	}
+
+	size_t track_count(clip_format format, uint32_t index) const
+	{
+		if (format == clip_format::compressed)
+		{
+			return compressed_clips->operator[](index).tracks.size();
+		}
+		if (format == clip_format::baked)
+		{
+			//no keys to search, nothing to cache
+			return 0;
+		}
+		return clips->operator[](index).tracks.size();
 	}
 
-};
\ No newline at end of file
+};
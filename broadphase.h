@@ -0,0 +1,334 @@
+#pragma once
+#include "collision.h"
+#include "mmath_simd.h"
+#include <vector>
+
+//Broadphases behind one function table so collision_system can switch between them, or be handed another one to
+//benchmark against. Every broadphase reports pairs of the object ids it was given, sorted, unique, a < b,
+//and never a pair of two static objects. Pairs may be conservative, bvh_broadphase tests against fattened boxes.
+
+struct broadphase
+{
+	void* context;
+	//returns the proxy id the other functions take
+	int (*add)(void* context, const aabb& box, int object, bool is_static);
+	void (*remove)(void* context, int proxy);
+	//displacement is how far the object moved since the last call
+	void (*move)(void* context, int proxy, const aabb& box, const float3& displacement);
+	void (*find_pairs)(void* context, std::vector<collision_pair>& pairs);
+};
+
+//fills the table from the member functions of impl, which has to outlive the table
+template<class T>
+inline broadphase make_broadphase(T& impl)
+{
+	broadphase b;
+	b.context = &impl;
+	b.add = [](void* context, const aabb& box, int object, bool is_static) { return static_cast<T*>(context)->add(box, object, is_static); };
+	b.remove = [](void* context, int proxy) { static_cast<T*>(context)->remove(proxy); };
+	b.move = [](void* context, int proxy, const aabb& box, const float3& displacement) { static_cast<T*>(context)->move(proxy, box, displacement); };
+	b.find_pairs = [](void* context, std::vector<collision_pair>& pairs) { static_cast<T*>(context)->find_pairs(pairs); };
+	return b;
+}
+
+//static objects in a static_bvh rebuilt after they change, dynamic objects in a tree.
+//Only dynamic objects query, level geometry costs nothing on frames it doesn't change
+struct bvh_broadphase
+{
+	//static proxies have this bit set, the rest of the id is the slot in the static pool
+	static constexpr int STATIC_PROXY = 1 << 30;
+
+	tree dynamic_tree;
+	static_bvh static_tree;
+	//tight box of every dynamic proxy, the tree only keeps the fat one
+	std::vector<aabb> dynamic_boxes;
+	std::vector<aabb> static_boxes;
+	//-1 for free slots
+	std::vector<int> static_objects;
+	std::vector<int> free_statics;
+	bool static_dirty = false;
+
+	//build input, kept around so a rebuild doesn't allocate
+	std::vector<aabb> build_boxes;
+	std::vector<int> build_objects;
+
+	int add(const aabb& box, int object, bool is_static)
+	{
+		if (is_static)
+		{
+			int slot;
+			if (free_statics.empty())
+			{
+				slot = (int)static_objects.size();
+				static_objects.push_back(object);
+				static_boxes.push_back(box);
+			}
+			else
+			{
+				slot = free_statics.back();
+				free_statics.pop_back();
+				static_objects[slot] = object;
+				static_boxes[slot] = box;
+			}
+			static_dirty = true;
+			return slot | STATIC_PROXY;
+		}
+
+		int proxy = dynamic_tree.insert(box, object);
+		if (dynamic_boxes.size() <= (size_t)proxy)
+		{
+			dynamic_boxes.resize(proxy + 1);
+		}
+		dynamic_boxes[proxy] = box;
+		return proxy;
+	}
+
+	void remove(int proxy)
+	{
+		if (proxy & STATIC_PROXY)
+		{
+			int slot = proxy & ~STATIC_PROXY;
+			static_objects[slot] = -1;
+			free_statics.push_back(slot);
+			static_dirty = true;
+			return;
+		}
+		dynamic_tree.remove(proxy);
+	}
+
+	void move(int proxy, const aabb& box, const float3& displacement)
+	{
+		if (proxy & STATIC_PROXY)
+		{
+			static_boxes[proxy & ~STATIC_PROXY] = box;
+			static_dirty = true;
+			return;
+		}
+		dynamic_tree.move(proxy, box, displacement);
+		dynamic_boxes[proxy] = box;
+	}
+
+	void find_pairs(std::vector<collision_pair>& pairs)
+	{
+		if (static_dirty)
+		{
+			build_boxes.clear();
+			build_objects.clear();
+			for (size_t i = 0; i < static_objects.size(); i++)
+			{
+				if (static_objects[i] >= 0)
+				{
+					build_boxes.push_back(static_boxes[i]);
+					build_objects.push_back(static_objects[i]);
+				}
+			}
+			static_tree.build(build_boxes.data(), build_objects.data(), build_boxes.size());
+			static_dirty = false;
+		}
+
+		pairs.clear();
+		for (int proxy = 0; proxy < (int)dynamic_tree.nodes.size(); proxy++)
+		{
+			const node& leaf = dynamic_tree.nodes[proxy];
+			if (leaf.height != 0)
+			{
+				continue;
+			}
+			const int self = leaf.object_index;
+			auto add_pair = [&pairs, self](int other)
+			{
+				if (other != self)
+				{
+					pairs.push_back(other < self ? collision_pair{ other, self } : collision_pair{ self, other });
+				}
+				return true;
+			};
+			static_tree.query(dynamic_boxes[proxy], add_pair);
+			dynamic_tree.query(dynamic_boxes[proxy], add_pair);
+		}
+		dynamic_tree.clear_moved();
+		//a dynamic pair is found from both sides when both boxes reach into the other's fat box
+		std::sort(pairs.begin(), pairs.end());
+		pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+	}
+};
+
+//Sweep and prune for dense scenes where most objects move a little every frame. Proxies are kept sorted by the
+//lower bound on the axis the boxes are spread out the most along; with temporal coherence the sort is an insertion
+//sort over an almost sorted array. The sweep tests each box against the run of boxes starting before it ends,
+//with the overlaps batch kernel on the other two axes a block of boxes at a time
+struct sweep_and_prune
+{
+	std::vector<aabb> boxes;
+	//-1 for free proxies
+	std::vector<int> objects;
+	std::vector<uint8_t> statics;
+	//free proxies that are no longer in order, the only ones add may hand out again
+	std::vector<int> free_proxies;
+	//removed since the last find_pairs, still in order until it is compacted
+	std::vector<int> removed_proxies;
+	//live proxies sorted by boxes[proxy].lower_bound[axis]
+	std::vector<int> order;
+	int axis = 0;
+	//proxies appended to order since the last sort
+	size_t added = 0;
+
+	//boxes in sorted order as 6 streams: lower x, y, z, upper x, y, z
+	std::vector<float> sorted;
+	std::vector<uint32_t> hits;
+
+	int add(const aabb& box, int object, bool is_static)
+	{
+		int proxy;
+		if (free_proxies.empty())
+		{
+			proxy = (int)objects.size();
+			boxes.push_back(box);
+			objects.push_back(object);
+			statics.push_back(is_static);
+		}
+		else
+		{
+			proxy = free_proxies.back();
+			free_proxies.pop_back();
+			boxes[proxy] = box;
+			objects[proxy] = object;
+			statics[proxy] = is_static;
+		}
+		//the next sort moves it into place
+		order.push_back(proxy);
+		added++;
+		return proxy;
+	}
+
+	void remove(int proxy)
+	{
+		objects[proxy] = -1;
+		removed_proxies.push_back(proxy);
+	}
+
+	void move(int proxy, const aabb& box, const float3&)
+	{
+		boxes[proxy] = box;
+	}
+
+	float key(int proxy) const
+	{
+		return (&boxes[proxy].lower_bound.x)[axis];
+	}
+
+	void find_pairs(std::vector<collision_pair>& pairs)
+	{
+		pairs.clear();
+		if (!removed_proxies.empty())
+		{
+			order.erase(std::remove_if(order.begin(), order.end(), [this](int proxy) { return objects[proxy] < 0; }), order.end());
+			free_proxies.insert(free_proxies.end(), removed_proxies.begin(), removed_proxies.end());
+			removed_proxies.clear();
+		}
+		const size_t n = order.size();
+		if (n < 2)
+		{
+			return;
+		}
+
+		//insertion sort is only cheap for a few new proxies at the end
+		bool resort = added * 8 > n;
+		added = 0;
+		if (choose_axis() || resort)
+		{
+			std::sort(order.begin(), order.end(), [this](int a, int b) { return key(a) < key(b); });
+		}
+		else
+		{
+			for (size_t i = 1; i < n; i++)
+			{
+				const int proxy = order[i];
+				const float k = key(proxy);
+				size_t j = i;
+				for (; j > 0 && key(order[j - 1]) > k; j--)
+				{
+					order[j] = order[j - 1];
+				}
+				order[j] = proxy;
+			}
+		}
+
+		sorted.resize(n * 6);
+		hits.resize(n);
+		math::simd::aabb_soa soa{
+			math::simd::float3_soa{ sorted.data(), sorted.data() + n, sorted.data() + n * 2 },
+			math::simd::float3_soa{ sorted.data() + n * 3, sorted.data() + n * 4, sorted.data() + n * 5 } };
+		for (size_t i = 0; i < n; i++)
+		{
+			const aabb& b = boxes[order[i]];
+			soa.lower.x[i] = b.lower_bound.x;
+			soa.lower.y[i] = b.lower_bound.y;
+			soa.lower.z[i] = b.lower_bound.z;
+			soa.upper.x[i] = b.upper_bound.x;
+			soa.upper.y[i] = b.upper_bound.y;
+			soa.upper.z[i] = b.upper_bound.z;
+		}
+
+		const float* lower = (&soa.lower.x)[axis];
+		for (size_t i = 0; i < n; i++)
+		{
+			const float end_key = (&soa.upper.x)[axis][i];
+			size_t end = i + 1;
+			while (end < n && lower[end] <= end_key)
+			{
+				end++;
+			}
+			if (end == i + 1)
+			{
+				continue;
+			}
+
+			const aabb& b = boxes[order[i]];
+			const size_t found = math::simd::overlaps(soa.offset(i + 1), b.lower_bound, b.upper_bound, hits.data(), end - i - 1);
+			const int self = objects[order[i]];
+			const bool self_static = statics[order[i]] != 0;
+			for (size_t h = 0; h < found; h++)
+			{
+				const int other_proxy = order[i + 1 + hits[h]];
+				if (self_static && statics[other_proxy])
+				{
+					continue;
+				}
+				const int other = objects[other_proxy];
+				pairs.push_back(other < self ? collision_pair{ other, self } : collision_pair{ self, other });
+			}
+		}
+		std::sort(pairs.begin(), pairs.end());
+	}
+
+	//picks the axis the box centers vary the most along, returns true when it changed.
+	//a new axis has to beat the current one by a margin so near ties don't resort every frame
+	bool choose_axis()
+	{
+		float3 sum = float3(0, 0, 0);
+		float3 sum2 = float3(0, 0, 0);
+		for (int proxy : order)
+		{
+			const float3 c = (boxes[proxy].lower_bound + boxes[proxy].upper_bound) * 0.5f;
+			sum = sum + c;
+			sum2 = sum2 + c * c;
+		}
+		const float inv = 1.0f / (float)order.size();
+		const float3 variance = sum2 * inv - (sum * inv) * (sum * inv);
+		int best = axis;
+		for (int a = 0; a < 3; a++)
+		{
+			if ((&variance.x)[a] > (&variance.x)[best] * 1.25f)
+			{
+				best = a;
+			}
+		}
+		if (best == axis)
+		{
+			return false;
+		}
+		axis = best;
+		return true;
+	}
+};
@@ -2,6 +2,7 @@
 
 #include "input.h"
 #include "mmath.h"
+#include "mmath_simd.h"
 #include "uniform_buffer_object.h"
 #include <iostream>
 struct camera_system
@@ -23,8 +24,19 @@ struct camera_system
 
 	void update_vp()
 	{
-		math::mul(cam_data.perspective, cam_data.view, vp);
-		math::inverse_matrix(cam_data.view, cam_data.view_inverse);
+		//the view is rotation + translation only
+		rigid3x4 view;
+		rigid3x4 view_inverse;
+		math::to_rigid3x4(cam_data.view, view);
+		math::inverse_matrix(view, view_inverse);
+		update_vp(view_inverse);
+	}
+
+	//for callers that already inverted cam_data.view
+	void update_vp(const rigid3x4& view_inverse)
+	{
+		math::simd::mul(cam_data.perspective, cam_data.view, vp);
+		math::to_float4x4(view_inverse, cam_data.view_inverse);
 	}
 
 	void initialize(int2 window_size)
@@ -60,7 +72,7 @@ struct camera_system
 
 		if (move_dir.x != 0 || move_dir.y != 0 || move_dir.z != 0)
 		{
-			camera_pos += math::normalize(move_dir) * fly_speed * dt;
+			camera_pos += math::normalize<math::precision_fast>(move_dir) * fly_speed * dt;
 		}
 
 		auto mouse_pos = im.mouse_pos();
@@ -70,23 +82,25 @@ struct camera_system
 		cam_rot += math::deg2rad(float3((center_x - mouse_pos.x), (center_y - mouse_pos.y), 0) * turn_speed * dt);
 		cam_rot.y = math::clamp(cam_rot.y, -math::pi / 2.0f + 0.1f, math::pi / 2.0f - 0.1f);
 		float4x4 rot_matrix;
-		math::rotation_matrix(cam_rot.y, float3(1.0f, 0.0f, 0.0f), rot_matrix);
+		math::rotation_matrix<math::precision_fast>(cam_rot.y, float3(1.0f, 0.0f, 0.0f), rot_matrix);
 
 		float4x4 rot_matrix2;
-		math::rotation_matrix(cam_rot.x, float3(0.0f, 1.0f, 0.0f), rot_matrix2);
+		math::rotation_matrix<math::precision_fast>(cam_rot.x, float3(0.0f, 1.0f, 0.0f), rot_matrix2);
 
 		float4x4 final_rot_matrix;
-		math::mul(rot_matrix, rot_matrix2, final_rot_matrix);
+		math::simd::mul(rot_matrix, rot_matrix2, final_rot_matrix);
 
 
 		float4x4 translation_matrix;
 		math::translate(camera_pos, translation_matrix);
-		math::mul(final_rot_matrix, translation_matrix, cam_data.view);
+		math::simd::mul(final_rot_matrix, translation_matrix, cam_data.view);
 
-		float4x4 inverted;
-		math::inverse_matrix(cam_data.view, inverted);
-		camera_dir = math::normalize(float3(inverted[8], inverted[9], inverted[10]));
+		rigid3x4 view;
+		rigid3x4 inverted;
+		math::to_rigid3x4(cam_data.view, view);
+		math::inverse_matrix(view, inverted);
+		camera_dir = math::normalize<math::precision_fast>(float3(inverted[2], inverted[6], inverted[10]));
 		camera_right = math::cross(camera_dir, -WORLD_UP);
-		update_vp();
+		update_vp(inverted);
 	}
 };
\ No newline at end of file
@@ -3,6 +3,10 @@
 #include <cstdlib>
 #include <cstdint>
 #include <cassert>
+#include <atomic>
+#include <new>
+#include <utility>
+#include <functional>
 
 
 
@@ -109,7 +113,907 @@ void dynamic_array<T>::grow()
 	resize_internal(new_size);
 }
 
-struct queue
+//Default allocator for the engine containers.
+//Any type with the same two member functions can be passed as the ALLOC parameter (arenas, frame allocators etc.)
+struct heap_allocator
 {
+	void* allocate(size_t bytes, size_t alignment)
+	{
+		return ::operator new(bytes, std::align_val_t(alignment));
+	}
+
+	void deallocate(void* ptr, size_t alignment)
+	{
+		::operator delete(ptr, std::align_val_t(alignment));
+	}
+};
+
+//Vector that keeps the first N elements inline and only touches the allocator when it grows past that.
+template<class T, uint32_t N, class ALLOC = heap_allocator>
+struct small_vector
+{
+	typedef uint32_t size_type;
+
+	small_vector() : data_ptr(inline_data()), used(0), allocated(N) {}
+	explicit small_vector(ALLOC alloc) : allocator(alloc), data_ptr(inline_data()), used(0), allocated(N) {}
+
+	small_vector(const small_vector& other) : allocator(other.allocator), data_ptr(inline_data()), used(0), allocated(N)
+	{
+		reserve(other.used);
+		for (size_type i = 0; i < other.used; i++)
+		{
+			new (&data_ptr[i]) T(other.data_ptr[i]);
+		}
+		used = other.used;
+	}
+
+	small_vector(small_vector&& other) noexcept : allocator(other.allocator), data_ptr(inline_data()), used(0), allocated(N)
+	{
+		take(other);
+	}
+
+	small_vector& operator=(const small_vector& other)
+	{
+		if (&other != this)
+		{
+			clear();
+			reserve(other.used);
+			for (size_type i = 0; i < other.used; i++)
+			{
+				new (&data_ptr[i]) T(other.data_ptr[i]);
+			}
+			used = other.used;
+		}
+		return *this;
+	}
+
+	small_vector& operator=(small_vector&& other) noexcept
+	{
+		if (&other != this)
+		{
+			dispose();
+			take(other);
+		}
+		return *this;
+	}
+
+	~small_vector()
+	{
+		dispose();
+	}
+
+	void push_back(const T& value)
+	{
+		if (used == allocated)
+		{
+			T copy = value; //value may live inside this vector
+			grow(used + 1);
+			new (&data_ptr[used]) T(std::move(copy));
+		}
+		else
+		{
+			new (&data_ptr[used]) T(value);
+		}
+		used++;
+	}
+
+	template<class... ARGS>
+	T& emplace_back(ARGS&&... args)
+	{
+		if (used == allocated)
+		{
+			grow(used + 1);
+		}
+		new (&data_ptr[used]) T(std::forward<ARGS>(args)...);
+		return data_ptr[used++];
+	}
+
+	void pop_back()
+	{
+		assert(used > 0);
+		used--;
+		data_ptr[used].~T();
+	}
+
+	void resize(size_type new_size)
+	{
+		reserve(new_size);
+		for (size_type i = used; i < new_size; i++)
+		{
+			new (&data_ptr[i]) T();
+		}
+		for (size_type i = new_size; i < used; i++)
+		{
+			data_ptr[i].~T();
+		}
+		used = new_size;
+	}
+
+	void reserve(size_type new_capacity)
+	{
+		if (new_capacity > allocated)
+		{
+			grow(new_capacity);
+		}
+	}
+
+	void clear()
+	{
+		for (size_type i = 0; i < used; i++)
+		{
+			data_ptr[i].~T();
+		}
+		used = 0;
+	}
+
+	//frees any heap storage and goes back to the inline buffer
+	void dispose()
+	{
+		clear();
+		if (!is_inline())
+		{
+			allocator.deallocate(data_ptr, alignof(T));
+			data_ptr = inline_data();
+			allocated = N;
+		}
+	}
+
+	T& operator[](size_type i) { assert(i < used); return data_ptr[i]; }
+	const T& operator[](size_type i) const { assert(i < used); return data_ptr[i]; }
+	T& front() { return data_ptr[0]; }
+	T& back() { return data_ptr[used - 1]; }
+	T* data() { return data_ptr; }
+	const T* data() const { return data_ptr; }
+	T* begin() { return data_ptr; }
+	T* end() { return data_ptr + used; }
+	const T* begin() const { return data_ptr; }
+	const T* end() const { return data_ptr + used; }
+	size_type size() const { return used; }
+	size_type capacity() const { return allocated; }
+	bool empty() const { return used == 0; }
+	bool is_inline() const { return data_ptr == inline_data(); }
+
+private:
+	T* inline_data() { return reinterpret_cast<T*>(inline_storage); }
+	const T* inline_data() const { return reinterpret_cast<const T*>(inline_storage); }
+
+	void grow(size_type min_capacity)
+	{
+		size_type new_capacity = allocated + allocated / 2;
+		if (new_capacity < min_capacity)
+		{
+			new_capacity = min_capacity;
+		}
+		T* temp = (T*)allocator.allocate(sizeof(T) * new_capacity, alignof(T));
+		assert(temp != nullptr);
+		for (size_type i = 0; i < used; i++)
+		{
+			new (&temp[i]) T(std::move(data_ptr[i]));
+			data_ptr[i].~T();
+		}
+		if (!is_inline())
+		{
+			allocator.deallocate(data_ptr, alignof(T));
+		}
+		data_ptr = temp;
+		allocated = new_capacity;
+	}
+
+	void take(small_vector& other)
+	{
+		allocator = other.allocator;
+		if (other.is_inline())
+		{
+			for (size_type i = 0; i < other.used; i++)
+			{
+				new (&inline_data()[i]) T(std::move(other.data_ptr[i]));
+			}
+			used = other.used;
+			other.clear();
+		}
+		else
+		{
+			data_ptr = other.data_ptr;
+			used = other.used;
+			allocated = other.allocated;
+			other.data_ptr = other.inline_data();
+			other.used = 0;
+			other.allocated = N;
+		}
+	}
+
+	ALLOC allocator;
+	T* data_ptr;
+	size_type used;
+	size_type allocated;
+	alignas(T) unsigned char inline_storage[sizeof(T) * N];
+};
+
+//Growable circular buffer, push/pop at both ends without shifting. Capacity is kept a power of two so wrapping is a mask.
+template<class T, class ALLOC = heap_allocator>
+struct ring_buffer
+{
+	typedef uint32_t size_type;
+
+	ring_buffer() : data(nullptr), head(0), used(0), allocated(0) {}
+	explicit ring_buffer(ALLOC alloc) : allocator(alloc), data(nullptr), head(0), used(0), allocated(0) {}
+	ring_buffer(const ring_buffer&) = delete;
+	ring_buffer& operator=(const ring_buffer&) = delete;
+
+	ring_buffer(ring_buffer&& other) noexcept : allocator(other.allocator), data(other.data), head(other.head), used(other.used), allocated(other.allocated)
+	{
+		other.data = nullptr;
+		other.head = other.used = other.allocated = 0;
+	}
+
+	ring_buffer& operator=(ring_buffer&& other) noexcept
+	{
+		if (&other != this)
+		{
+			dispose();
+			allocator = other.allocator;
+			data = other.data;
+			head = other.head;
+			used = other.used;
+			allocated = other.allocated;
+			other.data = nullptr;
+			other.head = other.used = other.allocated = 0;
+		}
+		return *this;
+	}
+
+	~ring_buffer()
+	{
+		dispose();
+	}
+
+	void push_back(const T& value)
+	{
+		if (used == allocated)
+		{
+			grow();
+		}
+		new (&data[(head + used) & (allocated - 1)]) T(value);
+		used++;
+	}
+
+	void push_front(const T& value)
+	{
+		if (used == allocated)
+		{
+			grow();
+		}
+		head = (head - 1) & (allocated - 1);
+		new (&data[head]) T(value);
+		used++;
+	}
+
+	void pop_front()
+	{
+		assert(used > 0);
+		data[head].~T();
+		head = (head + 1) & (allocated - 1);
+		used--;
+	}
+
+	void pop_back()
+	{
+		assert(used > 0);
+		used--;
+		data[(head + used) & (allocated - 1)].~T();
+	}
+
+	T& front() { assert(used > 0); return data[head]; }
+	T& back() { assert(used > 0); return data[(head + used - 1) & (allocated - 1)]; }
+	T& operator[](size_type i) { assert(i < used); return data[(head + i) & (allocated - 1)]; }
+	const T& operator[](size_type i) const { assert(i < used); return data[(head + i) & (allocated - 1)]; }
+
+	size_type size() const { return used; }
+	size_type capacity() const { return allocated; }
+	bool empty() const { return used == 0; }
+
+	void clear()
+	{
+		while (used > 0)
+		{
+			pop_front();
+		}
+		head = 0;
+	}
+
+	void dispose()
+	{
+		clear();
+		if (data)
+		{
+			allocator.deallocate(data, alignof(T));
+			data = nullptr;
+			allocated = 0;
+		}
+	}
+
+private:
+	void grow()
+	{
+		size_type new_capacity = allocated == 0 ? 8 : allocated * 2;
+		T* temp = (T*)allocator.allocate(sizeof(T) * new_capacity, alignof(T));
+		assert(temp != nullptr);
+		for (size_type i = 0; i < used; i++)
+		{
+			T& src = data[(head + i) & (allocated - 1)];
+			new (&temp[i]) T(std::move(src));
+			src.~T();
+		}
+		if (data)
+		{
+			allocator.deallocate(data, alignof(T));
+		}
+		data = temp;
+		head = 0;
+		allocated = new_capacity;
+	}
+
+	ALLOC allocator;
+	T* data;
+	size_type head;
+	size_type used;
+	size_type allocated;
+};
+
+//Open addressing hash map with robin hood probing and backward shift deletion.
+//Keys and values live in one contiguous slot array next to a byte array of probe distances (0 = empty),
+//so lookups walk a couple of bytes instead of chasing per-node allocations like std::unordered_map.
+//Iterators and references are invalidated by insert and erase.
+template<class K, class V, class HASH = std::hash<K>, class EQUAL = std::equal_to<K>, class ALLOC = heap_allocator>
+struct flat_hash_map
+{
+	typedef uint32_t size_type;
+
+	struct slot
+	{
+		K first;
+		V second;
+	};
+
+	struct iterator
+	{
+		flat_hash_map* map;
+		size_type index;
+
+		slot& operator*() const { return map->slots[index]; }
+		slot* operator->() const { return &map->slots[index]; }
+		iterator& operator++()
+		{
+			index++;
+			skip_empty();
+			return *this;
+		}
+		bool operator==(const iterator& other) const { return index == other.index; }
+		bool operator!=(const iterator& other) const { return index != other.index; }
+
+		void skip_empty()
+		{
+			while (index < map->allocated && map->distances[index] == 0)
+			{
+				index++;
+			}
+		}
+	};
+
+	flat_hash_map() : distances(nullptr), slots(nullptr), used(0), allocated(0), shift(64) {}
+	explicit flat_hash_map(ALLOC alloc) : allocator(alloc), distances(nullptr), slots(nullptr), used(0), allocated(0), shift(64) {}
+	flat_hash_map(const flat_hash_map&) = delete;
+	flat_hash_map& operator=(const flat_hash_map&) = delete;
+
+	flat_hash_map(flat_hash_map&& other) noexcept : allocator(other.allocator), distances(other.distances), slots(other.slots), used(other.used), allocated(other.allocated), shift(other.shift)
+	{
+		other.distances = nullptr;
+		other.slots = nullptr;
+		other.used = other.allocated = 0;
+		other.shift = 64;
+	}
+
+	flat_hash_map& operator=(flat_hash_map&& other) noexcept
+	{
+		if (&other != this)
+		{
+			dispose();
+			allocator = other.allocator;
+			distances = other.distances;
+			slots = other.slots;
+			used = other.used;
+			allocated = other.allocated;
+			shift = other.shift;
+			other.distances = nullptr;
+			other.slots = nullptr;
+			other.used = other.allocated = 0;
+			other.shift = 64;
+		}
+		return *this;
+	}
+
+	~flat_hash_map()
+	{
+		dispose();
+	}
+
+	iterator begin()
+	{
+		iterator it{ this, 0 };
+		it.skip_empty();
+		return it;
+	}
+
+	iterator end()
+	{
+		return iterator{ this, allocated };
+	}
+
+	iterator find(const K& key)
+	{
+		size_type index;
+		uint8_t dist;
+		return probe(key, index, dist) ? iterator{ this, index } : end();
+	}
+
+	bool contains(const K& key)
+	{
+		return find(key) != end();
+	}
+
+	std::pair<iterator, bool> insert(const std::pair<K, V>& kv)
+	{
+		return emplace(kv.first, kv.second);
+	}
+
+	std::pair<iterator, bool> insert(std::pair<K, V>&& kv)
+	{
+		return emplace(std::move(kv.first), std::move(kv.second));
+	}
+
+	template<class KEY, class... ARGS>
+	std::pair<iterator, bool> emplace(KEY&& key, ARGS&&... args)
+	{
+		//the probe that misses ends where the key belongs, insertion carries on from there unless the table grows
+		size_type index;
+		uint8_t dist;
+		if (probe(key, index, dist))
+		{
+			return { iterator{ this, index }, false };
+		}
+		slot s{ K(std::forward<KEY>(key)), V(std::forward<ARGS>(args)...) };
+		if ((used + 1) * 8 > allocated * 7)
+		{
+			rehash(allocated == 0 ? 16 : allocated * 2);
+			return { iterator{ this, insert_new(std::move(s)) }, true };
+		}
+		return { iterator{ this, insert_new(std::move(s), index, dist) }, true };
+	}
+
+	V& operator[](const K& key)
+	{
+		return emplace(key).first->second;
+	}
+
+	bool erase(const K& key)
+	{
+		iterator it = find(key);
+		if (it == end())
+		{
+			return false;
+		}
+		size_type mask = allocated - 1;
+		size_type index = it.index;
+		slots[index].~slot();
+		distances[index] = 0;
+
+		//shift the following run back one step so no tombstones are needed
+		size_type next = (index + 1) & mask;
+		while (distances[next] > 1)
+		{
+			new (&slots[index]) slot(std::move(slots[next]));
+			slots[next].~slot();
+			distances[index] = distances[next] - 1;
+			distances[next] = 0;
+			index = next;
+			next = (next + 1) & mask;
+		}
+		used--;
+		return true;
+	}
+
+	void reserve(size_type count)
+	{
+		size_type needed = 16;
+		while (needed * 7 < count * 8)
+		{
+			needed *= 2;
+		}
+		if (needed > allocated)
+		{
+			rehash(needed);
+		}
+	}
+
+	void clear()
+	{
+		for (size_type i = 0; i < allocated; i++)
+		{
+			if (distances[i] != 0)
+			{
+				slots[i].~slot();
+				distances[i] = 0;
+			}
+		}
+		used = 0;
+	}
+
+	void dispose()
+	{
+		if (slots)
+		{
+			clear();
+			allocator.deallocate(slots, alignof(slot));
+			allocator.deallocate(distances, alignof(uint8_t));
+			slots = nullptr;
+			distances = nullptr;
+			allocated = 0;
+			shift = 64;
+		}
+	}
+
+	size_type size() const { return used; }
+	bool empty() const { return used == 0; }
+
+private:
+	bool equal(const K& a, const K& b) const
+	{
+		return EQUAL()(a, b);
+	}
+
+	//fibonacci hashing spreads identity hashes (pointers, small ints) over the whole table
+	size_type home(const K& key) const
+	{
+		uint64_t h = (uint64_t)HASH()(key) * 11400714819323198485ull;
+		return (size_type)(h >> shift);
+	}
+
+	//index and dist of the key's slot if it is in the table, otherwise of the first slot whose resident is closer to
+	//its home than the key would be, where insert_new can put it
+	bool probe(const K& key, size_type& index, uint8_t& dist) const
+	{
+		if (used == 0)
+		{
+			index = allocated == 0 ? 0 : home(key);
+			dist = 1;
+			return false;
+		}
+		size_type mask = allocated - 1;
+		index = home(key);
+		for (dist = 1; dist <= distances[index]; dist++)
+		{
+			if (distances[index] == dist && equal(slots[index].first, key))
+			{
+				return true;
+			}
+			index = (index + 1) & mask;
+		}
+		return false;
+	}
+
+	size_type insert_new(slot&& s)
+	{
+		return insert_new(std::move(s), home(s.first), 1);
+	}
+
+	//places s dist - 1 steps from its home at index and returns where it went
+	size_type insert_new(slot&& s, size_type index, uint8_t dist)
+	{
+		size_type mask = allocated - 1;
+		size_type result = allocated;
+		for (;;)
+		{
+			//distances are kept below MAX_DISTANCE so they fit the byte and probe's counter can't wrap.
+			//A run that long means a poor hash for this size, take the original slot back and grow.
+			//What it was swapped for stays in the table with a wrong distance, rehash only needs it to be occupied
+			if (dist == MAX_DISTANCE)
+			{
+				if (result != allocated)
+				{
+					std::swap(s, slots[result]);
+				}
+				rehash(allocated * 2);
+				return insert_new(std::move(s));
+			}
+			if (distances[index] == 0)
+			{
+				new (&slots[index]) slot(std::move(s));
+				distances[index] = dist;
+				used++;
+				return result == allocated ? index : result;
+			}
+			//steal from the rich, the resident is closer to home than we are
+			if (distances[index] < dist)
+			{
+				std::swap(s, slots[index]);
+				std::swap(dist, distances[index]);
+				if (result == allocated)
+				{
+					result = index;
+				}
+			}
+			dist++;
+			index = (index + 1) & mask;
+		}
+	}
+
+	void rehash(size_type new_capacity)
+	{
+		uint8_t* old_distances = distances;
+		slot* old_slots = slots;
+		size_type old_allocated = allocated;
+
+		distances = (uint8_t*)allocator.allocate(new_capacity, alignof(uint8_t));
+		slots = (slot*)allocator.allocate(sizeof(slot) * new_capacity, alignof(slot));
+		assert(distances != nullptr && slots != nullptr);
+		memset(distances, 0, new_capacity);
+		allocated = new_capacity;
+		used = 0;
+		shift = 64;
+		for (size_type c = new_capacity; c > 1; c >>= 1)
+		{
+			shift--;
+		}
+
+		for (size_type i = 0; i < old_allocated; i++)
+		{
+			if (old_distances[i] != 0)
+			{
+				insert_new(std::move(old_slots[i]));
+				old_slots[i].~slot();
+			}
+		}
+
+		if (old_slots)
+		{
+			allocator.deallocate(old_slots, alignof(slot));
+			allocator.deallocate(old_distances, alignof(uint8_t));
+		}
+	}
+
+	static constexpr uint8_t MAX_DISTANCE = 255;
+
+	ALLOC allocator;
+	uint8_t* distances;
+	slot* slots;
+	size_type used;
+	size_type allocated;
+	uint32_t shift;
+};
+
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+//Bounded multi producer / multi consumer ring queue (Vyukov).
+//Every cell carries a sequence number, producers and consumers claim a slot with a single CAS on their own index,
+//the two indices live on separate cache lines so producers and consumers don't false share.
+template<class T, uint32_t CAPACITY>
+struct mpmc_queue
+{
+	static_assert(CAPACITY >= 2 && (CAPACITY & (CAPACITY - 1)) == 0, "mpmc_queue capacity must be a power of two");
+
+	mpmc_queue()
+	{
+		for (uint32_t i = 0; i < CAPACITY; i++)
+		{
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+		enqueue_pos.store(0, std::memory_order_relaxed);
+		dequeue_pos.store(0, std::memory_order_relaxed);
+	}
+
+	mpmc_queue(const mpmc_queue&) = delete;
+	mpmc_queue& operator=(const mpmc_queue&) = delete;
+
+	bool try_push(const T& value)
+	{
+		cell* c;
+		size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			c = &cells[pos & MASK];
+			size_t seq = c->sequence.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+			if (diff == 0)
+			{
+				if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (diff < 0)
+			{
+				return false; //full
+			}
+			else
+			{
+				pos = enqueue_pos.load(std::memory_order_relaxed);
+			}
+		}
+		c->data = value;
+		c->sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool try_pop(T& out)
+	{
+		cell* c;
+		size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			c = &cells[pos & MASK];
+			size_t seq = c->sequence.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+			if (diff == 0)
+			{
+				if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (diff < 0)
+			{
+				return false; //empty
+			}
+			else
+			{
+				pos = dequeue_pos.load(std::memory_order_relaxed);
+			}
+		}
+		out = c->data;
+		c->sequence.store(pos + MASK + 1, std::memory_order_release);
+		return true;
+	}
+
+	//returns the number of values pushed, stops at the first full slot
+	uint32_t try_push(const T* values, uint32_t count)
+	{
+		uint32_t i = 0;
+		for (; i < count; i++)
+		{
+			if (!try_push(values[i]))
+			{
+				break;
+			}
+		}
+		return i;
+	}
+
+	//returns the number of values popped, stops when the queue is empty
+	uint32_t try_pop(T* out, uint32_t count)
+	{
+		uint32_t i = 0;
+		for (; i < count; i++)
+		{
+			if (!try_pop(out[i]))
+			{
+				break;
+			}
+		}
+		return i;
+	}
+
+	//approximate, only exact when no other thread is pushing or popping
+	uint32_t size() const
+	{
+		size_t head = dequeue_pos.load(std::memory_order_relaxed);
+		size_t tail = enqueue_pos.load(std::memory_order_relaxed);
+		return tail > head ? (uint32_t)(tail - head) : 0;
+	}
+
+	constexpr uint32_t capacity() const
+	{
+		return CAPACITY;
+	}
+
+private:
+	constexpr static size_t MASK = CAPACITY - 1;
+
+	struct cell
+	{
+		std::atomic<size_t> sequence;
+		T data;
+	};
+
+	alignas(CACHE_LINE_SIZE) cell cells[CAPACITY];
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> enqueue_pos;
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> dequeue_pos;
+	char pad[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+};
+
+//Bounded single producer / single consumer ring queue.
+//Each side caches the other side's index and only reloads it when the cached value says full / empty.
+template<class T, uint32_t CAPACITY>
+struct spsc_queue
+{
+	static_assert(CAPACITY >= 2 && (CAPACITY & (CAPACITY - 1)) == 0, "spsc_queue capacity must be a power of two");
+
+	spsc_queue() : head(0), cached_tail(0), tail(0), cached_head(0) {}
+
+	spsc_queue(const spsc_queue&) = delete;
+	spsc_queue& operator=(const spsc_queue&) = delete;
+
+	//producer only
+	bool try_push(const T& value)
+	{
+		return try_push(&value, 1) == 1;
+	}
+
+	//consumer only
+	bool try_pop(T& out)
+	{
+		return try_pop(&out, 1) == 1;
+	}
+
+	//producer only, pushes as many values as fit and publishes them with a single store
+	uint32_t try_push(const T* values, uint32_t count)
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		size_t free_slots = CAPACITY - (t - cached_head);
+		if (free_slots < count)
+		{
+			cached_head = head.load(std::memory_order_acquire);
+			free_slots = CAPACITY - (t - cached_head);
+		}
+		uint32_t n = count < free_slots ? count : (uint32_t)free_slots;
+		for (uint32_t i = 0; i < n; i++)
+		{
+			data[(t + i) & MASK] = values[i];
+		}
+		tail.store(t + n, std::memory_order_release);
+		return n;
+	}
+
+	//consumer only, pops as many values as are available and releases the slots with a single store
+	uint32_t try_pop(T* out, uint32_t count)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		size_t available = cached_tail - h;
+		if (available < count)
+		{
+			cached_tail = tail.load(std::memory_order_acquire);
+			available = cached_tail - h;
+		}
+		uint32_t n = count < available ? count : (uint32_t)available;
+		for (uint32_t i = 0; i < n; i++)
+		{
+			out[i] = data[(h + i) & MASK];
+		}
+		head.store(h + n, std::memory_order_release);
+		return n;
+	}
+
+	//approximate, only exact when called from the producer or consumer thread while the other side is idle
+	uint32_t size() const
+	{
+		return (uint32_t)(tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire));
+	}
+
+	constexpr uint32_t capacity() const
+	{
+		return CAPACITY;
+	}
+
+private:
+	constexpr static size_t MASK = CAPACITY - 1;
+
+	T data[CAPACITY];
+
+	//consumer owned
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> head;
+	size_t cached_tail;
 
+	//producer owned
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail;
+	size_t cached_head;
+	char pad[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
 };
\ No newline at end of file
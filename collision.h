@@ -2,6 +2,12 @@
 #include "mmath.h"
 #include "components.h"
 #include "array_util.h"
+#include <assert.h>
+#include <float.h>
+#include <stdint.h>
+#include <algorithm>
+#include <limits>
+#include <vector>
 
 enum class collider_type
 {
@@ -36,38 +42,660 @@ struct collider
 
 };
 
-constexpr float area(aabb a)
+inline float area(aabb a)
 {
 	float3 d = a.upper_bound - a.lower_bound;
 	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
 }
 
-constexpr aabb aabb_union(aabb a, aabb b)
+inline aabb aabb_union(aabb a, aabb b)
 {
 	aabb res;
-	res.lower_bound = math::float3_min(a.lower_bound, b.lower_bound);
-	res.upper_bound = math::float3_max(a.upper_bound, b.upper_bound);
+	res.lower_bound = math::min(a.lower_bound, b.lower_bound);
+	res.upper_bound = math::max(a.upper_bound, b.upper_bound);
 	return res;
 }
 
+inline bool overlaps(const aabb& a, const aabb& b)
+{
+	return a.lower_bound.x <= b.upper_bound.x && a.upper_bound.x >= b.lower_bound.x &&
+		a.lower_bound.y <= b.upper_bound.y && a.upper_bound.y >= b.lower_bound.y &&
+		a.lower_bound.z <= b.upper_bound.z && a.upper_bound.z >= b.lower_bound.z;
+}
+
+inline bool contains(const aabb& outer, const aabb& inner)
+{
+	return outer.lower_bound.x <= inner.lower_bound.x && outer.lower_bound.y <= inner.lower_bound.y && outer.lower_bound.z <= inner.lower_bound.z &&
+		inner.upper_bound.x <= outer.upper_bound.x && inner.upper_bound.y <= outer.upper_bound.y && inner.upper_bound.z <= outer.upper_bound.z;
+}
+
+constexpr int NULL_NODE = -1;
+
 struct node
 {
 	aabb box;
+	//user data of a leaf, passed back in pairs and queries
 	int object_index;
+	//next free node while the node is in the free list
 	int parent_index;
 	int child1;
 	int child2;
-	bool is_leaf;
+	//0 for leaves, -1 for free nodes
+	int height;
+	//the leaf was inserted or reinserted since the last find_pairs
+	bool moved;
+
+	bool is_leaf() const
+	{
+		return child1 == NULL_NODE;
+	}
+};
+
+//potentially colliding objects, object indices of the two leaves with a < b
+struct collision_pair
+{
+	int a;
+	int b;
+
+	bool operator<(const collision_pair& other) const
+	{
+		return a != other.a ? a < other.a : b < other.b;
+	}
+
+	bool operator==(const collision_pair& other) const
+	{
+		return a == other.a && b == other.b;
+	}
 };
 
+//Dynamic bounding volume hierarchy over fattened aabbs.
+//Leaves keep a box grown by margin and stretched along the last displacement, so an object moving within it
+//costs nothing; only objects leaving their fat box are removed and reinserted.
+//Insertion walks down by the surface area cost of the new parent plus the area every ancestor grows by,
+//then rotations on the way up swap children and grandchildren wherever that shrinks the tree's surface area.
+//Nodes live in one pool, freed nodes are chained through parent_index and reused. Proxy ids are node indices.
 struct tree
 {
-	node* nodes;
-	int node_count;
-	int root_index;
+	std::vector<node> nodes;
+	int node_count = 0;
+	int root_index = NULL_NODE;
+	int free_list = NULL_NODE;
+
+	//every fat box is this much larger than its object on every side
+	float margin = 0.1f;
+	//the fat box also reaches this many displacements ahead
+	float displacement_multiplier = 4.0f;
+
+	//scratch, kept around so queries and pair updates don't allocate
+	std::vector<int> stack;
+	std::vector<int> move_buffer;
+
+	//returns the proxy id of the new leaf
+	int insert(const aabb& box, int object_index)
+	{
+		int proxy = allocate_node();
+		node& n = nodes[proxy];
+		n.box = fatten(box);
+		n.object_index = object_index;
+		n.height = 0;
+		n.moved = true;
+		insert_leaf(proxy);
+		move_buffer.push_back(proxy);
+		return proxy;
+	}
+
+	void remove(int proxy)
+	{
+		assert(proxy >= 0 && proxy < (int)nodes.size() && nodes[proxy].is_leaf());
+		remove_leaf(proxy);
+		free_node(proxy);
+	}
+
+	//box is the object's new tight box and displacement how far it moved since the last call.
+	//returns true when the leaf left its fat box and was reinserted
+	bool move(int proxy, const aabb& box, const float3& displacement)
+	{
+		assert(proxy >= 0 && proxy < (int)nodes.size() && nodes[proxy].is_leaf());
+		node& n = nodes[proxy];
+		if (contains(n.box, box))
+		{
+			//a fat box far larger than needed, e.g. after a fast move, is shrunk again
+			aabb huge = box;
+			huge.lower_bound = huge.lower_bound - float3(margin, margin, margin) * 4.0f;
+			huge.upper_bound = huge.upper_bound + float3(margin, margin, margin) * 4.0f;
+			if (contains(huge, n.box))
+			{
+				return false;
+			}
+		}
+
+		remove_leaf(proxy);
+		aabb fat = fatten(box);
+		float3 d = displacement * displacement_multiplier;
+		fat.lower_bound = math::min(fat.lower_bound, fat.lower_bound + d);
+		fat.upper_bound = math::max(fat.upper_bound, fat.upper_bound + d);
+		nodes[proxy].box = fat;
+		insert_leaf(proxy);
+		if (!nodes[proxy].moved)
+		{
+			nodes[proxy].moved = true;
+			move_buffer.push_back(proxy);
+		}
+		return true;
+	}
+
+	const aabb& fat_box(int proxy) const
+	{
+		return nodes[proxy].box;
+	}
+
+	//callback(object_index) for every leaf whose fat box overlaps box, return false from it to stop
+	template<class FUNC>
+	void query(const aabb& box, FUNC& callback)
+	{
+		stack.clear();
+		if (root_index != NULL_NODE)
+		{
+			stack.push_back(root_index);
+		}
+		while (!stack.empty())
+		{
+			int index = stack.back();
+			stack.pop_back();
+			const node& n = nodes[index];
+			if (!overlaps(n.box, box))
+			{
+				continue;
+			}
+			if (n.is_leaf())
+			{
+				if (!callback(n.object_index))
+				{
+					return;
+				}
+			}
+			else
+			{
+				stack.push_back(n.child1);
+				stack.push_back(n.child2);
+			}
+		}
+	}
+
+	//replaces pairs with every pair of overlapping fat boxes that has at least one leaf moved since the last call,
+	//sorted and without duplicates. Pairs whose leaves both stayed in their fat boxes were reported by an earlier call
+	void find_pairs(std::vector<collision_pair>& pairs)
+	{
+		pairs.clear();
+		for (int proxy : move_buffer)
+		{
+			if (proxy >= (int)nodes.size() || !nodes[proxy].moved || nodes[proxy].height != 0)
+			{
+				continue;
+			}
+			const aabb box = nodes[proxy].box;
+			const int self = nodes[proxy].object_index;
+			stack.clear();
+			stack.push_back(root_index);
+			while (!stack.empty())
+			{
+				int index = stack.back();
+				stack.pop_back();
+				const node& n = nodes[index];
+				if (!overlaps(n.box, box))
+				{
+					continue;
+				}
+				if (!n.is_leaf())
+				{
+					stack.push_back(n.child1);
+					stack.push_back(n.child2);
+				}
+				//both moved: the pair is found from the lower proxy only
+				else if (index != proxy && !(n.moved && index < proxy))
+				{
+					pairs.push_back(self < n.object_index ? collision_pair{ self, n.object_index } : collision_pair{ n.object_index, self });
+				}
+			}
+		}
+		clear_moved();
+		std::sort(pairs.begin(), pairs.end());
+		pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+	}
+
+	//forgets which leaves moved, for users that query the tree themselves instead of calling find_pairs
+	void clear_moved()
+	{
+		for (int proxy : move_buffer)
+		{
+			if (proxy < (int)nodes.size())
+			{
+				nodes[proxy].moved = false;
+			}
+		}
+		move_buffer.clear();
+	}
+
+	//every pair of overlapping fat boxes, sorted
+	void find_all_pairs(std::vector<collision_pair>& pairs)
+	{
+		for (int i = 0; i < (int)nodes.size(); i++)
+		{
+			if (nodes[i].height == 0 && !nodes[i].moved)
+			{
+				nodes[i].moved = true;
+				move_buffer.push_back(i);
+			}
+		}
+		find_pairs(pairs);
+	}
+
+	int height() const
+	{
+		return root_index == NULL_NODE ? 0 : nodes[root_index].height;
+	}
+
+	//sum of the surface areas of the internal nodes over the area of the root. Grows as the tree degrades,
+	//compare against a tree built from scratch over the same boxes
+	float area_ratio() const
+	{
+		if (root_index == NULL_NODE)
+		{
+			return 0.0f;
+		}
+		float total = 0.0f;
+		for (const node& n : nodes)
+		{
+			if (n.height > 0)
+			{
+				total += area(n.box);
+			}
+		}
+		return total / area(nodes[root_index].box);
+	}
+
+	//asserts the links, heights and boxes of every node
+	void validate() const
+	{
+		int leaves = 0;
+		int internal = 0;
+		for (int i = 0; i < (int)nodes.size(); i++)
+		{
+			const node& n = nodes[i];
+			if (n.height < 0)
+			{
+				continue;
+			}
+			if (i == root_index)
+			{
+				assert(n.parent_index == NULL_NODE);
+			}
+			else
+			{
+				assert(nodes[n.parent_index].child1 == i || nodes[n.parent_index].child2 == i);
+			}
+			if (n.is_leaf())
+			{
+				assert(n.height == 0);
+				leaves++;
+				continue;
+			}
+			internal++;
+			const node& a = nodes[n.child1];
+			const node& b = nodes[n.child2];
+			assert(n.height == 1 + std::max(a.height, b.height));
+			assert(contains(n.box, a.box) && contains(n.box, b.box));
+			(void)a;
+			(void)b;
+		}
+		assert(leaves + internal == node_count);
+		assert(leaves == 0 || internal == leaves - 1);
+		(void)leaves;
+		(void)internal;
+	}
+
+private:
+	aabb fatten(const aabb& box) const
+	{
+		aabb fat;
+		fat.lower_bound = box.lower_bound - float3(margin, margin, margin);
+		fat.upper_bound = box.upper_bound + float3(margin, margin, margin);
+		return fat;
+	}
+
+	int allocate_node()
+	{
+		int index = free_list;
+		if (index == NULL_NODE)
+		{
+			index = (int)nodes.size();
+			nodes.push_back(node());
+		}
+		else
+		{
+			free_list = nodes[index].parent_index;
+		}
+		node& n = nodes[index];
+		n.parent_index = NULL_NODE;
+		n.child1 = NULL_NODE;
+		n.child2 = NULL_NODE;
+		n.object_index = -1;
+		n.height = 0;
+		n.moved = false;
+		node_count++;
+		return index;
+	}
+
+	void free_node(int index)
+	{
+		nodes[index].parent_index = free_list;
+		nodes[index].height = -1;
+		nodes[index].moved = false;
+		free_list = index;
+		node_count--;
+	}
+
+	void insert_leaf(int leaf)
+	{
+		if (root_index == NULL_NODE)
+		{
+			root_index = leaf;
+			nodes[leaf].parent_index = NULL_NODE;
+			return;
+		}
+
+		//surface area heuristic: a new parent at index costs twice its area, and every ancestor grows by the union
+		const aabb box = nodes[leaf].box;
+		int index = root_index;
+		while (!nodes[index].is_leaf())
+		{
+			const node& n = nodes[index];
+			float node_area = area(n.box);
+			float combined_area = area(aabb_union(n.box, box));
+			float cost = 2.0f * combined_area;
+			float inheritance_cost = 2.0f * (combined_area - node_area);
+
+			float cost1 = child_cost(n.child1, box) + inheritance_cost;
+			float cost2 = child_cost(n.child2, box) + inheritance_cost;
+			if (cost < cost1 && cost < cost2)
+			{
+				break;
+			}
+			index = cost1 < cost2 ? n.child1 : n.child2;
+		}
+
+		const int sibling = index;
+		const int old_parent = nodes[sibling].parent_index;
+		const int new_parent = allocate_node();
+		node& p = nodes[new_parent];
+		p.parent_index = old_parent;
+		p.box = aabb_union(box, nodes[sibling].box);
+		p.height = nodes[sibling].height + 1;
+		p.child1 = sibling;
+		p.child2 = leaf;
+		nodes[sibling].parent_index = new_parent;
+		nodes[leaf].parent_index = new_parent;
+		if (old_parent == NULL_NODE)
+		{
+			root_index = new_parent;
+		}
+		else if (nodes[old_parent].child1 == sibling)
+		{
+			nodes[old_parent].child1 = new_parent;
+		}
+		else
+		{
+			nodes[old_parent].child2 = new_parent;
+		}
+
+		refit(nodes[leaf].parent_index);
+	}
+
+	//cost of descending into a child: a new parent there, plus its own growth if it is internal
+	float child_cost(int child, const aabb& box) const
+	{
+		const node& c = nodes[child];
+		float combined_area = area(aabb_union(c.box, box));
+		return c.is_leaf() ? combined_area : combined_area - area(c.box);
+	}
+
+	void remove_leaf(int leaf)
+	{
+		if (leaf == root_index)
+		{
+			root_index = NULL_NODE;
+			return;
+		}
+
+		const int parent = nodes[leaf].parent_index;
+		const int grand_parent = nodes[parent].parent_index;
+		const int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+		if (grand_parent == NULL_NODE)
+		{
+			root_index = sibling;
+			nodes[sibling].parent_index = NULL_NODE;
+			free_node(parent);
+			return;
+		}
+
+		if (nodes[grand_parent].child1 == parent)
+		{
+			nodes[grand_parent].child1 = sibling;
+		}
+		else
+		{
+			nodes[grand_parent].child2 = sibling;
+		}
+		nodes[sibling].parent_index = grand_parent;
+		free_node(parent);
+		refit(grand_parent);
+	}
+
+	//walks up from index fixing heights and boxes, rotating where it lowers the surface area
+	void refit(int index)
+	{
+		while (index != NULL_NODE)
+		{
+			rotate(index);
+			node& n = nodes[index];
+			n.height = 1 + std::max(nodes[n.child1].height, nodes[n.child2].height);
+			n.box = aabb_union(nodes[n.child1].box, nodes[n.child2].box);
+			index = n.parent_index;
+		}
+	}
+
+	//swaps a child of a with a grandchild under the other child when that shrinks the box of the node the
+	//grandchild is under. Only areas below a change, a's own box stays the same
+	void rotate(int a)
+	{
+		node& A = nodes[a];
+		if (A.height < 2)
+		{
+			return;
+		}
+
+		const int b = A.child1;
+		const int c = A.child2;
+		float best = 0.0f;
+		int best_child = NULL_NODE;
+		int best_grandchild = NULL_NODE;
+		auto consider = [this, &best, &best_child, &best_grandchild](int child, int other)
+		{
+			const node& O = nodes[other];
+			if (O.is_leaf())
+			{
+				return;
+			}
+			const float other_area = area(O.box);
+			//child takes the place of one grandchild, the box of other then covers child and the remaining grandchild
+			float saving1 = other_area - area(aabb_union(nodes[child].box, nodes[O.child2].box));
+			float saving2 = other_area - area(aabb_union(nodes[child].box, nodes[O.child1].box));
+			if (saving1 > best)
+			{
+				best = saving1;
+				best_child = child;
+				best_grandchild = O.child1;
+			}
+			if (saving2 > best)
+			{
+				best = saving2;
+				best_child = child;
+				best_grandchild = O.child2;
+			}
+		};
+		consider(b, c);
+		consider(c, b);
+		if (best_child == NULL_NODE)
+		{
+			return;
+		}
+
+		const int other = nodes[best_grandchild].parent_index;
+		node& O = nodes[other];
+		if (A.child1 == best_child)
+		{
+			A.child1 = best_grandchild;
+		}
+		else
+		{
+			A.child2 = best_grandchild;
+		}
+		if (O.child1 == best_grandchild)
+		{
+			O.child1 = best_child;
+		}
+		else
+		{
+			O.child2 = best_child;
+		}
+		nodes[best_grandchild].parent_index = a;
+		nodes[best_child].parent_index = other;
+		O.box = aabb_union(nodes[O.child1].box, nodes[O.child2].box);
+		O.height = 1 + std::max(nodes[O.child1].height, nodes[O.child2].height);
+	}
+};
+
+struct bvh_node
+{
+	aabb box;
+	//leaf: items [first, first + count), internal: children first and first + 1
+	int first;
+	int count;
 };
 
-//Todo: build dynamic aabb
+//Bounding volume hierarchy built in one pass over a fixed set of boxes, for geometry that doesn't move.
+//Top down, every node splits its items at the median centroid along the longest axis of the centroid bounds.
+//Nodes and items are flat arrays, a build reuses their memory. Query interface matches tree.
+struct static_bvh
+{
+	std::vector<bvh_node> nodes;
+	std::vector<aabb> boxes;
+	std::vector<int> objects;
+	//item order after the build, indices into boxes / objects
+	std::vector<int> items;
+	std::vector<float3> centroids;
+	std::vector<int> stack;
+
+	//items per leaf at most
+	int leaf_size = 2;
+
+	void build(const aabb* in_boxes, const int* in_objects, size_t count)
+	{
+		boxes.assign(in_boxes, in_boxes + count);
+		objects.assign(in_objects, in_objects + count);
+		items.resize(count);
+		centroids.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			items[i] = (int)i;
+			centroids[i] = (boxes[i].lower_bound + boxes[i].upper_bound) * 0.5f;
+		}
+		nodes.clear();
+		if (count == 0)
+		{
+			return;
+		}
+		nodes.reserve(count * 2);
+		nodes.push_back(bvh_node{ aabb(), 0, (int)count });
+
+		stack.clear();
+		stack.push_back(0);
+		while (!stack.empty())
+		{
+			const int index = stack.back();
+			stack.pop_back();
+			const int first = nodes[index].first;
+			const int n = nodes[index].count;
+
+			aabb box = boxes[items[first]];
+			float3 lower = centroids[items[first]];
+			float3 upper = lower;
+			for (int i = first + 1; i < first + n; i++)
+			{
+				box = aabb_union(box, boxes[items[i]]);
+				lower = math::min(lower, centroids[items[i]]);
+				upper = math::max(upper, centroids[items[i]]);
+			}
+			nodes[index].box = box;
+			if (n <= leaf_size)
+			{
+				continue;
+			}
+
+			const float3 extent = upper - lower;
+			const int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+			const int half = n / 2;
+			std::nth_element(items.begin() + first, items.begin() + first + half, items.begin() + first + n,
+				[this, axis](int a, int b) { return (&centroids[a].x)[axis] < (&centroids[b].x)[axis]; });
+
+			const int left = (int)nodes.size();
+			nodes.push_back(bvh_node{ aabb(), first, half });
+			nodes.push_back(bvh_node{ aabb(), first + half, n - half });
+			nodes[index].first = left;
+			nodes[index].count = 0;
+			stack.push_back(left);
+			stack.push_back(left + 1);
+		}
+	}
+
+	bool empty() const
+	{
+		return nodes.empty();
+	}
+
+	//callback(object) for every item whose box overlaps box, return false from it to stop
+	template<class FUNC>
+	void query(const aabb& box, FUNC& callback)
+	{
+		stack.clear();
+		if (!nodes.empty())
+		{
+			stack.push_back(0);
+		}
+		while (!stack.empty())
+		{
+			const bvh_node& n = nodes[stack.back()];
+			stack.pop_back();
+			if (!overlaps(n.box, box))
+			{
+				continue;
+			}
+			if (n.count == 0)
+			{
+				stack.push_back(n.first);
+				stack.push_back(n.first + 1);
+				continue;
+			}
+			for (int i = n.first; i < n.first + n.count; i++)
+			{
+				if (overlaps(boxes[items[i]], box) && !callback(objects[items[i]]))
+				{
+					return;
+				}
+			}
+		}
+	}
+};
 
 struct support_data
 {
@@ -94,65 +722,40 @@ struct support_point
 };
 
 
-constexpr float3 sphere_support(float3& search, const support_data& data)
+//world space direction of the collider's local axis i, the matrix is rotation only
+inline float3 local_axis(const collider& col, int i)
 {
-	float3 pos = data.pos;
-	float radius = data.col.radius;
-	float3 d = math::normalize(search);
-	return pos + radius * math::normalize(d);
+	return float3(col.local_to_world[i], col.local_to_world[4 + i], col.local_to_world[8 + i]);
 }
 
-constexpr float3 capsule_support(float3& search, const support_data& data)
+inline float3 sphere_support(const float3& search, const support_data& data)
 {
-	float4x4 mat = data.col.local_to_world;
-	search = math::mul(data.col.local_to_world_inverse, search);
-
-	float3 searchxz = float3(search.x, 0, search.z);
-	float3 search_result = math::normalize(searchxz) * data.col.radius;
-	search_result.y = (search.y > 0) ? data.col.y_cap : data.col.y_base;
-
-	return math::mul(mat, search_result) + data.pos;
+	return data.pos + math::normalize(search) * data.col.radius;
 }
 
-constexpr float3 box_support(const float3& search, const support_data& data)
+//the capsule is the segment from y_base to y_cap on its local y axis grown by radius
+inline float3 capsule_support(const float3& search, const support_data& data)
 {
-	float4x4 mat = data.col.local_to_world;
-	float3 result = float3(0, 0, 0);
-
-	float3 size = float3(data.col.x_size, data.col.y_size, data.col.z_size);
-
-	float3 vertices[] =
-	{
-		float3(-size.x, -size.y, -size.z),
-		float3(size.x, -size.y, -size.z),
-		float3(size.x, size.y, -size.z),
-		float3(-size.x, size.y, -size.z),
-		float3(-size.x, -size.y, size.z),
-		float3(size.x, -size.y, size.z),
-		float3(size.x, size.y, size.z),
-		float3(-size.x, size.y, size.z),
-	};
-
-
-	float3 d;
-	float maxDot = -std::numeric_limits<double>::infinity();
-	result = float3(0,0,0);
+	float3 up = local_axis(data.col, 1);
+	float3 end = data.pos + up * (math::dot(search, up) > 0 ? data.col.y_cap : data.col.y_base);
+	return end + math::normalize(search) * data.col.radius;
+}
 
-	for (int i = 0; i < COUNT_OF(vertices); i++)
+//sizes are half extents. The corner furthest along search is picked an axis at a time
+inline float3 box_support(const float3& search, const support_data& data)
+{
+	float3 result = data.pos;
+	const float size[] = { data.col.x_size, data.col.y_size, data.col.z_size };
+	for (int i = 0; i < 3; i++)
 	{
-		d = math::mul(mat, vertices[i]); 
-		float dot = math::dot(d, search);
-		if (dot > maxDot)
-		{
-			maxDot = dot;
-			result = d;
-		}
+		float3 axis = local_axis(data.col, i);
+		result = result + axis * (math::dot(axis, search) > 0 ? size[i] : -size[i]);
 	}
 	return result;
 }
 
 
-constexpr support_point support(float3& search, const support_data& a_data, const support_data& b_data, int& unique_id)
+inline support_point support(const float3& search, const support_data& a_data, const support_data& b_data, int& unique_id)
 {
 	float3 negative_search = -search;
 	float3 temp_a = float3(0, 0, 0);
@@ -221,56 +824,98 @@ struct simplex
 };
 
 
-struct triangle
-{
-	support_point a, b, c;
-	float3 n;
-
-	triangle(const support_point& a, const support_point& b, const support_point& c)
-	{
-		this->a = a;
-		this->b = b;
-		this->c = c;
-		n = math::normalize(math::cross((b.v - a.v), (c.v - a.v)));
-	}
-};
-
-struct edge
-{
-	support_point a_point;
-	support_point b_point;
-};
-
 namespace epa
 {
 	const int MAX_NUM_ITER = 64;
 	const float GROWTH_TOLERANCE = 0.0001f;
 
-	void add_edge(std::vector<edge>& edges, const support_point& a, const support_point& b)
+	//the gjk simplex plus one vertex per iteration
+	const int MAX_VERTICES = MAX_NUM_ITER + 4;
+	//a closed polytope with v vertices has at most 2v - 4 faces
+	const int MAX_FACES = 2 * MAX_VERTICES - 4;
+	//every face removed in an iteration adds its three edges
+	const int MAX_EDGES = 3 * MAX_FACES;
+
+	struct face
 	{
-		for (int i = 0; i < edges.size(); i++)
+		//indices into polytope::vertices, counter clockwise seen from outside
+		int a, b, c;
+		float3 n;
+		//of the face's plane from the origin
+		float dist;
+	};
+
+	struct edge
+	{
+		int a, b;
+		//false once the same edge came in the other direction from a neighbouring face
+		bool live;
+	};
+
+	//Working memory of calculate, fixed size so expanding never allocates. Keep one per thread and reuse it.
+	//Horizon edges are found through a table by (from, to) vertex: an edge shared by two removed faces arrives once
+	//in each direction and the second one cancels the first in O(1).
+	struct polytope
+	{
+		support_point vertices[MAX_VERTICES];
+		face faces[MAX_FACES];
+		edge edges[MAX_EDGES];
+		//index into edges of the edge from one vertex to another, -1 for none. Entries are reset after every iteration
+		int16_t edge_slot[MAX_VERTICES][MAX_VERTICES];
+		int vertex_count = 0;
+		int face_count = 0;
+		int edge_count = 0;
+
+		polytope()
 		{
-			if (edges[i].a_point.unique_id == b.unique_id && edges[i].b_point.unique_id == a.unique_id)
+			std::fill(&edge_slot[0][0], &edge_slot[0][0] + MAX_VERTICES * MAX_VERTICES, (int16_t)-1);
+		}
+
+		void add_face(int a, int b, int c)
+		{
+			face& f = faces[face_count++];
+			f.a = a;
+			f.b = b;
+			f.c = c;
+			f.n = math::normalize(math::cross(vertices[b].v - vertices[a].v, vertices[c].v - vertices[a].v));
+			f.dist = math::dot(f.n, vertices[a].v);
+		}
+
+		void add_edge(int a, int b)
+		{
+			int16_t& reverse = edge_slot[b][a];
+			if (reverse >= 0)
 			{
-				if (edges.size() > 1)
-				{
-					std::iter_swap(edges.begin() + i, edges.end() - 1);
-					edges.pop_back();
-				}
-				else
+				edges[reverse].live = false;
+				reverse = -1;
+				return;
+			}
+			edge_slot[a][b] = (int16_t)edge_count;
+			edges[edge_count++] = edge{ a, b, true };
+		}
+
+		//faces with a degenerate normal have a nan distance and are never picked
+		int closest_face() const
+		{
+			int closest = 0;
+			float min_dist = FLT_MAX;
+			for (int i = 0; i < face_count; i++)
+			{
+				if (faces[i].dist < min_dist)
 				{
-					edges.clear();
+					closest = i;
+					min_dist = faces[i].dist;
 				}
 			}
+			return closest;
 		}
-		edges.push_back(edge{ a, b });
-	}
+	};
 
-	constexpr bool is_valid(float value)
+	inline bool is_valid(float value)
 	{
 		return !isinf(value) && !isnan(value);
 	}
-	constexpr float3 barycentric(const float3& p, const float3& a, const float3& b, const float3& c)
+	inline float3 barycentric(const float3& p, const float3& a, const float3& b, const float3& c)
 	{
 		float3 v0 = b - a, v1 = c - a, v2 = p - a;
 		float d00 = math::dot(v0, v0);
@@ -285,81 +930,92 @@ namespace epa
 		return float3(u, v, w);
 	}
 
-	bool calculate(const simplex& simp, const support_data& a_support, const support_data& b_support, int unique_id, contact_data& data)
+	inline bool calculate(const simplex& simp, const support_data& a_support, const support_data& b_support, int& unique_id, contact_data& data, polytope& p)
 	{
-		std::vector<triangle> triangles
-		{
-			triangle(simp.a, simp.b, simp.c),
-			triangle(simp.a, simp.c, simp.d),
-			triangle(simp.a, simp.d, simp.b),
-			triangle(simp.b, simp.d, simp.c),
-		};
-
-		int closest_triangle_index = 0;
+		p.vertices[0] = simp.a;
+		p.vertices[1] = simp.b;
+		p.vertices[2] = simp.c;
+		p.vertices[3] = simp.d;
+		p.vertex_count = 4;
+		p.face_count = 0;
+		p.add_face(0, 1, 2);
+		p.add_face(0, 2, 3);
+		p.add_face(0, 3, 1);
+		p.add_face(1, 3, 2);
+
+		int closest_face_index = 0;
 		bool converged = false;
 		for (int iter = 0; iter < MAX_NUM_ITER; iter++)
 		{
-			std::vector<edge> edges;
-
-			float min_dist = FLT_MAX;
-			for (int i = 0; i < triangles.size(); i++)
-			{
-				float dist = math::dot(triangles[i].n, triangles[i].a.v);
-				if (dist < min_dist)
-				{
-					closest_triangle_index = i;
-					min_dist = dist;
-				}
-			}
-			float3 closest_triangle_normal = triangles[closest_triangle_index].n;
-			support_point search = support(closest_triangle_normal, a_support, b_support, unique_id);
+			closest_face_index = p.closest_face();
+			const face closest = p.faces[closest_face_index];
+			float3 closest_face_normal = closest.n;
+			support_point search = support(closest_face_normal, a_support, b_support, unique_id);
 
-
-			float new_dist = math::dot(triangles[closest_triangle_index].n, search.v);
-			float growth = new_dist - min_dist;
+			float growth = math::dot(closest.n, search.v) - closest.dist;
 			if (growth < GROWTH_TOLERANCE)
 			{
 				converged = true;
 				break;
 			}
-			for (int i = 0; i < triangles.size(); i++)
+
+			const int v = p.vertex_count++;
+			p.vertices[v] = search;
+			p.edge_count = 0;
+			for (int i = 0; i < p.face_count;)
 			{
-				//can this face be seen from the new search direction? 
-				if (math::dot(triangles[i].n, search.v - triangles[i].a.v) > 0)
+				//can this face be seen from the new support point?
+				const face& f = p.faces[i];
+				if (math::dot(f.n, search.v - p.vertices[f.a].v) > 0)
+				{
+					p.add_edge(f.a, f.b);
+					p.add_edge(f.b, f.c);
+					p.add_edge(f.c, f.a);
+					//the last face moves into slot i and is tested next
+					p.faces[i] = p.faces[--p.face_count];
+				}
+				else
 				{
-					support_point a = triangles[i].a;
-					support_point b = triangles[i].b;
-					support_point c = triangles[i].c;
-
-					add_edge(edges, a, b);
-					add_edge(edges, b, c);
-					add_edge(edges, c, a);
-
-					if (triangles.size() > 1)
-					{
-						std::iter_swap(triangles.begin() + i, triangles.end() - 1);
-						triangles.pop_back();
-					}
-					else
-					{
-						triangles.clear();
-					}
-					i--;
+					i++;
 				}
 			}
 
-			// create new triangles from the edges in the edge list
-			for (int i = 0; i < edges.size(); i++)
+			//fan the horizon out to the new vertex. Numerical trouble can make the visible region not a disc,
+			//stop with what there is instead of running out of faces
+			bool full = false;
+			for (int i = 0; i < p.edge_count; i++)
+			{
+				const edge& e = p.edges[i];
+				if (!e.live)
+				{
+					continue;
+				}
+				p.edge_slot[e.a][e.b] = -1;
+				if (p.face_count == MAX_FACES)
+				{
+					full = true;
+					continue;
+				}
+				p.add_face(v, e.a, e.b);
+			}
+			if (full || p.face_count == 0)
 			{
-				support_point a = edges[i].a_point;
-				support_point b = edges[i].b_point;
-				triangles.push_back(triangle(search, a, b));
+				return false;
 			}
 		}
+		//out of iterations the closest face is still a lower bound on the depth. Deep overlaps of round shapes need more
+		//vertices than there are to get within GROWTH_TOLERANCE, dropping the contact would let them sink through
+		if (!converged)
+		{
+			closest_face_index = p.closest_face();
+		}
 
-		triangle closest_triangle = triangles[closest_triangle_index];
-		float dist_from_origin = math::dot(closest_triangle.n, closest_triangle.a.v);
-		float3 uvw = barycentric(closest_triangle.n * dist_from_origin, closest_triangle.a.v, closest_triangle.b.v, closest_triangle.c.v);
+		const face& closest_face = p.faces[closest_face_index];
+		const support_point& a = p.vertices[closest_face.a];
+		const support_point& b = p.vertices[closest_face.b];
+		const support_point& c = p.vertices[closest_face.c];
+		float dist_from_origin = closest_face.dist;
+		float3 uvw = barycentric(closest_face.n * dist_from_origin, a.v, b.v, c.v);
 
 		if (!is_valid(uvw.x) || !is_valid(uvw.y) || !is_valid(uvw.z))
 		{
@@ -371,40 +1027,146 @@ namespace epa
 			return false;
 		}
 
-		float3 aPoint = float3(closest_triangle.a.a_support * uvw.x + closest_triangle.b.a_support * uvw.y + closest_triangle.c.a_support * uvw.z);
-		float3 bPoint = float3(closest_triangle.a.b_support * uvw.x + closest_triangle.b.b_support * uvw.y + closest_triangle.c.b_support * uvw.z);
+		float3 aPoint = float3(a.a_support * uvw.x + b.a_support * uvw.y + c.a_support * uvw.z);
+		float3 bPoint = float3(a.b_support * uvw.x + b.b_support * uvw.y + c.b_support * uvw.z);
 
 		//position of a + normal * depth;
 		//position of b + -normal * depth;
 
 		data = contact_data();
-		data.normal = math::normalize(closest_triangle.n);
+		data.normal = math::normalize(closest_face.n);
 		data.depth = dist_from_origin;
 		data.world_space_point_a = aPoint;
 		data.world_space_point_b = bPoint;
-		return converged;
+		return true;
 	}
 }
 
 
 namespace gjk
 {
+	//how far outside a face of the tetrahedron the origin has to be before the face is kept searching from.
+	//Support points on the line between the centres of two spheres put the origin on an edge, where the sign
+	//of the face test is rounding noise and the search would go round the same faces until it runs out
+	const float FACE_TOLERANCE = 0.00001f;
+
+	inline bool outside(const float3& face_normal, const float3& ao)
+	{
+		float d = math::dot(face_normal, ao);
+		return d > 0 && d * d > FACE_TOLERANCE * FACE_TOLERANCE * math::dot(face_normal, face_normal);
+	}
 
-	constexpr bool intersect(const support_data& a_data, const support_data& b_data, /*out*/ contact_data& data, int MAX_ITERATIONS = 64)
+	inline float3 update3(support_point& a, support_point& b, support_point& c, support_point& d, int& n)
+	{
+		float3 normal = math::cross(b.v - a.v, c.v - a.v);
+		float3 AO = -a.v;
+
+		n = 2;
+		if (math::dot(math::cross(b.v - a.v, normal), AO) > 0)
+		{
+			c = a;
+			return math::cross(math::cross(b.v - a.v, AO), b.v - a.v);
+		}
+
+		if (math::dot(math::cross(normal, c.v - a.v), AO) > 0)
+		{
+			b = a;
+			return math::cross(math::cross(c.v - a.v, AO), c.v - a.v);
+		}
+		n = 3;
+		if (math::dot(normal, AO) > 0)
+		{
+			d = c;
+			c = b;
+			b = a;
+			return  normal;
+		}
+		d = b;
+		b = a;
+		return -normal;
+	}
+
+	inline bool update4(support_point& a, support_point& b, support_point& c, support_point& d, int& n, float3& search)
+	{
+		float3 abc = math::cross(b.v - a.v, c.v - a.v);
+		float3 acd = math::cross(c.v - a.v, d.v - a.v);
+		float3 adb = math::cross(d.v - a.v, b.v - a.v);
+
+		float3 ao = -a.v;
+		n = 3;
+
+		if (outside(abc, ao))
+		{
+			d = c;
+			c = b;
+			b = a;
+			search = abc;
+			return false;
+		}
+
+		if (outside(acd, ao))
+		{
+			b = a;
+			search = acd;
+			return false;
+		}
+
+		if (outside(adb, ao))
+		{
+			c = d;
+			d = b;
+			b = a;
+			search = adb;
+			return false;
+		}
+		return true;
+	}
+
+	//what a pair keeps from one call to the next, zero initialized for a pair seen for the first time
+	struct warm_start
+	{
+		//last search direction, the separating axis if the shapes were apart
+		float3 direction;
+		//support points gjk and epa took in the last call
+		int iterations;
+		bool valid;
+		//the last call was settled by the cached direction alone, it still separated the shapes
+		bool early_out;
+	};
+
+	//polytope is the scratch memory of epa, one per thread. Shapes that barely moved since the last call are
+	//usually still separated along the axis that separated them then, which costs one support point to confirm
+	inline bool intersect(const support_data& a_data, const support_data& b_data, /*out*/ contact_data& data, epa::polytope& polytope, warm_start& warm, int MAX_ITERATIONS = 64)
 	{
 		int unique_id = 0;
+		const bool cached = warm.valid;
+		auto finish = [&warm, &unique_id](const float3& direction, bool early_out = false)
+		{
+			warm.direction = direction;
+			warm.iterations = unique_id;
+			warm.valid = true;
+			warm.early_out = early_out;
+		};
 
-		float3 search = a_data.pos - b_data.pos;
+		float3 search = cached ? warm.direction : a_data.pos - b_data.pos;
 
 		support_point d = support_point();
 		support_point c = support(search, a_data, b_data, unique_id);
 
+		//nothing of b - a reaches past the origin along search, it separates the shapes
+		if (math::dot(c.v, search) < 0)
+		{
+			finish(search, cached);
+			return false;
+		}
+
 		search = -c.v;
 
 		support_point b = support(search, a_data, b_data, unique_id);
 
 		if (math::dot(b.v, search) < 0)
 		{
+			finish(search);
 			return false;
 		}
 
@@ -425,6 +1187,7 @@ namespace gjk
 			support_point a = support(search, a_data, b_data, unique_id);
 			if (math::dot(a.v, search) < 0)
 			{
+				finish(search);
 				return false;
 			}
 			n++;
@@ -432,78 +1195,355 @@ namespace gjk
 			{
 				search = update3(a, b, c, d, n);
 			}
-			else if (update4(a, b, c, d, n, unique_id, search))
+			else if (update4(a, b, c, d, n, search))
 			{
 				simplex simp = simplex{ n, a, b ,c ,d };
-				return epa::calculate(simp, a_data, b_data, unique_id, data);
+				bool hit = epa::calculate(simp, a_data, b_data, unique_id, data, polytope);
+				finish(search);
+				return hit;
 			}
 		}
+		finish(search);
 		return false;
 	}
 
-	constexpr float3 update3(support_point& a, support_point& b, support_point& c, support_point& d, int& n)
+	//without anything kept from an earlier call
+	inline bool intersect(const support_data& a_data, const support_data& b_data, /*out*/ contact_data& data, epa::polytope& polytope, int MAX_ITERATIONS = 64)
 	{
-		float3 normal = math::cross(b.v - a.v, c.v - a.v);
-		float3 AO = -a.v;
+		warm_start cold = warm_start();
+		return intersect(a_data, b_data, data, polytope, cold, MAX_ITERATIONS);
+	}
 
-		n = 2;
-		if (math::dot(math::cross(b.v - a.v, normal), AO) > 0)
+	//the polytope of the calling thread, for callers without their own
+	inline bool intersect(const support_data& a_data, const support_data& b_data, /*out*/ contact_data& data, int MAX_ITERATIONS = 64)
+	{
+		static thread_local epa::polytope polytope;
+		return intersect(a_data, b_data, data, polytope, MAX_ITERATIONS);
+	}
+}
+
+//Closed form contacts for the shapes whose support functions are simple. Same contact_data as gjk::intersect:
+//normal is the direction that pushes a out of b, world_space_point_a the deepest point of a in b,
+//world_space_point_b the deepest point of b in a, and point_a = point_b - normal * depth
+namespace analytic
+{
+	inline float3 capsule_start(const support_data& capsule)
+	{
+		return capsule.pos + local_axis(capsule.col, 1) * capsule.col.y_base;
+	}
+
+	inline float3 capsule_end(const support_data& capsule)
+	{
+		return capsule.pos + local_axis(capsule.col, 1) * capsule.col.y_cap;
+	}
+
+	inline float3 closest_point_on_segment(const float3& p, const float3& start, const float3& end)
+	{
+		float3 d = end - start;
+		float length2 = math::dot(d, d);
+		float t = length2 > math::epsilon ? math::clamp(math::dot(p - start, d) / length2, 0.0f, 1.0f) : 0.0f;
+		return start + d * t;
+	}
+
+	//closest points of segments p1 q1 and p2 q2, from Real-Time Collision Detection 5.1.9
+	inline void closest_points(const float3& p1, const float3& q1, const float3& p2, const float3& q2, float3& c1, float3& c2)
+	{
+		float3 d1 = q1 - p1;
+		float3 d2 = q2 - p2;
+		float3 r = p1 - p2;
+		float a = math::dot(d1, d1);
+		float e = math::dot(d2, d2);
+		float f = math::dot(d2, r);
+		float s = 0.0f;
+		float t = 0.0f;
+		if (a <= math::epsilon && e <= math::epsilon)
 		{
-			c = a;
-			return math::cross(math::cross(b.v - a.v, AO), b.v - a.v);
+			c1 = p1;
+			c2 = p2;
+			return;
+		}
+		if (a <= math::epsilon)
+		{
+			t = math::clamp(f / e, 0.0f, 1.0f);
+		}
+		else
+		{
+			float c = math::dot(d1, r);
+			if (e <= math::epsilon)
+			{
+				s = math::clamp(-c / a, 0.0f, 1.0f);
+			}
+			else
+			{
+				float b = math::dot(d1, d2);
+				float denom = a * e - b * b;
+				//parallel segments, any s works
+				s = denom > math::epsilon ? math::clamp((b * f - c * e) / denom, 0.0f, 1.0f) : 0.0f;
+				t = (b * s + f) / e;
+				if (t < 0.0f)
+				{
+					t = 0.0f;
+					s = math::clamp(-c / a, 0.0f, 1.0f);
+				}
+				else if (t > 1.0f)
+				{
+					t = 1.0f;
+					s = math::clamp((b - c) / a, 0.0f, 1.0f);
+				}
+			}
 		}
+		c1 = p1 + d1 * s;
+		c2 = p2 + d2 * t;
+	}
 
-		if (math::dot(math::cross(normal, c.v - a.v), c.v - a.v) > 0)
+	//spheres around a and b, what sphere, capsule and capsule pairs come down to
+	inline bool spheres(const float3& a, float a_radius, const float3& b, float b_radius, contact_data& data)
+	{
+		float3 d = a - b;
+		float distance2 = math::dot(d, d);
+		float radius = a_radius + b_radius;
+		if (distance2 >= radius * radius)
 		{
-			b = a;
-			return math::cross(math::cross(c.v - a.v, AO), c.v - a.v);
+			return false;
 		}
-		n = 3;
-		if (math::dot(normal, AO) > 0)
+		float distance = sqrtf(distance2);
+		//concentric, any direction pushes them apart
+		float3 normal = distance > math::epsilon ? d * (1.0f / distance) : float3(0, 1, 0);
+		data = contact_data();
+		data.normal = normal;
+		data.depth = radius - distance;
+		data.world_space_point_a = a - normal * a_radius;
+		data.world_space_point_b = b + normal * b_radius;
+		return true;
+	}
+
+	inline bool sphere_sphere(const support_data& a, const support_data& b, contact_data& data)
+	{
+		return spheres(a.pos, a.col.radius, b.pos, b.col.radius, data);
+	}
+
+	inline bool sphere_capsule(const support_data& a, const support_data& b, contact_data& data)
+	{
+		float3 closest = closest_point_on_segment(a.pos, capsule_start(b), capsule_end(b));
+		return spheres(a.pos, a.col.radius, closest, b.col.radius, data);
+	}
+
+	inline bool capsule_capsule(const support_data& a, const support_data& b, contact_data& data)
+	{
+		float3 on_a, on_b;
+		closest_points(capsule_start(a), capsule_end(a), capsule_start(b), capsule_end(b), on_a, on_b);
+		return spheres(on_a, a.col.radius, on_b, b.col.radius, data);
+	}
+
+	inline bool sphere_box(const support_data& a, const support_data& b, contact_data& data)
+	{
+		const float size[] = { b.col.x_size, b.col.y_size, b.col.z_size };
+		float3 axes[3];
+		float local[3];
+		float clamped[3];
+		float3 d = a.pos - b.pos;
+		bool inside = true;
+		for (int i = 0; i < 3; i++)
 		{
-			d = c;
-			c = b;
-			b = a;
-			return  normal;
+			axes[i] = local_axis(b.col, i);
+			local[i] = math::dot(d, axes[i]);
+			clamped[i] = math::clamp(local[i], -size[i], size[i]);
+			inside = inside && clamped[i] == local[i];
 		}
-		d = b;
-		b = a;
-		return -normal;
+
+		float3 normal;
+		float depth;
+		if (inside)
+		{
+			//center inside the box, out through the nearest face
+			int face = 0;
+			float face_distance = FLT_MAX;
+			for (int i = 0; i < 3; i++)
+			{
+				float distance = size[i] - math::abs(local[i]);
+				if (distance < face_distance)
+				{
+					face = i;
+					face_distance = distance;
+				}
+			}
+			float side = local[face] < 0.0f ? -1.0f : 1.0f;
+			clamped[face] = size[face] * side;
+			normal = axes[face] * side;
+			depth = face_distance + a.col.radius;
+		}
+		else
+		{
+			float3 offset = d - (axes[0] * clamped[0] + axes[1] * clamped[1] + axes[2] * clamped[2]);
+			float distance2 = math::dot(offset, offset);
+			if (distance2 >= a.col.radius * a.col.radius)
+			{
+				return false;
+			}
+			float distance = sqrtf(distance2);
+			normal = offset * (1.0f / distance);
+			depth = a.col.radius - distance;
+		}
+
+		data = contact_data();
+		data.normal = normal;
+		data.depth = depth;
+		data.world_space_point_a = a.pos - normal * a.col.radius;
+		data.world_space_point_b = b.pos + axes[0] * clamped[0] + axes[1] * clamped[1] + axes[2] * clamped[2];
+		return true;
 	}
 
-	constexpr bool update4(support_point& a, support_point& b, support_point& c, support_point& d, int& n, int uniqueId, float3& search)
+	//the corner furthest along direction, or the middle of the edge or face when direction is about perpendicular to it
+	inline float3 box_feature(const support_data& box, const float3* axes, const float* size, const float3& direction)
 	{
-		float3 abc = math::cross(b.v - a.v, c.v - a.v);
-		float3 acd = math::cross(c.v - a.v, d.v - a.v);
-		float3 adb = math::cross(d.v - a.v, b.v - a.v);
+		float3 center = box.pos;
+		for (int i = 0; i < 3; i++)
+		{
+			float along = math::dot(axes[i], direction);
+			if (math::abs(along) > 0.02f)
+			{
+				center = center + axes[i] * (along > 0 ? size[i] : -size[i]);
+			}
+		}
+		return center;
+	}
 
-		float3 ao = -a.v;
-		n = 3;
+	//the point, moved onto the face of the box across its two other axes
+	inline float3 clamp_to_face(const float3& p, const support_data& box, const float3* axes, const float* size, int face)
+	{
+		float3 d = p - box.pos;
+		float3 result = p;
+		for (int i = 0; i < 3; i++)
+		{
+			if (i == face)
+			{
+				continue;
+			}
+			float along = math::dot(d, axes[i]);
+			result = result + axes[i] * (math::clamp(along, -size[i], size[i]) - along);
+		}
+		return result;
+	}
 
-		if (math::dot(abc, ao) > 0)
+	//separating axis test over the 3 face normals of each box and the 9 edge cross products. The axis of least
+	//overlap is the normal, face axes win near ties so resting boxes don't flicker to an edge pair.
+	//One contact point, in the middle of the overlapping features
+	inline bool box_box(const support_data& a, const support_data& b, contact_data& data)
+	{
+		const float a_size[] = { a.col.x_size, a.col.y_size, a.col.z_size };
+		const float b_size[] = { b.col.x_size, b.col.y_size, b.col.z_size };
+		float3 a_axes[3];
+		float3 b_axes[3];
+		for (int i = 0; i < 3; i++)
 		{
-			d = c;
-			c = b;
-			b = a;
-			search = abc;
-			return false;
+			a_axes[i] = local_axis(a.col, i);
+			b_axes[i] = local_axis(b.col, i);
 		}
+		const float3 t = b.pos - a.pos;
+
+		//axis points from a to b
+		float best_score = FLT_MAX;
+		float best_overlap = 0.0f;
+		float3 best_axis = float3(0, 1, 0);
+		//0-2 faces of a, 3-5 faces of b, 6-14 edge pairs
+		int best = -1;
+		auto test = [&](float3 axis, int index)
+		{
+			float along = math::dot(t, axis);
+			if (along < 0.0f)
+			{
+				axis = -axis;
+				along = -along;
+			}
+			float a_extent = 0.0f;
+			float b_extent = 0.0f;
+			for (int i = 0; i < 3; i++)
+			{
+				a_extent += math::abs(math::dot(a_axes[i], axis)) * a_size[i];
+				b_extent += math::abs(math::dot(b_axes[i], axis)) * b_size[i];
+			}
+			float overlap = a_extent + b_extent - along;
+			if (overlap < 0.0f)
+			{
+				return false;
+			}
+			float score = index < 6 ? overlap : overlap * 1.05f + 0.001f;
+			if (score < best_score)
+			{
+				best_score = score;
+				best_overlap = overlap;
+				best_axis = axis;
+				best = index;
+			}
+			return true;
+		};
 
-		if (math::dot(acd, ao) > 0)
+		for (int i = 0; i < 3; i++)
 		{
-			b = a;
-			search = acd;
-			return false;
+			if (!test(a_axes[i], i) || !test(b_axes[i], 3 + i))
+			{
+				return false;
+			}
+		}
+		for (int i = 0; i < 3; i++)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				float3 axis = math::cross(a_axes[i], b_axes[j]);
+				float length2 = math::dot(axis, axis);
+				//parallel edges, the face axes already cover them
+				if (length2 < 1e-6f)
+				{
+					continue;
+				}
+				if (!test(axis * (1.0f / sqrtf(length2)), 6 + i * 3 + j))
+				{
+					return false;
+				}
+			}
 		}
 
-		if (math::dot(adb, ao) > 0)
+		const float3 normal = -best_axis;
+		const float depth = best_overlap;
+		float3 point_a;
+		float3 point_b;
+		if (best < 3)
 		{
-			c = d;
-			d = b;
-			b = a;
-			search = adb;
-			return false;
+			//face of a, b's deepest feature kept within the face
+			point_b = clamp_to_face(box_feature(b, b_axes, b_size, normal), a, a_axes, a_size, best);
+			point_a = point_b - normal * depth;
+		}
+		else if (best < 6)
+		{
+			point_a = clamp_to_face(box_feature(a, a_axes, a_size, best_axis), b, b_axes, b_size, best - 3);
+			point_b = point_a + normal * depth;
 		}
+		else
+		{
+			//edge of a along a_axes[i] and edge of b along b_axes[j], each the one furthest towards the other box
+			const int i = (best - 6) / 3;
+			const int j = (best - 6) % 3;
+			float3 a_edge = a.pos;
+			float3 b_edge = b.pos;
+			for (int k = 0; k < 3; k++)
+			{
+				if (k != i)
+				{
+					a_edge = a_edge + a_axes[k] * (math::dot(a_axes[k], best_axis) > 0 ? a_size[k] : -a_size[k]);
+				}
+				if (k != j)
+				{
+					b_edge = b_edge + b_axes[k] * (math::dot(b_axes[k], normal) > 0 ? b_size[k] : -b_size[k]);
+				}
+			}
+			closest_points(a_edge - a_axes[i] * a_size[i], a_edge + a_axes[i] * a_size[i], b_edge - b_axes[j] * b_size[j], b_edge + b_axes[j] * b_size[j], point_a, point_b);
+		}
+
+		data = contact_data();
+		data.normal = normal;
+		data.depth = depth;
+		data.world_space_point_a = point_a;
+		data.world_space_point_b = point_b;
 		return true;
 	}
-}
\ No newline at end of file
+}
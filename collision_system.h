@@ -0,0 +1,260 @@
+#pragma once
+#include "ecs.h"
+#include "components.h"
+#include "collision.h"
+#include "broadphase.h"
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+//Broadphase over entities with position and aabb. Entities tagged static_tag are only handed to the broadphase
+//when the number of static entities changes or invalidate_static() is called, so level geometry costs nothing
+//per frame. Entities tagged dynamic_tag are moved every update. Static vs static pairs are never reported.
+//The pairs of each update are diffed against the last one, so contacts can be started and ended on new_pairs
+//and removed_pairs instead of rescanning every pair.
+
+struct collision_body
+{
+	entity e;
+	//world space
+	aabb box;
+	float3 position;
+	//id in the current broadphase, -1 when not added yet
+	int proxy;
+	uint32_t last_seen;
+	bool is_static;
+	bool in_use;
+};
+
+struct collision_system
+{
+	bvh_broadphase bvh;
+	sweep_and_prune sap;
+	//bvh unless set_broadphase picked another one
+	broadphase phase = make_broadphase(bvh);
+	std::vector<collision_body> bodies;
+	std::vector<uint32_t> free_bodies;
+	//released during this update. Pairs are keyed by body id, so an id is only handed out again once the
+	//pairs of its old body were reported removed, or the new body's pairs would look like they persisted
+	std::vector<uint32_t> released_bodies;
+	//body ids, rebuilt every update
+	std::vector<uint32_t> dynamic_bodies;
+	std::vector<uint32_t> static_bodies;
+	//body ids with a < b, sorted. Every pair has at least one dynamic body
+	std::vector<collision_pair> pairs;
+	//in pairs but not in last update's, sorted. The pairs that persist are the rest of pairs
+	std::vector<collision_pair> new_pairs;
+	//in last update's pairs but not in pairs, sorted. The bodies may have been released since
+	std::vector<collision_pair> removed_pairs;
+	std::vector<collision_pair> previous_pairs;
+
+	uint32_t frame = 0;
+	size_t static_count = 0;
+	bool static_dirty = true;
+
+	//kept around so a steady state frame doesn't allocate
+	std::vector<uint32_t> seen_static;
+	std::vector<uint32_t> previous_dynamic;
+
+	component_id_array<position, aabb, static_tag> static_comps;
+	component_id_array<position, aabb, dynamic_tag> dynamic_comps;
+
+	//static entities that moved or were swapped for others without changing the count are only seen after this
+	void invalidate_static()
+	{
+		static_dirty = true;
+	}
+
+	//moves every body over to b, e.g. make_broadphase(sap). The next update reports every pair as new
+	void set_broadphase(const broadphase& b)
+	{
+		for (collision_body& body : bodies)
+		{
+			if (body.in_use && body.proxy >= 0)
+			{
+				phase.remove(phase.context, body.proxy);
+			}
+			body.proxy = -1;
+		}
+		phase = b;
+		previous_pairs.clear();
+		for (collision_body& body : bodies)
+		{
+			if (body.in_use)
+			{
+				body.proxy = phase.add(phase.context, body.box, (int)(&body - bodies.data()), body.is_static);
+			}
+		}
+	}
+
+	void update(entity_component_system* ecs)
+	{
+		frame++;
+		update_static(ecs);
+		update_dynamic(ecs);
+		find_pairs();
+	}
+
+	void update_static(entity_component_system* ecs)
+	{
+		auto view = ecs->get_view(static_comps.arr, static_comps.size);
+		size_t count = 0;
+		for (auto g : *view)
+		{
+			count += g->num();
+		}
+		if (!static_dirty && count == static_count)
+		{
+			return;
+		}
+		static_dirty = false;
+		static_count = count;
+
+		auto positions = ecs->get_component_array<position>();
+		auto boxes = ecs->get_component_array<aabb>();
+		auto tags = ecs->get_component_array<static_tag>();
+		seen_static.clear();
+		for (auto g : *view)
+		{
+			auto position_offset = positions + g->get_offset(component_id<position>);
+			auto box_offset = boxes + g->get_offset(component_id<aabb>);
+			auto tag_offset = tags + g->get_offset(component_id<static_tag>);
+			for (auto i : *g)
+			{
+				uint32_t id = get_body(tag_offset[i].body, g->em->dense[i], true);
+				collision_body& b = bodies[id];
+				float3 p = to_float3(position_offset[i]);
+				b.box = world_box(box_offset[i], p);
+				if (b.proxy < 0)
+				{
+					b.proxy = phase.add(phase.context, b.box, (int)id, true);
+				}
+				else
+				{
+					phase.move(phase.context, b.proxy, b.box, p - b.position);
+				}
+				b.position = p;
+				b.last_seen = frame;
+				seen_static.push_back(id);
+			}
+		}
+
+		//statics that weren't seen are gone
+		for (uint32_t id : static_bodies)
+		{
+			if (bodies[id].in_use && bodies[id].last_seen != frame)
+			{
+				release_body(id);
+			}
+		}
+		static_bodies.swap(seen_static);
+	}
+
+	void update_dynamic(entity_component_system* ecs)
+	{
+		auto view = ecs->get_view(dynamic_comps.arr, dynamic_comps.size);
+		auto positions = ecs->get_component_array<position>();
+		auto boxes = ecs->get_component_array<aabb>();
+		auto tags = ecs->get_component_array<dynamic_tag>();
+
+		previous_dynamic.swap(dynamic_bodies);
+		dynamic_bodies.clear();
+		for (auto g : *view)
+		{
+			auto position_offset = positions + g->get_offset(component_id<position>);
+			auto box_offset = boxes + g->get_offset(component_id<aabb>);
+			auto tag_offset = tags + g->get_offset(component_id<dynamic_tag>);
+			for (auto i : *g)
+			{
+				uint32_t id = get_body(tag_offset[i].body, g->em->dense[i], false);
+				collision_body& b = bodies[id];
+				float3 p = to_float3(position_offset[i]);
+				b.box = world_box(box_offset[i], p);
+				if (b.proxy < 0)
+				{
+					b.proxy = phase.add(phase.context, b.box, (int)id, false);
+				}
+				else
+				{
+					phase.move(phase.context, b.proxy, b.box, p - b.position);
+				}
+				b.position = p;
+				b.last_seen = frame;
+				dynamic_bodies.push_back(id);
+			}
+		}
+
+		for (uint32_t id : previous_dynamic)
+		{
+			if (bodies[id].in_use && bodies[id].last_seen != frame)
+			{
+				release_body(id);
+			}
+		}
+	}
+
+	void find_pairs()
+	{
+		previous_pairs.swap(pairs);
+		phase.find_pairs(phase.context, pairs);
+
+		new_pairs.clear();
+		removed_pairs.clear();
+		std::set_difference(pairs.begin(), pairs.end(), previous_pairs.begin(), previous_pairs.end(), std::back_inserter(new_pairs));
+		std::set_difference(previous_pairs.begin(), previous_pairs.end(), pairs.begin(), pairs.end(), std::back_inserter(removed_pairs));
+
+		free_bodies.insert(free_bodies.end(), released_bodies.begin(), released_bodies.end());
+		released_bodies.clear();
+	}
+
+	//body is the index + 1 kept in the entity's tag
+	uint32_t get_body(uint32_t& body, entity e, bool is_static)
+	{
+		if (body != 0 && bodies[body - 1].in_use && bodies[body - 1].e.id == e.id && bodies[body - 1].is_static == is_static)
+		{
+			return body - 1;
+		}
+
+		uint32_t id;
+		if (free_bodies.empty())
+		{
+			id = (uint32_t)bodies.size();
+			bodies.push_back(collision_body());
+		}
+		else
+		{
+			id = free_bodies.back();
+			free_bodies.pop_back();
+		}
+		collision_body& b = bodies[id];
+		b.e = e;
+		b.proxy = -1;
+		b.last_seen = frame;
+		b.is_static = is_static;
+		b.in_use = true;
+		body = id + 1;
+		return id;
+	}
+
+	void release_body(uint32_t id)
+	{
+		collision_body& b = bodies[id];
+		if (b.proxy >= 0)
+		{
+			phase.remove(phase.context, b.proxy);
+			b.proxy = -1;
+		}
+		b.in_use = false;
+		released_bodies.push_back(id);
+	}
+
+	static float3 to_float3(const position& p)
+	{
+		return float3(p.x, p.y, p.z);
+	}
+
+	static aabb world_box(const aabb& local, const float3& p)
+	{
+		return aabb{ local.lower_bound + p, local.upper_bound + p };
+	}
+};
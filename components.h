@@ -41,11 +41,35 @@ struct point_light
 	float4 color;
 };
 
+//which clip storage animation_clip indexes into
+enum class clip_format : uint32_t
+{
+	raw,
+	compressed,
+	baked
+};
+
 struct animation
 {
 	float time;
 	uint32_t animation_clip;
+	clip_format format;
 	uint32_t rig;
+	//index + 1 into animation_system::instances, 0 until the system first sees the entity
+	uint32_t instance;
+	//first matrix of this entity's joints in the skinning palette, written every update
+	uint32_t palette_offset;
+};
+
+//plays a property_clip on the entity's other components, see property_animation_system
+struct property_animation
+{
+	float time;
+	//clip time per unit of the dt passed to update. game_app's dt is in tenths of a second, 0.1 plays a clip in seconds
+	float speed;
+	uint32_t clip;
+	//index + 1 into property_animation_system::instances, 0 until the system first sees the entity
+	uint32_t instance;
 };
 
 struct directional_light
@@ -60,6 +84,7 @@ struct tag
 };
 
 
+//relative to the entity's position when used as a component
 struct aabb
 {
 	float3 lower_bound;
@@ -72,13 +97,17 @@ struct rigidbody
 };
 
 
+//level geometry, collision_system keeps these in a bvh that is only rebuilt when the set changes
 struct static_tag
 {
-
+	//index + 1 into collision_system::bodies, 0 until the system first sees the entity
+	uint32_t body;
 };
 
+//moves every frame, collision_system tracks these incrementally
 struct dynamic_tag
 {
-
+	//index + 1 into collision_system::bodies, 0 until the system first sees the entity
+	uint32_t body;
 };
 
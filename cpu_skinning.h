@@ -0,0 +1,163 @@
+#pragma once
+#include "skinned_vertex.h"
+#include "mmath_simd.h"
+#include "job_system.h"
+#include <vector>
+
+//Skinning on the cpu, for hit detection and headless validation that need the deformed mesh.
+//Vertices are split into streams once, every frame is then one batch kernel pass per mesh
+//with meshes spread over the job system.
+
+enum class skinning_mode
+{
+	linear,
+	//needs rigid palettes, scale is dropped
+	dual_quaternion
+};
+
+//skinned_vertex data as streams, built once per mesh
+struct cpu_skinned_mesh
+{
+	//position x, y, z, normal x, y, z, weight 0..3
+	std::vector<float> floats;
+	//joint 0..3
+	std::vector<int> joints;
+	size_t vertex_count = 0;
+
+	void load(const std::vector<skinned_vertex>& vertices)
+	{
+		const size_t n = vertices.size();
+		vertex_count = n;
+		floats.resize(n * 10);
+		joints.resize(n * 4);
+		for (size_t i = 0; i < n; i++)
+		{
+			const skinned_vertex& v = vertices[i];
+			floats[i] = v.position.x;
+			floats[i + n] = v.position.y;
+			floats[i + n * 2] = v.position.z;
+			floats[i + n * 3] = v.normal.x;
+			floats[i + n * 4] = v.normal.y;
+			floats[i + n * 5] = v.normal.z;
+			floats[i + n * 6] = v.weights.x;
+			floats[i + n * 7] = v.weights.y;
+			floats[i + n * 8] = v.weights.z;
+			floats[i + n * 9] = v.weights.w;
+			//unused influences are -1 before the loader clamps them, their weight is 0 either way
+			joints[i] = std::max(0, v.bones.x);
+			joints[i + n] = std::max(0, v.bones.y);
+			joints[i + n * 2] = std::max(0, v.bones.z);
+			joints[i + n * 3] = std::max(0, v.bones.w);
+		}
+	}
+
+	//the kernels only read from the input streams
+	math::simd::skinning_soa view() const
+	{
+		float* f = const_cast<float*>(floats.data());
+		int* j = const_cast<int*>(joints.data());
+		const size_t n = vertex_count;
+		return math::simd::skinning_soa{
+			math::simd::float3_soa{ f, f + n, f + n * 2 },
+			math::simd::float3_soa{ f + n * 3, f + n * 4, f + n * 5 },
+			{ j, j + n, j + n * 2, j + n * 3 },
+			{ f + n * 6, f + n * 7, f + n * 8, f + n * 9 } };
+	}
+};
+
+//deformed positions and normals, same stream layout as the input
+struct cpu_skinned_output
+{
+	std::vector<float> positions;
+	std::vector<float> normals;
+	size_t vertex_count = 0;
+
+	void resize(size_t count)
+	{
+		if (vertex_count != count)
+		{
+			vertex_count = count;
+			positions.resize(count * 3);
+			normals.resize(count * 3);
+		}
+	}
+
+	math::simd::float3_soa position_view()
+	{
+		const size_t n = vertex_count;
+		return math::simd::float3_soa{ positions.data(), positions.data() + n, positions.data() + n * 2 };
+	}
+
+	math::simd::float3_soa normal_view()
+	{
+		const size_t n = vertex_count;
+		return math::simd::float3_soa{ normals.data(), normals.data() + n, normals.data() + n * 2 };
+	}
+
+	float3 position(size_t i) const
+	{
+		return float3(positions[i], positions[i + vertex_count], positions[i + vertex_count * 2]);
+	}
+
+	float3 normal(size_t i) const
+	{
+		return float3(normals[i], normals[i + vertex_count], normals[i + vertex_count * 2]);
+	}
+};
+
+struct skinning_job
+{
+	const cpu_skinned_mesh* mesh;
+	//joint_count skinning matrices, e.g. an entity's range of the animation_system palette
+	const float4x4* palette;
+	uint32_t joint_count;
+	cpu_skinned_output* out;
+};
+
+struct cpu_skinning
+{
+	job_system* jobs;
+	skinning_mode mode = skinning_mode::linear;
+	//dual quaternion palettes, one per job, kept between calls
+	std::vector<std::vector<dual_quaternion>> dq_palettes;
+
+	void initialize(job_system* jobs)
+	{
+		this->jobs = jobs;
+	}
+
+	void skin(const skinning_job* work, size_t count)
+	{
+		if (mode == skinning_mode::dual_quaternion && dq_palettes.size() < count)
+		{
+			dq_palettes.resize(count);
+		}
+
+		auto run = [this, work](size_t begin, size_t end, uint32_t)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				const skinning_job& job = work[i];
+				job.out->resize(job.mesh->vertex_count);
+				if (mode == skinning_mode::dual_quaternion)
+				{
+					std::vector<dual_quaternion>& dq = dq_palettes[i];
+					if (dq.size() < job.joint_count)
+					{
+						dq.resize(job.joint_count);
+					}
+					for (uint32_t j = 0; j < job.joint_count; j++)
+					{
+						math::to_dual_quaternion(job.palette[j], dq[j]);
+					}
+					math::simd::skin_dual_quaternion(job.mesh->view(), dq.data(), job.out->position_view(), job.out->normal_view(), job.mesh->vertex_count);
+				}
+				else
+				{
+					math::simd::skin_linear(job.mesh->view(), job.palette, job.out->position_view(), job.out->normal_view(), job.mesh->vertex_count);
+				}
+			}
+		};
+		jobs->parallel_for(count, 1, run);
+	}
+};
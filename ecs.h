@@ -1212,6 +1212,16 @@ struct entity_component_system
 		return (T*)_component_arrays[id]->_data;
 	}
 
+	//untyped column of component id, for systems that write fields by byte offset
+	char* get_component_data(const size_type id)
+	{
+		if (!(id < _component_arrays.nComponents))
+		{
+			_component_arrays.resize(id + 1);
+		}
+		return _component_arrays[id]->_data;
+	}
+
 	template<typename T>
 	T& get_component(const entity_key& e)
 	{
@@ -1232,10 +1242,10 @@ struct entity_component_system
 	{
 		const size_type comp_id = component_id<T>;
 		assert(_component_arrays.nComponents > comp_id);
-		assert(_component_arrays[comp_id]._data != nullptr);
+		assert(_component_arrays[comp_id]->_data != nullptr);
 		assert(_groups[e.e].component_exists(comp_id));
 
-		T* compArray = (T*)_component_arrays[comp_id]._data;
+		T* compArray = (T*)_component_arrays[comp_id]->_data;
 		compArray[_groups[e.e].get_offset(comp_id) + e.e.index()] = value;
 	}
 
@@ -4,27 +4,14 @@
 #include <future>
 #include "skinned_vertex.h"
 #include "vertex.h"
+#include "mmath_simd.h"
 
 using namespace std::chrono_literals;
 bool game_app::running = false;
 
-float noise(float3 position, int octaves, float frequency, float persistence) {
-	float total = 0.0;
-	float maxAmplitude = 0.0;
-	float amplitude = 1.0;
-	for (int i = 0; i < octaves; i++) {
-		total += math::improved_noise::noise(position * frequency) * amplitude;
-		frequency *= 2.0;
-		maxAmplitude += amplitude;
-		amplitude *= persistence;
-	}
-	return total / maxAmplitude;
-}
-
 void game_app::initialize()
 {
 	srand((unsigned int)time(nullptr));
-	math::improved_noise::init();
 
 	wm.create(1280, 720, L"test");
 	render.create_vulkan_context("test", wm.window, int2{ wm.wr.right, wm.wr.bottom });
@@ -38,7 +25,9 @@ void game_app::initialize()
 
 	skinned_mesh goblin = resources.load_skinned_mesh("assets/woman.gltf");
 	clip goblin_clip = resources.load_animation("assets/woman.gltf");
-	anim_sys.initialize(&resources.clips, &resources.rigs);
+	jobs.initialize();
+	anim_sys.initialize(&resources.clips, &resources.compressed_clips, &resources.baked_clips, &resources.rigs, &jobs);
+	property_sys.initialize(&jobs);
 
 	auto mesh_load_future = std::async(std::launch::async, [this, &bunny_mesh, &teapot_mesh, &cube_mesh]() {
 		bunny_mesh = resources.load_mesh("assets/hana.fbx");
@@ -67,14 +56,27 @@ void game_app::initialize()
 	wm.set_cursor_locked(locked_mouse, { window_center });
 	int world_size = 128;
 
+	//one row of k at a time through the batched fbm. Noise is 0 on the integer lattice, the frequency keeps the voxel
+	//coordinates off it and the threshold cuts about a quarter of the block out of [-1, 1] as dirt
+	constexpr int row_size = 128;
+	constexpr float dirt_frequency = 0.07f;
+	constexpr float dirt_threshold = 0.1f;
+	float row_x[row_size], row_y[row_size], row_z[row_size], row_noise[row_size];
 	for (int i = 30; i < world_size - 30; i++)
 	{
 		for (int j = 10; j < 30; j++)
 		{
+			int count = 0;
+			for (int k = 30; k < world_size - 30; k++, count++)
+			{
+				row_x[count] = (float)i;
+				row_y[count] = (float)j;
+				row_z[count] = (float)k;
+			}
+			math::simd::fbm(math::simd::float3_soa{ row_x, row_y, row_z }, row_noise, count, 5, dirt_frequency, 0.5f);
 			for (int k = 30; k < world_size - 30; k++)
 			{
-				float f = noise(float3((float)i, (float)j, (float)(rand() % 100)), 5, 3, 1);
-				if (f > 10)
+				if (row_noise[k - 30] > dirt_threshold)
 				{
 					storage.set_voxel(uint32_3(i, j, k), dirt);
 				}
@@ -208,7 +210,13 @@ void game_app::initialize()
 	rend5.desc = skinned_mesh_desc_index;
 
 	auto& anim = ecs.get_component<animation>(e1);
-	anim.animation_clip = 0;
+	anim.animation_clip = resources.compress_animation(0, 0);
+	anim.format = clip_format::compressed;
+	if (anim.animation_clip == resource_manager::INVALID_CLIP)
+	{
+		anim.animation_clip = 0;
+		anim.format = clip_format::raw;
+	}
 	anim.rig = 0;
 
 	auto& p5 = ecs.get_component<position>(e1);
@@ -308,7 +316,9 @@ void game_app::start()
 			auto dt = std::min(lag, target_time);
 			float dt_float = (float)(dt.count() / 100000000.0f);
 			update(dt_float);
-			anim_sys.update(&ecs, dt_float, poses);
+			property_sys.update(&ecs, dt_float);
+			collision_sys.update(&ecs);
+			anim_sys.update(&ecs, dt_float, camera_sys.camera_pos, poses);
 			//std::cout << dt_float << std::endl;
 			lag -= dt;
 		}
@@ -346,5 +356,6 @@ void game_app::update(float dt)
 
 void game_app::dispose()
 {
+	jobs.dispose();
 	ecs.dispose();
 }
@@ -6,6 +6,8 @@
 #include "light_system.h"
 #include "resource_manager.h"
 #include "animation_system.h"
+#include "property_animation_system.h"
+#include "collision_system.h"
 #include <chrono>
 struct game_app_data
 {
@@ -42,6 +44,9 @@ struct game_app
 	render_system render_sys;
 	light_system light_sys;
 	animation_system anim_sys;
+	property_animation_system property_sys;
+	collision_system collision_sys;
+	job_system jobs;
 	time_point base_time;
 
 	nano_seconds target_time;
@@ -40,7 +40,7 @@ void free_gltf_file(cgltf_data* handle)
 	}
 }
 
-void mesh_from_attribute(std::vector<skinned_vertex>& vertices, cgltf_attribute& attribute, cgltf_skin* skin, cgltf_node* nodes, size_t node_count)
+void mesh_from_attribute(std::vector<skinned_vertex>& vertices, cgltf_attribute& attribute, const std::vector<int>& skin_joints)
 {
 	cgltf_attribute_type attrib_type = attribute.type;
 	cgltf_accessor& accessor = *attribute.data;
@@ -94,10 +94,10 @@ void mesh_from_attribute(std::vector<skinned_vertex>& vertices, cgltf_attribute&
 			bone_ids.y = (int)(values[index + 1] + 0.5f);
 			bone_ids.z = (int)(values[index + 2] + 0.5f);
 			bone_ids.w = (int)(values[index + 3] + 0.5f);
-			bone_ids.x = get_node_index(skin->joints[bone_ids.x], nodes, node_count);
-			bone_ids.y = get_node_index(skin->joints[bone_ids.y], nodes, node_count);
-			bone_ids.z = get_node_index(skin->joints[bone_ids.z], nodes, node_count);
-			bone_ids.w = get_node_index(skin->joints[bone_ids.w], nodes, node_count);
+			bone_ids.x = skin_joints[bone_ids.x];
+			bone_ids.y = skin_joints[bone_ids.y];
+			bone_ids.z = skin_joints[bone_ids.z];
+			bone_ids.w = skin_joints[bone_ids.w];
 			bone_ids.x = std::max<int>(0, bone_ids.x);
 			bone_ids.y = std::max<int>(0, bone_ids.y);
 			bone_ids.z = std::max<int>(0, bone_ids.z);
@@ -110,24 +110,72 @@ void mesh_from_attribute(std::vector<skinned_vertex>& vertices, cgltf_attribute&
 
 }
 
+std::vector<int> get_joint_remap(cgltf_data* data)
+{
+	//depth first from every root, children are pushed in reverse so they come out in node order
+	size_t node_count = data->nodes_count;
+	std::vector<int> remap(node_count, -1);
+	std::vector<cgltf_node*> stack;
+	stack.reserve(node_count);
+	for (size_t i = node_count; i-- > 0;)
+	{
+		if (data->nodes[i].parent == 0)
+		{
+			stack.push_back(&data->nodes[i]);
+		}
+	}
+
+	int next = 0;
+	while (!stack.empty())
+	{
+		cgltf_node* node = stack.back();
+		stack.pop_back();
+		remap[node - data->nodes] = next++;
+		for (size_t c = node->children_count; c-- > 0;)
+		{
+			stack.push_back(node->children[c]);
+		}
+	}
+	return remap;
+}
+
+int get_joint_index(cgltf_node* target, cgltf_node* all_nodes, const std::vector<int>& joint_remap)
+{
+	int node = get_node_index(target, all_nodes, joint_remap.size());
+	return node < 0 ? -1 : joint_remap[node];
+}
+
+std::vector<int> get_skin_joints(cgltf_skin* skin, cgltf_node* all_nodes, const std::vector<int>& joint_remap)
+{
+	std::vector<int> result(skin->joints_count);
+	for (size_t i = 0; i < skin->joints_count; ++i)
+	{
+		result[i] = get_joint_index(skin->joints[i], all_nodes, joint_remap);
+	}
+	return result;
+}
+
 rig load_skeleton(cgltf_data* data)
 {
 	pose rest = load_rest_pose(data), bind = load_bind_pose(data);
 	std::vector<std::string> joint_names = load_joint_names(data);
-	return rig(rest, bind, joint_names);
+	rig result(rest, bind, joint_names);
+	result.joint_remap = get_joint_remap(data);
+	return result;
 }
 
 pose load_rest_pose(cgltf_data* data)
 {
 	size_t bone_count = data->nodes_count;
+	std::vector<int> remap = get_joint_remap(data);
 	pose result((uint32_t)bone_count);
 	for (size_t i = 0; i < bone_count; ++i)
 	{
 		cgltf_node* node = &(data->nodes[i]);
 		transform t = get_local_transform(data->nodes[i]);
-		result.set_local_transform(i, t);
-		int parent = get_node_index(node->parent, data->nodes, bone_count);
-		result.set_parent(i, parent);
+		result.set_local_transform(remap[i], t);
+		int parent = get_joint_index(node->parent, data->nodes, remap);
+		result.set_parent(remap[i], parent);
 	}
 	return result;
 }
@@ -135,6 +183,7 @@ pose load_rest_pose(cgltf_data* data)
 pose load_bind_pose(cgltf_data* data)
 {
 	pose rest_pose = load_rest_pose(data);
+	std::vector<int> remap = get_joint_remap(data);
 	size_t num_bones = rest_pose.size();
 	std::vector<transform> world_bind_pose(num_bones);
 	for (size_t i = 0; i < num_bones; ++i)
@@ -156,11 +205,16 @@ pose load_bind_pose(cgltf_data* data)
 			float4x4 bind_matrix;
 			memcpy(inv_bind_matrix.data(), matrix, 16 * sizeof(float));
 
-			math::inverse_matrix(inv_bind_matrix, bind_matrix);
+			//inverse bind matrices are affine, skip the full 4x4 adjugate
+			float3x4 inv_bind_affine;
+			float3x4 bind_affine;
+			math::to_float3x4(inv_bind_matrix, inv_bind_affine);
+			math::inverse_matrix(inv_bind_affine, bind_affine);
+			math::to_float4x4(bind_affine, bind_matrix);
 			transform bind_transform = math::to_transform(bind_matrix);
 
 			cgltf_node* jointNode = skin->joints[j];
-			int joint_index = get_node_index(jointNode, data->nodes, num_bones);
+			int joint_index = get_joint_index(jointNode, data->nodes, remap);
 			world_bind_pose[joint_index] = bind_transform;
 		}
 
@@ -332,7 +386,7 @@ void track_from_channel(quaternion_track& out, const cgltf_animation_channel& ch
 void load_animation_clips(std::vector<clip>& clips, cgltf_data* data)
 {
 	size_t num_clips = data->animations_count;   
-	size_t num_nodes = data->nodes_count;    
+	std::vector<int> remap = get_joint_remap(data);
 	clips.resize(num_clips);
 	for (size_t i = 0; i < num_clips; ++i)
 	{
@@ -342,7 +396,11 @@ void load_animation_clips(std::vector<clip>& clips, cgltf_data* data)
 		{
 			cgltf_animation_channel& channel = data->animations[i].channels[j];
 			cgltf_node* target = channel.target_node;
-			int node_id = get_node_index(target, data->nodes, num_nodes);
+			int node_id = get_joint_index(target, data->nodes, remap);
+			if (node_id < 0)
+			{
+				continue;
+			}
 
 			if (channel.target_path == cgltf_animation_path_type_translation)
 			{
@@ -367,6 +425,7 @@ void load_animation_clips(std::vector<clip>& clips, cgltf_data* data)
 std::vector<std::string> load_joint_names(cgltf_data* data)
 {
 	size_t bone_Count = (size_t)data->nodes_count;
+	std::vector<int> remap = get_joint_remap(data);
 	std::vector<std::string> result(bone_Count, "");   
 	for (size_t i = 0; i < bone_Count; ++i)
 	{
@@ -374,7 +433,7 @@ std::vector<std::string> load_joint_names(cgltf_data* data)
 
 		if (node->name != nullptr)
 		{
-			result[i] = node->name;
+			result[remap[i]] = node->name;
 		}
 	}    
 	return result;
@@ -10,7 +10,14 @@ cgltf_data* load_gltf_file(const char* file_path);
 
 void free_gltf_file(cgltf_data* handle);
 
-void mesh_from_attribute(std::vector<skinned_vertex>& vertices, cgltf_attribute& attribute, cgltf_skin* skin, cgltf_node* nodes, size_t node_count);
+void mesh_from_attribute(std::vector<skinned_vertex>& vertices, cgltf_attribute& attribute, const std::vector<int>& skin_joints);
+
+//joint index of every node. Joints are sorted so parents always come before their children,
+//node order in a glTF file is arbitrary
+std::vector<int> get_joint_remap(cgltf_data* data);
+int get_joint_index(cgltf_node* target, cgltf_node* all_nodes, const std::vector<int>& joint_remap);
+//joint index of every joint of skin, what the vertex joint attributes index into
+std::vector<int> get_skin_joints(cgltf_skin* skin, cgltf_node* all_nodes, const std::vector<int>& joint_remap);
 
 rig load_skeleton(cgltf_data* data);
 pose load_rest_pose(cgltf_data* data);
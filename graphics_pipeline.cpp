@@ -106,8 +106,13 @@ namespace em
 		material_constant_range.offset = sizeof(float4x4);
 		material_constant_range.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
+		VkPushConstantRange palette_constant_range = VkPushConstantRange();
+		palette_constant_range.size = sizeof(uint32_t);
+		palette_constant_range.offset = sizeof(float4x4) + sizeof(uint32_t);
+		palette_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
 		VkPushConstantRange constant_ranges[] = {
-			push_constant_range, material_constant_range
+			push_constant_range, material_constant_range, palette_constant_range
 		};
 
 
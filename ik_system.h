@@ -0,0 +1,254 @@
+#pragma once
+#include "animation_system.h"
+#include "mmath_simd.h"
+#include "job_system.h"
+#include <vector>
+
+//Batched fabrik. Chains run as an animation_system pose modifier: after the local poses are sampled, the chains of every
+//freshly evaluated entity are gathered in model space into one structure of arrays per joint count, solved a block of
+//chains per kernel call across the job system, and written back as local rotations before the palettes are built.
+
+//limits on the bone leaving a joint, relative to the bone before it
+struct ik_joint_constraint
+{
+	//in the joint's local space, the bone stays in the plane normal to it. Zero for no hinge.
+	//taken in the pose before solving, the parent turning during the solve doesn't turn the axis
+	float3 hinge_axis = float3(0, 0, 0);
+	//largest angle to the bone before it, pi for no limit
+	float cone_angle = math::pi;
+};
+
+struct ik_batch_chain
+{
+	//animation::instance of the entity
+	uint32_t instance = 0;
+	//root to tip, each joint the parent of the next. Chains of one entity are solved in parallel,
+	//so none may contain an ancestor of another's joints (two arms and two legs are fine, a spine and an arm are not)
+	std::vector<uint32_t> joints;
+	//one per joint, the tip's is unused
+	std::vector<ik_joint_constraint> constraints;
+	//model space, what the tip is moved to
+	float3 target = float3(0, 0, 0);
+	bool enabled = true;
+	//distance from the tip to the target after the last solve
+	float error = 0.0f;
+};
+
+struct ik_settings
+{
+	int max_iterations = 10;
+	//model space units, a chain is done once its tip is this close to the target
+	float tolerance = 0.001f;
+};
+
+//every chain solved this update with the same joint count
+struct ik_group
+{
+	int joint_count = 0;
+	std::vector<uint32_t> chains;
+	std::vector<float> data;
+	math::simd::fabrik_soa view;
+
+	//keeps the memory between updates
+	void resize(size_t count)
+	{
+		const size_t n = count;
+		const size_t j = (size_t)joint_count;
+		data.resize(n * (j * 8 + 7));
+		float* p = data.data();
+		auto take = [&p](size_t floats)
+		{
+			float* r = p;
+			p += floats;
+			return r;
+		};
+		view.stride = n;
+		view.joints = math::simd::float3_soa{ take(j * n), take(j * n), take(j * n) };
+		view.lengths = take(j * n);
+		view.hinge_axes = math::simd::float3_soa{ take(j * n), take(j * n), take(j * n) };
+		view.cone_cos = take(j * n);
+		view.reference = math::simd::float3_soa{ take(n), take(n), take(n) };
+		view.targets = math::simd::float3_soa{ take(n), take(n), take(n) };
+		view.error = take(n);
+	}
+};
+
+struct ik_system
+{
+	animation_system* animations;
+	job_system* jobs;
+	ik_settings settings;
+	std::vector<ik_batch_chain> chains;
+	//rebuilt every update, kept around so a steady state frame doesn't allocate
+	std::vector<ik_group> groups;
+
+	void initialize(animation_system* animations, job_system* jobs)
+	{
+		this->animations = animations;
+		this->jobs = jobs;
+		animations->add_modifier(pose_modifier{ &ik_system::run, this });
+	}
+
+	//joints root to tip, returns the index chain() takes
+	uint32_t add_chain(animation& a, const uint32_t* joints, size_t count)
+	{
+		animations->get_instance(a);
+		ik_batch_chain c;
+		c.instance = a.instance;
+		c.joints.assign(joints, joints + count);
+		c.constraints.resize(count);
+		chains.push_back(c);
+		return (uint32_t)chains.size() - 1;
+	}
+
+	ik_batch_chain& chain(uint32_t index)
+	{
+		return chains[index];
+	}
+
+	static void run(void* context, animation_system&)
+	{
+		static_cast<ik_system*>(context)->solve();
+	}
+
+	void solve()
+	{
+		for (ik_group& g : groups)
+		{
+			g.chains.clear();
+		}
+		for (uint32_t c = 0; c < (uint32_t)chains.size(); c++)
+		{
+			const ik_batch_chain& chain = chains[c];
+			if (!chain.enabled || chain.joints.size() < 2 || !animations->instances[chain.instance - 1].in_use || !animations->instances[chain.instance - 1].evaluated)
+			{
+				continue;
+			}
+			get_group((int)chain.joints.size()).chains.push_back(c);
+		}
+
+		for (ik_group& g : groups)
+		{
+			if (g.chains.empty())
+			{
+				continue;
+			}
+			g.resize(g.chains.size());
+
+			auto gather = [this, &g](size_t begin, size_t end, uint32_t)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					gather_chain(chains[g.chains[i]], g.view, i);
+				}
+			};
+			jobs->parallel_for(g.chains.size(), 16, gather);
+
+			auto fabrik = [this, &g](size_t begin, size_t end, uint32_t)
+			{
+				math::simd::fabrik(g.view.offset(begin), end - begin, g.joint_count, settings.max_iterations, settings.tolerance);
+			};
+			jobs->parallel_for(g.chains.size(), 64, fabrik);
+
+			auto write = [this, &g](size_t begin, size_t end, uint32_t)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					write_chain(chains[g.chains[i]], g.view, i);
+				}
+			};
+			jobs->parallel_for(g.chains.size(), 16, write);
+		}
+	}
+
+	ik_group& get_group(int joint_count)
+	{
+		for (ik_group& g : groups)
+		{
+			if (g.joint_count == joint_count)
+			{
+				return g;
+			}
+		}
+		groups.push_back(ik_group());
+		groups.back().joint_count = joint_count;
+		return groups.back();
+	}
+
+	//model space transform of the root's parent, identity for a root without one
+	static transform parent_transform(const pose& p, uint32_t root)
+	{
+		int parent = p.parents[root];
+		return parent >= 0 ? p.get_global_transform(parent) : transform();
+	}
+
+	void gather_chain(const ik_batch_chain& chain, const math::simd::fabrik_soa& v, size_t i)
+	{
+		const pose& p = animations->instances[chain.instance - 1].local;
+		const size_t n = v.stride;
+		const size_t count = chain.joints.size();
+
+		const transform parent = parent_transform(p, chain.joints[0]);
+		transform world = math::combine(parent, p.joints[chain.joints[0]]);
+		float3 previous = world.position;
+		for (size_t j = 0; j < count; j++)
+		{
+			if (j > 0)
+			{
+				world = math::combine(world, p.joints[chain.joints[j]]);
+			}
+			const size_t o = j * n + i;
+			v.joints.x[o] = world.position.x;
+			v.joints.y[o] = world.position.y;
+			v.joints.z[o] = world.position.z;
+			v.lengths[o] = math::length(world.position - previous);
+			previous = world.position;
+
+			const ik_joint_constraint& c = chain.constraints[j];
+			float3 axis = math::length(c.hinge_axis) > math::epsilon ? math::normalize(world.rotation * c.hinge_axis) : float3(0, 0, 0);
+			v.hinge_axes.x[o] = axis.x;
+			v.hinge_axes.y[o] = axis.y;
+			v.hinge_axes.z[o] = axis.z;
+			v.cone_cos[o] = c.cone_angle >= math::pi ? -1.0f : cosf(c.cone_angle);
+		}
+
+		//the root's cone is around the parent bone, or around the first bone as sampled when there is none
+		const float3 root(v.joints.x[i], v.joints.y[i], v.joints.z[i]);
+		float3 reference = root - parent.position;
+		if (p.parents[chain.joints[0]] < 0 || math::length(reference) < math::epsilon)
+		{
+			reference = float3(v.joints.x[n + i], v.joints.y[n + i], v.joints.z[n + i]) - root;
+		}
+		reference = math::normalize(reference);
+		v.reference.x[i] = reference.x;
+		v.reference.y[i] = reference.y;
+		v.reference.z[i] = reference.z;
+		v.targets.x[i] = chain.target.x;
+		v.targets.y[i] = chain.target.y;
+		v.targets.z[i] = chain.target.z;
+	}
+
+	//turns every joint but the tip so its bone points at the solved position of the next joint
+	void write_chain(ik_batch_chain& chain, const math::simd::fabrik_soa& v, size_t i)
+	{
+		pose& p = animations->instances[chain.instance - 1].local;
+		const size_t n = v.stride;
+		const size_t count = chain.joints.size();
+
+		transform parent = parent_transform(p, chain.joints[0]);
+		transform world = math::combine(parent, p.joints[chain.joints[0]]);
+		for (size_t j = 0; j + 1 < count; j++)
+		{
+			transform& local = p.joints[chain.joints[j]];
+			const transform child = math::combine(world, p.joints[chain.joints[j + 1]]);
+			const float3 solved(v.joints.x[j * n + i], v.joints.y[j * n + i], v.joints.z[j * n + i]);
+			const float3 solved_child(v.joints.x[(j + 1) * n + i], v.joints.y[(j + 1) * n + i], v.joints.z[(j + 1) * n + i]);
+
+			world.rotation = world.rotation * math::from_to(child.position - world.position, solved_child - solved);
+			local.rotation = world.rotation * math::inverse(parent.rotation);
+			parent = world;
+			world = math::combine(world, p.joints[chain.joints[j + 1]]);
+		}
+		chain.error = v.error[i];
+	}
+};
@@ -0,0 +1,171 @@
+#pragma once
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Persistent worker threads for data parallel loops.
+//parallel_for splits [0, count) into chunks of grain elements, the calling thread takes chunks too and
+//returns once all of them are done. Nothing is allocated per call, the loop body is passed by reference.
+//Not reentrant: a loop body must not start another parallel_for.
+struct job_system
+{
+	//thread_count includes the calling thread, 0 picks one per hardware thread
+	void initialize(uint32_t thread_count = 0)
+	{
+		if (thread_count == 0)
+		{
+			thread_count = std::max(1U, std::thread::hardware_concurrency());
+		}
+		quit = false;
+		workers.reserve(thread_count - 1);
+		for (uint32_t i = 1; i < thread_count; i++)
+		{
+			workers.emplace_back(&job_system::worker_main, this, i);
+		}
+	}
+
+	void dispose()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wake.notify_all();
+		for (auto& w : workers)
+		{
+			w.join();
+		}
+		workers.clear();
+	}
+
+	//calling thread included, worker indices passed to the loop body are in [0, worker_count())
+	uint32_t worker_count() const
+	{
+		return (uint32_t)workers.size() + 1;
+	}
+
+	//func(begin, end, worker_index)
+	template<class FUNC>
+	void parallel_for(size_t count, size_t grain, FUNC& func)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+		//the chunk index gets the low 32 bits of next_chunk
+		grain = std::max<size_t>(grain, (size_t)(((uint64_t)count >> 32) + 1));
+		size_t chunks = (count + grain - 1) / grain;
+		if (workers.empty() || chunks == 1)
+		{
+			func((size_t)0, count, 0U);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			generation++;
+			current.invoke = &invoke<FUNC>;
+			current.context = &func;
+			current.count = count;
+			current.grain = grain;
+			current.generation = (uint32_t)generation;
+			next_chunk.store((uint64_t)current.generation << 32, std::memory_order_relaxed);
+			remaining_chunks.store(chunks, std::memory_order_relaxed);
+		}
+		wake.notify_all();
+
+		run(current, chunks, 0);
+
+		//func has to outlive every chunk, including the ones workers are still running
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this]() { return remaining_chunks.load(std::memory_order_acquire) == 0 && busy == 0; });
+	}
+
+private:
+	struct job
+	{
+		void (*invoke)(void* context, size_t begin, size_t end, uint32_t worker_index);
+		void* context;
+		size_t count;
+		size_t grain;
+		//low bits of job_system::generation when the loop started, what next_chunk is tagged with
+		uint32_t generation;
+	};
+
+	template<class FUNC>
+	static void invoke(void* context, size_t begin, size_t end, uint32_t worker_index)
+	{
+		(*(FUNC*)context)(begin, end, worker_index);
+	}
+
+	//a worker that woke up for a loop which finished before it got the mutex still holds that loop's job, and the next
+	//loop may have reset next_chunk by the time it gets here. Chunks are only claimed while next_chunk carries the
+	//generation of j, so such a worker finds nothing to do instead of running the new loop's chunks with a stale context
+	void run(const job& j, size_t chunks, uint32_t worker_index)
+	{
+		const uint64_t tag = (uint64_t)j.generation << 32;
+		uint64_t claim = next_chunk.load(std::memory_order_relaxed);
+		while (true)
+		{
+			if ((claim & ~CHUNK_MASK) != tag || (claim & CHUNK_MASK) >= chunks)
+			{
+				return;
+			}
+			if (!next_chunk.compare_exchange_weak(claim, claim + 1, std::memory_order_relaxed))
+			{
+				continue;
+			}
+			size_t c = (size_t)(claim & CHUNK_MASK);
+			size_t begin = c * j.grain;
+			size_t end = std::min(j.count, begin + j.grain);
+			j.invoke(j.context, begin, end, worker_index);
+			remaining_chunks.fetch_sub(1, std::memory_order_acq_rel);
+			claim = next_chunk.load(std::memory_order_relaxed);
+		}
+	}
+
+	void worker_main(uint32_t worker_index)
+	{
+		uint64_t seen = 0;
+		while (true)
+		{
+			job j;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this, seen]() { return quit || generation != seen; });
+				if (quit)
+				{
+					return;
+				}
+				seen = generation;
+				j = current;
+				busy++;
+			}
+
+			run(j, (j.count + j.grain - 1) / j.grain, worker_index);
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				busy--;
+			}
+			done.notify_all();
+		}
+	}
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	job current{};
+	uint64_t generation = 0;
+	uint32_t busy = 0;
+	bool quit = false;
+	//generation of the running loop in the high 32 bits, index of the next unclaimed chunk in the low 32
+	static constexpr uint64_t CHUNK_MASK = 0xffffffffULL;
+	std::atomic<uint64_t> next_chunk{ 0 };
+	std::atomic<size_t> remaining_chunks{ 0 };
+};
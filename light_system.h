@@ -3,6 +3,7 @@
 #include "renderer.h"
 #include "components.h"
 #include "uniform_buffer_object.h"
+#include "mmath_simd.h"
 struct light_system
 {
 	component_id_array<position, directional_light> comps;
@@ -44,11 +45,11 @@ struct light_system
 				auto& light = light_offset[i];
 
 				float4x4 rot_matrix;
-				math::rotation_matrix(fmod(accumulate, 360.0f), float3(1, 1, 0), rot_matrix);
+				math::rotation_matrix<math::precision_fast>(fmod(accumulate, 360.0f), float3(1, 1, 0), rot_matrix);
 				float4x4 inverted;
-				bool valid = math::inverse_matrix(rot_matrix, inverted);
+				bool valid = math::simd::inverse_matrix(rot_matrix, inverted);
 
-				light.direction = float4(math::normalize(float3(inverted[8], inverted[9], inverted[10])), 0.0f);
+				light.direction = float4(math::normalize<math::precision_fast>(float3(inverted[8], inverted[9], inverted[10])), 0.0f);
 
 				lbo.lights[index] = light_data{ float4(pos.x, pos.y, pos.z, 1.0f), light.color, light.direction};
 				index++;
@@ -20,6 +20,8 @@ struct mesh_batch
 {
 	mesh_batch(): count(0), vbo(VK_NULL_HANDLE), ibo(VK_NULL_HANDLE), vertex_count(0), material(0), descriptor_set(0), pipeline(0){}
 	float4x4 model[MAX_BATCHED_MESHES_COUNT]{};
+	//animation::palette_offset of each skinned instance, 0 for static meshes
+	uint32_t palette_offset[MAX_BATCHED_MESHES_COUNT]{};
 	uint8_t count;
 	VkBuffer vbo;
 	VkBuffer ibo;
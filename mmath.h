@@ -1,6 +1,8 @@
 #pragma once
 #include <stdint.h>
 #include <math.h>
+#include <string.h>
+#include <xmmintrin.h>
 #undef far
 #undef near
 #include <array>
@@ -14,6 +16,81 @@ namespace math
 	inline constexpr static float d2r = pi / 180.0f;
 	inline constexpr static float r2d = 180.0f / pi;
 	inline constexpr static float epsilon = 0.000001f;
+
+	//Precision policies for the functions below that need sqrt or trig (length, normalize, angle_between, angle_axis, rotation_matrix).
+	//Pass one as template argument, e.g. math::normalize<math::precision_fast>(v), or define MMATH_FAST_MATH
+	//to make precision_fast the default for every call that doesn't name a policy.
+	struct precision_exact
+	{
+		static float sqrt(float x) { return sqrtf(x); }
+		static float rsqrt(float x) { return 1.0f / sqrtf(x); }
+		static float sin(float x) { return sinf(x); }
+		static float cos(float x) { return cosf(x); }
+		static float acos(float x) { return acosf(x); }
+	};
+
+	//Max errors, measured over the float range the engine feeds them:
+	//rsqrt: 3e-7 relative (hardware estimate + one newton step)
+	//sqrt: 3e-7 relative, 0 for x <= 0
+	//sin / cos: 2.5e-7 absolute for |x| < 8192, degree 11 / 12 polynomial after reduction to [-pi/2, pi/2], accuracy drops past that
+	//acos: 6e-7 absolute (Abramowitz & Stegun 4.4.46), input clamped to [-1, 1]
+	struct precision_fast
+	{
+		static float rsqrt(float x)
+		{
+			float y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+			return y * (1.5f - 0.5f * x * y * y);
+		}
+
+		static float sqrt(float x)
+		{
+			return x <= 0.0f ? 0.0f : x * rsqrt(x);
+		}
+
+		//r = x - k * pi, with pi split in two so k * pi_hi is exact
+		static float reduce(float x, int& k)
+		{
+			constexpr float inv_pi = 0.318309886f;
+			constexpr float pi_hi = 3.140625f;
+			constexpr float pi_lo = 9.67653589793e-4f;
+			float fk = (float)(int)(x * inv_pi + (x < 0.0f ? -0.5f : 0.5f));
+			k = (int)fk;
+			return (x - fk * pi_hi) - fk * pi_lo;
+		}
+
+		static float sin(float x)
+		{
+			int k;
+			float r = reduce(x, k);
+			float r2 = r * r;
+			float p = r + r * r2 * (-1.6666667e-1f + r2 * (8.3333333e-3f + r2 * (-1.9841270e-4f + r2 * (2.7557319e-6f + r2 * -2.5052108e-8f))));
+			return (k & 1) ? -p : p;
+		}
+
+		static float cos(float x)
+		{
+			int k;
+			float r = reduce(x, k);
+			float r2 = r * r;
+			float p = 1.0f + r2 * (-0.5f + r2 * (4.1666667e-2f + r2 * (-1.3888889e-3f + r2 * (2.4801587e-5f + r2 * (-2.7557319e-7f + r2 * 2.0876757e-9f)))));
+			return (k & 1) ? -p : p;
+		}
+
+		static float acos(float x)
+		{
+			float a = x < 0.0f ? -x : x;
+			a = a > 1.0f ? 1.0f : a;
+			float p = 1.5707963050f + a * (-0.2145988016f + a * (0.0889789874f + a * (-0.0501743046f + a * (0.0308918810f + a * (-0.0170881256f + a * (0.0066700901f + a * -0.0012624911f))))));
+			float r = sqrt(1.0f - a) * p;
+			return x < 0.0f ? 3.14159265f - r : r;
+		}
+	};
+
+#if defined(MMATH_FAST_MATH)
+	typedef precision_fast default_precision;
+#else
+	typedef precision_exact default_precision;
+#endif
 };
 
 
@@ -214,6 +291,23 @@ inline float4x4 operator*(const float4x4& a, const float4x4& b) {
 		M4D(0, 3), M4D(1, 3), M4D(2, 3), M4D(3, 3)  // Column 3
 	};
 }
+
+//affine transform without the constant (0 0 0 1) row, 48 instead of 64 bytes.
+//row major, three rows of (basis x, basis y, basis z, translation): the VkTransformMatrixKHR layout
+struct float3x4
+{
+	std::array<float, 12> m;
+
+	float& operator[](size_t i) { return m[i]; }
+	const float& operator[](size_t i) const { return m[i]; }
+};
+
+//rotation + translation only (orthonormal basis), the math:: overloads taking it pick the cheaper
+//versions at compile time: the inverse is a transpose and no normalization is needed.
+//converts implicitly to float3x4, the affine versions are always correct for it
+struct rigid3x4 : float3x4
+{
+};
 struct int2
 {
 	inline constexpr int2() : x(0), y(0) {}
@@ -365,7 +459,8 @@ namespace math
 		return dot(p, p);
 	}
 
-	
+
+	template<class PRECISION = default_precision>
 	inline float length(const float3& p)
 	{
 		float len = sqr_length(p);
@@ -373,7 +468,7 @@ namespace math
 		{
 			return 0.0f;
 		}
-		return sqrtf(len);
+		return PRECISION::sqrt(len);
 	}
 
 	inline float3 float3_min(const float3& a, const float3& b)
@@ -400,9 +495,21 @@ namespace math
 		}
 	}
 
+	//component wise, float3_min / float3_max pick the shorter / longer vector
+	inline float3 min(const float3& a, const float3& b)
+	{
+		return float3(a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y, a.z < b.z ? a.z : b.z);
+	}
+
+	inline float3 max(const float3& a, const float3& b)
+	{
+		return float3(a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y, a.z > b.z ? a.z : b.z);
+	}
+
+	template<class PRECISION = default_precision>
 	inline float3 normalize(const float3& a)
 	{
-		return a * (1.0f / sqrtf(dot(a, a)));
+		return a * PRECISION::rsqrt(dot(a, a));
 	}
 
 	
@@ -424,7 +531,6 @@ struct quaternion
 	inline float& operator[](int i) { return (&x)[i]; }
 	union { 
 		struct { float x;  float y; float z; float w; }; 
-		struct { float3 vector; float scalar; };
 		float v[4]; 
 	};
 	inline constexpr quaternion() : x(0), y(0), z(0), w(1) {}
@@ -461,11 +567,13 @@ inline constexpr quaternion operator-(const quaternion& a)
 	return quaternion(-a.x, -a.y, -a.z, -a.w);
 }
 
-inline constexpr float3 operator*(const quaternion& q, const float3& v)
+inline float3 operator*(const quaternion& q, const float3& v)
 {
-	return q.vector * 2.0f * math::dot(q.vector, v) +
-		v * (q.scalar * q.scalar - math::dot(q.vector, q.vector)) +
-		math::cross(q.vector, v) * 2.0f * q.scalar;
+	//float3 has constructors, so it can't share the union with x, y, z outside of msvc
+	const float3 u(q.x, q.y, q.z);
+	return u * 2.0f * math::dot(u, v) +
+		v * (q.w * q.w - math::dot(u, u)) +
+		math::cross(u, v) * 2.0f * q.w;
 }
 
 
@@ -487,17 +595,26 @@ struct transform
 	float3 scale;
 };
 
+//rigid transform as real + dual quaternion, blends without the volume loss of blended matrices.
+//real is the rotation, dual = 0.5 * (translation, 0) * real in Hamilton order
+struct dual_quaternion
+{
+	quaternion real;
+	quaternion dual;
+};
+
 namespace math
 {
 
 	inline constexpr float dot(const quaternion& a, const quaternion& b)
 	{
-		return a.x * b.x + a.y * b.y + a.z * b.z + a.w * a.z;
+		return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
 	}inline constexpr float sqr_length(const quaternion& q)
 	{
 		return dot(q, q);
 	}
 
+	template<class PRECISION = default_precision>
 	inline float length(const quaternion& q)
 	{
 		float len = sqr_length(q);
@@ -507,8 +624,11 @@ namespace math
 			return 0.0f;
 		}
 
-		return sqrtf(len);
-	}inline constexpr quaternion normalize(const quaternion& a)
+		return PRECISION::sqrt(len);
+	}
+
+	template<class PRECISION = default_precision>
+	inline constexpr quaternion normalize(const quaternion& a)
 	{
 		float len = a.x * a.x + a.y * a.y + a.z * a.z + a.w * a.w;
 		if (len < epsilon)
@@ -516,7 +636,7 @@ namespace math
 			return quaternion();
 		}
 
-		float s = 1.0f / sqrtf(len);
+		float s = PRECISION::rsqrt(len);
 		return quaternion(a.x * s, a.y * s, a.z * s, a.w * s);
 	}
 
@@ -549,6 +669,7 @@ namespace math
 		return a - projection;
 	}	
 
+	template<class PRECISION = default_precision>
 	inline float angle_between(const float3& a, const float3& b)
 	{
 		float lensqr_a = sqr_length(a);
@@ -558,13 +679,13 @@ namespace math
 			return 0.0f;
 		}
 		float val = dot(a, b);
-		float len = sqrtf(lensqr_a) * sqrtf(lensqr_b);
-		return acosf(val / len);
+		float len = PRECISION::sqrt(lensqr_a) * PRECISION::sqrt(lensqr_b);
+		return PRECISION::acos(val / len);
 	}
 
 	inline float abs(float x)
 	{
-		return (float)((unsigned int)x & 0x7FFFFFFF);
+		return fabsf(x);
 	}
 
 	inline bool equals(const float3& a, const float3& b)
@@ -684,11 +805,12 @@ namespace math
 		return float3(x, y, z);
 	}
 
+	template<class PRECISION = default_precision>
 	inline quaternion angle_axis(float angle, const float3& axis)
 	{
-		float3 normalized_axis = normalize(axis);
-		float s = sinf(angle * 0.5f);
-		return quaternion(normalized_axis.x * s, normalized_axis.y * s, normalized_axis.z * s, cosf(angle * 0.5f));
+		float3 normalized_axis = normalize<PRECISION>(axis);
+		float s = PRECISION::sin(angle * 0.5f);
+		return quaternion(normalized_axis.x * s, normalized_axis.y * s, normalized_axis.z * s, PRECISION::cos(angle * 0.5f));
 	}
 
 	inline quaternion mix(const quaternion& from, const quaternion& to, float t) 
@@ -696,6 +818,33 @@ namespace math
 		return from * (1.0f - t) + to * t; 
 	}
 
+	//mix along the shorter arc, renormalized
+	inline quaternion nlerp(const quaternion& from, const quaternion& to, float t)
+	{
+		quaternion end = dot(from, to) < 0.0f ? -to : to;
+		return normalize(mix(from, end, t));
+	}
+
+	//constant angular velocity, falls back to nlerp when the angle is too small for 1 / sin(theta)
+	template<class PRECISION = default_precision>
+	inline quaternion slerp(const quaternion& from, const quaternion& to, float t)
+	{
+		float d = dot(from, to);
+		quaternion end = to;
+		if (d < 0.0f)
+		{
+			d = -d;
+			end = -to;
+		}
+		if (d > 0.9995f)
+		{
+			return normalize<PRECISION>(mix(from, end, t));
+		}
+		float theta = PRECISION::acos(d);
+		float inv_sin = 1.0f / PRECISION::sin(theta);
+		return from * (PRECISION::sin((1.0f - t) * theta) * inv_sin) + end * (PRECISION::sin(t * theta) * inv_sin);
+	}
+
 	inline quaternion inverse(const quaternion& q)
 	{
 		float lenSq = q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w;
@@ -915,15 +1064,184 @@ namespace math
 
 
 
+	inline void to_float4x4(const float3x4& a, float4x4& out)
+	{
+		out[0] = a[0]; out[1] = a[4]; out[2] = a[8]; out[3] = 0.0f;
+		out[4] = a[1]; out[5] = a[5]; out[6] = a[9]; out[7] = 0.0f;
+		out[8] = a[2]; out[9] = a[6]; out[10] = a[10]; out[11] = 0.0f;
+		out[12] = a[3]; out[13] = a[7]; out[14] = a[11]; out[15] = 1.0f;
+	}
+
+	//drops the last row, m has to be affine
+	inline void to_float3x4(const float4x4& m, float3x4& out)
+	{
+		out[0] = m[0]; out[1] = m[4]; out[2] = m[8]; out[3] = m[12];
+		out[4] = m[1]; out[5] = m[5]; out[6] = m[9]; out[7] = m[13];
+		out[8] = m[2]; out[9] = m[6]; out[10] = m[10]; out[11] = m[14];
+	}
+
+	inline void to_float3x4(const transform& a, float3x4& out)
+	{
+		float4x4 m;
+		to_float4x4(a, m);
+		to_float3x4(m, out);
+	}
+
+	//scale is ignored
+	inline void to_rigid3x4(const transform& a, rigid3x4& out)
+	{
+		float3 x = a.rotation * float3(1, 0, 0);
+		float3 y = a.rotation * float3(0, 1, 0);
+		float3 z = a.rotation * float3(0, 0, 1);
+		out[0] = x.x; out[1] = y.x; out[2] = z.x; out[3] = a.position.x;
+		out[4] = x.y; out[5] = y.y; out[6] = z.y; out[7] = a.position.y;
+		out[8] = x.z; out[9] = y.z; out[10] = z.z; out[11] = a.position.z;
+	}
+
+	//the caller vouches for m having an orthonormal basis
+	inline void to_rigid3x4(const float4x4& m, rigid3x4& out)
+	{
+		to_float3x4(m, out);
+	}
+
+	inline float3 transform_point(const float3x4& m, const float3& p)
+	{
+		return float3(
+			m[0] * p.x + m[1] * p.y + m[2] * p.z + m[3],
+			m[4] * p.x + m[5] * p.y + m[6] * p.z + m[7],
+			m[8] * p.x + m[9] * p.y + m[10] * p.z + m[11]);
+	}
+
+	inline float3 transform_vector(const float3x4& m, const float3& v)
+	{
+		return float3(
+			m[0] * v.x + m[1] * v.y + m[2] * v.z,
+			m[4] * v.x + m[5] * v.y + m[6] * v.z,
+			m[8] * v.x + m[9] * v.y + m[10] * v.z);
+	}
+
+	//out = left * right, 36 mul instead of 64. out may alias left or right
+	inline void mul(const float3x4& left, const float3x4& right, float3x4& out)
+	{
+		float3x4 r;
+		for (int row = 0; row < 3; row++)
+		{
+			const float* l = &left.m[row * 4];
+			r[row * 4 + 0] = l[0] * right[0] + l[1] * right[4] + l[2] * right[8];
+			r[row * 4 + 1] = l[0] * right[1] + l[1] * right[5] + l[2] * right[9];
+			r[row * 4 + 2] = l[0] * right[2] + l[1] * right[6] + l[2] * right[10];
+			r[row * 4 + 3] = l[0] * right[3] + l[1] * right[7] + l[2] * right[11] + l[3];
+		}
+		out = r;
+	}
+
+	inline void mul(const rigid3x4& left, const rigid3x4& right, rigid3x4& out)
+	{
+		mul(static_cast<const float3x4&>(left), static_cast<const float3x4&>(right), static_cast<float3x4&>(out));
+	}
+
+	//3x3 inverse through the cofactors, then the translation through it
+	inline bool inverse_matrix(const float3x4& m, float3x4& out)
+	{
+		float c00 = m[5] * m[10] - m[6] * m[9];
+		float c01 = m[6] * m[8] - m[4] * m[10];
+		float c02 = m[4] * m[9] - m[5] * m[8];
+		float det = m[0] * c00 + m[1] * c01 + m[2] * c02;
+
+		if (det == 0.0f) {
+			return false;
+		}
+		float d = 1.0f / det;
+
+		float3x4 r;
+		r[0] = c00 * d;
+		r[1] = (m[2] * m[9] - m[1] * m[10]) * d;
+		r[2] = (m[1] * m[6] - m[2] * m[5]) * d;
+		r[4] = c01 * d;
+		r[5] = (m[0] * m[10] - m[2] * m[8]) * d;
+		r[6] = (m[2] * m[4] - m[0] * m[6]) * d;
+		r[8] = c02 * d;
+		r[9] = (m[1] * m[8] - m[0] * m[9]) * d;
+		r[10] = (m[0] * m[5] - m[1] * m[4]) * d;
+		r[3] = -(r[0] * m[3] + r[1] * m[7] + r[2] * m[11]);
+		r[7] = -(r[4] * m[3] + r[5] * m[7] + r[6] * m[11]);
+		r[11] = -(r[8] * m[3] + r[9] * m[7] + r[10] * m[11]);
+		out = r;
+		return true;
+	}
+
+	//transposed rotation, translation = -R^T t. Never fails
+	inline bool inverse_matrix(const rigid3x4& m, rigid3x4& out)
+	{
+		rigid3x4 r;
+		r[0] = m[0]; r[1] = m[4]; r[2] = m[8];
+		r[4] = m[1]; r[5] = m[5]; r[6] = m[9];
+		r[8] = m[2]; r[9] = m[6]; r[10] = m[10];
+		r[3] = -(r[0] * m[3] + r[1] * m[7] + r[2] * m[11]);
+		r[7] = -(r[4] * m[3] + r[5] * m[7] + r[6] * m[11]);
+		r[11] = -(r[8] * m[3] + r[9] * m[7] + r[10] * m[11]);
+		out = r;
+		return true;
+	}
+
+	//the caller vouches for m being rigid, scale and shear are dropped
+	inline void to_dual_quaternion(const float4x4& m, dual_quaternion& out)
+	{
+		//largest diagonal term first for precision, m is column major
+		quaternion q;
+		float trace = m[0] + m[5] + m[10];
+		if (trace > 0.0f)
+		{
+			float s = sqrtf(trace + 1.0f) * 2.0f;
+			q = quaternion((m[6] - m[9]) / s, (m[8] - m[2]) / s, (m[1] - m[4]) / s, 0.25f * s);
+		}
+		else if (m[0] > m[5] && m[0] > m[10])
+		{
+			float s = sqrtf(1.0f + m[0] - m[5] - m[10]) * 2.0f;
+			q = quaternion(0.25f * s, (m[4] + m[1]) / s, (m[8] + m[2]) / s, (m[6] - m[9]) / s);
+		}
+		else if (m[5] > m[10])
+		{
+			float s = sqrtf(1.0f + m[5] - m[0] - m[10]) * 2.0f;
+			q = quaternion((m[4] + m[1]) / s, 0.25f * s, (m[9] + m[6]) / s, (m[8] - m[2]) / s);
+		}
+		else
+		{
+			float s = sqrtf(1.0f + m[10] - m[0] - m[5]) * 2.0f;
+			q = quaternion((m[8] + m[2]) / s, (m[9] + m[6]) / s, 0.25f * s, (m[1] - m[4]) / s);
+		}
+		q = normalize(q);
+
+		float tx = m[12], ty = m[13], tz = m[14];
+		out.real = q;
+		out.dual = quaternion(
+			0.5f * (tx * q.w + ty * q.z - tz * q.y),
+			0.5f * (-tx * q.z + ty * q.w + tz * q.x),
+			0.5f * (tx * q.y - ty * q.x + tz * q.w),
+			-0.5f * (tx * q.x + ty * q.y + tz * q.z));
+	}
+
+	//dq has to be normalized (|real| = 1)
+	inline float3 transform_point(const dual_quaternion& dq, const float3& p)
+	{
+		const quaternion& r = dq.real;
+		const quaternion& d = dq.dual;
+		float3 rv = float3(r.x, r.y, r.z);
+		float3 dv = float3(d.x, d.y, d.z);
+		float3 translation = (dv * r.w - rv * d.w + cross(rv, dv)) * 2.0f;
+		return r * p + translation;
+	}
+
+	template<class PRECISION = default_precision>
 	inline void rotation_matrix(const float angle, float3 const& axis, float4x4& output)
 	{
 		float x = axis.x, y = axis.y, z = axis.z;
 
 		float angle_in_rad = angle;
 
-		const float c = cosf(angle_in_rad);
+		const float c = PRECISION::cos(angle_in_rad);
 		const float one_minus_c = 1.0f - c;
-		const float s = sinf(angle_in_rad);
+		const float s = PRECISION::sin(angle_in_rad);
 
 		output[0] = x * x * one_minus_c + c;
 		output[1] = y * x * one_minus_c - z * s;
@@ -1039,14 +1357,20 @@ namespace math
    138,236,205,93,222,114,67,29,24,72,243,141,128,195,78,66,215,61,156,180
 	};
 
-	struct improved_noise {
-		static std::vector<int> p;
-
-		static void init()
+	constexpr std::array<int, 512> make_permutation()
+	{
+		std::array<int, 512> p{};
+		for (size_t i = 0; i < 256; i++)
 		{
-			p.resize(512);
-			for (size_t i = 0; i < 256; i++) p[256U + i] = p[i] = perlin_hash[i];
+			p[i] = perlin_hash[i];
+			p[256 + i] = perlin_hash[i];
 		}
+		return p;
+	}
+
+	struct improved_noise {
+		//doubled so p[i + 1] never needs wrapping, batch versions live in mmath_simd.h
+		constexpr static std::array<int, 512> p = make_permutation();
 
 		static float fade(float t) { return t * t * t * (t * (t * 6 - 15) + 10); }
 		static float lerp(float t, float a, float b) { return a + t * (b - a); }
@@ -1057,12 +1381,15 @@ namespace math
 			return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
 		}
 		static float noise(float3 pos) {
-			int x = (int)floorf(pos.x) & 255;                 
-			int y = (int)floorf(pos.y) & 255;                  
-			int z = (int)floorf(pos.z) & 255;
-			pos.x -= floorf(float(x));                                
-			pos.y -= floorf(float(y));                                
-			pos.z -= floorf(float(z));
+			float fx = floorf(pos.x);
+			float fy = floorf(pos.y);
+			float fz = floorf(pos.z);
+			int x = (int)fx & 255;                 
+			int y = (int)fy & 255;                  
+			int z = (int)fz & 255;
+			pos.x -= fx;                                
+			pos.y -= fy;                                
+			pos.z -= fz;
 			float u = fade(pos.x);                               
 			float v = fade(pos.y);                            
 			float w = fade(pos.z);
@@ -1084,6 +1411,5 @@ namespace math
 		}
 
 	};
-	inline std::vector<int> improved_noise::p;
 }
 
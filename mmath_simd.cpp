@@ -0,0 +1,557 @@
+#include "mmath_simd.h"
+#include <immintrin.h>
+#include <float.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+//msvc allows any intrinsic without /arch, the dispatch makes sure they only run on cpus that have them
+#define EM_TARGET(isa)
+#else
+#include <cpuid.h>
+#define EM_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace math
+{
+	namespace simd
+	{
+		static void cpuid(int out[4], int leaf, int subleaf)
+		{
+#if defined(_MSC_VER)
+			__cpuidex(out, leaf, subleaf);
+#else
+			unsigned int a, b, c, d;
+			__cpuid_count(leaf, subleaf, a, b, c, d);
+			out[0] = (int)a;
+			out[1] = (int)b;
+			out[2] = (int)c;
+			out[3] = (int)d;
+#endif
+		}
+
+		static uint64_t xgetbv0()
+		{
+#if defined(_MSC_VER)
+			return _xgetbv(0);
+#else
+			unsigned int lo, hi;
+			__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+			return ((uint64_t)hi << 32) | lo;
+#endif
+		}
+
+		instruction_set detect_instruction_set()
+		{
+			int info[4];
+			cpuid(info, 0, 0);
+			int max_leaf = info[0];
+
+			cpuid(info, 1, 0);
+			bool sse3 = (info[2] & (1 << 0)) != 0;
+			bool sse41 = (info[2] & (1 << 19)) != 0;
+			bool fma = (info[2] & (1 << 12)) != 0;
+			bool osxsave = (info[2] & (1 << 27)) != 0;
+			bool avx = (info[2] & (1 << 28)) != 0;
+
+			if (!sse3 || !sse41)
+			{
+				return instruction_set::scalar;
+			}
+
+			//the os has to save the ymm / zmm registers on context switch, otherwise the bits are lying
+			uint64_t xcr0 = osxsave ? xgetbv0() : 0;
+			bool os_avx = (xcr0 & 0x6) == 0x6;
+			bool os_avx512 = (xcr0 & 0xE6) == 0xE6;
+
+			bool avx2 = false;
+			bool avx512f = false;
+			if (max_leaf >= 7)
+			{
+				cpuid(info, 7, 0);
+				avx2 = (info[1] & (1 << 5)) != 0;
+				avx512f = (info[1] & (1 << 16)) != 0;
+			}
+
+			if (avx && avx2 && fma && os_avx)
+			{
+				if (avx512f && os_avx512)
+				{
+					return instruction_set::avx512;
+				}
+				return instruction_set::avx2;
+			}
+			return instruction_set::sse4;
+		}
+
+		//scalar, forwards to mmath.h
+
+		static void mul_scalar(const float4x4& left, const float4x4& right, float4x4& out)
+		{
+			float4x4 result;
+			math::mul(left, right, result);
+			out = result;
+		}
+
+		static void mul_batch_scalar(const float4x4* left, const float4x4* right, float4x4* out, size_t count)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				mul_scalar(left[i], right[i], out[i]);
+			}
+		}
+
+		static void transpose_scalar(const float4x4& m, float4x4& out)
+		{
+			float4x4 result;
+			math::transpose(m, result);
+			out = result;
+		}
+
+		static bool inverse_scalar(const float4x4& m, float4x4& out)
+		{
+			return math::inverse_matrix(m, out);
+		}
+
+		//sse4
+		//matrices are column major, column j of the result is the sum of the columns of left scaled by the elements of column j of right
+
+		EM_TARGET("sse4.1") static void mul_sse4(const float4x4& left, const float4x4& right, float4x4& out)
+		{
+			__m128 a0 = _mm_loadu_ps(&left[0]);
+			__m128 a1 = _mm_loadu_ps(&left[4]);
+			__m128 a2 = _mm_loadu_ps(&left[8]);
+			__m128 a3 = _mm_loadu_ps(&left[12]);
+
+			__m128 r[4];
+			for (int j = 0; j < 4; j++)
+			{
+				__m128 b = _mm_loadu_ps(&right[j * 4]);
+				__m128 c = _mm_mul_ps(a0, _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 0, 0, 0)));
+				c = _mm_add_ps(c, _mm_mul_ps(a1, _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 1, 1, 1))));
+				c = _mm_add_ps(c, _mm_mul_ps(a2, _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 2, 2))));
+				c = _mm_add_ps(c, _mm_mul_ps(a3, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 3, 3))));
+				r[j] = c;
+			}
+			_mm_storeu_ps(&out[0], r[0]);
+			_mm_storeu_ps(&out[4], r[1]);
+			_mm_storeu_ps(&out[8], r[2]);
+			_mm_storeu_ps(&out[12], r[3]);
+		}
+
+		EM_TARGET("sse4.1") static void mul_batch_sse4(const float4x4* left, const float4x4* right, float4x4* out, size_t count)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				mul_sse4(left[i], right[i], out[i]);
+			}
+		}
+
+		EM_TARGET("sse4.1") static void transpose_sse4(const float4x4& m, float4x4& out)
+		{
+			__m128 c0 = _mm_loadu_ps(&m[0]);
+			__m128 c1 = _mm_loadu_ps(&m[4]);
+			__m128 c2 = _mm_loadu_ps(&m[8]);
+			__m128 c3 = _mm_loadu_ps(&m[12]);
+			_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+			_mm_storeu_ps(&out[0], c0);
+			_mm_storeu_ps(&out[4], c1);
+			_mm_storeu_ps(&out[8], c2);
+			_mm_storeu_ps(&out[12], c3);
+		}
+
+#define EM_SHUFFLE_MASK(x, y, z, w) ((x) | ((y) << 2) | ((z) << 4) | ((w) << 6))
+#define EM_SWIZZLE(v, x, y, z, w) _mm_castsi128_ps(_mm_shuffle_epi32(_mm_castps_si128(v), EM_SHUFFLE_MASK(x, y, z, w)))
+#define EM_SHUFFLE(a, b, x, y, z, w) _mm_shuffle_ps(a, b, EM_SHUFFLE_MASK(x, y, z, w))
+
+		//2x2 blocks stored as (m00, m01, m10, m11)
+		//A * B
+		EM_TARGET("sse4.1") static inline __m128 mat2_mul(__m128 a, __m128 b)
+		{
+			return _mm_add_ps(_mm_mul_ps(a, EM_SWIZZLE(b, 0, 3, 0, 3)), _mm_mul_ps(EM_SWIZZLE(a, 1, 0, 3, 2), EM_SWIZZLE(b, 2, 1, 2, 1)));
+		}
+		//adj(A) * B
+		EM_TARGET("sse4.1") static inline __m128 mat2_adj_mul(__m128 a, __m128 b)
+		{
+			return _mm_sub_ps(_mm_mul_ps(EM_SWIZZLE(a, 3, 3, 0, 0), b), _mm_mul_ps(EM_SWIZZLE(a, 1, 1, 2, 2), EM_SWIZZLE(b, 2, 3, 0, 1)));
+		}
+		//A * adj(B)
+		EM_TARGET("sse4.1") static inline __m128 mat2_mul_adj(__m128 a, __m128 b)
+		{
+			return _mm_sub_ps(_mm_mul_ps(a, EM_SWIZZLE(b, 3, 0, 3, 0)), _mm_mul_ps(EM_SWIZZLE(a, 1, 0, 3, 2), EM_SWIZZLE(b, 2, 1, 2, 1)));
+		}
+
+		//block wise inverse through 2x2 adjugates.
+		//written for rows, fed columns: inverse(transpose(M)) == transpose(inverse(M)) so the layout works out the same
+		EM_TARGET("sse4.1") static bool inverse_sse4(const float4x4& m, float4x4& out)
+		{
+			__m128 c0 = _mm_loadu_ps(&m[0]);
+			__m128 c1 = _mm_loadu_ps(&m[4]);
+			__m128 c2 = _mm_loadu_ps(&m[8]);
+			__m128 c3 = _mm_loadu_ps(&m[12]);
+
+			__m128 a = _mm_movelh_ps(c0, c1);
+			__m128 b = _mm_movehl_ps(c1, c0);
+			__m128 c = _mm_movelh_ps(c2, c3);
+			__m128 d = _mm_movehl_ps(c3, c2);
+
+			//(|A| |B| |C| |D|)
+			__m128 det_sub = _mm_sub_ps(
+				_mm_mul_ps(EM_SHUFFLE(c0, c2, 0, 2, 0, 2), EM_SHUFFLE(c1, c3, 1, 3, 1, 3)),
+				_mm_mul_ps(EM_SHUFFLE(c0, c2, 1, 3, 1, 3), EM_SHUFFLE(c1, c3, 0, 2, 0, 2)));
+			__m128 det_a = EM_SWIZZLE(det_sub, 0, 0, 0, 0);
+			__m128 det_b = EM_SWIZZLE(det_sub, 1, 1, 1, 1);
+			__m128 det_c = EM_SWIZZLE(det_sub, 2, 2, 2, 2);
+			__m128 det_d = EM_SWIZZLE(det_sub, 3, 3, 3, 3);
+
+			__m128 d_c = mat2_adj_mul(d, c);
+			__m128 a_b = mat2_adj_mul(a, b);
+			__m128 x = _mm_sub_ps(_mm_mul_ps(det_d, a), mat2_mul(b, d_c));
+			__m128 w = _mm_sub_ps(_mm_mul_ps(det_a, d), mat2_mul(c, a_b));
+			__m128 y = _mm_sub_ps(_mm_mul_ps(det_b, c), mat2_mul_adj(d, a_b));
+			__m128 z = _mm_sub_ps(_mm_mul_ps(det_c, b), mat2_mul_adj(a, d_c));
+
+			__m128 det = _mm_add_ps(_mm_mul_ps(det_a, det_d), _mm_mul_ps(det_b, det_c));
+			__m128 tr = _mm_mul_ps(a_b, EM_SWIZZLE(d_c, 0, 2, 1, 3));
+			tr = _mm_hadd_ps(tr, tr);
+			tr = _mm_hadd_ps(tr, tr);
+			det = _mm_sub_ps(det, tr);
+
+			if (_mm_cvtss_f32(det) == 0.0f)
+			{
+				return false;
+			}
+
+			__m128 rcp_det = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+			x = _mm_mul_ps(x, rcp_det);
+			y = _mm_mul_ps(y, rcp_det);
+			z = _mm_mul_ps(z, rcp_det);
+			w = _mm_mul_ps(w, rcp_det);
+
+			_mm_storeu_ps(&out[0], EM_SHUFFLE(x, y, 3, 1, 3, 1));
+			_mm_storeu_ps(&out[4], EM_SHUFFLE(x, y, 2, 0, 2, 0));
+			_mm_storeu_ps(&out[8], EM_SHUFFLE(z, w, 3, 1, 3, 1));
+			_mm_storeu_ps(&out[12], EM_SHUFFLE(z, w, 2, 0, 2, 0));
+			return true;
+		}
+
+#undef EM_SHUFFLE
+#undef EM_SWIZZLE
+#undef EM_SHUFFLE_MASK
+
+		//avx2, two result columns per register
+
+		EM_TARGET("avx2,fma") static inline void mul_avx2_impl(const float* left, const float* right, float* out)
+		{
+			__m256 a0 = _mm256_broadcast_ps((const __m128*)&left[0]);
+			__m256 a1 = _mm256_broadcast_ps((const __m128*)&left[4]);
+			__m256 a2 = _mm256_broadcast_ps((const __m128*)&left[8]);
+			__m256 a3 = _mm256_broadcast_ps((const __m128*)&left[12]);
+
+			__m256 b01 = _mm256_loadu_ps(&right[0]);
+			__m256 b23 = _mm256_loadu_ps(&right[8]);
+
+			__m256 r01 = _mm256_mul_ps(a0, _mm256_shuffle_ps(b01, b01, _MM_SHUFFLE(0, 0, 0, 0)));
+			__m256 r23 = _mm256_mul_ps(a0, _mm256_shuffle_ps(b23, b23, _MM_SHUFFLE(0, 0, 0, 0)));
+			r01 = _mm256_fmadd_ps(a1, _mm256_shuffle_ps(b01, b01, _MM_SHUFFLE(1, 1, 1, 1)), r01);
+			r23 = _mm256_fmadd_ps(a1, _mm256_shuffle_ps(b23, b23, _MM_SHUFFLE(1, 1, 1, 1)), r23);
+			r01 = _mm256_fmadd_ps(a2, _mm256_shuffle_ps(b01, b01, _MM_SHUFFLE(2, 2, 2, 2)), r01);
+			r23 = _mm256_fmadd_ps(a2, _mm256_shuffle_ps(b23, b23, _MM_SHUFFLE(2, 2, 2, 2)), r23);
+			r01 = _mm256_fmadd_ps(a3, _mm256_shuffle_ps(b01, b01, _MM_SHUFFLE(3, 3, 3, 3)), r01);
+			r23 = _mm256_fmadd_ps(a3, _mm256_shuffle_ps(b23, b23, _MM_SHUFFLE(3, 3, 3, 3)), r23);
+
+			_mm256_storeu_ps(&out[0], r01);
+			_mm256_storeu_ps(&out[8], r23);
+		}
+
+		EM_TARGET("avx2,fma") static void mul_avx2(const float4x4& left, const float4x4& right, float4x4& out)
+		{
+			mul_avx2_impl(left.data(), right.data(), out.data());
+		}
+
+		EM_TARGET("avx2,fma") static void mul_batch_avx2(const float4x4* left, const float4x4* right, float4x4* out, size_t count)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				mul_avx2_impl(left[i].data(), right[i].data(), out[i].data());
+			}
+		}
+
+		//avx512, the whole right matrix in one register
+
+		EM_TARGET("avx512f") static inline void mul_avx512_impl(const float* left, const float* right, float* out)
+		{
+			__m512 a0 = _mm512_broadcast_f32x4(_mm_loadu_ps(&left[0]));
+			__m512 a1 = _mm512_broadcast_f32x4(_mm_loadu_ps(&left[4]));
+			__m512 a2 = _mm512_broadcast_f32x4(_mm_loadu_ps(&left[8]));
+			__m512 a3 = _mm512_broadcast_f32x4(_mm_loadu_ps(&left[12]));
+			__m512 b = _mm512_loadu_ps(right);
+
+			__m512 r = _mm512_mul_ps(a0, _mm512_permute_ps(b, _MM_SHUFFLE(0, 0, 0, 0)));
+			r = _mm512_fmadd_ps(a1, _mm512_permute_ps(b, _MM_SHUFFLE(1, 1, 1, 1)), r);
+			r = _mm512_fmadd_ps(a2, _mm512_permute_ps(b, _MM_SHUFFLE(2, 2, 2, 2)), r);
+			r = _mm512_fmadd_ps(a3, _mm512_permute_ps(b, _MM_SHUFFLE(3, 3, 3, 3)), r);
+			_mm512_storeu_ps(out, r);
+		}
+
+		EM_TARGET("avx512f") static void mul_avx512(const float4x4& left, const float4x4& right, float4x4& out)
+		{
+			mul_avx512_impl(left.data(), right.data(), out.data());
+		}
+
+		EM_TARGET("avx512f") static void mul_batch_avx512(const float4x4* left, const float4x4* right, float4x4* out, size_t count)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				mul_avx512_impl(left[i].data(), right[i].data(), out[i].data());
+			}
+		}
+
+		//batch kernels, mmath_simd_batch.inl is compiled once per lane width.
+		//gcc/clang need the target switched for the whole region since the lane helpers get inlined into the kernels
+
+		namespace scalar_batch
+		{
+			struct lanes
+			{
+				typedef float reg;
+				constexpr static int width = 1;
+				static reg load(const float* p) { return *p; }
+				static void store(float* p, reg v) { *p = v; }
+				static reg set1(float v) { return v; }
+				static reg add(reg a, reg b) { return a + b; }
+				static reg sub(reg a, reg b) { return a - b; }
+				static reg mul(reg a, reg b) { return a * b; }
+				static reg div(reg a, reg b) { return a / b; }
+				static reg fmadd(reg a, reg b, reg c) { return a * b + c; }
+				static reg sqrt(reg a) { return sqrtf(a); }
+				//integer lanes and masks, used by the noise and skinning kernels
+				typedef int ireg;
+				typedef bool mask;
+				static reg floor(reg a) { return floorf(a); }
+				static ireg to_int(reg a) { return (int)a; }
+				static ireg iset1(int v) { return v; }
+				static ireg iadd(ireg a, ireg b) { return a + b; }
+				static ireg iand(ireg a, int b) { return a & b; }
+				static ireg gather(const int* table, ireg index) { return table[index]; }
+				static ireg iload(const int* p) { return *p; }
+				static ireg ishl(ireg a, int bits) { return a << bits; }
+				static reg fgather(const float* table, ireg index) { return table[index]; }
+				static mask ilt(ireg a, int b) { return a < b; }
+				static mask ieq(ireg a, int b) { return a == b; }
+				static mask itest(ireg a, int bit) { return (a & bit) != 0; }
+				static mask mask_or(mask a, mask b) { return a || b; }
+				static bool all(mask m) { return m; }
+				static int bits(mask m) { return m ? 1 : 0; }
+				static reg select(mask m, reg a, reg b) { return m ? a : b; }
+				static reg min(reg a, reg b) { return a < b ? a : b; }
+				static mask lt(reg a, reg b) { return a < b; }
+			};
+			namespace tail = scalar_batch;
+#include "mmath_simd_batch.inl"
+		}
+
+#if !defined(_MSC_VER)
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#endif
+		namespace sse4_batch
+		{
+			struct lanes
+			{
+				typedef __m128 reg;
+				constexpr static int width = 4;
+				static reg load(const float* p) { return _mm_loadu_ps(p); }
+				static void store(float* p, reg v) { _mm_storeu_ps(p, v); }
+				static reg set1(float v) { return _mm_set1_ps(v); }
+				static reg add(reg a, reg b) { return _mm_add_ps(a, b); }
+				static reg sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+				static reg mul(reg a, reg b) { return _mm_mul_ps(a, b); }
+				static reg div(reg a, reg b) { return _mm_div_ps(a, b); }
+				static reg fmadd(reg a, reg b, reg c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+				static reg sqrt(reg a) { return _mm_sqrt_ps(a); }
+				typedef __m128i ireg;
+				typedef __m128 mask;
+				static reg floor(reg a) { return _mm_floor_ps(a); }
+				static ireg to_int(reg a) { return _mm_cvttps_epi32(a); }
+				static ireg iset1(int v) { return _mm_set1_epi32(v); }
+				static ireg iadd(ireg a, ireg b) { return _mm_add_epi32(a, b); }
+				static ireg iand(ireg a, int b) { return _mm_and_si128(a, _mm_set1_epi32(b)); }
+				//no gather before avx2
+				static ireg gather(const int* table, ireg index)
+				{
+					alignas(16) int idx[4];
+					_mm_store_si128((__m128i*)idx, index);
+					return _mm_setr_epi32(table[idx[0]], table[idx[1]], table[idx[2]], table[idx[3]]);
+				}
+				static ireg iload(const int* p) { return _mm_loadu_si128((const __m128i*)p); }
+				static ireg ishl(ireg a, int bits) { return _mm_sll_epi32(a, _mm_cvtsi32_si128(bits)); }
+				static reg fgather(const float* table, ireg index)
+				{
+					alignas(16) int idx[4];
+					_mm_store_si128((__m128i*)idx, index);
+					return _mm_setr_ps(table[idx[0]], table[idx[1]], table[idx[2]], table[idx[3]]);
+				}
+				static mask ilt(ireg a, int b) { return _mm_castsi128_ps(_mm_cmplt_epi32(a, _mm_set1_epi32(b))); }
+				static mask ieq(ireg a, int b) { return _mm_castsi128_ps(_mm_cmpeq_epi32(a, _mm_set1_epi32(b))); }
+				static mask itest(ireg a, int bit) { return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(a, _mm_set1_epi32(bit)), _mm_set1_epi32(bit))); }
+				static mask mask_or(mask a, mask b) { return _mm_or_ps(a, b); }
+				static bool all(mask m) { return _mm_movemask_ps(m) == 0xf; }
+				static int bits(mask m) { return _mm_movemask_ps(m); }
+				static reg select(mask m, reg a, reg b) { return _mm_blendv_ps(b, a, m); }
+				static reg min(reg a, reg b) { return _mm_min_ps(a, b); }
+				static mask lt(reg a, reg b) { return _mm_cmplt_ps(a, b); }
+			};
+			namespace tail = scalar_batch;
+#include "mmath_simd_batch.inl"
+		}
+#if !defined(_MSC_VER)
+#pragma GCC pop_options
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+		namespace avx2_batch
+		{
+			struct lanes
+			{
+				typedef __m256 reg;
+				constexpr static int width = 8;
+				static reg load(const float* p) { return _mm256_loadu_ps(p); }
+				static void store(float* p, reg v) { _mm256_storeu_ps(p, v); }
+				static reg set1(float v) { return _mm256_set1_ps(v); }
+				static reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+				static reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+				static reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+				static reg div(reg a, reg b) { return _mm256_div_ps(a, b); }
+				static reg fmadd(reg a, reg b, reg c) { return _mm256_fmadd_ps(a, b, c); }
+				static reg sqrt(reg a) { return _mm256_sqrt_ps(a); }
+				typedef __m256i ireg;
+				typedef __m256 mask;
+				static reg floor(reg a) { return _mm256_floor_ps(a); }
+				static ireg to_int(reg a) { return _mm256_cvttps_epi32(a); }
+				static ireg iset1(int v) { return _mm256_set1_epi32(v); }
+				static ireg iadd(ireg a, ireg b) { return _mm256_add_epi32(a, b); }
+				static ireg iand(ireg a, int b) { return _mm256_and_si256(a, _mm256_set1_epi32(b)); }
+				static ireg gather(const int* table, ireg index) { return _mm256_i32gather_epi32(table, index, 4); }
+				static ireg iload(const int* p) { return _mm256_loadu_si256((const __m256i*)p); }
+				static ireg ishl(ireg a, int bits) { return _mm256_sll_epi32(a, _mm_cvtsi32_si128(bits)); }
+				static reg fgather(const float* table, ireg index) { return _mm256_i32gather_ps(table, index, 4); }
+				static mask ilt(ireg a, int b) { return _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(b), a)); }
+				static mask ieq(ireg a, int b) { return _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, _mm256_set1_epi32(b))); }
+				static mask itest(ireg a, int bit) { return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(a, _mm256_set1_epi32(bit)), _mm256_set1_epi32(bit))); }
+				static mask mask_or(mask a, mask b) { return _mm256_or_ps(a, b); }
+				static bool all(mask m) { return _mm256_movemask_ps(m) == 0xff; }
+				static int bits(mask m) { return _mm256_movemask_ps(m); }
+				static reg select(mask m, reg a, reg b) { return _mm256_blendv_ps(b, a, m); }
+				static reg min(reg a, reg b) { return _mm256_min_ps(a, b); }
+				static mask lt(reg a, reg b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+			};
+			namespace tail = sse4_batch;
+#include "mmath_simd_batch.inl"
+		}
+#if !defined(_MSC_VER)
+#pragma GCC pop_options
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#endif
+		namespace avx512_batch
+		{
+			struct lanes
+			{
+				typedef __m512 reg;
+				constexpr static int width = 16;
+				static reg load(const float* p) { return _mm512_loadu_ps(p); }
+				static void store(float* p, reg v) { _mm512_storeu_ps(p, v); }
+				static reg set1(float v) { return _mm512_set1_ps(v); }
+				static reg add(reg a, reg b) { return _mm512_add_ps(a, b); }
+				static reg sub(reg a, reg b) { return _mm512_sub_ps(a, b); }
+				static reg mul(reg a, reg b) { return _mm512_mul_ps(a, b); }
+				static reg div(reg a, reg b) { return _mm512_div_ps(a, b); }
+				static reg fmadd(reg a, reg b, reg c) { return _mm512_fmadd_ps(a, b, c); }
+				static reg sqrt(reg a) { return _mm512_sqrt_ps(a); }
+				typedef __m512i ireg;
+				typedef __mmask16 mask;
+				static reg floor(reg a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+				static ireg to_int(reg a) { return _mm512_cvttps_epi32(a); }
+				static ireg iset1(int v) { return _mm512_set1_epi32(v); }
+				static ireg iadd(ireg a, ireg b) { return _mm512_add_epi32(a, b); }
+				static ireg iand(ireg a, int b) { return _mm512_and_si512(a, _mm512_set1_epi32(b)); }
+				static ireg gather(const int* table, ireg index) { return _mm512_i32gather_epi32(index, table, 4); }
+				static ireg iload(const int* p) { return _mm512_loadu_si512(p); }
+				static ireg ishl(ireg a, int bits) { return _mm512_sll_epi32(a, _mm_cvtsi32_si128(bits)); }
+				static reg fgather(const float* table, ireg index) { return _mm512_i32gather_ps(index, table, 4); }
+				static mask ilt(ireg a, int b) { return _mm512_cmplt_epi32_mask(a, _mm512_set1_epi32(b)); }
+				static mask ieq(ireg a, int b) { return _mm512_cmpeq_epi32_mask(a, _mm512_set1_epi32(b)); }
+				static mask itest(ireg a, int bit) { return _mm512_test_epi32_mask(a, _mm512_set1_epi32(bit)); }
+				static mask mask_or(mask a, mask b) { return _mm512_kor(a, b); }
+				static bool all(mask m) { return m == 0xffff; }
+				static int bits(mask m) { return (int)m; }
+				static reg select(mask m, reg a, reg b) { return _mm512_mask_blend_ps(m, b, a); }
+				static reg min(reg a, reg b) { return _mm512_min_ps(a, b); }
+				static mask lt(reg a, reg b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+			};
+			namespace tail = avx2_batch;
+#include "mmath_simd_batch.inl"
+		}
+#if !defined(_MSC_VER)
+#pragma GCC pop_options
+#endif
+
+		//transpose and inverse are shuffle bound, the wider sets reuse the sse4 versions
+		static const float4x4_kernels scalar_kernels = { instruction_set::scalar, mul_scalar, mul_batch_scalar, transpose_scalar, inverse_scalar };
+		static const float4x4_kernels sse4_kernels = { instruction_set::sse4, mul_sse4, mul_batch_sse4, transpose_sse4, inverse_sse4 };
+		static const float4x4_kernels avx2_kernels = { instruction_set::avx2, mul_avx2, mul_batch_avx2, transpose_sse4, inverse_sse4 };
+		static const float4x4_kernels avx512_kernels = { instruction_set::avx512, mul_avx512, mul_batch_avx512, transpose_sse4, inverse_sse4 };
+
+		const float4x4_kernels& get_kernels(instruction_set isa)
+		{
+			switch (isa)
+			{
+			case instruction_set::avx512: return avx512_kernels;
+			case instruction_set::avx2: return avx2_kernels;
+			case instruction_set::sse4: return sse4_kernels;
+			default:
+				break;
+			}
+			return scalar_kernels;
+		}
+
+		static const batch_kernels scalar_batch_kernels = { instruction_set::scalar, scalar_batch::transform_points, scalar_batch::combine, scalar_batch::to_float4x4, scalar_batch::normalize, scalar_batch::noise, scalar_batch::noise_derivatives, scalar_batch::fbm,
+			scalar_batch::normalize_quaternion, scalar_batch::mul_quaternion, scalar_batch::nlerp, scalar_batch::slerp, scalar_batch::hermite, scalar_batch::lerp, scalar_batch::blend, scalar_batch::difference, scalar_batch::add,
+			scalar_batch::skin_linear, scalar_batch::skin_dual_quaternion, scalar_batch::fabrik, scalar_batch::overlaps };
+		static const batch_kernels sse4_batch_kernels = { instruction_set::sse4, sse4_batch::transform_points, sse4_batch::combine, sse4_batch::to_float4x4, sse4_batch::normalize, sse4_batch::noise, sse4_batch::noise_derivatives, sse4_batch::fbm,
+			sse4_batch::normalize_quaternion, sse4_batch::mul_quaternion, sse4_batch::nlerp, sse4_batch::slerp, sse4_batch::hermite, sse4_batch::lerp, sse4_batch::blend, sse4_batch::difference, sse4_batch::add,
+			sse4_batch::skin_linear, sse4_batch::skin_dual_quaternion, sse4_batch::fabrik, sse4_batch::overlaps };
+		static const batch_kernels avx2_batch_kernels = { instruction_set::avx2, avx2_batch::transform_points, avx2_batch::combine, avx2_batch::to_float4x4, avx2_batch::normalize, avx2_batch::noise, avx2_batch::noise_derivatives, avx2_batch::fbm,
+			avx2_batch::normalize_quaternion, avx2_batch::mul_quaternion, avx2_batch::nlerp, avx2_batch::slerp, avx2_batch::hermite, avx2_batch::lerp, avx2_batch::blend, avx2_batch::difference, avx2_batch::add,
+			avx2_batch::skin_linear, avx2_batch::skin_dual_quaternion, avx2_batch::fabrik, avx2_batch::overlaps };
+		static const batch_kernels avx512_batch_kernels = { instruction_set::avx512, avx512_batch::transform_points, avx512_batch::combine, avx512_batch::to_float4x4, avx512_batch::normalize, avx512_batch::noise, avx512_batch::noise_derivatives, avx512_batch::fbm,
+			avx512_batch::normalize_quaternion, avx512_batch::mul_quaternion, avx512_batch::nlerp, avx512_batch::slerp, avx512_batch::hermite, avx512_batch::lerp, avx512_batch::blend, avx512_batch::difference, avx512_batch::add,
+			avx512_batch::skin_linear, avx512_batch::skin_dual_quaternion, avx512_batch::fabrik, avx512_batch::overlaps };
+
+		const batch_kernels& get_batch_kernels(instruction_set isa)
+		{
+			switch (isa)
+			{
+			case instruction_set::avx512: return avx512_batch_kernels;
+			case instruction_set::avx2: return avx2_batch_kernels;
+			case instruction_set::sse4: return sse4_batch_kernels;
+			default:
+				break;
+			}
+			return scalar_batch_kernels;
+		}
+
+		const float4x4_kernels* active_kernels = &scalar_kernels;
+		const batch_kernels* active_batch_kernels = &scalar_batch_kernels;
+
+		static struct kernel_selector
+		{
+			kernel_selector()
+			{
+				instruction_set isa = detect_instruction_set();
+				active_kernels = &get_kernels(isa);
+				active_batch_kernels = &get_batch_kernels(isa);
+			}
+		} selector;
+	}
+}
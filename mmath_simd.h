@@ -0,0 +1,304 @@
+#pragma once
+#include "mmath.h"
+
+//SIMD versions of the float4x4 operations in mmath.h.
+//The best kernel set the cpu (and os) supports is picked once at startup through cpuid,
+//the scalar functions in mmath.h stay the reference implementation and the fallback.
+namespace math
+{
+	namespace simd
+	{
+		enum class instruction_set
+		{
+			scalar,
+			sse4,
+			avx2,
+			avx512
+		};
+
+		struct float4x4_kernels
+		{
+			instruction_set isa;
+			void (*mul)(const float4x4& left, const float4x4& right, float4x4& out);
+			void (*mul_batch)(const float4x4* left, const float4x4* right, float4x4* out, size_t count);
+			void (*transpose)(const float4x4& m, float4x4& out);
+			bool (*inverse)(const float4x4& m, float4x4& out);
+		};
+
+		//Structure of arrays streams for the batch kernels, the pointers are plain columns
+		//so ecs component arrays or pose scratch buffers can be handed over directly. No alignment requirement.
+		struct float3_soa
+		{
+			float* x;
+			float* y;
+			float* z;
+
+			float3_soa offset(size_t i) const { return float3_soa{ x + i, y + i, z + i }; }
+		};
+
+		struct quaternion_soa
+		{
+			float* x;
+			float* y;
+			float* z;
+			float* w;
+
+			quaternion_soa offset(size_t i) const { return quaternion_soa{ x + i, y + i, z + i, w + i }; }
+		};
+
+		struct transform_soa
+		{
+			float3_soa position;
+			quaternion_soa rotation;
+			float3_soa scale;
+
+			transform_soa offset(size_t i) const { return transform_soa{ position.offset(i), rotation.offset(i), scale.offset(i) }; }
+		};
+
+		//chains of equal joint count for the fabrik kernel, one chain per lane.
+		//joint j of chain i is at [j * stride + i] in the per joint streams
+		struct fabrik_soa
+		{
+			float3_soa joints;
+			//distance from joint j to joint j - 1, j = 0 unused
+			float* lengths;
+			//bone j (joint j to j + 1) is kept in the plane normal to the axis, zero for no hinge
+			float3_soa hinge_axes;
+			//cos of the largest angle between bone j and the bone before it, -1 for no limit
+			float* cone_cos;
+			//per chain: direction of the bone before joint 0, what the cone of bone 0 is around
+			float3_soa reference;
+			float3_soa targets;
+			//per chain: distance between the end effector and the target after solving
+			float* error;
+			size_t stride;
+
+			fabrik_soa offset(size_t i) const
+			{
+				return fabrik_soa{ joints.offset(i), lengths + i, hinge_axes.offset(i), cone_cos + i,
+					reference.offset(i), targets.offset(i), error + i, stride };
+			}
+		};
+
+		struct aabb_soa
+		{
+			float3_soa lower;
+			float3_soa upper;
+
+			aabb_soa offset(size_t i) const { return aabb_soa{ lower.offset(i), upper.offset(i) }; }
+		};
+
+		//skinned vertex streams, 4 influences per vertex: palette index and weight
+		struct skinning_soa
+		{
+			float3_soa position;
+			float3_soa normal;
+			int* joints[4];
+			float* weights[4];
+
+			skinning_soa offset(size_t i) const
+			{
+				return skinning_soa{ position.offset(i), normal.offset(i),
+					{ joints[0] + i, joints[1] + i, joints[2] + i, joints[3] + i },
+					{ weights[0] + i, weights[1] + i, weights[2] + i, weights[3] + i } };
+			}
+		};
+
+		//4 (sse4), 8 (avx2) or 16 (avx512) elements per iteration, the remainder goes through the next narrower set.
+		//in and out may be the same stream.
+		struct batch_kernels
+		{
+			instruction_set isa;
+			//out[i] = m * (in[i], 1)
+			void (*transform_points)(const float4x4& m, const float3_soa& in, const float3_soa& out, size_t count);
+			//out[i] = math::combine(parent[i], local[i])
+			void (*combine)(const transform_soa& parent, const transform_soa& local, const transform_soa& out, size_t count);
+			//math::to_float4x4(in[i], out[i])
+			void (*to_float4x4)(const transform_soa& in, float4x4* out, size_t count);
+			//out[i] = math::normalize(in[i])
+			void (*normalize)(const float3_soa& in, const float3_soa& out, size_t count);
+			//out[i] = math::improved_noise::noise(in[i])
+			void (*noise)(const float3_soa& in, float* out, size_t count);
+			//noise plus its analytic gradient, for normals and domain warping without extra samples
+			void (*noise_derivatives)(const float3_soa& in, float* out, const float3_soa& out_derivatives, size_t count);
+			//fractal sum of octaves of noise normalized to [-1, 1], all octaves of a block in one pass
+			void (*fbm)(const float3_soa& in, float* out, size_t count, int octaves, float frequency, float persistence);
+			//out[i] = math::normalize(in[i])
+			void (*normalize_quaternion)(const quaternion_soa& in, const quaternion_soa& out, size_t count);
+			//out[i] = a[i] * b[i]
+			void (*mul_quaternion)(const quaternion_soa& a, const quaternion_soa& b, const quaternion_soa& out, size_t count);
+			//out[i] = math::nlerp(from[i], to[i], t)
+			void (*nlerp)(const quaternion_soa& from, const quaternion_soa& to, float t, const quaternion_soa& out, size_t count);
+			//out[i] = math::slerp<precision_fast>(from[i], to[i], t)
+			void (*slerp)(const quaternion_soa& from, const quaternion_soa& to, float t, const quaternion_soa& out, size_t count);
+			//quaternion_track::hermite for every lane, s1 and s2 already scaled by the frame delta
+			void (*hermite)(const quaternion_soa& p1, const quaternion_soa& s1, const quaternion_soa& p2, const quaternion_soa& s2,
+				float t, const quaternion_soa& out, size_t count);
+			//out[i] = a[i] + (b[i] - a[i]) * t over plain float streams
+			void (*lerp)(const float* a, const float* b, float t, float* out, size_t count);
+			//position and scale lerp, rotation nlerp from a[i] to b[i] by weights[i]
+			void (*blend)(const transform_soa& a, const transform_soa& b, const float* weights, const transform_soa& out, size_t count);
+			//additive layer from a[i] and the reference pose it was authored against, rotation is inverse(reference) * a
+			void (*difference)(const transform_soa& a, const transform_soa& reference, const transform_soa& out, size_t count);
+			//additive layer: base[i] plus difference[i] scaled by weights[i], rotation is base * nlerp(identity, difference, weight)
+			void (*add)(const transform_soa& base, const transform_soa& difference, const float* weights, const transform_soa& out, size_t count);
+			//linear blend skinning of positions and normals, palette indexed by in.joints
+			void (*skin_linear)(const skinning_soa& in, const float4x4* palette, const float3_soa& out_position, const float3_soa& out_normal, size_t count);
+			//dual quaternion skinning, palette from math::to_dual_quaternion. Rigid palettes only
+			void (*skin_dual_quaternion)(const skinning_soa& in, const dual_quaternion* palette, const float3_soa& out_position, const float3_soa& out_normal, size_t count);
+			//fabrik with hinge / cone constraints on the root to tip pass. Joint 0 stays in place, a block stops iterating
+			//once every chain is within tolerance of its target or stopped getting closer
+			void (*fabrik)(const fabrik_soa& chains, size_t count, int joint_count, int max_iterations, float tolerance);
+			//writes the indices of the boxes overlapping [lower, upper] to out in increasing order, returns how many.
+			//out has room for count indices
+			size_t (*overlaps)(const aabb_soa& boxes, const float3& lower, const float3& upper, uint32_t* out, size_t count);
+		};
+
+		instruction_set detect_instruction_set();
+
+		//returns the kernels for isa, or the closest lower set this build has kernels for
+		const float4x4_kernels& get_kernels(instruction_set isa);
+
+		const batch_kernels& get_batch_kernels(instruction_set isa);
+
+		//selected during static initialization, starts out pointing at the scalar kernels
+		extern const float4x4_kernels* active_kernels;
+		extern const batch_kernels* active_batch_kernels;
+
+		inline const char* to_string(instruction_set isa)
+		{
+			switch (isa)
+			{
+			case instruction_set::scalar: return "scalar";
+			case instruction_set::sse4: return "sse4";
+			case instruction_set::avx2: return "avx2";
+			case instruction_set::avx512: return "avx512";
+			default:
+				break;
+			}
+			return "unknown";
+		}
+
+		inline void mul(const float4x4& left, const float4x4& right, float4x4& out)
+		{
+			active_kernels->mul(left, right, out);
+		}
+
+		//out[i] = left[i] * right[i], out may alias left or right
+		inline void mul_batch(const float4x4* left, const float4x4* right, float4x4* out, size_t count)
+		{
+			active_kernels->mul_batch(left, right, out, count);
+		}
+
+		inline void transpose(const float4x4& m, float4x4& out)
+		{
+			active_kernels->transpose(m, out);
+		}
+
+		inline bool inverse_matrix(const float4x4& m, float4x4& out)
+		{
+			return active_kernels->inverse(m, out);
+		}
+
+		inline void transform_points(const float4x4& m, const float3_soa& in, const float3_soa& out, size_t count)
+		{
+			active_batch_kernels->transform_points(m, in, out, count);
+		}
+
+		inline void combine(const transform_soa& parent, const transform_soa& local, const transform_soa& out, size_t count)
+		{
+			active_batch_kernels->combine(parent, local, out, count);
+		}
+
+		inline void to_float4x4(const transform_soa& in, float4x4* out, size_t count)
+		{
+			active_batch_kernels->to_float4x4(in, out, count);
+		}
+
+		inline void normalize(const float3_soa& in, const float3_soa& out, size_t count)
+		{
+			active_batch_kernels->normalize(in, out, count);
+		}
+
+		inline void noise(const float3_soa& in, float* out, size_t count)
+		{
+			active_batch_kernels->noise(in, out, count);
+		}
+
+		inline void noise_derivatives(const float3_soa& in, float* out, const float3_soa& out_derivatives, size_t count)
+		{
+			active_batch_kernels->noise_derivatives(in, out, out_derivatives, count);
+		}
+
+		inline void fbm(const float3_soa& in, float* out, size_t count, int octaves, float frequency, float persistence)
+		{
+			active_batch_kernels->fbm(in, out, count, octaves, frequency, persistence);
+		}
+
+		inline void normalize(const quaternion_soa& in, const quaternion_soa& out, size_t count)
+		{
+			active_batch_kernels->normalize_quaternion(in, out, count);
+		}
+
+		inline void mul(const quaternion_soa& a, const quaternion_soa& b, const quaternion_soa& out, size_t count)
+		{
+			active_batch_kernels->mul_quaternion(a, b, out, count);
+		}
+
+		inline void nlerp(const quaternion_soa& from, const quaternion_soa& to, float t, const quaternion_soa& out, size_t count)
+		{
+			active_batch_kernels->nlerp(from, to, t, out, count);
+		}
+
+		inline void slerp(const quaternion_soa& from, const quaternion_soa& to, float t, const quaternion_soa& out, size_t count)
+		{
+			active_batch_kernels->slerp(from, to, t, out, count);
+		}
+
+		inline void hermite(const quaternion_soa& p1, const quaternion_soa& s1, const quaternion_soa& p2, const quaternion_soa& s2,
+			float t, const quaternion_soa& out, size_t count)
+		{
+			active_batch_kernels->hermite(p1, s1, p2, s2, t, out, count);
+		}
+
+		inline void lerp(const float* a, const float* b, float t, float* out, size_t count)
+		{
+			active_batch_kernels->lerp(a, b, t, out, count);
+		}
+
+		inline void blend(const transform_soa& a, const transform_soa& b, const float* weights, const transform_soa& out, size_t count)
+		{
+			active_batch_kernels->blend(a, b, weights, out, count);
+		}
+
+		inline void difference(const transform_soa& a, const transform_soa& reference, const transform_soa& out, size_t count)
+		{
+			active_batch_kernels->difference(a, reference, out, count);
+		}
+
+		inline void add(const transform_soa& base, const transform_soa& difference, const float* weights, const transform_soa& out, size_t count)
+		{
+			active_batch_kernels->add(base, difference, weights, out, count);
+		}
+
+		inline void skin_linear(const skinning_soa& in, const float4x4* palette, const float3_soa& out_position, const float3_soa& out_normal, size_t count)
+		{
+			active_batch_kernels->skin_linear(in, palette, out_position, out_normal, count);
+		}
+
+		inline void skin_dual_quaternion(const skinning_soa& in, const dual_quaternion* palette, const float3_soa& out_position, const float3_soa& out_normal, size_t count)
+		{
+			active_batch_kernels->skin_dual_quaternion(in, palette, out_position, out_normal, count);
+		}
+
+		inline void fabrik(const fabrik_soa& chains, size_t count, int joint_count, int max_iterations, float tolerance)
+		{
+			active_batch_kernels->fabrik(chains, count, joint_count, max_iterations, tolerance);
+		}
+
+		inline size_t overlaps(const aabb_soa& boxes, const float3& lower, const float3& upper, uint32_t* out, size_t count)
+		{
+			return active_batch_kernels->overlaps(boxes, lower, upper, out, count);
+		}
+	}
+}
@@ -0,0 +1,967 @@
+//Batch SoA kernels, included once per instruction set by mmath_simd.cpp.
+//The including namespace provides `lanes` (register type + ops) and `tail`, the namespace that handles the remainder
+//of a stream that doesn't fill a whole register. No include guard on purpose.
+
+static void transform_points(const float4x4& m, const float3_soa& in, const float3_soa& out, size_t count)
+{
+	typedef lanes::reg reg;
+	const reg m0 = lanes::set1(m[0]), m1 = lanes::set1(m[1]), m2 = lanes::set1(m[2]);
+	const reg m4 = lanes::set1(m[4]), m5 = lanes::set1(m[5]), m6 = lanes::set1(m[6]);
+	const reg m8 = lanes::set1(m[8]), m9 = lanes::set1(m[9]), m10 = lanes::set1(m[10]);
+	const reg m12 = lanes::set1(m[12]), m13 = lanes::set1(m[13]), m14 = lanes::set1(m[14]);
+
+	size_t i = 0;
+	for (; i + lanes::width <= count; i += lanes::width)
+	{
+		reg x = lanes::load(in.x + i);
+		reg y = lanes::load(in.y + i);
+		reg z = lanes::load(in.z + i);
+		reg rx = lanes::fmadd(m8, z, lanes::fmadd(m4, y, lanes::fmadd(m0, x, m12)));
+		reg ry = lanes::fmadd(m9, z, lanes::fmadd(m5, y, lanes::fmadd(m1, x, m13)));
+		reg rz = lanes::fmadd(m10, z, lanes::fmadd(m6, y, lanes::fmadd(m2, x, m14)));
+		lanes::store(out.x + i, rx);
+		lanes::store(out.y + i, ry);
+		lanes::store(out.z + i, rz);
+	}
+	if (i < count)
+	{
+		tail::transform_points(m, in.offset(i), out.offset(i), count - i);
+	}
+}
+
+static void normalize(const float3_soa& in, const float3_soa& out, size_t count)
+{
+	typedef lanes::reg reg;
+	const reg one = lanes::set1(1.0f);
+
+	size_t i = 0;
+	for (; i + lanes::width <= count; i += lanes::width)
+	{
+		reg x = lanes::load(in.x + i);
+		reg y = lanes::load(in.y + i);
+		reg z = lanes::load(in.z + i);
+		reg len_sq = lanes::fmadd(z, z, lanes::fmadd(y, y, lanes::mul(x, x)));
+		reg inv_len = lanes::div(one, lanes::sqrt(len_sq));
+		lanes::store(out.x + i, lanes::mul(x, inv_len));
+		lanes::store(out.y + i, lanes::mul(y, inv_len));
+		lanes::store(out.z + i, lanes::mul(z, inv_len));
+	}
+	if (i < count)
+	{
+		tail::normalize(in.offset(i), out.offset(i), count - i);
+	}
+}
+
+//same math as math::combine(parent, local)
+static void combine(const transform_soa& parent, const transform_soa& local, const transform_soa& out, size_t count)
+{
+	typedef lanes::reg reg;
+	const reg two = lanes::set1(2.0f);
+
+	size_t i = 0;
+	for (; i + lanes::width <= count; i += lanes::width)
+	{
+		reg psx = lanes::load(parent.scale.x + i), psy = lanes::load(parent.scale.y + i), psz = lanes::load(parent.scale.z + i);
+		reg lsx = lanes::load(local.scale.x + i), lsy = lanes::load(local.scale.y + i), lsz = lanes::load(local.scale.z + i);
+		lanes::store(out.scale.x + i, lanes::mul(psx, lsx));
+		lanes::store(out.scale.y + i, lanes::mul(psy, lsy));
+		lanes::store(out.scale.z + i, lanes::mul(psz, lsz));
+
+		//q1 = local rotation, q2 = parent rotation, out = q1 * q2
+		reg ax = lanes::load(parent.rotation.x + i), ay = lanes::load(parent.rotation.y + i);
+		reg az = lanes::load(parent.rotation.z + i), aw = lanes::load(parent.rotation.w + i);
+		reg bx = lanes::load(local.rotation.x + i), by = lanes::load(local.rotation.y + i);
+		reg bz = lanes::load(local.rotation.z + i), bw = lanes::load(local.rotation.w + i);
+
+		reg rx = lanes::add(lanes::sub(lanes::add(lanes::mul(ax, bw), lanes::mul(ay, bz)), lanes::mul(az, by)), lanes::mul(aw, bx));
+		reg ry = lanes::add(lanes::add(lanes::sub(lanes::mul(ay, bw), lanes::mul(ax, bz)), lanes::mul(az, bx)), lanes::mul(aw, by));
+		reg rz = lanes::add(lanes::add(lanes::sub(lanes::mul(ax, by), lanes::mul(ay, bx)), lanes::mul(az, bw)), lanes::mul(aw, bz));
+		reg rw = lanes::sub(lanes::sub(lanes::sub(lanes::mul(aw, bw), lanes::mul(ax, bx)), lanes::mul(ay, by)), lanes::mul(az, bz));
+		lanes::store(out.rotation.x + i, rx);
+		lanes::store(out.rotation.y + i, ry);
+		lanes::store(out.rotation.z + i, rz);
+		lanes::store(out.rotation.w + i, rw);
+
+		//parent.position + parent.rotation * (parent.scale * local.position)
+		reg vx = lanes::mul(psx, lanes::load(local.position.x + i));
+		reg vy = lanes::mul(psy, lanes::load(local.position.y + i));
+		reg vz = lanes::mul(psz, lanes::load(local.position.z + i));
+
+		reg qv_dot_v = lanes::fmadd(az, vz, lanes::fmadd(ay, vy, lanes::mul(ax, vx)));
+		reg qv_dot_qv = lanes::fmadd(az, az, lanes::fmadd(ay, ay, lanes::mul(ax, ax)));
+		reg k0 = lanes::mul(two, qv_dot_v);
+		reg k1 = lanes::sub(lanes::mul(aw, aw), qv_dot_qv);
+		reg k2 = lanes::mul(two, aw);
+		reg cx = lanes::sub(lanes::mul(ay, vz), lanes::mul(az, vy));
+		reg cy = lanes::sub(lanes::mul(az, vx), lanes::mul(ax, vz));
+		reg cz = lanes::sub(lanes::mul(ax, vy), lanes::mul(ay, vx));
+
+		reg px = lanes::fmadd(cx, k2, lanes::fmadd(vx, k1, lanes::mul(ax, k0)));
+		reg py = lanes::fmadd(cy, k2, lanes::fmadd(vy, k1, lanes::mul(ay, k0)));
+		reg pz = lanes::fmadd(cz, k2, lanes::fmadd(vz, k1, lanes::mul(az, k0)));
+		lanes::store(out.position.x + i, lanes::add(lanes::load(parent.position.x + i), px));
+		lanes::store(out.position.y + i, lanes::add(lanes::load(parent.position.y + i), py));
+		lanes::store(out.position.z + i, lanes::add(lanes::load(parent.position.z + i), pz));
+	}
+	if (i < count)
+	{
+		tail::combine(parent.offset(i), local.offset(i), out.offset(i), count - i);
+	}
+}
+
+//same math as math::to_float4x4(transform), the matrices come out AoS ready for upload
+static void to_float4x4(const transform_soa& in, float4x4* out, size_t count)
+{
+	typedef lanes::reg reg;
+	const reg two = lanes::set1(2.0f);
+
+	size_t i = 0;
+	for (; i + lanes::width <= count; i += lanes::width)
+	{
+		reg qx = lanes::load(in.rotation.x + i), qy = lanes::load(in.rotation.y + i);
+		reg qz = lanes::load(in.rotation.z + i), qw = lanes::load(in.rotation.w + i);
+		reg sx = lanes::load(in.scale.x + i), sy = lanes::load(in.scale.y + i), sz = lanes::load(in.scale.z + i);
+
+		reg diag = lanes::sub(lanes::mul(qw, qw), lanes::fmadd(qz, qz, lanes::fmadd(qy, qy, lanes::mul(qx, qx))));
+		reg x2 = lanes::mul(two, qx), y2 = lanes::mul(two, qy), w2 = lanes::mul(two, qw);
+		reg xx = lanes::mul(x2, qx), yy = lanes::mul(y2, qy), zz = lanes::mul(lanes::mul(two, qz), qz);
+		reg xy = lanes::mul(x2, qy), xz = lanes::mul(x2, qz), yz = lanes::mul(y2, qz);
+		reg wx = lanes::mul(w2, qx), wy = lanes::mul(w2, qy), wz = lanes::mul(w2, qz);
+
+		alignas(64) float m[12][lanes::width];
+		lanes::store(m[0], lanes::mul(lanes::add(xx, diag), sx));
+		lanes::store(m[1], lanes::mul(lanes::add(xy, wz), sx));
+		lanes::store(m[2], lanes::mul(lanes::sub(xz, wy), sx));
+		lanes::store(m[3], lanes::mul(lanes::sub(xy, wz), sy));
+		lanes::store(m[4], lanes::mul(lanes::add(yy, diag), sy));
+		lanes::store(m[5], lanes::mul(lanes::add(yz, wx), sy));
+		lanes::store(m[6], lanes::mul(lanes::add(xz, wy), sz));
+		lanes::store(m[7], lanes::mul(lanes::sub(yz, wx), sz));
+		lanes::store(m[8], lanes::mul(lanes::add(zz, diag), sz));
+		lanes::store(m[9], lanes::load(in.position.x + i));
+		lanes::store(m[10], lanes::load(in.position.y + i));
+		lanes::store(m[11], lanes::load(in.position.z + i));
+
+		for (int l = 0; l < lanes::width; l++)
+		{
+			float4x4& o = out[i + l];
+			o[0] = m[0][l]; o[1] = m[1][l]; o[2] = m[2][l]; o[3] = 0.0f;
+			o[4] = m[3][l]; o[5] = m[4][l]; o[6] = m[5][l]; o[7] = 0.0f;
+			o[8] = m[6][l]; o[9] = m[7][l]; o[10] = m[8][l]; o[11] = 0.0f;
+			o[12] = m[9][l]; o[13] = m[10][l]; o[14] = m[11][l]; o[15] = 1.0f;
+		}
+	}
+	if (i < count)
+	{
+		tail::to_float4x4(in.offset(i), out + i, count - i);
+	}
+}
+
+//improved noise, same lattice and gradients as math::improved_noise but 4/8/16 points at a time.
+//the corner gradients are built as vectors (instead of the branchy grad()) so the same code also yields derivatives.
+static inline void noise_gradient(lanes::ireg hash, lanes::reg& gx, lanes::reg& gy, lanes::reg& gz)
+{
+	typedef lanes::reg reg;
+	const reg zero = lanes::set1(0.0f);
+	lanes::ireg h = lanes::iand(hash, 15);
+	lanes::mask u_is_x = lanes::ilt(h, 8);
+	lanes::mask v_is_y = lanes::ilt(h, 4);
+	lanes::mask v_is_x = lanes::mask_or(lanes::ieq(h, 12), lanes::ieq(h, 14));
+	reg su = lanes::select(lanes::itest(h, 1), lanes::set1(-1.0f), lanes::set1(1.0f));
+	reg sv = lanes::select(lanes::itest(h, 2), lanes::set1(-1.0f), lanes::set1(1.0f));
+	gx = lanes::add(lanes::select(u_is_x, su, zero), lanes::select(v_is_x, sv, zero));
+	gy = lanes::add(lanes::select(u_is_x, zero, su), lanes::select(v_is_y, sv, zero));
+	gz = lanes::select(v_is_y, zero, lanes::select(v_is_x, zero, sv));
+}
+
+//value and, when d is not null, the analytic gradient d[0..2]
+static inline void noise_block(lanes::reg x, lanes::reg y, lanes::reg z, lanes::reg& value, lanes::reg* d)
+{
+	typedef lanes::reg reg;
+	typedef lanes::ireg ireg;
+	const int* p = math::improved_noise::p.data();
+	const reg one = lanes::set1(1.0f);
+
+	reg fx = lanes::floor(x), fy = lanes::floor(y), fz = lanes::floor(z);
+	ireg ix = lanes::iand(lanes::to_int(fx), 255);
+	ireg iy = lanes::iand(lanes::to_int(fy), 255);
+	ireg iz = lanes::iand(lanes::to_int(fz), 255);
+	x = lanes::sub(x, fx);
+	y = lanes::sub(y, fy);
+	z = lanes::sub(z, fz);
+
+	//fade t^3 (t (6t - 15) + 10) and its derivative 30 t^2 (t - 1)^2
+	reg u = lanes::mul(lanes::mul(lanes::mul(x, x), x), lanes::fmadd(x, lanes::fmadd(x, lanes::set1(6.0f), lanes::set1(-15.0f)), lanes::set1(10.0f)));
+	reg v = lanes::mul(lanes::mul(lanes::mul(y, y), y), lanes::fmadd(y, lanes::fmadd(y, lanes::set1(6.0f), lanes::set1(-15.0f)), lanes::set1(10.0f)));
+	reg w = lanes::mul(lanes::mul(lanes::mul(z, z), z), lanes::fmadd(z, lanes::fmadd(z, lanes::set1(6.0f), lanes::set1(-15.0f)), lanes::set1(10.0f)));
+
+	ireg a = lanes::iadd(lanes::gather(p, ix), iy);
+	ireg aa = lanes::iadd(lanes::gather(p, a), iz);
+	ireg ab = lanes::iadd(lanes::gather(p, lanes::iadd(a, lanes::iset1(1))), iz);
+	ireg b = lanes::iadd(lanes::gather(p, lanes::iadd(ix, lanes::iset1(1))), iy);
+	ireg ba = lanes::iadd(lanes::gather(p, b), iz);
+	ireg bb = lanes::iadd(lanes::gather(p, lanes::iadd(b, lanes::iset1(1))), iz);
+
+	const ireg i1 = lanes::iset1(1);
+	ireg hashes[8] = {
+		lanes::gather(p, aa), lanes::gather(p, ba), lanes::gather(p, ab), lanes::gather(p, bb),
+		lanes::gather(p, lanes::iadd(aa, i1)), lanes::gather(p, lanes::iadd(ba, i1)), lanes::gather(p, lanes::iadd(ab, i1)), lanes::gather(p, lanes::iadd(bb, i1))
+	};
+
+	reg x1 = lanes::sub(x, one), y1 = lanes::sub(y, one), z1 = lanes::sub(z, one);
+	reg gx[8], gy[8], gz[8], n[8];
+	for (int c = 0; c < 8; c++)
+	{
+		noise_gradient(hashes[c], gx[c], gy[c], gz[c]);
+		reg dx = (c & 1) ? x1 : x;
+		reg dy = (c & 2) ? y1 : y;
+		reg dz = (c & 4) ? z1 : z;
+		n[c] = lanes::fmadd(gz[c], dz, lanes::fmadd(gy[c], dy, lanes::mul(gx[c], dx)));
+	}
+
+	//n = k0 + k1 u + k2 v + k3 w + k4 uv + k5 vw + k6 wu + k7 uvw
+	reg k0 = n[0];
+	reg k1 = lanes::sub(n[1], n[0]);
+	reg k2 = lanes::sub(n[2], n[0]);
+	reg k3 = lanes::sub(n[4], n[0]);
+	reg k4 = lanes::sub(lanes::sub(lanes::add(n[0], n[3]), n[1]), n[2]);
+	reg k5 = lanes::sub(lanes::sub(lanes::add(n[0], n[6]), n[2]), n[4]);
+	reg k6 = lanes::sub(lanes::sub(lanes::add(n[0], n[5]), n[1]), n[4]);
+	reg k7 = lanes::sub(lanes::sub(lanes::add(lanes::add(n[1], n[2]), lanes::add(n[4], n[7])), lanes::add(n[0], n[3])), lanes::add(n[5], n[6]));
+
+	reg uv = lanes::mul(u, v), vw = lanes::mul(v, w), wu = lanes::mul(w, u);
+	value = lanes::fmadd(k7, lanes::mul(uv, w), lanes::fmadd(k6, wu, lanes::fmadd(k5, vw, lanes::fmadd(k4, uv,
+		lanes::fmadd(k3, w, lanes::fmadd(k2, v, lanes::fmadd(k1, u, k0)))))));
+
+	if (d)
+	{
+		const reg thirty = lanes::set1(30.0f);
+		reg du = lanes::mul(lanes::mul(thirty, lanes::mul(x, x)), lanes::mul(x1, x1));
+		reg dv = lanes::mul(lanes::mul(thirty, lanes::mul(y, y)), lanes::mul(y1, y1));
+		reg dw = lanes::mul(lanes::mul(thirty, lanes::mul(z, z)), lanes::mul(z1, z1));
+
+		//the corner values change with the position too, that part is the trilinear blend of the gradients
+		reg g[3];
+		reg* comps[3] = { gx, gy, gz };
+		for (int axis = 0; axis < 3; axis++)
+		{
+			reg* c = comps[axis];
+			reg x00 = lanes::fmadd(u, lanes::sub(c[1], c[0]), c[0]);
+			reg x10 = lanes::fmadd(u, lanes::sub(c[3], c[2]), c[2]);
+			reg x01 = lanes::fmadd(u, lanes::sub(c[5], c[4]), c[4]);
+			reg x11 = lanes::fmadd(u, lanes::sub(c[7], c[6]), c[6]);
+			reg y0 = lanes::fmadd(v, lanes::sub(x10, x00), x00);
+			reg y1v = lanes::fmadd(v, lanes::sub(x11, x01), x01);
+			g[axis] = lanes::fmadd(w, lanes::sub(y1v, y0), y0);
+		}
+
+		d[0] = lanes::fmadd(du, lanes::fmadd(k7, vw, lanes::fmadd(k6, w, lanes::fmadd(k4, v, k1))), g[0]);
+		d[1] = lanes::fmadd(dv, lanes::fmadd(k7, wu, lanes::fmadd(k5, w, lanes::fmadd(k4, u, k2))), g[1]);
+		d[2] = lanes::fmadd(dw, lanes::fmadd(k7, uv, lanes::fmadd(k6, u, lanes::fmadd(k5, v, k3))), g[2]);
+	}
+}
+
+static void noise(const float3_soa& in, float* out, size_t count)
+{
+	size_t i = 0;
+	for (; i + lanes::width <= count; i += lanes::width)
+	{
+		lanes::reg value;
+		noise_block(lanes::load(in.x + i), lanes::load(in.y + i), lanes::load(in.z + i), value, nullptr);
+		lanes::store(out + i, value);
+	}
+	if (i < count)
+	{
+		tail::noise(in.offset(i), out + i, count - i);
+	}
+}
+
+static void noise_derivatives(const float3_soa& in, float* out, const float3_soa& out_derivatives, size_t count)
+{
+	size_t i = 0;
+	for (; i + lanes::width <= count; i += lanes::width)
+	{
+		lanes::reg value;
+		lanes::reg d[3];
+		noise_block(lanes::load(in.x + i), lanes::load(in.y + i), lanes::load(in.z + i), value, d);
+		lanes::store(out + i, value);
+		lanes::store(out_derivatives.x + i, d[0]);
+		lanes::store(out_derivatives.y + i, d[1]);
+		lanes::store(out_derivatives.z + i, d[2]);
+	}
+	if (i < count)
+	{
+		tail::noise_derivatives(in.offset(i), out + i, out_derivatives.offset(i), count - i);
+	}
+}
+
+//every octave of a block is evaluated while the positions are still in registers
+static void fbm(const float3_soa& in, float* out, size_t count, int octaves, float frequency, float persistence)
+{
+	typedef lanes::reg reg;
+	float max_amplitude = 0.0f;
+	float amplitude = 1.0f;
+	for (int o = 0; o < octaves; o++)
+	{
+		max_amplitude += amplitude;
+		amplitude *= persistence;
+	}
+	const reg inv_max_amplitude = lanes::set1(1.0f / max_amplitude);
+
+	size_t i = 0;
+	for (; i + lanes::width <= count; i += lanes::width)
+	{
+		reg x = lanes::load(in.x + i), y = lanes::load(in.y + i), z = lanes::load(in.z + i);
+		reg total = lanes::set1(0.0f);
+		float f = frequency;
+		float a = 1.0f;
+		for (int o = 0; o < octaves; o++)
+		{
+			reg fr = lanes::set1(f);
+			reg value;
+			noise_block(lanes::mul(x, fr), lanes::mul(y, fr), lanes::mul(z, fr), value, nullptr);
+			total = lanes::fmadd(value, lanes::set1(a), total);
+			f *= 2.0f;
+			a *= persistence;
+		}
+		lanes::store(out + i, lanes::mul(total, inv_max_amplitude));
+	}
+	if (i < count)
+	{
+		tail::fbm(in.offset(i), out + i, count - i, octaves, frequency, persistence);
+	}
+}
+
+//quaternions, one joint per lane
+
+static inline void normalize_quaternion_block(lanes::reg& x, lanes::reg& y, lanes::reg& z, lanes::reg& w)
+{
+	typedef lanes::reg reg;
+	reg len_sq = lanes::fmadd(w, w, lanes::fmadd(z, z, lanes::fmadd(y, y, lanes::mul(x, x))));
+	//same as math::normalize, degenerate quaternions become the identity
+	lanes::mask degenerate = lanes::lt(len_sq, lanes::set1(math::epsilon));
+	reg inv_len = lanes::div(lanes::set1(1.0f), lanes::sqrt(len_sq));
+	const reg zero = lanes::set1(0.0f);
+	x = lanes::select(degenerate, zero, lanes::mul(x, inv_len));
+	y = lanes::select(degenerate, zero, lanes::mul(y, inv_len));
+	z = lanes::select(degenerate, zero, lanes::mul(z, inv_len));
+	w = lanes::select(degenerate, lanes::set1(1.0f), lanes::mul(w, inv_len));
+}
+
+//flips b where it is in the other hemisphere from a, returns |dot(a, b)|
+static inline lanes::reg neighborhood(lanes::reg ax, lanes::reg ay, lanes::reg az, lanes::reg aw,
+	lanes::reg& bx, lanes::reg& by, lanes::reg& bz, lanes::reg& bw)
+{
+	typedef lanes::reg reg;
+	const reg zero = lanes::set1(0.0f);
+	reg d = lanes::fmadd(aw, bw, lanes::fmadd(az, bz, lanes::fmadd(ay, by, lanes::mul(ax, bx))));
+	lanes::mask flip = lanes::lt(d, zero);
+	bx = lanes::select(flip, lanes::sub(zero, bx), bx);
+	by = lanes::select(flip, lanes::sub(zero, by), by);
+	bz = lanes::select(flip, lanes::sub(zero, bz), bz);
+	bw = lanes::select(flip, lanes::sub(zero, bw), bw);
+	return lanes::select(flip, lanes::sub(zero, d), d);
+}
+
+static void normalize_quaternion(const quaternion_soa& in, const quaternion_soa& out, size_t count)
+{
+	size_t i = 0;
+	for (; i + lanes::width <= count; i += lanes::width)
+	{
+		lanes::reg x = lanes::load(in.x + i), y = lanes::load(in.y + i), z = lanes::load(in.z + i), w = lanes::load(in.w + i);
+		normalize_quaternion_block(x, y, z, w);
+		lanes::store(out.x + i, x);
+		lanes::store(out.y + i, y);
+		lanes::store(out.z + i, z);
+		lanes::store(out.w + i, w);
+	}
+	if (i < count)
+	{
+		tail::normalize_quaternion(in.offset(i), out.offset(i), count - i);
+	}
+}
+
+static inline void mul_quaternion_block(lanes::reg ax, lanes::reg ay, lanes::reg az, lanes::reg aw,
+	lanes::reg bx, lanes::reg by, lanes::reg bz, lanes::reg bw,
+	lanes::reg& rx, lanes::reg& ry, lanes::reg& rz, lanes::reg& rw)
+{
+	rx = lanes::add(lanes::sub(lanes::add(lanes::mul(bx, aw), lanes::mul(by, az)), lanes::mul(bz, ay)), lanes::mul(bw, ax));
+	ry = lanes::add(lanes::add(lanes::sub(lanes::mul(by, aw), lanes::mul(bx, az)), lanes::mul(bz, ax)), lanes::mul(bw, ay));
+	rz = lanes::add(lanes::add(lanes::sub(lanes::mul(bx, ay), lanes::mul(by, ax)), lanes::mul(bz, aw)), lanes::mul(bw, az));
+	rw = lanes::sub(lanes::sub(lanes::sub(lanes::mul(bw, aw), lanes::mul(bx, ax)), lanes::mul(by, ay)), lanes::mul(bz, az));
+}
+
+//same as a[i] * b[i] in mmath.h
+static void mul_quaternion(const quaternion_soa& a, const quaternion_soa& b, const quaternion_soa& out, size_t count)
+{
+	typedef lanes::reg reg;
+	size_t i = 0;
+	for (; i + lanes::width <= count; i += lanes::width)
+	{
+		reg ax = lanes::load(a.x + i), ay = lanes::load(a.y + i), az = lanes::load(a.z + i), aw = lanes::load(a.w + i);
+		reg bx = lanes::load(b.x + i), by = lanes::load(b.y + i), bz = lanes::load(b.z + i), bw = lanes::load(b.w + i);
+		reg rx, ry, rz, rw;
+		mul_quaternion_block(ax, ay, az, aw, bx, by, bz, bw, rx, ry, rz, rw);
+		lanes::store(out.x + i, rx);
+		lanes::store(out.y + i, ry);
+		lanes::store(out.z + i, rz);
+		lanes::store(out.w + i, rw);
+	}
+	if (i < count)
+	{
+		tail::mul_quaternion(a.offset(i), b.offset(i), out.offset(i), count - i);
+	}
+}
+
+//same as math::nlerp
+static void nlerp(const quaternion_soa& from, const quaternion_soa& to, float t, const quaternion_soa& out, size_t count)
+{
+	typedef lanes::reg reg;
+	const reg vt = lanes::set1(t);
+	size_t i = 0;
+	for (; i + lanes::width <= count; i += lanes::width)
+	{
+		reg ax = lanes::load(from.x + i), ay = lanes::load(from.y + i), az = lanes::load(from.z + i), aw = lanes::load(from.w + i);
+		reg bx = lanes::load(to.x + i), by = lanes::load(to.y + i), bz = lanes::load(to.z + i), bw = lanes::load(to.w + i);
+		neighborhood(ax, ay, az, aw, bx, by, bz, bw);
+		reg x = lanes::fmadd(vt, lanes::sub(bx, ax), ax);
+		reg y = lanes::fmadd(vt, lanes::sub(by, ay), ay);
+		reg z = lanes::fmadd(vt, lanes::sub(bz, az), az);
+		reg w = lanes::fmadd(vt, lanes::sub(bw, aw), aw);
+		normalize_quaternion_block(x, y, z, w);
+		lanes::store(out.x + i, x);
+		lanes::store(out.y + i, y);
+		lanes::store(out.z + i, z);
+		lanes::store(out.w + i, w);
+	}
+	if (i < count)
+	{
+		tail::nlerp(from.offset(i), to.offset(i), t, out.offset(i), count - i);
+	}
+}
+
+//sin on [0, pi / 2], no range reduction needed there (same polynomial as math::precision_fast::sin)
+static inline lanes::reg sin_quadrant(lanes::reg r)
+{
+	lanes::reg r2 = lanes::mul(r, r);
+	lanes::reg p = lanes::fmadd(r2, lanes::set1(-2.5052108e-8f), lanes::set1(2.7557319e-6f));
+	p = lanes::fmadd(r2, p, lanes::set1(-1.9841270e-4f));
+	p = lanes::fmadd(r2, p, lanes::set1(8.3333333e-3f));
+	p = lanes::fmadd(r2, p, lanes::set1(-1.6666667e-1f));
+	return lanes::fmadd(lanes::mul(r, r2), p, r);
+}
+
+//acos on [0, 1] (same polynomial as math::precision_fast::acos)
+static inline lanes::reg acos_positive(lanes::reg a)
+{
+	lanes::reg p = lanes::fmadd(a, lanes::set1(-0.0012624911f), lanes::set1(0.0066700901f));
+	p = lanes::fmadd(a, p, lanes::set1(-0.0170881256f));
+	p = lanes::fmadd(a, p, lanes::set1(0.0308918810f));
+	p = lanes::fmadd(a, p, lanes::set1(-0.0501743046f));
+	p = lanes::fmadd(a, p, lanes::set1(0.0889789874f));
+	p = lanes::fmadd(a, p, lanes::set1(-0.2145988016f));
+	p = lanes::fmadd(a, p, lanes::set1(1.5707963050f));
+	return lanes::mul(lanes::sqrt(lanes::sub(lanes::set1(1.0f), a)), p);
+}
+
+//same as math::slerp<precision_fast>, lanes with a tiny angle take the nlerp result
+static void slerp(const quaternion_soa& from, const quaternion_soa& to, float t, const quaternion_soa& out, size_t count)
+{
+	typedef lanes::reg reg;
+	const reg vt = lanes::set1(t);
+	const reg one = lanes::set1(1.0f);
+	const reg one_minus_t = lanes::set1(1.0f - t);
+	size_t i = 0;
+	for (; i + lanes::width <= count; i += lanes::width)
+	{
+		reg ax = lanes::load(from.x + i), ay = lanes::load(from.y + i), az = lanes::load(from.z + i), aw = lanes::load(from.w + i);
+		reg bx = lanes::load(to.x + i), by = lanes::load(to.y + i), bz = lanes::load(to.z + i), bw = lanes::load(to.w + i);
+		reg d = neighborhood(ax, ay, az, aw, bx, by, bz, bw);
+		lanes::mask close = lanes::lt(lanes::set1(0.9995f), d);
+
+		reg theta = acos_positive(lanes::min(d, one));
+		reg inv_sin = lanes::div(one, sin_quadrant(theta));
+		reg wa = lanes::mul(sin_quadrant(lanes::mul(one_minus_t, theta)), inv_sin);
+		reg wb = lanes::mul(sin_quadrant(lanes::mul(vt, theta)), inv_sin);
+		wa = lanes::select(close, one_minus_t, wa);
+		wb = lanes::select(close, vt, wb);
+
+		reg x = lanes::fmadd(bx, wb, lanes::mul(ax, wa));
+		reg y = lanes::fmadd(by, wb, lanes::mul(ay, wa));
+		reg z = lanes::fmadd(bz, wb, lanes::mul(az, wa));
+		reg w = lanes::fmadd(bw, wb, lanes::mul(aw, wa));
+		//renormalizing is only required for the nlerp lanes, doing it for all of them is cheaper than a blend
+		normalize_quaternion_block(x, y, z, w);
+		lanes::store(out.x + i, x);
+		lanes::store(out.y + i, y);
+		lanes::store(out.z + i, z);
+		lanes::store(out.w + i, w);
+	}
+	if (i < count)
+	{
+		tail::slerp(from.offset(i), to.offset(i), t, out.offset(i), count - i);
+	}
+}
+
+//same as quaternion_track::hermite, the slopes already scaled by the frame delta
+static void hermite(const quaternion_soa& p1, const quaternion_soa& s1, const quaternion_soa& p2, const quaternion_soa& s2,
+	float t, const quaternion_soa& out, size_t count)
+{
+	typedef lanes::reg reg;
+	float tt = t * t;
+	float ttt = tt * t;
+	const reg h1 = lanes::set1(2.0f * ttt - 3.0f * tt + 1.0f);
+	const reg h2 = lanes::set1(-2.0f * ttt + 3.0f * tt);
+	const reg h3 = lanes::set1(ttt - 2.0f * tt + t);
+	const reg h4 = lanes::set1(ttt - tt);
+	size_t i = 0;
+	for (; i + lanes::width <= count; i += lanes::width)
+	{
+		reg ax = lanes::load(p1.x + i), ay = lanes::load(p1.y + i), az = lanes::load(p1.z + i), aw = lanes::load(p1.w + i);
+		reg bx = lanes::load(p2.x + i), by = lanes::load(p2.y + i), bz = lanes::load(p2.z + i), bw = lanes::load(p2.w + i);
+		neighborhood(ax, ay, az, aw, bx, by, bz, bw);
+		reg x = lanes::fmadd(lanes::load(s2.x + i), h4, lanes::fmadd(lanes::load(s1.x + i), h3, lanes::fmadd(bx, h2, lanes::mul(ax, h1))));
+		reg y = lanes::fmadd(lanes::load(s2.y + i), h4, lanes::fmadd(lanes::load(s1.y + i), h3, lanes::fmadd(by, h2, lanes::mul(ay, h1))));
+		reg z = lanes::fmadd(lanes::load(s2.z + i), h4, lanes::fmadd(lanes::load(s1.z + i), h3, lanes::fmadd(bz, h2, lanes::mul(az, h1))));
+		reg w = lanes::fmadd(lanes::load(s2.w + i), h4, lanes::fmadd(lanes::load(s1.w + i), h3, lanes::fmadd(bw, h2, lanes::mul(aw, h1))));
+		normalize_quaternion_block(x, y, z, w);
+		lanes::store(out.x + i, x);
+		lanes::store(out.y + i, y);
+		lanes::store(out.z + i, z);
+		lanes::store(out.w + i, w);
+	}
+	if (i < count)
+	{
+		tail::hermite(p1.offset(i), s1.offset(i), p2.offset(i), s2.offset(i), t, out.offset(i), count - i);
+	}
+}
+
+//out[i] = a[i] + (b[i] - a[i]) * t
+static void lerp(const float* a, const float* b, float t, float* out, size_t count)
+{
+	const lanes::reg vt = lanes::set1(t);
+	size_t i = 0;
+	for (; i + lanes::width <= count; i += lanes::width)
+	{
+		lanes::reg va = lanes::load(a + i);
+		lanes::store(out + i, lanes::fmadd(vt, lanes::sub(lanes::load(b + i), va), va));
+	}
+	if (i < count)
+	{
+		tail::lerp(a + i, b + i, t, out + i, count - i);
+	}
+}
+
+//pose blending, one joint per lane
+
+//lerp of position and scale, nlerp of rotation, each joint by its own weight
+static void blend(const transform_soa& a, const transform_soa& b, const float* weights, const transform_soa& out, size_t count)
+{
+	typedef lanes::reg reg;
+	size_t i = 0;
+	for (; i + lanes::width <= count; i += lanes::width)
+	{
+		reg t = lanes::load(weights + i);
+
+		reg px = lanes::load(a.position.x + i), py = lanes::load(a.position.y + i), pz = lanes::load(a.position.z + i);
+		lanes::store(out.position.x + i, lanes::fmadd(t, lanes::sub(lanes::load(b.position.x + i), px), px));
+		lanes::store(out.position.y + i, lanes::fmadd(t, lanes::sub(lanes::load(b.position.y + i), py), py));
+		lanes::store(out.position.z + i, lanes::fmadd(t, lanes::sub(lanes::load(b.position.z + i), pz), pz));
+
+		reg sx = lanes::load(a.scale.x + i), sy = lanes::load(a.scale.y + i), sz = lanes::load(a.scale.z + i);
+		lanes::store(out.scale.x + i, lanes::fmadd(t, lanes::sub(lanes::load(b.scale.x + i), sx), sx));
+		lanes::store(out.scale.y + i, lanes::fmadd(t, lanes::sub(lanes::load(b.scale.y + i), sy), sy));
+		lanes::store(out.scale.z + i, lanes::fmadd(t, lanes::sub(lanes::load(b.scale.z + i), sz), sz));
+
+		const quaternion_soa& from = a.rotation;
+		const quaternion_soa& to = b.rotation;
+		reg ax = lanes::load(from.x + i), ay = lanes::load(from.y + i), az = lanes::load(from.z + i), aw = lanes::load(from.w + i);
+		reg bx = lanes::load(to.x + i), by = lanes::load(to.y + i), bz = lanes::load(to.z + i), bw = lanes::load(to.w + i);
+		neighborhood(ax, ay, az, aw, bx, by, bz, bw);
+		reg x = lanes::fmadd(t, lanes::sub(bx, ax), ax);
+		reg y = lanes::fmadd(t, lanes::sub(by, ay), ay);
+		reg z = lanes::fmadd(t, lanes::sub(bz, az), az);
+		reg w = lanes::fmadd(t, lanes::sub(bw, aw), aw);
+		normalize_quaternion_block(x, y, z, w);
+		lanes::store(out.rotation.x + i, x);
+		lanes::store(out.rotation.y + i, y);
+		lanes::store(out.rotation.z + i, z);
+		lanes::store(out.rotation.w + i, w);
+	}
+	if (i < count)
+	{
+		tail::blend(a.offset(i), b.offset(i), weights + i, out.offset(i), count - i);
+	}
+}
+
+//additive layer from a pose and the reference pose it was authored against:
+//position and scale subtract, the rotation is inverse(reference) * a
+static void difference(const transform_soa& a, const transform_soa& reference, const transform_soa& out, size_t count)
+{
+	typedef lanes::reg reg;
+	const reg zero = lanes::set1(0.0f);
+	size_t i = 0;
+	for (; i + lanes::width <= count; i += lanes::width)
+	{
+		lanes::store(out.position.x + i, lanes::sub(lanes::load(a.position.x + i), lanes::load(reference.position.x + i)));
+		lanes::store(out.position.y + i, lanes::sub(lanes::load(a.position.y + i), lanes::load(reference.position.y + i)));
+		lanes::store(out.position.z + i, lanes::sub(lanes::load(a.position.z + i), lanes::load(reference.position.z + i)));
+		lanes::store(out.scale.x + i, lanes::sub(lanes::load(a.scale.x + i), lanes::load(reference.scale.x + i)));
+		lanes::store(out.scale.y + i, lanes::sub(lanes::load(a.scale.y + i), lanes::load(reference.scale.y + i)));
+		lanes::store(out.scale.z + i, lanes::sub(lanes::load(a.scale.z + i), lanes::load(reference.scale.z + i)));
+
+		//unit quaternions, the conjugate is the inverse
+		const quaternion_soa& r = reference.rotation;
+		const quaternion_soa& q = a.rotation;
+		reg rx, ry, rz, rw;
+		mul_quaternion_block(lanes::sub(zero, lanes::load(r.x + i)), lanes::sub(zero, lanes::load(r.y + i)), lanes::sub(zero, lanes::load(r.z + i)), lanes::load(r.w + i),
+			lanes::load(q.x + i), lanes::load(q.y + i), lanes::load(q.z + i), lanes::load(q.w + i), rx, ry, rz, rw);
+		lanes::store(out.rotation.x + i, rx);
+		lanes::store(out.rotation.y + i, ry);
+		lanes::store(out.rotation.z + i, rz);
+		lanes::store(out.rotation.w + i, rw);
+	}
+	if (i < count)
+	{
+		tail::difference(a.offset(i), reference.offset(i), out.offset(i), count - i);
+	}
+}
+
+//base plus weight times difference: position and scale add up, the rotation is
+//base * nlerp(identity, difference, weight)
+static void add(const transform_soa& base, const transform_soa& difference, const float* weights, const transform_soa& out, size_t count)
+{
+	typedef lanes::reg reg;
+	const reg zero = lanes::set1(0.0f);
+	const reg one = lanes::set1(1.0f);
+	size_t i = 0;
+	for (; i + lanes::width <= count; i += lanes::width)
+	{
+		reg t = lanes::load(weights + i);
+
+		lanes::store(out.position.x + i, lanes::fmadd(t, lanes::load(difference.position.x + i), lanes::load(base.position.x + i)));
+		lanes::store(out.position.y + i, lanes::fmadd(t, lanes::load(difference.position.y + i), lanes::load(base.position.y + i)));
+		lanes::store(out.position.z + i, lanes::fmadd(t, lanes::load(difference.position.z + i), lanes::load(base.position.z + i)));
+		lanes::store(out.scale.x + i, lanes::fmadd(t, lanes::load(difference.scale.x + i), lanes::load(base.scale.x + i)));
+		lanes::store(out.scale.y + i, lanes::fmadd(t, lanes::load(difference.scale.y + i), lanes::load(base.scale.y + i)));
+		lanes::store(out.scale.z + i, lanes::fmadd(t, lanes::load(difference.scale.z + i), lanes::load(base.scale.z + i)));
+
+		const quaternion_soa& d = difference.rotation;
+		reg dx = lanes::load(d.x + i), dy = lanes::load(d.y + i), dz = lanes::load(d.z + i), dw = lanes::load(d.w + i);
+		neighborhood(zero, zero, zero, one, dx, dy, dz, dw);
+		reg x = lanes::mul(t, dx);
+		reg y = lanes::mul(t, dy);
+		reg z = lanes::mul(t, dz);
+		reg w = lanes::fmadd(t, lanes::sub(dw, one), one);
+		normalize_quaternion_block(x, y, z, w);
+
+		const quaternion_soa& b = base.rotation;
+		reg rx, ry, rz, rw;
+		mul_quaternion_block(lanes::load(b.x + i), lanes::load(b.y + i), lanes::load(b.z + i), lanes::load(b.w + i), x, y, z, w, rx, ry, rz, rw);
+		normalize_quaternion_block(rx, ry, rz, rw);
+		lanes::store(out.rotation.x + i, rx);
+		lanes::store(out.rotation.y + i, ry);
+		lanes::store(out.rotation.z + i, rz);
+		lanes::store(out.rotation.w + i, rw);
+	}
+	if (i < count)
+	{
+		tail::add(base.offset(i), difference.offset(i), weights + i, out.offset(i), count - i);
+	}
+}
+
+//skinning, one vertex per lane
+
+static inline void normalize3_block(lanes::reg& x, lanes::reg& y, lanes::reg& z)
+{
+	typedef lanes::reg reg;
+	reg len_sq = lanes::fmadd(z, z, lanes::fmadd(y, y, lanes::mul(x, x)));
+	//zero weights or a degenerate palette give a zero normal, keep it instead of producing nans
+	lanes::mask degenerate = lanes::lt(len_sq, lanes::set1(math::epsilon));
+	reg inv_len = lanes::select(degenerate, lanes::set1(1.0f), lanes::div(lanes::set1(1.0f), lanes::sqrt(len_sq)));
+	x = lanes::mul(x, inv_len);
+	y = lanes::mul(y, inv_len);
+	z = lanes::mul(z, inv_len);
+}
+
+//sum of the 4 weighted palette matrices, normals go through the same 3x3 part like the vertex shader does
+static void skin_linear(const skinning_soa& in, const float4x4* palette, const float3_soa& out_position, const float3_soa& out_normal, size_t count)
+{
+	typedef lanes::reg reg;
+	static constexpr int elements[12] = { 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14 };
+	const float* base = palette->data();
+	size_t i = 0;
+	for (; i + lanes::width <= count; i += lanes::width)
+	{
+		reg m[12];
+		for (int e = 0; e < 12; e++)
+		{
+			m[e] = lanes::set1(0.0f);
+		}
+		for (int k = 0; k < 4; k++)
+		{
+			lanes::ireg index = lanes::ishl(lanes::iload(in.joints[k] + i), 4);
+			reg w = lanes::load(in.weights[k] + i);
+			for (int e = 0; e < 12; e++)
+			{
+				m[e] = lanes::fmadd(w, lanes::fgather(base + elements[e], index), m[e]);
+			}
+		}
+
+		reg x = lanes::load(in.position.x + i), y = lanes::load(in.position.y + i), z = lanes::load(in.position.z + i);
+		lanes::store(out_position.x + i, lanes::fmadd(m[6], z, lanes::fmadd(m[3], y, lanes::fmadd(m[0], x, m[9]))));
+		lanes::store(out_position.y + i, lanes::fmadd(m[7], z, lanes::fmadd(m[4], y, lanes::fmadd(m[1], x, m[10]))));
+		lanes::store(out_position.z + i, lanes::fmadd(m[8], z, lanes::fmadd(m[5], y, lanes::fmadd(m[2], x, m[11]))));
+
+		x = lanes::load(in.normal.x + i), y = lanes::load(in.normal.y + i), z = lanes::load(in.normal.z + i);
+		reg nx = lanes::fmadd(m[6], z, lanes::fmadd(m[3], y, lanes::mul(m[0], x)));
+		reg ny = lanes::fmadd(m[7], z, lanes::fmadd(m[4], y, lanes::mul(m[1], x)));
+		reg nz = lanes::fmadd(m[8], z, lanes::fmadd(m[5], y, lanes::mul(m[2], x)));
+		normalize3_block(nx, ny, nz);
+		lanes::store(out_normal.x + i, nx);
+		lanes::store(out_normal.y + i, ny);
+		lanes::store(out_normal.z + i, nz);
+	}
+	if (i < count)
+	{
+		tail::skin_linear(in.offset(i), palette, out_position.offset(i), out_normal.offset(i), count - i);
+	}
+}
+
+//blends the dual quaternions of the 4 joints, each flipped into the hemisphere of the first one, then
+//normalizes and applies the result as rotation + translation
+static void skin_dual_quaternion(const skinning_soa& in, const dual_quaternion* palette, const float3_soa& out_position, const float3_soa& out_normal, size_t count)
+{
+	typedef lanes::reg reg;
+	const float* base = &palette->real.x;
+	const reg zero = lanes::set1(0.0f);
+	const reg two = lanes::set1(2.0f);
+	size_t i = 0;
+	for (; i + lanes::width <= count; i += lanes::width)
+	{
+		reg q[8];
+		reg first[4];
+		for (int k = 0; k < 4; k++)
+		{
+			lanes::ireg index = lanes::ishl(lanes::iload(in.joints[k] + i), 3);
+			reg w = lanes::load(in.weights[k] + i);
+			reg c[8];
+			for (int e = 0; e < 8; e++)
+			{
+				c[e] = lanes::fgather(base + e, index);
+			}
+			if (k == 0)
+			{
+				for (int e = 0; e < 4; e++)
+				{
+					first[e] = c[e];
+				}
+			}
+			else
+			{
+				reg d = lanes::fmadd(first[3], c[3], lanes::fmadd(first[2], c[2], lanes::fmadd(first[1], c[1], lanes::mul(first[0], c[0]))));
+				w = lanes::select(lanes::lt(d, zero), lanes::sub(zero, w), w);
+			}
+			for (int e = 0; e < 8; e++)
+			{
+				q[e] = k == 0 ? lanes::mul(w, c[e]) : lanes::fmadd(w, c[e], q[e]);
+			}
+		}
+
+		//normalize by the length of the real part, the dual part scales along
+		reg len_sq = lanes::fmadd(q[3], q[3], lanes::fmadd(q[2], q[2], lanes::fmadd(q[1], q[1], lanes::mul(q[0], q[0]))));
+		lanes::mask degenerate = lanes::lt(len_sq, lanes::set1(math::epsilon));
+		reg inv_len = lanes::select(degenerate, zero, lanes::div(lanes::set1(1.0f), lanes::sqrt(len_sq)));
+		reg rx = lanes::mul(q[0], inv_len), ry = lanes::mul(q[1], inv_len), rz = lanes::mul(q[2], inv_len);
+		reg rw = lanes::select(degenerate, lanes::set1(1.0f), lanes::mul(q[3], inv_len));
+		reg dx = lanes::mul(q[4], inv_len), dy = lanes::mul(q[5], inv_len), dz = lanes::mul(q[6], inv_len), dw = lanes::mul(q[7], inv_len);
+
+		//translation = 2 * (rw * dv - dw * rv + rv x dv)
+		reg tx = lanes::mul(two, lanes::add(lanes::sub(lanes::mul(rw, dx), lanes::mul(dw, rx)), lanes::sub(lanes::mul(ry, dz), lanes::mul(rz, dy))));
+		reg ty = lanes::mul(two, lanes::add(lanes::sub(lanes::mul(rw, dy), lanes::mul(dw, ry)), lanes::sub(lanes::mul(rz, dx), lanes::mul(rx, dz))));
+		reg tz = lanes::mul(two, lanes::add(lanes::sub(lanes::mul(rw, dz), lanes::mul(dw, rz)), lanes::sub(lanes::mul(rx, dy), lanes::mul(ry, dx))));
+
+		//v + 2 * rv x (rv x v + rw * v)
+		for (int pass = 0; pass < 2; pass++)
+		{
+			const float3_soa& src = pass == 0 ? in.position : in.normal;
+			const float3_soa& dst = pass == 0 ? out_position : out_normal;
+			reg vx = lanes::load(src.x + i), vy = lanes::load(src.y + i), vz = lanes::load(src.z + i);
+			reg ax = lanes::fmadd(rw, vx, lanes::sub(lanes::mul(ry, vz), lanes::mul(rz, vy)));
+			reg ay = lanes::fmadd(rw, vy, lanes::sub(lanes::mul(rz, vx), lanes::mul(rx, vz)));
+			reg az = lanes::fmadd(rw, vz, lanes::sub(lanes::mul(rx, vy), lanes::mul(ry, vx)));
+			reg ox = lanes::fmadd(two, lanes::sub(lanes::mul(ry, az), lanes::mul(rz, ay)), vx);
+			reg oy = lanes::fmadd(two, lanes::sub(lanes::mul(rz, ax), lanes::mul(rx, az)), vy);
+			reg oz = lanes::fmadd(two, lanes::sub(lanes::mul(rx, ay), lanes::mul(ry, ax)), vz);
+			if (pass == 0)
+			{
+				ox = lanes::add(ox, tx);
+				oy = lanes::add(oy, ty);
+				oz = lanes::add(oz, tz);
+			}
+			lanes::store(dst.x + i, ox);
+			lanes::store(dst.y + i, oy);
+			lanes::store(dst.z + i, oz);
+		}
+	}
+	if (i < count)
+	{
+		tail::skin_dual_quaternion(in.offset(i), palette, out_position.offset(i), out_normal.offset(i), count - i);
+	}
+}
+
+//inverse kinematics, one chain per lane
+
+//keeps (dx, dy, dz) in the plane normal to the hinge axis and within the cone around the reference direction
+static inline void constrain_direction(lanes::reg& dx, lanes::reg& dy, lanes::reg& dz,
+	lanes::reg ax, lanes::reg ay, lanes::reg az, lanes::reg cone_cos, lanes::reg rx, lanes::reg ry, lanes::reg rz)
+{
+	typedef lanes::reg reg;
+	const reg one = lanes::set1(1.0f);
+
+	//a zero axis leaves the direction as is
+	reg along = lanes::fmadd(dz, az, lanes::fmadd(dy, ay, lanes::mul(dx, ax)));
+	reg hx = lanes::sub(dx, lanes::mul(ax, along));
+	reg hy = lanes::sub(dy, lanes::mul(ay, along));
+	reg hz = lanes::sub(dz, lanes::mul(az, along));
+	//pointing along the axis, no direction in the plane to prefer
+	lanes::mask parallel = lanes::lt(lanes::fmadd(hz, hz, lanes::fmadd(hy, hy, lanes::mul(hx, hx))), lanes::set1(math::epsilon));
+	normalize3_block(hx, hy, hz);
+	dx = lanes::select(parallel, dx, hx);
+	dy = lanes::select(parallel, dy, hy);
+	dz = lanes::select(parallel, dz, hz);
+
+	reg c = lanes::fmadd(dz, rz, lanes::fmadd(dy, ry, lanes::mul(dx, rx)));
+	lanes::mask outside = lanes::lt(c, cone_cos);
+	reg px = lanes::sub(dx, lanes::mul(rx, c));
+	reg py = lanes::sub(dy, lanes::mul(ry, c));
+	reg pz = lanes::sub(dz, lanes::mul(rz, c));
+	normalize3_block(px, py, pz);
+	reg sin_limit = lanes::sqrt(lanes::sub(one, lanes::min(one, lanes::mul(cone_cos, cone_cos))));
+	dx = lanes::select(outside, lanes::fmadd(px, sin_limit, lanes::mul(rx, cone_cos)), dx);
+	dy = lanes::select(outside, lanes::fmadd(py, sin_limit, lanes::mul(ry, cone_cos)), dy);
+	dz = lanes::select(outside, lanes::fmadd(pz, sin_limit, lanes::mul(rz, cone_cos)), dz);
+}
+
+static void fabrik(const fabrik_soa& chains, size_t count, int joint_count, int max_iterations, float tolerance)
+{
+	typedef lanes::reg reg;
+	const size_t stride = chains.stride;
+	const int last = joint_count - 1;
+	const reg tol = lanes::set1(tolerance);
+	const reg stall = lanes::set1(tolerance * 0.01f);
+	float* jx = chains.joints.x;
+	float* jy = chains.joints.y;
+	float* jz = chains.joints.z;
+
+	size_t i = 0;
+	for (; i + lanes::width <= count; i += lanes::width)
+	{
+		const reg root_x = lanes::load(jx + i), root_y = lanes::load(jy + i), root_z = lanes::load(jz + i);
+		const reg tx = lanes::load(chains.targets.x + i), ty = lanes::load(chains.targets.y + i), tz = lanes::load(chains.targets.z + i);
+		reg error = lanes::set1(FLT_MAX);
+
+		for (int iteration = 0; iteration < max_iterations; iteration++)
+		{
+			//tip to root: end effector on the target
+			reg nx = tx, ny = ty, nz = tz;
+			size_t o = last * stride + i;
+			lanes::store(jx + o, nx);
+			lanes::store(jy + o, ny);
+			lanes::store(jz + o, nz);
+			for (int j = last - 1; j >= 0; j--)
+			{
+				o = j * stride + i;
+				reg len = lanes::load(chains.lengths + (j + 1) * stride + i);
+				reg dx = lanes::sub(lanes::load(jx + o), nx);
+				reg dy = lanes::sub(lanes::load(jy + o), ny);
+				reg dz = lanes::sub(lanes::load(jz + o), nz);
+				normalize3_block(dx, dy, dz);
+				nx = lanes::fmadd(dx, len, nx);
+				ny = lanes::fmadd(dy, len, ny);
+				nz = lanes::fmadd(dz, len, nz);
+				lanes::store(jx + o, nx);
+				lanes::store(jy + o, ny);
+				lanes::store(jz + o, nz);
+			}
+
+			//root to tip: root back in place, every bone constrained against the one before it
+			reg px = root_x, py = root_y, pz = root_z;
+			reg rx = lanes::load(chains.reference.x + i), ry = lanes::load(chains.reference.y + i), rz = lanes::load(chains.reference.z + i);
+			lanes::store(jx + i, px);
+			lanes::store(jy + i, py);
+			lanes::store(jz + i, pz);
+			for (int j = 1; j <= last; j++)
+			{
+				o = j * stride + i;
+				const size_t bone = (j - 1) * stride + i;
+				reg len = lanes::load(chains.lengths + o);
+				reg dx = lanes::sub(lanes::load(jx + o), px);
+				reg dy = lanes::sub(lanes::load(jy + o), py);
+				reg dz = lanes::sub(lanes::load(jz + o), pz);
+				normalize3_block(dx, dy, dz);
+				constrain_direction(dx, dy, dz,
+					lanes::load(chains.hinge_axes.x + bone), lanes::load(chains.hinge_axes.y + bone), lanes::load(chains.hinge_axes.z + bone),
+					lanes::load(chains.cone_cos + bone), rx, ry, rz);
+				px = lanes::fmadd(dx, len, px);
+				py = lanes::fmadd(dy, len, py);
+				pz = lanes::fmadd(dz, len, pz);
+				lanes::store(jx + o, px);
+				lanes::store(jy + o, py);
+				lanes::store(jz + o, pz);
+				rx = dx;
+				ry = dy;
+				rz = dz;
+			}
+
+			reg ex = lanes::sub(px, tx), ey = lanes::sub(py, ty), ez = lanes::sub(pz, tz);
+			reg new_error = lanes::sqrt(lanes::fmadd(ez, ez, lanes::fmadd(ey, ey, lanes::mul(ex, ex))));
+			lanes::mask done = lanes::mask_or(lanes::lt(new_error, tol), lanes::lt(lanes::sub(error, new_error), stall));
+			error = new_error;
+			if (lanes::all(done))
+			{
+				break;
+			}
+		}
+		lanes::store(chains.error + i, error);
+	}
+	if (i < count)
+	{
+		tail::fabrik(chains.offset(i), count - i, joint_count, max_iterations, tolerance);
+	}
+}
+
+//broadphase
+
+static size_t overlaps(const aabb_soa& boxes, const float3& lower, const float3& upper, uint32_t* out, size_t count)
+{
+	typedef lanes::reg reg;
+	const reg lx = lanes::set1(lower.x), ly = lanes::set1(lower.y), lz = lanes::set1(lower.z);
+	const reg ux = lanes::set1(upper.x), uy = lanes::set1(upper.y), uz = lanes::set1(upper.z);
+	const int all_lanes = (int)((1u << lanes::width) - 1);
+	size_t found = 0;
+	size_t i = 0;
+	for (; i + lanes::width <= count; i += lanes::width)
+	{
+		lanes::mask apart = lanes::mask_or(lanes::lt(lanes::load(boxes.upper.x + i), lx), lanes::lt(ux, lanes::load(boxes.lower.x + i)));
+		apart = lanes::mask_or(apart, lanes::mask_or(lanes::lt(lanes::load(boxes.upper.y + i), ly), lanes::lt(uy, lanes::load(boxes.lower.y + i))));
+		apart = lanes::mask_or(apart, lanes::mask_or(lanes::lt(lanes::load(boxes.upper.z + i), lz), lanes::lt(uz, lanes::load(boxes.lower.z + i))));
+		int hit = ~lanes::bits(apart) & all_lanes;
+		//every lane is written, found only moves past the hits. Never writes past out[i + width - 1]
+		for (int k = 0; k < lanes::width; k++)
+		{
+			out[found] = (uint32_t)(i + k);
+			found += (hit >> k) & 1;
+		}
+	}
+	if (i < count)
+	{
+		size_t tail_found = tail::overlaps(boxes.offset(i), lower, upper, out + found, count - i);
+		for (size_t k = 0; k < tail_found; k++)
+		{
+			out[found + k] += (uint32_t)i;
+		}
+		found += tail_found;
+	}
+	return found;
+}
@@ -0,0 +1,273 @@
+#pragma once
+#include "collision.h"
+#include "job_system.h"
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+//Contacts for a broadphase pair list. Pairs are bucketed by the collider types of their two shapes so each chunk of
+//work runs one routine over one kind of shape, the bucketed list is split across the job system and every worker
+//appends to its own contact stream. The streams are merged in pair order afterwards, so the contacts come out the
+//same whatever the thread count or the order chunks were picked up in.
+//Every pair keeps a gjk::warm_start from the last run it was in, matched up by merging the sorted pair lists.
+
+constexpr int COLLIDER_TYPE_COUNT = (int)collider_type::mesh + 1;
+
+//normal and points as gjk::intersect reports them, with a the first shape.
+//warm belongs to the pair and scratch to the calling worker
+typedef bool (*collide_function)(const support_data& a, const support_data& b, contact_data& data, gjk::warm_start& warm, epa::polytope& scratch);
+
+inline bool collide_gjk(const support_data& a, const support_data& b, contact_data& data, gjk::warm_start& warm, epa::polytope& scratch)
+{
+	return gjk::intersect(a, b, data, scratch, warm);
+}
+
+//a closed form routine from collision.h, they need neither cache nor scratch
+template<bool (*COLLIDE)(const support_data&, const support_data&, contact_data&)>
+inline bool collide_analytic(const support_data& a, const support_data& b, contact_data& data, gjk::warm_start&, epa::polytope&)
+{
+	return COLLIDE(a, b, data);
+}
+
+//the routine for b against a, with the contact turned around
+template<bool (*COLLIDE)(const support_data&, const support_data&, contact_data&)>
+inline bool collide_swapped(const support_data& a, const support_data& b, contact_data& data, gjk::warm_start&, epa::polytope&)
+{
+	if (!COLLIDE(b, a, data))
+	{
+		return false;
+	}
+	std::swap(data.world_space_point_a, data.world_space_point_b);
+	data.normal = -data.normal;
+	return true;
+}
+
+struct contact
+{
+	//index into the pair list the contacts were generated from
+	uint32_t pair;
+	//object ids of the pair, shape a is shapes[a]
+	int a;
+	int b;
+	contact_data data;
+};
+
+struct narrowphase_cache
+{
+	collision_pair pair;
+	gjk::warm_start warm;
+	//support points of the pair's first call, what every later call is compared against
+	int cold_iterations;
+};
+
+struct narrowphase_stats
+{
+	//pairs handed to a collide function
+	uint32_t tested = 0;
+	//gjk and epa support points over every tested pair
+	uint32_t iterations = 0;
+	//pairs the cached axis still separated
+	uint32_t early_outs = 0;
+	//cold_iterations minus iterations of pairs that had a cache entry, counting only pairs that got cheaper
+	uint32_t iterations_saved = 0;
+
+	void add(const narrowphase_stats& other)
+	{
+		tested += other.tested;
+		iterations += other.iterations;
+		early_outs += other.early_outs;
+		iterations_saved += other.iterations_saved;
+	}
+};
+
+//one per worker, only ever touched by that worker during a run
+struct narrowphase_worker
+{
+	std::vector<contact> contacts;
+	epa::polytope polytope;
+	narrowphase_stats stats;
+};
+
+struct narrowphase
+{
+	job_system* jobs;
+	//by the collider types of a and b, null for combinations without contacts (meshes have no support function yet).
+	//pairs with a closed form get it, the rest go through gjk and epa
+	collide_function functions[COLLIDER_TYPE_COUNT][COLLIDER_TYPE_COUNT];
+	//sorted by pair
+	std::vector<contact> contacts;
+	std::vector<narrowphase_worker> workers;
+
+	//one per pair of the last run, in the same order
+	std::vector<narrowphase_cache> cache;
+	std::vector<narrowphase_cache> previous_cache;
+	//off to measure against cold starts, every pair then starts from scratch
+	bool warm_start = true;
+
+	//pair indices grouped by type combination, kept around so a steady state frame doesn't allocate
+	std::vector<uint32_t> order;
+	uint32_t bucket_start[COLLIDER_TYPE_COUNT * COLLIDER_TYPE_COUNT + 1];
+
+	//pairs per chunk handed to a worker
+	size_t grain = 32;
+
+	void initialize(job_system* jobs)
+	{
+		this->jobs = jobs;
+		for (int a = 0; a < COLLIDER_TYPE_COUNT; a++)
+		{
+			for (int b = 0; b < COLLIDER_TYPE_COUNT; b++)
+			{
+				bool mesh = a == (int)collider_type::mesh || b == (int)collider_type::mesh;
+				functions[a][b] = mesh ? nullptr : &collide_gjk;
+			}
+		}
+		const int sphere = (int)collider_type::sphere;
+		const int capsule = (int)collider_type::capsule;
+		const int box = (int)collider_type::box;
+		functions[sphere][sphere] = &collide_analytic<analytic::sphere_sphere>;
+		functions[sphere][capsule] = &collide_analytic<analytic::sphere_capsule>;
+		functions[capsule][sphere] = &collide_swapped<analytic::sphere_capsule>;
+		functions[capsule][capsule] = &collide_analytic<analytic::capsule_capsule>;
+		functions[sphere][box] = &collide_analytic<analytic::sphere_box>;
+		functions[box][sphere] = &collide_swapped<analytic::sphere_box>;
+		functions[box][box] = &collide_analytic<analytic::box_box>;
+	}
+
+	//shapes is indexed by the object ids in pairs, e.g. collision_system body ids.
+	//pairs have to be sorted for their caches to be found again, as every broadphase reports them
+	void run(const std::vector<collision_pair>& pairs, const support_data* shapes)
+	{
+		contacts.clear();
+		workers.resize(jobs->worker_count());
+		for (narrowphase_worker& w : workers)
+		{
+			w.contacts.clear();
+			w.stats = narrowphase_stats();
+		}
+		match_cache(pairs);
+		if (pairs.empty())
+		{
+			return;
+		}
+
+		//counting sort by combination, pairs keep their relative order within a bucket
+		uint32_t counts[COLLIDER_TYPE_COUNT * COLLIDER_TYPE_COUNT] = {};
+		for (const collision_pair& p : pairs)
+		{
+			counts[bucket(shapes[p.a], shapes[p.b])]++;
+		}
+		bucket_start[0] = 0;
+		for (int k = 0; k < COLLIDER_TYPE_COUNT * COLLIDER_TYPE_COUNT; k++)
+		{
+			bucket_start[k + 1] = bucket_start[k] + counts[k];
+			counts[k] = bucket_start[k];
+		}
+		order.resize(pairs.size());
+		for (uint32_t i = 0; i < (uint32_t)pairs.size(); i++)
+		{
+			order[counts[bucket(shapes[pairs[i].a], shapes[pairs[i].b])]++] = i;
+		}
+
+		auto collide = [this, &pairs, shapes](size_t begin, size_t end, uint32_t worker)
+		{
+			narrowphase_worker& w = workers[worker];
+			for (size_t i = begin; i < end; i++)
+			{
+				const uint32_t index = order[i];
+				const collision_pair& p = pairs[index];
+				const support_data& a = shapes[p.a];
+				const support_data& b = shapes[p.b];
+				collide_function f = functions[(int)a.col.type][(int)b.col.type];
+				if (f == nullptr)
+				{
+					continue;
+				}
+				narrowphase_cache& entry = cache[index];
+				const bool warm = entry.warm.valid;
+				//the closed forms leave the cache alone
+				entry.warm.iterations = 0;
+				entry.warm.early_out = false;
+				contact c;
+				const bool hit = f(a, b, c.data, entry.warm, w.polytope);
+				if (hit)
+				{
+					c.pair = index;
+					c.a = p.a;
+					c.b = p.b;
+					w.contacts.push_back(c);
+				}
+
+				const int iterations = entry.warm.iterations;
+				w.stats.tested++;
+				w.stats.iterations += iterations;
+				if (!warm)
+				{
+					entry.cold_iterations = iterations;
+					continue;
+				}
+				if (entry.warm.early_out)
+				{
+					w.stats.early_outs++;
+				}
+				if (entry.cold_iterations > iterations)
+				{
+					w.stats.iterations_saved += entry.cold_iterations - iterations;
+				}
+			}
+		};
+		jobs->parallel_for(order.size(), grain, collide);
+
+		size_t total = 0;
+		for (const narrowphase_worker& w : workers)
+		{
+			total += w.contacts.size();
+		}
+		contacts.reserve(total);
+		for (const narrowphase_worker& w : workers)
+		{
+			contacts.insert(contacts.end(), w.contacts.begin(), w.contacts.end());
+		}
+		//which worker found a contact depends on scheduling, the pair it came from doesn't
+		std::sort(contacts.begin(), contacts.end(), [](const contact& x, const contact& y) { return x.pair < y.pair; });
+	}
+
+	//of the last run
+	narrowphase_stats stats() const
+	{
+		narrowphase_stats total;
+		for (const narrowphase_worker& w : workers)
+		{
+			total.add(w.stats);
+		}
+		return total;
+	}
+
+	//carries the cache of every pair that was in the last run over, both lists are sorted
+	void match_cache(const std::vector<collision_pair>& pairs)
+	{
+		previous_cache.swap(cache);
+		cache.resize(pairs.size());
+		size_t j = 0;
+		for (size_t i = 0; i < pairs.size(); i++)
+		{
+			while (j < previous_cache.size() && previous_cache[j].pair < pairs[i])
+			{
+				j++;
+			}
+			if (warm_start && j < previous_cache.size() && previous_cache[j].pair == pairs[i])
+			{
+				cache[i] = previous_cache[j];
+			}
+			else
+			{
+				cache[i] = narrowphase_cache{ pairs[i], gjk::warm_start(), 0 };
+			}
+		}
+	}
+
+	static int bucket(const support_data& a, const support_data& b)
+	{
+		return (int)a.col.type * COLLIDER_TYPE_COUNT + (int)b.col.type;
+	}
+};
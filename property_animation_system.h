@@ -0,0 +1,280 @@
+#pragma once
+#include "ecs.h"
+#include "components.h"
+#include "animation.h"
+#include "job_system.h"
+#include <stddef.h>
+#include <vector>
+
+//Curves on component fields: moving platforms, flickering lights, material parameters.
+//A binding names a field by component id and byte offset, a property_clip holds one track per bound field.
+//Every update the entities are sorted by clip and each run of entities playing the same clip is evaluated a track
+//at a time, so a track's keys stay in cache while it is written into the component column of every entity in the run.
+
+enum class property_type : uint32_t
+{
+	//x of a float3_track
+	scalar,
+	float3,
+	quaternion
+};
+
+struct property_binding
+{
+	size_type component;
+	size_type component_size;
+	//byte offset of the field in the component, e.g. offsetof(point_light, color)
+	uint32_t field_offset;
+	property_type type;
+};
+
+struct property_track
+{
+	//index into property_animation_system::bindings
+	uint32_t binding = 0;
+	//the one type of the binding is used
+	float3_track values;
+	quaternion_track rotations;
+};
+
+struct property_clip
+{
+	std::vector<property_track> tracks;
+	bool loop = true;
+	float start_time = 0.0f;
+	float end_time = 0.0f;
+	std::string name = "no name";
+
+	//start and end over every track
+	void recalculate_duration()
+	{
+		bool is_set = false;
+		for (property_track& track : tracks)
+		{
+			size_t size = std::max(track.values.size(), track.rotations.size());
+			if (size < 2)
+			{
+				continue;
+			}
+			float start = track.values.size() > 1 ? track.values.start_time() : track.rotations.start_time();
+			float end = track.values.size() > 1 ? track.values.end_time() : track.rotations.end_time();
+			start_time = is_set ? std::min(start_time, start) : start;
+			end_time = is_set ? std::max(end_time, end) : end;
+			is_set = true;
+		}
+	}
+
+	//same time handling as clip::adjust_time_to_fit
+	float adjust_time_to_fit(float t) const
+	{
+		float duration = end_time - start_time;
+		if (duration <= 0.0f)
+		{
+			return start_time;
+		}
+		if (loop)
+		{
+			t = fmodf(t - start_time, duration);
+			if (t < 0.0f)
+			{
+				t += duration;
+			}
+			return t + start_time;
+		}
+		return math::clamp(t, start_time, end_time);
+	}
+};
+
+//per entity state, a cursor per track of the clip
+struct property_instance
+{
+	uint32_t clip;
+	std::vector<int> cursors;
+	//property_animation_system::frame of the last update that saw the entity, instances that miss one are released
+	uint32_t last_seen;
+	bool in_use;
+};
+
+struct property_work
+{
+	uint32_t clip;
+	uint32_t instance;
+	float time;
+	const group* g;
+	uint32_t slot;
+};
+
+struct property_animation_system
+{
+	job_system* jobs;
+	std::vector<property_binding> bindings;
+	std::vector<property_clip> clips;
+	std::vector<property_instance> instances;
+	//released instances, handed out again before instances grows
+	std::vector<uint32_t> free_instances;
+	uint32_t frame = 0;
+	//rebuilt every update, kept around so a steady state frame doesn't allocate
+	std::vector<property_work> work;
+	//component column of every binding, resolved once per update
+	std::vector<char*> columns;
+
+	void initialize(job_system* jobs)
+	{
+		this->jobs = jobs;
+	}
+
+	//returns the index property_track::binding refers to it by
+	template<class T>
+	uint32_t add_binding(size_t field_offset, property_type type)
+	{
+		bindings.push_back(property_binding{ component_id<T>, sizeof(T), (uint32_t)field_offset, type });
+		return (uint32_t)bindings.size() - 1;
+	}
+
+	uint32_t add_clip(const property_clip& c)
+	{
+		clips.push_back(c);
+		clips.back().recalculate_duration();
+		return (uint32_t)clips.size() - 1;
+	}
+
+	component_id_array<property_animation> comps;
+	void update(entity_component_system* ecs, float dt)
+	{
+		frame++;
+		work.clear();
+		auto view = ecs->get_view(comps.arr, comps.size);
+		auto animations = ecs->get_component_array<property_animation>();
+		for (auto g : *view)
+		{
+			auto animation_offset = animations + g->get_offset(component_id<property_animation>);
+			for (auto i : *g)
+			{
+				property_animation& a = animation_offset[i];
+				get_instance(a).last_seen = frame;
+				const property_clip& c = clips[a.clip];
+				a.time = c.adjust_time_to_fit(a.time + dt * a.speed);
+				work.push_back(property_work{ a.clip, a.instance - 1, a.time, g, (uint32_t)i });
+			}
+		}
+		release_unseen();
+		if (work.empty())
+		{
+			return;
+		}
+
+		//entities playing the same clip end up next to each other, in ecs order within a clip
+		std::stable_sort(work.begin(), work.end(), [](const property_work& a, const property_work& b) { return a.clip < b.clip; });
+
+		columns.resize(bindings.size());
+		for (size_t b = 0; b < bindings.size(); b++)
+		{
+			columns[b] = ecs->get_component_data(bindings[b].component);
+		}
+
+		//entities write to their own rows only, chunks never touch the same memory
+		auto evaluate = [this](size_t begin, size_t end, uint32_t)
+		{
+			while (begin < end)
+			{
+				size_t run_end = begin + 1;
+				while (run_end < end && work[run_end].clip == work[begin].clip)
+				{
+					run_end++;
+				}
+				evaluate_run(begin, run_end);
+				begin = run_end;
+			}
+		};
+		jobs->parallel_for(work.size(), 64, evaluate);
+	}
+
+	//work[begin, end) all play the same clip
+	void evaluate_run(size_t begin, size_t end)
+	{
+		property_clip& c = clips[work[begin].clip];
+		for (uint32_t t = 0; t < (uint32_t)c.tracks.size(); t++)
+		{
+			property_track& track = c.tracks[t];
+			const property_binding& binding = bindings[track.binding];
+			char* column = columns[track.binding];
+			for (size_t w = begin; w < end; w++)
+			{
+				const property_work& item = work[w];
+				if (!item.g->component_exists(binding.component))
+				{
+					continue;
+				}
+				char* field = column + (item.g->get_offset(binding.component) + item.slot) * binding.component_size + binding.field_offset;
+				int* cursor = &instances[item.instance].cursors[t];
+				switch (binding.type)
+				{
+				case property_type::scalar:
+					if (track.values.size() > 1)
+					{
+						*(float*)field = track.values.sample(item.time, c.loop, cursor).x;
+					}
+					break;
+				case property_type::float3:
+					if (track.values.size() > 1)
+					{
+						float3 v = track.values.sample(item.time, c.loop, cursor);
+						memcpy(field, &v, sizeof(float3));
+					}
+					break;
+				case property_type::quaternion:
+					if (track.rotations.size() > 1)
+					{
+						quaternion q = track.rotations.sample(item.time, c.loop, cursor);
+						memcpy(field, &q, sizeof(quaternion));
+					}
+					break;
+				default:
+					break;
+				}
+			}
+		}
+	}
+
+	//creates the instance the first time the entity is seen, and resets the cursors when its clip changed
+	property_instance& get_instance(property_animation& a)
+	{
+		if (a.instance == 0)
+		{
+			property_instance instance{ a.clip, std::vector<int>(clips[a.clip].tracks.size(), 0), frame, true };
+			if (free_instances.empty())
+			{
+				instances.push_back(std::move(instance));
+				a.instance = (uint32_t)instances.size();
+			}
+			else
+			{
+				a.instance = free_instances.back() + 1;
+				free_instances.pop_back();
+				instances[a.instance - 1] = std::move(instance);
+			}
+		}
+		property_instance& instance = instances[a.instance - 1];
+		if (instance.clip != a.clip)
+		{
+			instance.clip = a.clip;
+			instance.cursors.assign(clips[a.clip].tracks.size(), 0);
+		}
+		return instance;
+	}
+
+	//the ecs has no removal callbacks, an entity that was removed or lost its property_animation component
+	//simply isn't in the view anymore. Its instance is freed and handed to the next new entity
+	void release_unseen()
+	{
+		for (uint32_t id = 0; id < (uint32_t)instances.size(); id++)
+		{
+			property_instance& instance = instances[id];
+			if (instance.in_use && instance.last_seen != frame)
+			{
+				instance = property_instance();
+				free_instances.push_back(id);
+			}
+		}
+	}
+};
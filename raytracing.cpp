@@ -325,11 +325,11 @@ namespace em
 
 				auto& model_matrix = batches[i].model[j];
 
-				VkTransformMatrixKHR transform_matrix = { 
-					model_matrix[0], model_matrix[4], model_matrix[8], model_matrix[12],
-					model_matrix[1], model_matrix[5], model_matrix[9], model_matrix[13],
-					model_matrix[2], model_matrix[6], model_matrix[10], model_matrix[14],
-				};
+				//same row major 3x4 layout
+				float3x4 affine;
+				math::to_float3x4(model_matrix, affine);
+				VkTransformMatrixKHR transform_matrix;
+				memcpy(&transform_matrix, affine.m.data(), sizeof(transform_matrix));
 
 				VkAccelerationStructureInstanceKHR instance{ };
 				instance.transform = transform_matrix;
@@ -5,6 +5,7 @@
 #include "mmath.h"
 #include "camera_system.h"
 #include "renderer.h"
+#include "collections.h"
 
 constexpr double scaleFactor = 65530.0;
 constexpr double cp = 256.0 * 256.0;
@@ -44,13 +45,14 @@ struct render_system
 	component_id_array<position, renderable> comps;
 
 	std::vector<mesh_batch> batches;
-	std::unordered_map<renderable, uint32_t> batch_indexing;
+	flat_hash_map<renderable, uint32_t> batch_indexing;
 
 	void gather_renderables(renderer* render, entity_component_system* ecs, const float4x4& vp)
 	{
 		std::vector<float4x4> mvps;
 		position* positions = ecs->get_component_array<position>();
 		renderable* renderables = ecs->get_component_array<renderable>();
+		animation* animations = ecs->get_component_array<animation>();
 		renderable_view = ecs->get_view(comps.arr, comps.size);
 		size_type j = 0;
 		uint8_t index = 0;
@@ -66,19 +68,24 @@ struct render_system
 		{
 			auto positionOffset = positions + g->get_offset(component_id<position>);
 			auto renderableOffset = renderables + g->get_offset(component_id<renderable>);
+			//skinned meshes index their joints from the entity's slice of the palette
+			animation* animationOffset = g->component_exists(component_id<animation>) ? animations + g->get_offset(component_id<animation>) : nullptr;
 
 			for (auto i : *g)
 			{
 				auto& pos = positionOffset[i];
 				auto& rend = renderableOffset[i];
+				uint32_t palette_offset = animationOffset ? animationOffset[i].palette_offset : 0;
 
-				if (batch_indexing.find(rend) != batch_indexing.end())
+				auto batch_it = batch_indexing.find(rend);
+				if (batch_it != batch_indexing.end())
 				{
-					auto batch_index = batch_indexing[rend];
+					auto batch_index = batch_it->second;
 					auto batch_count = batches[batch_index].count++;
 					if (batch_count < MAX_BATCHED_MESHES_COUNT)
 					{
 						math::translate(float3(pos.x, pos.y, pos.z), batches[batch_index].model[batch_count]);
+						batches[batch_index].palette_offset[batch_count] = palette_offset;
 					}
 				}
 				else
@@ -93,6 +100,7 @@ struct render_system
 					batch.pipeline = rend.pipeline;
 					batch.vertex_stride = rend.vertex_stride;
 					math::translate(float3(pos.x, pos.y, pos.z), batch.model[0]);
+					batch.palette_offset[0] = palette_offset;
 				
 					batch_indexing[rend] = (uint32_t)(batches.size() - 1);
 				}
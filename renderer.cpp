@@ -1,5 +1,6 @@
 #include "renderer.h"
 #include <iostream>
+#include <algorithm>
 
 #include "shader.h"
 #include "uniform_buffer_object.h"
@@ -221,7 +222,7 @@ void renderer::create_uniform_buffer()
 	{
 		device.create_buffer(ubos[i], sizeof(camera_data), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 		device.create_buffer(lbos[i], sizeof(light_buffer_object), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-		device.create_buffer(pbo[i], sizeof(float4x4) * 120, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		device.create_buffer(pbo[i], sizeof(float4x4) * MAX_PALETTE_SIZE, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 	}
 }
 
@@ -236,8 +237,13 @@ void renderer::update_uniform_buffers(const uint32_t current_image, const light_
 	memcpy(data, &light_data, sizeof(light_buffer_object));
 	vkUnmapMemory(device.logical_device, lbos[current_image].buffer_memory);
 
-	vkMapMemory(device.logical_device, pbo[current_image].buffer_memory, 0, sizeof(float) * 16 * poses.size(), 0, &data);
-	memcpy(data, poses.data(), sizeof(float4x4) * poses.size());
+	size_t palette_size = std::min(poses.size(), (size_t)MAX_PALETTE_SIZE);
+	if (palette_size == 0)
+	{
+		return;
+	}
+	vkMapMemory(device.logical_device, pbo[current_image].buffer_memory, 0, sizeof(float4x4) * palette_size, 0, &data);
+	memcpy(data, poses.data(), sizeof(float4x4) * palette_size);
 	vkUnmapMemory(device.logical_device, pbo[current_image].buffer_memory);
 
 }
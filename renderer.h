@@ -25,6 +25,8 @@
 #include "mmath.h"
 
 constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 2;
+//skinning matrices the palette uniform buffer holds
+constexpr uint32_t MAX_PALETTE_SIZE = 120;
 
 
 
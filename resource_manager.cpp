@@ -115,6 +115,23 @@ clip resource_manager::load_animation(const char* file_path)
 	return animations[name.c_str()];
 }
 
+uint32_t resource_manager::compress_animation(uint32_t clip_index, uint32_t rig_index, const clip_compression_settings& settings)
+{
+	compressed_clip compressed;
+	if (!compress_clip(clips[clip_index], rigs[rig_index], settings, compressed))
+	{
+		return INVALID_CLIP;
+	}
+	compressed_clips.push_back(std::move(compressed));
+	return (uint32_t)compressed_clips.size() - 1;
+}
+
+uint32_t resource_manager::bake_animation(uint32_t clip_index, uint32_t rig_index, float sample_rate)
+{
+	baked_clips.push_back(bake_clip(clips[clip_index], rigs[rig_index], sample_rate));
+	return (uint32_t)baked_clips.size() - 1;
+}
+
 uint32_t resource_manager::load_material(const char* albedo_path, const char* normal_path, const char* m_r_ao_path)
 {
 	uint32_t index = (uint32_t)materials.size() / 3;
@@ -156,12 +173,14 @@ skinned_mesh resource_manager::load_skinned_mesh(const char* file_path)
 
 	cgltf_node* nodes = data->nodes;    
 	size_t node_count = data->nodes_count;    
+	std::vector<int> joint_remap = get_joint_remap(data);
 
 	for (size_t i = 0; i < node_count; ++i)
 	{
 		cgltf_node* node = &nodes[i];       
 		if (node->mesh == 0 || node->skin == 0) { continue; }
 		int num_primitives = node->mesh->primitives_count;       
+		std::vector<int> skin_joints = get_skin_joints(node->skin, nodes, joint_remap);
 		for (int j = 0; j < num_primitives; ++j)
 		{
 			cgltf_primitive* primitive = &node->mesh->primitives[j];           
@@ -169,7 +188,7 @@ skinned_mesh resource_manager::load_skinned_mesh(const char* file_path)
 			for (unsigned int k = 0; k < ac; ++k) 
 			{
 				cgltf_attribute* attribute = &primitive -> attributes[k];                
-				mesh_from_attribute(vertices, *attribute, node->skin, nodes, node_count);
+				mesh_from_attribute(vertices, *attribute, skin_joints);
 			}
 			if (primitive->indices != 0) 
 			{
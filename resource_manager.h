@@ -1,15 +1,20 @@
 #pragma once
-#include <unordered_map>
+#include "collections.h"
 #include "mesh.h"
 #include "texture.h"
 #include "shader.h"
 #include "skinned_mesh.h"
 #include "skinned_vertex.h"
 #include "animation.h"
+#include "animation_compression.h"
+#include "animation_baking.h"
 #include "device.h"
 class resource_manager
 {
 public:
+	//returned instead of an index when an animation couldn't be processed
+	static constexpr uint32_t INVALID_CLIP = UINT32_MAX;
+
 	void initialize(em::device* device);
 
 	mesh load_mesh(const char* filePath);
@@ -22,20 +27,27 @@ public:
 	mesh load_mesh(const std::vector<skinned_vertex>& verts);
 
 	clip load_animation(const char* file_path);
+	//compresses clips[clip_index] against rigs[rig_index] into compressed_clips, returns its index there.
+	//INVALID_CLIP when the clip has more than MAX_COMPRESSED_SAMPLES at settings.sample_rate, bake or play it uncompressed instead
+	uint32_t compress_animation(uint32_t clip_index, uint32_t rig_index, const clip_compression_settings& settings = clip_compression_settings());
+	//resamples clips[clip_index] into baked_clips, rigs[rig_index] fills the channels the clip doesn't animate. returns its index there
+	uint32_t bake_animation(uint32_t clip_index, uint32_t rig_index, float sample_rate = 30.0f);
 
 	em::texture load_texture(const char* file_Path);
 	em::shader load_shader(const char* file_path, em::shader_type);
 
-	std::unordered_map<const char*, mesh> meshes;
-	std::unordered_map<const char*, em::texture> textures;
-	std::unordered_map<const char*, em::shader> shaders;
-	std::unordered_map<const char*, uint32_t> material_to_index;
-	std::unordered_map<const char*, skinned_mesh> skinned_meshes;
-	std::unordered_map<const char*, clip> animations;
+	flat_hash_map<const char*, mesh> meshes;
+	flat_hash_map<const char*, em::texture> textures;
+	flat_hash_map<const char*, em::shader> shaders;
+	flat_hash_map<const char*, uint32_t> material_to_index;
+	flat_hash_map<const char*, skinned_mesh> skinned_meshes;
+	flat_hash_map<const char*, clip> animations;
 	std::vector<em::texture> materials;
 
 	std::vector<rig> rigs;
 	std::vector<clip> clips;
+	std::vector<compressed_clip> compressed_clips;
+	std::vector<baked_clip> baked_clips;
 
 	void clear();
 
@@ -28,11 +28,14 @@ layout(location = 3) out vec3 frag_pos;
 
 layout(push_constant) uniform indices {
     mat4 model;
+    //first matrix of this entity's joints in pose, the material index sits at offset 64
+    layout(offset = 68) uint palette_offset;
 };
 
 void main() {
 
-    mat4 skin = pose[in_bones.x] * in_weights.x; +  pose[in_bones.y] * in_weights.y +  pose[in_bones.z] * in_weights.z + pose[in_bones.w] * in_weights.w;
+    uvec4 bones = palette_offset + uvec4(in_bones);
+    mat4 skin = pose[bones.x] * in_weights.x +  pose[bones.y] * in_weights.y +  pose[bones.z] * in_weights.z + pose[bones.w] * in_weights.w;
     vec4 p = vec4(in_pos.x, in_pos.y, in_pos.z, 1.0);
     view_pos = vec3(cam_pos);
     normal =  mat3(model)* mat3(skin) * vec3(in_normal);
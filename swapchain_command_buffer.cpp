@@ -66,6 +66,7 @@ namespace em
 			{
 				vkCmdPushConstants(command_buffers[current_image], pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(float4x4), &batches[j].model[k]);
 				vkCmdPushConstants(command_buffers[current_image], pipeline_layout, VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(float4x4), sizeof(uint32_t), &batches[j].material);
+				vkCmdPushConstants(command_buffers[current_image], pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, sizeof(float4x4) + sizeof(uint32_t), sizeof(uint32_t), &batches[j].palette_offset[k]);
 				vkCmdDraw(command_buffers[current_image], static_cast<uint32_t>(batches[j].vertex_count), 1, 0, 0);
 			}
 		}
@@ -0,0 +1,263 @@
+#include "test_common.h"
+#include "animation_compression.h"
+#include <random>
+
+//compress_clip against the source clip in world space, the smallest three rotation encoding on its own and the
+//16 bit key frame limit. The error budget is a distance in world units at the skinned vertices: joint_reach puts
+//them skin_radius past the joint and its descendants, these tests measure at the same distance.
+
+static std::mt19937 rng(31);
+
+static float random_float(float lower, float upper)
+{
+	return std::uniform_real_distribution<float>(lower, upper)(rng);
+}
+
+static quaternion random_rotation()
+{
+	return math::normalize(quaternion(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1), random_float(-1, 1)));
+}
+
+static float3 transform_point(const transform& t, const float3& p)
+{
+	return t.position + t.rotation * (t.scale * p);
+}
+
+//root, a spine of three and two arms off the second joint
+static rig make_rig()
+{
+	const int parents[] = { -1, 0, 1, 2, 1, 4, 1, 6 };
+	rig r;
+	for (int j = 0; j < (int)(sizeof(parents) / sizeof(parents[0])); j++)
+	{
+		transform bind;
+		bind.position = j == 0 ? float3(0, 1, 0) : float3(random_float(-0.2f, 0.2f), 0.4f, random_float(-0.2f, 0.2f));
+		r.add_joint(bind, bind, parents[j], "joint", float4x4());
+	}
+	r.update_inverse_bind_pose();
+	return r;
+}
+
+//every joint rotates, the root moves and one joint scales, all with linear keys at uneven times
+static clip make_clip(const rig& r, float duration)
+{
+	clip c;
+	c.loop = true;
+	for (uint32_t j = 0; j < (uint32_t)r.rest_pose.size(); j++)
+	{
+		transform_track& track = c[j];
+		const int key_count = 12;
+		track.rotation.type = interpolation_type::linear;
+		track.rotation.resize(key_count);
+		quaternion q = r.rest_pose.joints[j].rotation;
+		for (int k = 0; k < key_count; k++)
+		{
+			track.rotation[k].t = duration * k / (key_count - 1);
+			q = math::normalize(q * math::angle_axis(random_float(-0.6f, 0.6f), math::normalize(float3(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1)))));
+			track.rotation[k].value = q;
+		}
+		if (j == 0 || j == 5)
+		{
+			track.position.type = interpolation_type::linear;
+			track.position.resize(key_count);
+			for (int k = 0; k < key_count; k++)
+			{
+				track.position[k].t = duration * k / (key_count - 1);
+				track.position[k].value = r.rest_pose.joints[j].position + float3(random_float(-0.5f, 0.5f), random_float(-0.1f, 0.1f), random_float(-0.5f, 0.5f));
+			}
+		}
+		if (j == 3)
+		{
+			track.scale.type = interpolation_type::linear;
+			track.scale.resize(4);
+			for (int k = 0; k < 4; k++)
+			{
+				track.scale[k].t = duration * k / 3;
+				track.scale[k].value = float3(1, 1, 1) * random_float(0.8f, 1.2f);
+			}
+		}
+	}
+	c.recalculate_duration();
+	return c;
+}
+
+static float3 random_direction()
+{
+	return math::normalize(float3(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1)));
+}
+
+//largest distance between the two poses over the joints and points skin_radius away from them, in every direction
+static float world_error(const pose& a, const pose& b, float skin_radius)
+{
+	float3 offsets[17] = { float3(), float3(skin_radius, 0, 0), float3(0, skin_radius, 0), float3(0, 0, skin_radius) };
+	for (int o = 4; o < 17; o++)
+	{
+		offsets[o] = random_direction() * skin_radius;
+	}
+	float worst = 0.0f;
+	for (size_t j = 0; j < a.size(); j++)
+	{
+		transform ta = a.get_global_transform(j);
+		transform tb = b.get_global_transform(j);
+		for (const float3& o : offsets)
+		{
+			float3 d = transform_point(ta, o) - transform_point(tb, o);
+			worst = std::max(worst, sqrtf(math::dot(d, d)));
+		}
+	}
+	return worst;
+}
+
+static void decompressed_poses_stay_within_budget()
+{
+	//the default 0.0001 is below what 16 bit rotations can hold on a rig this size: half a quantization step is
+	//~4e-5 rad, which moves a vertex a metre away by 4e-5, and four joints down a chain add up past the budget.
+	//Every key is kept then and what's left is quantization error, so only budgets above that are checked
+	const float budgets[] = { 0.01f, 0.003f, 0.001f };
+	for (float budget : budgets)
+	{
+		for (int n = 0; n < 16; n++)
+		{
+			rig r = make_rig();
+			clip source = make_clip(r, random_float(1.0f, 3.0f));
+			clip_compression_settings settings;
+			settings.error_budget = budget;
+			compressed_clip compressed;
+			CHECK(compress_clip(source, r, settings, compressed));
+
+			//the budget holds at the samples the clip was reduced at, the source is linear in between as well
+			//but the resampling can cut a source segment, so only the sample times are checked
+			const int sample_count = (int)roundf(compressed.get_duration() * compressed.sample_rate) + 1;
+			int over = 0;
+			float worst = 0.0f;
+			pose exact = r.rest_pose;
+			pose decompressed = r.rest_pose;
+			for (int s = 0; s < sample_count; s++)
+			{
+				float t = std::min(source.start_time + s / compressed.sample_rate, source.end_time);
+				source.sample(exact, t);
+				compressed.sample(decompressed, t);
+				float e = world_error(exact, decompressed, settings.skin_radius);
+				worst = std::max(worst, e);
+				over += e > budget * 1.01f + 1e-5f;
+			}
+			if (over != 0)
+			{
+				printf("budget %g: %d of %d samples over, worst %g\n", budget, over, sample_count, worst);
+			}
+			CHECK(over == 0);
+			//the generous budget has to actually drop keys
+			if (budget >= 0.01f)
+			{
+				CHECK(compressed.frames.size() < (size_t)sample_count * source.tracks.size());
+			}
+		}
+	}
+}
+
+static void check_round_trip(const quaternion& q, int& wrong, float& worst)
+{
+	uint16_t packed[3];
+	compressed_clip::quantize(q, packed);
+	quaternion decoded = compressed_clip::dequantize_rotation(packed);
+	//q and -q are the same rotation, the encoding keeps the largest component positive
+	quaternion expected = math::normalize(q);
+	if (math::dot(expected, decoded) < 0.0f)
+	{
+		expected = -expected;
+	}
+	float error = 0.0f;
+	for (int c = 0; c < 4; c++)
+	{
+		error = std::max(error, fabsf(expected.v[c] - decoded.v[c]));
+	}
+	worst = std::max(worst, error);
+	//15 bits over +-1/sqrt(2) is 4.3e-5 a step, the rebuilt component picks up the error of the others
+	wrong += error > 1e-4f;
+}
+
+static void smallest_three_round_trips()
+{
+	int wrong = 0;
+	float worst = 0.0f;
+	for (int i = 0; i < 20000; i++)
+	{
+		check_round_trip(random_rotation(), wrong, worst);
+	}
+
+	//every component as the largest, positive and negative, and the ties and extremes around it
+	for (int largest = 0; largest < 4; largest++)
+	{
+		for (float sign : { 1.0f, -1.0f })
+		{
+			for (int i = 0; i < 2000; i++)
+			{
+				quaternion q;
+				for (int c = 0; c < 4; c++)
+				{
+					q.v[c] = random_float(-0.5f, 0.5f);
+				}
+				q.v[largest] = sign * random_float(0.75f, 1.0f);
+				check_round_trip(math::normalize(q), wrong, worst);
+			}
+			quaternion axis;
+			axis.v[0] = axis.v[1] = axis.v[2] = axis.v[3] = 0.0f;
+			axis.v[largest] = sign;
+			check_round_trip(axis, wrong, worst);
+
+			quaternion tie;
+			tie.v[0] = tie.v[1] = tie.v[2] = tie.v[3] = 0.0f;
+			tie.v[largest] = sign * 0.70710678f;
+			tie.v[(largest + 1) % 4] = -sign * 0.70710678f;
+			check_round_trip(tie, wrong, worst);
+
+			quaternion even;
+			even.v[0] = even.v[1] = even.v[2] = even.v[3] = -0.5f;
+			even.v[largest] = sign * 0.5f;
+			check_round_trip(even, wrong, worst);
+		}
+	}
+	if (wrong != 0)
+	{
+		printf("smallest three: %d rotations off, worst component error %g\n", wrong, worst);
+	}
+	CHECK(wrong == 0);
+}
+
+static void clips_past_the_frame_limit_are_rejected()
+{
+	rig r;
+	r.add_joint(transform(), transform(), -1, "root", float4x4());
+	clip_compression_settings settings;
+	settings.sample_rate = 30.0f;
+
+	//65535 intervals at 30 keys a second is the longest clip that fits, the channel is constant so it stays cheap
+	clip longest;
+	transform_track& track = longest[0];
+	track.rotation.type = interpolation_type::linear;
+	track.rotation.resize(2);
+	track.rotation[0].t = 0.0f;
+	track.rotation[1].t = 65535.0f / 30.0f;
+	longest.recalculate_duration();
+	compressed_clip compressed;
+	CHECK(compress_clip(longest, r, settings, compressed));
+	CHECK(compressed.frames.size() == 1);
+
+	//compress_clip asserts on the clips it rejects
+#ifdef NDEBUG
+	clip too_long = longest;
+	too_long[0].rotation[1].t = 65537.0f / 30.0f;
+	too_long.recalculate_duration();
+	compressed.name = "untouched";
+	CHECK(!compress_clip(too_long, r, settings, compressed));
+	CHECK(compressed.name == "untouched");
+#endif
+}
+
+int main()
+{
+	decompressed_poses_stay_within_budget();
+	smallest_three_round_trips();
+	clips_past_the_frame_limit_are_rejected();
+	return test_result("animation_compression_test");
+}
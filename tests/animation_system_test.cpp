@@ -0,0 +1,336 @@
+#include "test_common.h"
+//ecs.h picks up math.h from whatever the engine includes before it
+#include "mmath.h"
+#include "animation_system.h"
+#include <random>
+
+//animation_system's distance lod through an ecs: which level an entity gets, which joints it freezes, how often it
+//is evaluated and what the palette holds in between, and how max_evaluations shares the updates out.
+
+static std::mt19937 rng(41);
+
+static float random_float(float lower, float upper)
+{
+	return std::uniform_real_distribution<float>(lower, upper)(rng);
+}
+
+//update() advances the clips by dt * 0.1 seconds, game_app's dt is in tenths of a second
+constexpr float dt = 0.16f;
+constexpr float seconds_per_update = dt * 0.1f;
+
+//a root with a spine of four and an arm of two off the second joint
+static rig make_rig()
+{
+	const int parents[] = { -1, 0, 1, 2, 3, 1, 5 };
+	rig r;
+	for (int j = 0; j < (int)(sizeof(parents) / sizeof(parents[0])); j++)
+	{
+		transform bind;
+		bind.position = float3(random_float(-0.1f, 0.1f), 0.3f, random_float(-0.1f, 0.1f));
+		bind.rotation = math::normalize(quaternion(random_float(-0.2f, 0.2f), random_float(-0.2f, 0.2f), random_float(-0.2f, 0.2f), 1.0f));
+		r.add_joint(bind, bind, parents[j], "joint", float4x4());
+	}
+	r.update_inverse_bind_pose();
+	return r;
+}
+
+static clip make_clip(const rig& r)
+{
+	clip c;
+	c.loop = true;
+	for (uint32_t j = 0; j < (uint32_t)r.rest_pose.size(); j++)
+	{
+		transform_track& track = c[j];
+		track.rotation.type = interpolation_type::linear;
+		track.rotation.resize(5);
+		for (int k = 0; k < 5; k++)
+		{
+			track.rotation[k].t = k * 0.25f;
+			track.rotation[k].value = math::normalize(quaternion(random_float(-0.5f, 0.5f), random_float(-0.5f, 0.5f), random_float(-0.5f, 0.5f), 1.0f));
+		}
+		track.rotation[4].value = track.rotation[0].value;
+	}
+	c.recalculate_duration();
+	return c;
+}
+
+struct scene
+{
+	entity_component_system ecs;
+	job_system jobs;
+	std::vector<clip> clips;
+	std::vector<compressed_clip> compressed_clips;
+	std::vector<baked_clip> baked_clips;
+	std::vector<rig> rigs;
+	animation_system animations;
+	std::vector<entity_key> entities;
+	std::vector<float4x4> poses;
+	archetype<position, animation> animated;
+
+	explicit scene(uint32_t workers)
+	{
+		jobs.initialize(workers);
+		rigs.push_back(make_rig());
+		clips.push_back(make_clip(rigs[0]));
+		animations.initialize(&clips, &compressed_clips, &baked_clips, &rigs, &jobs);
+	}
+
+	~scene()
+	{
+		jobs.dispose();
+		ecs.dispose();
+	}
+
+	size_t add(float distance)
+	{
+		entity_key e = ecs.create_entity(animated.descriptor(), 64);
+		position& p = ecs.get_component<position>(e);
+		p.x = distance;
+		p.y = 0.0f;
+		p.z = 0.0f;
+		animation& a = ecs.get_component<animation>(e);
+		a.time = 0.0f;
+		a.animation_clip = 0;
+		a.format = clip_format::raw;
+		a.rig = 0;
+		a.instance = 0;
+		a.palette_offset = 0;
+		entities.push_back(e);
+		return entities.size() - 1;
+	}
+
+	void update()
+	{
+		animations.update(&ecs, dt, float3(0, 0, 0), poses);
+	}
+
+	animation& component(size_t i)
+	{
+		return ecs.get_component<animation>(entities[i]);
+	}
+
+	animation_instance& instance(size_t i)
+	{
+		return animations.instances[component(i).instance - 1];
+	}
+
+	const float4x4* palette(size_t i)
+	{
+		return poses.data() + component(i).palette_offset;
+	}
+};
+
+//the palette of the clip at time t with the joints frozen at lod in the bind pose
+static std::vector<float4x4> reference_palette(const scene& s, const animation_system& animations, uint32_t lod, float t)
+{
+	const rig& r = s.rigs[0];
+	pose p = r.rest_pose;
+	clip c = s.clips[0];
+	c.sample(p, t);
+	for (uint32_t j : animations.rig_lods[0].frozen[lod])
+	{
+		p.joints[j] = r.bind_pose.joints[j];
+	}
+	std::vector<float4x4> matrices;
+	p.get_matrices(matrices);
+	std::vector<float4x4> palette(matrices.size());
+	for (size_t j = 0; j < matrices.size(); j++)
+	{
+		math::simd::mul(matrices[j], r.inv_bind_pose[j], palette[j]);
+	}
+	return palette;
+}
+
+static bool near(const float4x4& a, const float4x4& b, float tolerance)
+{
+	for (int i = 0; i < 16; i++)
+	{
+		if (fabsf(a[i] - b[i]) > tolerance)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static void levels_follow_camera_distance()
+{
+	scene s(1);
+	const animation_lod_settings& settings = s.animations.lod_settings;
+	CHECK(s.animations.lod_level(0.0f) == 0);
+	CHECK(s.animations.lod_level(settings.distances[0] - 0.01f) == 0);
+	CHECK(s.animations.lod_level(settings.distances[0]) == 1);
+	CHECK(s.animations.lod_level(settings.distances[1] + 0.01f) == 2);
+	CHECK(s.animations.lod_level(settings.distances[2]) == 3);
+	CHECK(s.animations.lod_level(1e6f) == ANIMATION_LOD_COUNT - 1);
+
+	const float distances[] = { 1.0f, 20.0f, 40.0f, 100.0f };
+	for (float d : distances)
+	{
+		s.add(d);
+	}
+	s.update();
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		CHECK(s.instance(i).lod == i);
+	}
+	//moving an entity changes its level on the next update
+	s.ecs.get_component<position>(s.entities[3]).x = 2.0f;
+	s.update();
+	CHECK(s.instance(3).lod == 0);
+}
+
+static void leaves_freeze_at_the_far_levels()
+{
+	scene s(1);
+	const rig_lod& lods = s.animations.get_rig_lod(0);
+	//frozen_height 1 freezes the leaves 4 and 6, 2 also their parents 3 and 5
+	CHECK(lods.frozen[0].empty());
+	CHECK(lods.frozen[1].empty());
+	CHECK((lods.frozen[2] == std::vector<uint32_t>{ 4, 6 }));
+	CHECK((lods.frozen[3] == std::vector<uint32_t>{ 3, 4, 5, 6 }));
+	for (uint32_t l = 0; l < ANIMATION_LOD_COUNT; l++)
+	{
+		for (uint32_t j = 0; j < 7; j++)
+		{
+			bool frozen = std::find(lods.frozen[l].begin(), lods.frozen[l].end(), j) != lods.frozen[l].end();
+			CHECK(lods.sampled[l][j] == (frozen ? 0 : 1));
+		}
+	}
+
+	s.add(100.0f);
+	for (int frame = 0; frame < 20; frame++)
+	{
+		s.update();
+		const animation_instance& instance = s.instance(0);
+		for (uint32_t j : lods.frozen[3])
+		{
+			CHECK(math::equals(instance.local.joints[j].position, s.rigs[0].bind_pose.joints[j].position));
+			CHECK(instance.local.joints[j].rotation == s.rigs[0].bind_pose.joints[j].rotation);
+		}
+		//the joints still sampled move
+		CHECK(!(instance.local.joints[2].rotation == s.rigs[0].bind_pose.joints[2].rotation));
+	}
+}
+
+//an entity at each level: evaluated every update_interval frames at the time that passed in total, the palette lerps
+//from the previous evaluation to the latest one over the interval and lands on it on the interval's last frame
+static void intervals_interpolate_between_evaluations()
+{
+	scene s(2);
+	const float distances[] = { 1.0f, 20.0f, 40.0f, 100.0f };
+	for (float d : distances)
+	{
+		s.add(d);
+	}
+	const uint32_t joint_count = (uint32_t)s.rigs[0].rest_pose.size();
+	std::vector<int> evaluations(4, 0);
+	int wrong_palette = 0;
+	int wrong_time = 0;
+	for (int frame = 0; frame < 48; frame++)
+	{
+		s.update();
+		const float elapsed = (frame + 1) * seconds_per_update;
+		for (uint32_t i = 0; i < 4; i++)
+		{
+			const animation_instance& instance = s.instance(i);
+			const uint32_t interval = s.animations.lod_settings.update_interval[i];
+			//the first update evaluates every entity, from then on every interval frames
+			const bool due = frame == 0 || (frame % interval) == 0;
+			CHECK(instance.evaluated == due);
+			evaluations[i] += instance.evaluated;
+			if (instance.evaluated)
+			{
+				//nothing of the elapsed time is dropped between evaluations
+				wrong_time += fabsf(s.component(i).time - s.clips[0].adjust_time_to_fit(elapsed)) > 1e-4f;
+				std::vector<float4x4> expected = reference_palette(s, s.animations, i, elapsed);
+				for (uint32_t j = 0; j < joint_count; j++)
+				{
+					wrong_palette += !near(instance.next[j], expected[j], 1e-4f);
+				}
+			}
+
+			const float alpha = std::min(1.0f, (float)(instance.frames_since_update + 1) / (float)interval);
+			for (uint32_t j = 0; j < joint_count; j++)
+			{
+				float4x4 expected;
+				for (int e = 0; e < 16; e++)
+				{
+					expected[e] = instance.previous.size() == instance.next.size() ?
+						instance.previous[j][e] + (instance.next[j][e] - instance.previous[j][e]) * alpha : instance.next[j][e];
+				}
+				wrong_palette += !near(s.palette(i)[j], expected, 1e-5f);
+				if (alpha >= 1.0f)
+				{
+					wrong_palette += !near(s.palette(i)[j], instance.next[j], 0.0f);
+				}
+			}
+		}
+	}
+	CHECK(wrong_palette == 0);
+	CHECK(wrong_time == 0);
+	CHECK(evaluations[0] == 48);
+	CHECK(evaluations[1] == 24);
+	CHECK(evaluations[2] == 12);
+	CHECK(evaluations[3] == 6);
+}
+
+//with more entities due than max_evaluations, exactly that many are evaluated per update and the most overdue go
+//first, so nobody starves
+static void budget_shares_the_updates()
+{
+	scene s(2);
+	s.animations.lod_settings.max_evaluations = 3;
+	const size_t count = 12;
+	for (size_t i = 0; i < count; i++)
+	{
+		s.add(random_float(16.0f, 29.0f));
+	}
+	std::vector<int> last_evaluated(count, 0);
+	int worst_gap = 0;
+	for (int frame = 0; frame < 60; frame++)
+	{
+		s.update();
+		int evaluated = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			CHECK(s.instance(i).lod == 1);
+			if (s.instance(i).evaluated)
+			{
+				evaluated++;
+				//the first round after everyone was forced takes a frame longer
+				if (frame > 6)
+				{
+					worst_gap = std::max(worst_gap, frame - last_evaluated[i]);
+				}
+				last_evaluated[i] = frame;
+			}
+		}
+		//the first update has no palettes yet and evaluates everyone regardless of the budget, on the next one
+		//nobody has waited an interval yet
+		const int expected = frame == 0 ? (int)count : frame == 1 ? 0 : 3;
+		CHECK(evaluated == expected);
+	}
+	//12 entities at 3 a frame come round every 4 frames
+	CHECK(worst_gap == 4);
+
+	//a new entity is evaluated straight away and takes one of the budget's evaluations
+	size_t late = s.add(20.0f);
+	s.update();
+	CHECK(s.instance(late).evaluated);
+	int evaluated = 0;
+	for (size_t i = 0; i <= count; i++)
+	{
+		evaluated += s.instance(i).evaluated;
+	}
+	CHECK(evaluated == 3);
+}
+
+int main()
+{
+	levels_follow_camera_distance();
+	leaves_freeze_at_the_far_levels();
+	intervals_interpolate_between_evaluations();
+	budget_shares_the_updates();
+	return test_result("animation_system_test");
+}
@@ -0,0 +1,173 @@
+#include "test_common.h"
+#include "animation.h"
+#include <random>
+
+//find_frame's cursor against a linear scan. The cursor only walks forward a few frames, anything else (seeks,
+//loop wraps, time going backwards, a cursor left over from another track) has to fall back to the binary search.
+
+static std::mt19937 rng(23);
+
+static float random_float(float lower, float upper)
+{
+	return std::uniform_real_distribution<float>(lower, upper)(rng);
+}
+
+static int random_int(int lower, int upper)
+{
+	return std::uniform_int_distribution<int>(lower, upper)(rng);
+}
+
+//keyframe times from start, some of them repeated
+static float3_track random_track(int frame_count, float start)
+{
+	float3_track track;
+	track.type = interpolation_type::linear;
+	track.resize(frame_count);
+	float t = start;
+	for (int i = 0; i < frame_count; i++)
+	{
+		track[i].t = t;
+		track[i].value = float3(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1));
+		t += random_int(0, 9) == 0 ? 0.0f : random_float(0.01f, 0.5f);
+	}
+	if (track.end_time() == track.start_time())
+	{
+		track[frame_count - 1].t += 0.1f;
+	}
+	return track;
+}
+
+//the last frame of [0, size - 2] that starts at or before t, 0 before the first frame
+static int linear_find(const std::vector<float3_frame>& frames, float t)
+{
+	int found = 0;
+	for (int i = 0; i <= (int)frames.size() - 2; i++)
+	{
+		if (frames[i].t <= t)
+		{
+			found = i;
+		}
+	}
+	return found;
+}
+
+static void cursor_matches_linear_scan()
+{
+	int wrong = 0;
+	int lookups = 0;
+	for (int n = 0; n < 200; n++)
+	{
+		float3_track track = random_track(random_int(2, 40), random_float(-2, 2));
+		const float start = track.start_time();
+		const float end = track.end_time();
+		int cursor = 0;
+		float t = start - 0.3f;
+		for (int step = 0; step < 400; step++)
+		{
+			switch (random_int(0, 9))
+			{
+			//seek anywhere, including before the first and past the last frame
+			case 0: t = random_float(start - 1.0f, end + 1.0f); break;
+			//backwards
+			case 1: t -= random_float(0.0f, 0.8f); break;
+			case 2: t -= random_float(0.0f, 0.02f); break;
+			//a cursor left over from another track, or garbage
+			case 3: cursor = random_int(-5, 60); break;
+			//playback, sometimes far enough to skip more frames than the cursor walks
+			case 4: t += random_float(0.5f, 3.0f); break;
+			default: t += random_float(0.0f, 0.1f); break;
+			}
+			const float clamped = math::clamp(t, start, end);
+			wrong += find_frame(track.frames, clamped, &cursor) != linear_find(track.frames, clamped);
+			wrong += find_frame(track.frames, t, &cursor) != linear_find(track.frames, t);
+			lookups += 2;
+		}
+	}
+	CHECK(lookups == 160000);
+	CHECK(wrong == 0);
+}
+
+//frame_index wraps looping time before find_frame sees it, the cursor has to follow the wrap in both directions
+static void cursor_follows_loop_wraps()
+{
+	int wrong_index = 0;
+	int wrong_value = 0;
+	for (int n = 0; n < 100; n++)
+	{
+		float3_track track = random_track(random_int(2, 30), random_float(-1, 1));
+		const float duration = track.end_time() - track.start_time();
+		const float direction = n % 2 ? 1.0f : -1.0f;
+		int cursor = random_int(0, 5);
+		float t = random_float(-duration, duration);
+		for (int step = 0; step < 500; step++)
+		{
+			t += direction * random_float(0.0f, duration * 0.15f);
+			wrong_index += track.frame_index(t, true, &cursor) != track.frame_index(t, true);
+			float3 with_cursor = track.sample(t, true, &cursor);
+			float3 without = track.sample(t, true);
+			wrong_value += !math::equals(with_cursor, without);
+		}
+	}
+	CHECK(wrong_index == 0);
+	CHECK(wrong_value == 0);
+}
+
+//clip::sample keeps one cursor per track, playing a clip forwards, backwards and seeking has to give the poses
+//sampling without cursors gives
+static void clip_cursors_match_uncached_sampling()
+{
+	const int joint_count = 6;
+	clip c;
+	for (int j = 0; j < joint_count; j++)
+	{
+		transform_track& track = c[j];
+		track.position = random_track(random_int(2, 20), 0.0f);
+		track.scale = random_track(random_int(2, 20), 0.0f);
+		const int rotation_count = random_int(2, 20);
+		track.rotation.type = interpolation_type::linear;
+		track.rotation.resize(rotation_count);
+		for (int i = 0; i < rotation_count; i++)
+		{
+			track.rotation[i].t = i * 0.2f;
+			track.rotation[i].value = math::normalize(quaternion(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1), random_float(-1, 1)));
+		}
+	}
+	c.recalculate_duration();
+
+	pose with_cursors(joint_count);
+	pose without(joint_count);
+	for (int j = 0; j < joint_count; j++)
+	{
+		with_cursors.set_parent(j, j - 1);
+		without.set_parent(j, j - 1);
+	}
+	std::vector<track_cursor> cursors(c.size());
+
+	for (int loop = 0; loop < 2; loop++)
+	{
+		c.loop = loop == 1;
+		int different = 0;
+		float t = 0.0f;
+		for (int step = 0; step < 2000; step++)
+		{
+			switch (random_int(0, 19))
+			{
+			case 0: t = random_float(-10, 10); break;
+			case 1: t -= random_float(0.0f, 0.5f); break;
+			default: t += random_float(0.0f, 0.05f); break;
+			}
+			c.sample(with_cursors, t, cursors.data());
+			c.sample(without, t);
+			different += with_cursors != without;
+		}
+		CHECK(different == 0);
+	}
+}
+
+int main()
+{
+	cursor_matches_linear_scan();
+	cursor_follows_loop_wraps();
+	clip_cursors_match_uncached_sampling();
+	return test_result("animation_test");
+}
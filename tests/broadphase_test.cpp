@@ -0,0 +1,146 @@
+#include "test_common.h"
+#include "broadphase.h"
+#include <random>
+
+//Both broadphases through the shared table against brute force over the tight boxes, with objects added, removed
+//and moved between and within frames. sweep_and_prune tests tight boxes and has to match exactly,
+//bvh_broadphase may add pairs of fat boxes but never miss one.
+
+static aabb box_at(const float3& center, float half)
+{
+	aabb box;
+	box.lower_bound = center - float3(half, half, half);
+	box.upper_bound = center + float3(half, half, half);
+	return box;
+}
+
+static bool valid_pair_list(const std::vector<collision_pair>& pairs)
+{
+	for (size_t i = 0; i < pairs.size(); i++)
+	{
+		if (pairs[i].a >= pairs[i].b || (i > 0 && !(pairs[i - 1] < pairs[i])))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+//a proxy removed and another one added before the next find_pairs must not show up twice in the sweep
+static void sap_reuses_removed_proxy()
+{
+	sweep_and_prune sap;
+	const aabb box = box_at(float3(0, 0, 0), 1.0f);
+	int p0 = sap.add(box, 0, false);
+	sap.add(box, 1, false);
+	sap.add(box, 2, false);
+	std::vector<collision_pair> pairs;
+	sap.find_pairs(pairs);
+	CHECK(pairs.size() == 3);
+
+	sap.remove(p0);
+	sap.add(box, 3, false);
+	sap.find_pairs(pairs);
+	const std::vector<collision_pair> expected = { { 1, 2 }, { 1, 3 }, { 2, 3 } };
+	CHECK(pairs == expected);
+
+	//once it left the sweep, the freed proxy is handed out again
+	int p4 = sap.add(box, 4, false);
+	CHECK(p4 == p0);
+	sap.remove(p4);
+	sap.find_pairs(pairs);
+	CHECK(pairs == expected);
+}
+
+struct object
+{
+	float3 center;
+	float half;
+	bool is_static;
+	int proxy;
+	bool alive;
+};
+
+static void random_scene(broadphase phase, bool exact)
+{
+	std::mt19937 rng(9);
+	auto random_float = [&rng](float lower, float upper) { return std::uniform_real_distribution<float>(lower, upper)(rng); };
+	std::vector<object> objects;
+	auto add = [&]()
+	{
+		object o;
+		o.center = float3(random_float(-20, 20), random_float(-5, 5), random_float(-20, 20));
+		o.half = random_float(0.5f, 2.0f);
+		o.is_static = rng() % 5 == 0;
+		o.alive = true;
+		o.proxy = phase.add(phase.context, box_at(o.center, o.half), (int)objects.size(), o.is_static);
+		objects.push_back(o);
+	};
+	for (int i = 0; i < 300; i++)
+	{
+		add();
+	}
+
+	std::vector<collision_pair> pairs;
+	int mismatched_frames = 0;
+	for (int frame = 0; frame < 200; frame++)
+	{
+		//removes and adds within a frame, so freed proxies get handed out before the next find_pairs
+		for (int k = 0; k < 8; k++)
+		{
+			object& o = objects[rng() % objects.size()];
+			if (o.alive)
+			{
+				phase.remove(phase.context, o.proxy);
+				o.alive = false;
+			}
+			add();
+		}
+		for (object& o : objects)
+		{
+			if (o.alive && !o.is_static)
+			{
+				float3 step(random_float(-0.3f, 0.3f), random_float(-0.1f, 0.1f), random_float(-0.3f, 0.3f));
+				o.center = o.center + step;
+				phase.move(phase.context, o.proxy, box_at(o.center, o.half), step);
+			}
+		}
+		phase.find_pairs(phase.context, pairs);
+
+		std::vector<collision_pair> expected;
+		for (int a = 0; a < (int)objects.size(); a++)
+		{
+			for (int b = a + 1; b < (int)objects.size(); b++)
+			{
+				const object& oa = objects[a];
+				const object& ob = objects[b];
+				if (oa.alive && ob.alive && !(oa.is_static && ob.is_static) &&
+					overlaps(box_at(oa.center, oa.half), box_at(ob.center, ob.half)))
+				{
+					expected.push_back(collision_pair{ a, b });
+				}
+			}
+		}
+		bool dead_reported = false;
+		for (const collision_pair& p : pairs)
+		{
+			dead_reported = dead_reported || !objects[p.a].alive || !objects[p.b].alive;
+		}
+		const bool match = exact ? pairs == expected : std::includes(pairs.begin(), pairs.end(), expected.begin(), expected.end());
+		if (!match || dead_reported || !valid_pair_list(pairs))
+		{
+			mismatched_frames++;
+		}
+	}
+	CHECK(mismatched_frames == 0);
+}
+
+int main()
+{
+	sap_reuses_removed_proxy();
+	sweep_and_prune sap;
+	random_scene(make_broadphase(sap), true);
+	bvh_broadphase bvh;
+	random_scene(make_broadphase(bvh), false);
+	return test_result("broadphase_test");
+}
@@ -0,0 +1,280 @@
+#include "test_common.h"
+#include "collections.h"
+#include <string.h>
+#include <deque>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+//The engine containers against the std ones they replace.
+//containers: flat_hash_map against std::unordered_map, small_vector against std::vector and ring_buffer against
+//std::deque, single threaded.
+//queues: throughput of mpmc_queue and spsc_queue against a mutex protected std::queue of the same capacity,
+//with more threads than queue ends so producers and consumers contend on the indices.
+//usage: collections_bench [containers|queues|all]
+
+//the baseline, bounded like the lock free queues
+struct locked_queue
+{
+	std::mutex mutex;
+	std::queue<uint64_t> q;
+	size_t capacity = 1024;
+
+	bool try_push(uint64_t v)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (q.size() == capacity)
+		{
+			return false;
+		}
+		q.push(v);
+		return true;
+	}
+
+	bool try_pop(uint64_t& v)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (q.empty())
+		{
+			return false;
+		}
+		v = q.front();
+		q.pop();
+		return true;
+	}
+};
+
+template<class QUEUE>
+static void run(const char* name, uint32_t producers, uint32_t consumers, uint64_t per_producer)
+{
+	QUEUE* q = new QUEUE();
+	std::atomic<uint64_t> consumed(0);
+	std::atomic<uint64_t> sum(0);
+	const uint64_t total = producers * per_producer;
+	std::vector<std::thread> threads;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (uint32_t p = 0; p < producers; p++)
+	{
+		threads.emplace_back([q, per_producer]()
+		{
+			for (uint64_t i = 0; i < per_producer;)
+			{
+				if (q->try_push(i))
+				{
+					i++;
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+	for (uint32_t c = 0; c < consumers; c++)
+	{
+		threads.emplace_back([q, &consumed, &sum, total]()
+		{
+			uint64_t local = 0;
+			uint64_t v;
+			while (consumed.load(std::memory_order_relaxed) < total)
+			{
+				if (q->try_pop(v))
+				{
+					local += v;
+					consumed.fetch_add(1, std::memory_order_relaxed);
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+			sum.fetch_add(local);
+		});
+	}
+	for (std::thread& t : threads)
+	{
+		t.join();
+	}
+	double ms = elapsed_ms(start);
+	//keeps the consumers' work from being optimized out, and catches a lost value
+	const uint64_t expected = producers * (per_producer * (per_producer - 1) / 2);
+	printf("%-10s %2u producers %2u consumers: %8.1f ms, %7.2f M ops/s%s\n", name, producers, consumers, ms,
+		total / ms / 1000.0, sum.load() == expected ? "" : "  SUM MISMATCH");
+	delete q;
+}
+
+//keeps results alive so the loops aren't optimized out
+static volatile uint64_t sink;
+
+static void print_row(const char* what, double ours, double theirs)
+{
+	printf("%-34s %10.2f ms %10.2f ms %8.2fx\n", what, ours, theirs, theirs / ours);
+}
+
+//random keys, found both ways and missed, then all erased
+static void hash_maps(uint32_t count)
+{
+	std::mt19937 rng(1);
+	std::vector<uint32_t> keys(count);
+	std::vector<uint32_t> misses(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		keys[i] = rng();
+		misses[i] = rng();
+	}
+	flat_hash_map<uint32_t, uint32_t> ours;
+	std::unordered_map<uint32_t, uint32_t> theirs;
+	uint64_t sum = 0;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < count; i++)
+	{
+		ours[keys[i]] = i;
+	}
+	double ours_ms = elapsed_ms(start);
+	start = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < count; i++)
+	{
+		theirs[keys[i]] = i;
+	}
+	print_row("hash map insert", ours_ms, elapsed_ms(start));
+
+	start = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < count; i++)
+	{
+		sum += ours.find(keys[i])->second;
+	}
+	ours_ms = elapsed_ms(start);
+	start = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < count; i++)
+	{
+		sum += theirs.find(keys[i])->second;
+	}
+	print_row("hash map find hit", ours_ms, elapsed_ms(start));
+
+	start = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < count; i++)
+	{
+		sum += ours.contains(misses[i]);
+	}
+	ours_ms = elapsed_ms(start);
+	start = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < count; i++)
+	{
+		sum += theirs.count(misses[i]);
+	}
+	print_row("hash map find miss", ours_ms, elapsed_ms(start));
+
+	start = std::chrono::high_resolution_clock::now();
+	for (auto& kv : ours)
+	{
+		sum += kv.second;
+	}
+	ours_ms = elapsed_ms(start);
+	start = std::chrono::high_resolution_clock::now();
+	for (auto& kv : theirs)
+	{
+		sum += kv.second;
+	}
+	print_row("hash map iterate", ours_ms, elapsed_ms(start));
+
+	start = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < count; i++)
+	{
+		sum += ours.erase(keys[i]);
+	}
+	ours_ms = elapsed_ms(start);
+	start = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < count; i++)
+	{
+		sum += theirs.erase(keys[i]);
+	}
+	print_row("hash map erase", ours_ms, elapsed_ms(start));
+	sink = sum;
+}
+
+//many short lists built and thrown away, like per entity scratch lists in a system update
+template<class VECTOR>
+static double short_lists(uint32_t lists, uint32_t length)
+{
+	uint64_t sum = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (uint32_t l = 0; l < lists; l++)
+	{
+		VECTOR v;
+		for (uint32_t i = 0; i < length; i++)
+		{
+			v.push_back(l + i);
+		}
+		for (uint32_t x : v)
+		{
+			sum += x;
+		}
+	}
+	sink = sum;
+	return elapsed_ms(start);
+}
+
+//a sliding window, push at the back and pop at the front once it's full
+template<class QUEUE>
+static double sliding_window(uint32_t count, uint32_t window)
+{
+	QUEUE q;
+	uint64_t sum = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < count; i++)
+	{
+		q.push_back(i);
+		if (q.size() > window)
+		{
+			sum += q.front();
+			q.pop_front();
+		}
+	}
+	sink = sum;
+	return elapsed_ms(start);
+}
+
+static void containers()
+{
+	printf("%-34s %13s %13s %9s\n", "", "engine", "std", "speedup");
+	hash_maps(1000000);
+	print_row("1M lists of 8, small_vector<8>", short_lists<small_vector<uint32_t, 8>>(1000000, 8),
+		short_lists<std::vector<uint32_t>>(1000000, 8));
+	print_row("100k lists of 64, small_vector<8>", short_lists<small_vector<uint32_t, 8>>(100000, 64),
+		short_lists<std::vector<uint32_t>>(100000, 64));
+	print_row("10M through window of 1000, ring", sliding_window<ring_buffer<uint32_t>>(10000000, 1000),
+		sliding_window<std::deque<uint32_t>>(10000000, 1000));
+}
+
+static void queues()
+{
+	const uint32_t hardware = std::max(2u, std::thread::hardware_concurrency());
+	const uint64_t count = 2000000;
+	run<spsc_queue<uint64_t, 1024>>("spsc", 1, 1, count);
+	run<mpmc_queue<uint64_t, 1024>>("mpmc", 1, 1, count);
+	run<locked_queue>("mutex", 1, 1, count);
+	for (uint32_t threads = 2; threads <= hardware; threads *= 2)
+	{
+		run<mpmc_queue<uint64_t, 1024>>("mpmc", threads, threads, count / threads);
+		run<locked_queue>("mutex", threads, threads, count / threads);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const char* mode = argc > 1 ? argv[1] : "all";
+	const bool all = strcmp(mode, "all") == 0;
+	if (all || strcmp(mode, "containers") == 0)
+	{
+		containers();
+	}
+	if (all || strcmp(mode, "queues") == 0)
+	{
+		queues();
+	}
+	return 0;
+}
@@ -0,0 +1,487 @@
+#include "test_common.h"
+#include "collections.h"
+#include <deque>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+//flat_hash_map, small_vector and ring_buffer against the std containers they stand in for, and conservation and
+//ordering of the lock free queues under contention. Run a -DEMBER_SANITIZE=thread build too, a data race in a queue
+//shows up there long before it shows up as a lost value.
+
+//counts what the containers ask for, to check they go through ALLOC and give everything back
+struct counting_allocator
+{
+	int* live;
+
+	void* allocate(size_t bytes, size_t alignment)
+	{
+		(*live)++;
+		return ::operator new(bytes, std::align_val_t(alignment));
+	}
+
+	void deallocate(void* ptr, size_t alignment)
+	{
+		(*live)--;
+		::operator delete(ptr, std::align_val_t(alignment));
+	}
+};
+
+//constructions minus destructions, a container that leaks or double destroys an element leaves it off zero
+static int live_items = 0;
+
+struct tracked
+{
+	std::string value;
+
+	tracked() { live_items++; }
+	tracked(const std::string& v) : value(v) { live_items++; }
+	tracked(const tracked& other) : value(other.value) { live_items++; }
+	tracked(tracked&& other) noexcept : value(std::move(other.value)) { live_items++; }
+	tracked& operator=(const tracked& other) { value = other.value; return *this; }
+	tracked& operator=(tracked&& other) noexcept { value = std::move(other.value); return *this; }
+	~tracked() { live_items--; }
+};
+
+//random inserts, overwrites and erases mirrored in std::unordered_map, compared after every step by lookups and
+//by walking the whole map. Key ranges are picked so the table grows through several sizes and erases run often
+static void flat_hash_map_against_std()
+{
+	std::mt19937 rng(3);
+	int blocks = 0;
+	{
+		flat_hash_map<uint32_t, tracked, std::hash<uint32_t>, std::equal_to<uint32_t>, counting_allocator> map(counting_allocator{ &blocks });
+		std::unordered_map<uint32_t, std::string> reference;
+		int lookups_wrong = 0;
+		int walks_wrong = 0;
+		for (int step = 0; step < 20000; step++)
+		{
+			//the key range widens as it goes so the table keeps growing
+			const uint32_t key = rng() % (64 + step / 4);
+			const std::string value = std::to_string(rng());
+			switch (rng() % 4)
+			{
+			case 0:
+			{
+				auto result = map.emplace(key, value);
+				auto expected = reference.emplace(key, value);
+				lookups_wrong += result.second != expected.second || result.first->first != key || result.first->second.value != expected.first->second;
+			} break;
+			case 1:
+				map[key].value = value;
+				reference[key] = value;
+				break;
+			case 2:
+				lookups_wrong += map.erase(key) != (reference.erase(key) == 1);
+				break;
+			default:
+			{
+				auto it = map.find(key);
+				auto expected = reference.find(key);
+				lookups_wrong += (it == map.end()) != (expected == reference.end());
+				lookups_wrong += it != map.end() && it->second.value != expected->second;
+			} break;
+			}
+			lookups_wrong += map.size() != reference.size() || map.contains(key) != (reference.count(key) == 1);
+
+			if (step % 500 == 0)
+			{
+				size_t visited = 0;
+				for (auto& kv : map)
+				{
+					auto expected = reference.find(kv.first);
+					walks_wrong += expected == reference.end() || expected->second != kv.second.value;
+					visited++;
+				}
+				walks_wrong += visited != reference.size();
+			}
+		}
+		CHECK(lookups_wrong == 0);
+		CHECK(walks_wrong == 0);
+		CHECK(live_items == (int)map.size());
+
+		//reserve up front and then fill without growing
+		flat_hash_map<uint32_t, uint32_t> reserved;
+		reserved.reserve(1000);
+		auto first = reserved.emplace(0u, 0u).first;
+		uint32_t* first_value = &first->second;
+		for (uint32_t i = 1; i < 1000; i++)
+		{
+			reserved[i] = i;
+		}
+		CHECK(&reserved.find(0)->second == first_value);
+		CHECK(reserved.size() == 1000);
+
+		//moving hands the table over, clearing keeps it
+		flat_hash_map<uint32_t, tracked, std::hash<uint32_t>, std::equal_to<uint32_t>, counting_allocator> moved(std::move(map));
+		CHECK(map.size() == 0 && map.find(1) == map.end() && map.begin() == map.end());
+		CHECK(moved.size() == reference.size());
+		moved.clear();
+		CHECK(moved.empty() && moved.begin() == moved.end());
+		CHECK(live_items == 0);
+		CHECK(blocks == 2);
+		moved[7].value = "seven";
+		CHECK(moved.size() == 1 && moved.find(7)->second.value == "seven");
+	}
+	CHECK(live_items == 0);
+	CHECK(blocks == 0);
+}
+
+static void small_vector_against_std()
+{
+	int blocks = 0;
+	{
+		small_vector<tracked, 4, counting_allocator> v(counting_allocator{ &blocks });
+		std::vector<std::string> reference;
+		//inline up to N, nothing allocated
+		for (int i = 0; i < 4; i++)
+		{
+			v.push_back(tracked(std::to_string(i)));
+			reference.push_back(std::to_string(i));
+		}
+		CHECK(v.is_inline() && blocks == 0 && v.capacity() == 4);
+		//one past N moves to the heap, pushing an element of the vector itself has to survive the move
+		v.push_back(v[0]);
+		reference.push_back(reference[0]);
+		CHECK(!v.is_inline() && blocks == 1);
+		for (int i = 5; i < 100; i++)
+		{
+			v.emplace_back(std::to_string(i));
+			reference.push_back(std::to_string(i));
+		}
+		v.pop_back();
+		reference.pop_back();
+		v.resize(60);
+		reference.resize(60);
+		v.resize(70);
+		reference.resize(70);
+
+		bool same = v.size() == reference.size();
+		for (uint32_t i = 0; same && i < v.size(); i++)
+		{
+			same = v[i].value == reference[i];
+		}
+		CHECK(same);
+		size_t walked = 0;
+		for (const tracked& t : v)
+		{
+			walked += t.value == reference[walked];
+		}
+		CHECK(walked == reference.size());
+		CHECK(live_items == 70);
+
+		//copies are deep, a moved from heap vector hands its block over and falls back to inline
+		small_vector<tracked, 4, counting_allocator> copy(v);
+		CHECK(blocks == 2 && copy.size() == 70 && copy[69].value == v[69].value);
+		small_vector<tracked, 4, counting_allocator> moved(std::move(v));
+		CHECK(blocks == 2 && moved.size() == 70 && v.empty() && v.is_inline());
+		CHECK(live_items == 140);
+
+		//a moved inline vector moves its elements
+		small_vector<tracked, 4, counting_allocator> small(counting_allocator{ &blocks });
+		small.emplace_back("a");
+		small.emplace_back("b");
+		small_vector<tracked, 4, counting_allocator> small_moved(std::move(small));
+		CHECK(small_moved.is_inline() && small_moved.size() == 2 && small_moved[1].value == "b" && small.empty());
+
+		copy.dispose();
+		CHECK(copy.is_inline() && blocks == 1);
+	}
+	CHECK(live_items == 0);
+	CHECK(blocks == 0);
+}
+
+//pushes and pops at both ends mirrored in std::deque, so the contents wrap around the end of the storage and grow
+//while wrapped
+static void ring_buffer_against_std()
+{
+	std::mt19937 rng(9);
+	int blocks = 0;
+	{
+		ring_buffer<tracked, counting_allocator> ring(counting_allocator{ &blocks });
+		std::deque<std::string> reference;
+		int wrong = 0;
+		for (int step = 0; step < 20000; step++)
+		{
+			//drifts towards growing for the first half and towards emptying for the second
+			const uint32_t r = rng() % 10;
+			const bool push = step < 10000 ? r < 6 : r < 4;
+			const std::string value = std::to_string(step);
+			if (push || reference.empty())
+			{
+				if (rng() % 2)
+				{
+					ring.push_back(tracked(value));
+					reference.push_back(value);
+				}
+				else
+				{
+					ring.push_front(tracked(value));
+					reference.push_front(value);
+				}
+			}
+			else if (rng() % 2)
+			{
+				wrong += ring.back().value != reference.back();
+				ring.pop_back();
+				reference.pop_back();
+			}
+			else
+			{
+				wrong += ring.front().value != reference.front();
+				ring.pop_front();
+				reference.pop_front();
+			}
+			wrong += ring.size() != reference.size();
+			if (step % 500 == 0)
+			{
+				for (uint32_t i = 0; i < ring.size(); i++)
+				{
+					wrong += ring[i].value != reference[i];
+				}
+			}
+		}
+		CHECK(wrong == 0);
+		CHECK(live_items == (int)ring.size());
+		CHECK((ring.capacity() & (ring.capacity() - 1)) == 0);
+		CHECK(blocks == 1);
+		ring.clear();
+		CHECK(ring.empty() && live_items == 0);
+	}
+	CHECK(blocks == 0);
+}
+
+constexpr uint32_t PRODUCER_SHIFT = 24;
+constexpr uint32_t SEQUENCE_MASK = (1u << PRODUCER_SHIFT) - 1;
+
+static void single_thread()
+{
+	mpmc_queue<uint32_t, 8> q;
+	uint32_t v;
+	CHECK(!q.try_pop(v));
+	for (uint32_t i = 0; i < 8; i++)
+	{
+		CHECK(q.try_push(i));
+	}
+	CHECK(!q.try_push(8));
+	CHECK(q.size() == 8);
+	for (uint32_t i = 0; i < 8; i++)
+	{
+		CHECK(q.try_pop(v) && v == i);
+	}
+	CHECK(!q.try_pop(v));
+
+	//wraps around the ring a few times with batches that don't divide the capacity
+	spsc_queue<uint32_t, 8> s;
+	uint32_t in[5];
+	uint32_t out[5];
+	uint32_t next_in = 0;
+	uint32_t next_out = 0;
+	for (int round = 0; round < 20; round++)
+	{
+		for (uint32_t i = 0; i < 5; i++)
+		{
+			in[i] = next_in + i;
+		}
+		next_in += s.try_push(in, 5);
+		uint32_t n = s.try_pop(out, 3);
+		for (uint32_t i = 0; i < n; i++)
+		{
+			CHECK(out[i] == next_out + i);
+		}
+		next_out += n;
+	}
+	CHECK(s.size() == next_in - next_out);
+	CHECK(s.size() <= 8);
+}
+
+//every value is consumed exactly once, and a consumer sees each producer's values in the order they were pushed
+static void mpmc_contention(uint32_t producers, uint32_t consumers, uint32_t per_producer, bool batched)
+{
+	mpmc_queue<uint32_t, 64> q;
+	std::atomic<uint32_t> consumed(0);
+	const uint32_t total = producers * per_producer;
+	std::vector<std::vector<uint32_t>> received(consumers);
+	std::vector<std::thread> threads;
+
+	for (uint32_t p = 0; p < producers; p++)
+	{
+		threads.emplace_back([&q, p, per_producer, batched]()
+		{
+			uint32_t values[7];
+			uint32_t i = 0;
+			while (i < per_producer)
+			{
+				if (batched)
+				{
+					uint32_t n = std::min<uint32_t>(7, per_producer - i);
+					for (uint32_t k = 0; k < n; k++)
+					{
+						values[k] = (p << PRODUCER_SHIFT) | (i + k);
+					}
+					i += q.try_push(values, n);
+				}
+				else if (q.try_push((p << PRODUCER_SHIFT) | i))
+				{
+					i++;
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+	for (uint32_t c = 0; c < consumers; c++)
+	{
+		threads.emplace_back([&q, &consumed, &received, c, total, batched]()
+		{
+			uint32_t values[5];
+			while (consumed.load(std::memory_order_relaxed) < total)
+			{
+				uint32_t n = batched ? q.try_pop(values, 5) : (q.try_pop(values[0]) ? 1 : 0);
+				if (n == 0)
+				{
+					std::this_thread::yield();
+					continue;
+				}
+				received[c].insert(received[c].end(), values, values + n);
+				consumed.fetch_add(n, std::memory_order_relaxed);
+			}
+		});
+	}
+	for (std::thread& t : threads)
+	{
+		t.join();
+	}
+
+	std::vector<uint8_t> seen(total, 0);
+	bool ordered = true;
+	for (const std::vector<uint32_t>& r : received)
+	{
+		std::vector<int64_t> last(producers, -1);
+		for (uint32_t v : r)
+		{
+			uint32_t p = v >> PRODUCER_SHIFT;
+			uint32_t i = v & SEQUENCE_MASK;
+			CHECK(p < producers && i < per_producer);
+			if (p >= producers || i >= per_producer)
+			{
+				continue;
+			}
+			seen[p * per_producer + i]++;
+			ordered = ordered && (int64_t)i > last[p];
+			last[p] = i;
+		}
+	}
+	uint32_t missing = 0;
+	uint32_t duplicated = 0;
+	for (uint8_t s : seen)
+	{
+		missing += s == 0;
+		duplicated += s > 1;
+	}
+	CHECK(missing == 0);
+	CHECK(duplicated == 0);
+	CHECK(ordered);
+	CHECK(consumed.load() == total);
+}
+
+//the consumer sees exactly the sequence the producer pushed
+static void spsc_contention(uint32_t count, bool batched)
+{
+	spsc_queue<uint32_t, 64> q;
+	uint32_t mismatches = 0;
+	std::thread producer([&q, count, batched]()
+	{
+		uint32_t values[9];
+		uint32_t i = 0;
+		while (i < count)
+		{
+			uint32_t n = batched ? std::min<uint32_t>(9, count - i) : 1;
+			for (uint32_t k = 0; k < n; k++)
+			{
+				values[k] = i + k;
+			}
+			uint32_t pushed = q.try_push(values, n);
+			if (pushed == 0)
+			{
+				std::this_thread::yield();
+			}
+			i += pushed;
+		}
+	});
+	std::thread consumer([&q, &mismatches, count, batched]()
+	{
+		uint32_t values[11];
+		uint32_t expected = 0;
+		while (expected < count)
+		{
+			uint32_t n = q.try_pop(values, batched ? 11 : 1);
+			if (n == 0)
+			{
+				std::this_thread::yield();
+			}
+			for (uint32_t k = 0; k < n; k++)
+			{
+				mismatches += values[k] != expected++;
+			}
+		}
+	});
+	producer.join();
+	consumer.join();
+	CHECK(mismatches == 0);
+	CHECK(q.size() == 0);
+}
+
+//undoes flat_hash_map's fibonacci multiply so keys land where the test wants: k << 48 puts every key below 2^16
+//into slot 0 of a table smaller than 2^16 slots, runs far longer than a probe distance byte can hold
+struct clustering_hash
+{
+	size_t operator()(uint32_t k) const
+	{
+		return (size_t)(((uint64_t)k << 48) * 0xf1de83e19937733dull);
+	}
+};
+
+static void flat_hash_map_long_runs()
+{
+	flat_hash_map<uint32_t, uint32_t, clustering_hash> map;
+	for (uint32_t i = 0; i < 1000; i++)
+	{
+		map[i] = i * 3;
+	}
+	CHECK(map.size() == 1000);
+	int wrong = 0;
+	for (uint32_t i = 0; i < 1000; i++)
+	{
+		auto it = map.find(i);
+		wrong += it == map.end() || it->second != i * 3;
+	}
+	CHECK(wrong == 0);
+	uint32_t visited = 0;
+	for (auto& kv : map)
+	{
+		visited += kv.second == kv.first * 3;
+	}
+	CHECK(visited == 1000);
+}
+
+int main()
+{
+	flat_hash_map_against_std();
+	flat_hash_map_long_runs();
+	small_vector_against_std();
+	ring_buffer_against_std();
+	single_thread();
+	mpmc_contention(1, 1, 100000, false);
+	mpmc_contention(4, 4, 50000, false);
+	mpmc_contention(4, 4, 50000, true);
+	mpmc_contention(8, 2, 20000, false);
+	mpmc_contention(2, 8, 50000, true);
+	spsc_contention(200000, false);
+	spsc_contention(200000, true);
+	return test_result("collections_test");
+}
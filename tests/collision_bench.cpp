@@ -0,0 +1,333 @@
+//validate() checks through assert
+#undef NDEBUG
+#include "test_common.h"
+#include "collision.h"
+#include "narrowphase.h"
+#include <string.h>
+#include <random>
+#include <vector>
+
+//The broadphase and narrowphase on their own, without a scene around them.
+//tree: 50k boxes moving through a flat world, what the dynamic tree sees from a crowd of rigid bodies. Reports the
+//cost of tree::move and tree::find_pairs per frame, and how the tree's quality drifts: area_ratio() against a tree
+//built from scratch over the same boxes, and the height, with validate() on every report.
+//gjk: pairs per second through gjk::intersect for every shape combination, cold and warm started, next to the
+//closed form routines the narrowphase uses where there is one.
+//narrowphase: the same pairs through narrowphase::run on 1, 2, 4 and every hardware thread, and the speedup over one.
+//usage: collision_bench [tree|gjk|narrowphase|all] [frames] [boxes] [pairs]
+
+struct moving_box
+{
+	float3 position;
+	float3 velocity;
+	float3 half_extents;
+	int proxy;
+};
+
+static aabb box_of(const moving_box& b)
+{
+	aabb box;
+	box.lower_bound = b.position - b.half_extents;
+	box.upper_bound = b.position + b.half_extents;
+	return box;
+}
+
+static std::mt19937 rng(5);
+
+static float random_float(float lower, float upper)
+{
+	return std::uniform_real_distribution<float>(lower, upper)(rng);
+}
+
+static void tree_benchmark(int frames, int count)
+{
+	const float dt = 1.0f / 60.0f;
+	//wide and low like a level, dense enough that most boxes touch another one
+	float3 world(150.0f, 10.0f, 150.0f);
+
+	std::vector<moving_box> boxes(count);
+	tree t;
+	for (int i = 0; i < count; i++)
+	{
+		moving_box& b = boxes[i];
+		b.position = float3(random_float(-world.x, world.x), random_float(-world.y, world.y), random_float(-world.z, world.z));
+		//a quarter stands still, the rest walk or run
+		float speed = i % 4 == 0 ? 0.0f : random_float(1.0f, 8.0f);
+		b.velocity = math::normalize(float3(random_float(-1, 1), random_float(-0.1f, 0.1f), random_float(-1, 1))) * speed;
+		b.half_extents = float3(random_float(0.3f, 1.5f), random_float(0.3f, 1.5f), random_float(0.3f, 1.5f));
+		b.proxy = t.insert(box_of(b), i);
+	}
+
+	std::vector<collision_pair> pairs;
+	t.find_pairs(pairs);
+	printf("%d boxes, %zu initial pairs\n", count, pairs.size());
+	printf("%8s %10s %10s %8s %8s %8s %8s %8s\n", "frame", "move ms", "pairs ms", "moved", "pairs", "height", "area", "fresh");
+
+	double move_total = 0;
+	double pairs_total = 0;
+	for (int frame = 1; frame <= frames; frame++)
+	{
+		for (moving_box& b : boxes)
+		{
+			b.position = b.position + b.velocity * dt;
+			//bounce off the walls
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (fabsf(b.position[axis]) > world[axis])
+				{
+					b.velocity[axis] = -b.velocity[axis];
+				}
+			}
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+		int moved = 0;
+		for (const moving_box& b : boxes)
+		{
+			moved += t.move(b.proxy, box_of(b), b.velocity * dt);
+		}
+		double move_ms = elapsed_ms(start);
+
+		start = std::chrono::high_resolution_clock::now();
+		t.find_pairs(pairs);
+		double pairs_ms = elapsed_ms(start);
+		move_total += move_ms;
+		pairs_total += pairs_ms;
+
+		if (frame % 100 == 0 || frame == frames)
+		{
+			t.validate();
+			tree fresh;
+			for (int i = 0; i < count; i++)
+			{
+				fresh.insert(box_of(boxes[i]), i);
+			}
+			printf("%8d %10.3f %10.3f %8d %8zu %8d %8.1f %8.1f\n", frame, move_ms, pairs_ms, moved, pairs.size(),
+				t.height(), t.area_ratio(), fresh.area_ratio());
+		}
+	}
+	printf("average per frame: move %.3f ms, find_pairs %.3f ms\n", move_total / frames, pairs_total / frames);
+}
+
+//randomly turned, a little bigger or smaller than a person
+static support_data random_shape(collider_type type)
+{
+	support_data s;
+	memset(&s, 0, sizeof(s));
+	s.col.type = type;
+	quaternion rotation = math::normalize(quaternion(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1), random_float(-1, 1)));
+	math::to_float4x4(rotation, s.col.local_to_world);
+	switch (type)
+	{
+	case collider_type::sphere:
+		s.col.radius = random_float(0.3f, 1.0f);
+		break;
+	case collider_type::capsule:
+		s.col.radius = random_float(0.2f, 0.5f);
+		s.col.y_base = -random_float(0.2f, 0.8f);
+		s.col.y_cap = random_float(0.2f, 0.8f);
+		break;
+	default:
+		s.col.x_size = random_float(0.2f, 1.0f);
+		s.col.y_size = random_float(0.2f, 1.0f);
+		s.col.z_size = random_float(0.2f, 1.0f);
+		break;
+	}
+	return s;
+}
+
+//of a sphere around the shape's position that holds all of it
+static float bounding_radius(const support_data& s)
+{
+	switch (s.col.type)
+	{
+	case collider_type::sphere:
+		return s.col.radius;
+	case collider_type::capsule:
+		return std::max(-s.col.y_base, s.col.y_cap) + s.col.radius;
+	default:
+		return math::length(float3(s.col.x_size, s.col.y_size, s.col.z_size));
+	}
+}
+
+struct shape_pair
+{
+	support_data a;
+	support_data b;
+	float3 velocity;
+	gjk::warm_start warm;
+};
+
+static double pairs_per_second(int count, double ms)
+{
+	return count / (ms / 1000.0);
+}
+
+static void gjk_benchmark(int count)
+{
+	const char* names[] = { "sphere", "capsule", "box" };
+	const collider_type types[] = { collider_type::sphere, collider_type::capsule, collider_type::box };
+	//the closed forms narrowphase::initialize picks, null where it falls back to gjk
+	typedef bool (*analytic_function)(const support_data&, const support_data&, contact_data&);
+	const analytic_function analytic_functions[3][3] =
+	{
+		{ analytic::sphere_sphere, analytic::sphere_capsule, analytic::sphere_box },
+		{ nullptr, analytic::capsule_capsule, nullptr },
+		{ nullptr, nullptr, analytic::box_box },
+	};
+
+	printf("%d pairs per combination, from deep overlaps to just apart\n", count);
+	printf("%-18s %8s %12s %12s %12s %10s %10s\n", "pair", "hits", "cold pairs/s", "warm pairs/s", "closed form", "cold iter", "warm iter");
+	epa::polytope polytope;
+	std::vector<shape_pair> pairs(count);
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = i; j < 3; j++)
+		{
+			for (shape_pair& p : pairs)
+			{
+				p.a = random_shape(types[i]);
+				p.b = random_shape(types[j]);
+				p.a.pos = float3(random_float(-100, 100), random_float(-100, 100), random_float(-100, 100));
+				//from one inside the other to clear of each other's bounding spheres, resting contacts are the common case
+				float reach = bounding_radius(p.a) + bounding_radius(p.b);
+				float3 direction = math::normalize(float3(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1)));
+				p.b.pos = p.a.pos + direction * reach * random_float(0.2f, 1.1f);
+				p.velocity = math::normalize(float3(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1))) * 0.01f;
+				p.warm = gjk::warm_start();
+			}
+
+			//the first frame fills the caches and is timed as the cold start
+			contact_data data;
+			int hits = 0;
+			long long cold_iterations = 0;
+			auto start = std::chrono::high_resolution_clock::now();
+			for (shape_pair& p : pairs)
+			{
+				hits += gjk::intersect(p.a, p.b, data, polytope, p.warm);
+				cold_iterations += p.warm.iterations;
+			}
+			double cold_ms = elapsed_ms(start);
+
+			//a frame later everything moved a little
+			for (shape_pair& p : pairs)
+			{
+				p.b.pos = p.b.pos + p.velocity;
+			}
+			long long warm_iterations = 0;
+			start = std::chrono::high_resolution_clock::now();
+			for (shape_pair& p : pairs)
+			{
+				gjk::intersect(p.a, p.b, data, polytope, p.warm);
+				warm_iterations += p.warm.iterations;
+			}
+			double warm_ms = elapsed_ms(start);
+
+			char closed_form[32] = "-";
+			if (analytic_functions[i][j] != nullptr)
+			{
+				start = std::chrono::high_resolution_clock::now();
+				int closed_hits = 0;
+				for (const shape_pair& p : pairs)
+				{
+					closed_hits += analytic_functions[i][j](p.a, p.b, data);
+				}
+				double closed_ms = elapsed_ms(start);
+				//keeps the loop from being thrown away
+				if (closed_hits < 0)
+				{
+					printf("%d\n", closed_hits);
+				}
+				snprintf(closed_form, sizeof(closed_form), "%.0f", pairs_per_second(count, closed_ms));
+			}
+
+			char name[32];
+			snprintf(name, sizeof(name), "%s-%s", names[i], names[j]);
+			printf("%-18s %8d %12.0f %12.0f %12s %10.1f %10.1f\n", name, hits, pairs_per_second(count, cold_ms),
+				pairs_per_second(count, warm_ms), closed_form, (double)cold_iterations / count, (double)warm_iterations / count);
+		}
+	}
+}
+
+//the narrowphase over one pair list on 1, 2, 4 and every hardware thread. Pairs of every shape combination, close
+//enough that most touch, drift a little between runs so the warm starts see what a frame of a game gives them
+static void narrowphase_benchmark(int frames, int count)
+{
+	const collider_type types[] = { collider_type::sphere, collider_type::capsule, collider_type::box };
+	std::vector<support_data> shapes(count * 2);
+	std::vector<float3> velocities(count);
+	std::vector<collision_pair> pairs(count);
+	for (int i = 0; i < count; i++)
+	{
+		support_data& a = shapes[i * 2];
+		support_data& b = shapes[i * 2 + 1];
+		a = random_shape(types[i % 3]);
+		b = random_shape(types[(i / 3) % 3]);
+		a.pos = float3(random_float(-100, 100), random_float(-100, 100), random_float(-100, 100));
+		float reach = bounding_radius(a) + bounding_radius(b);
+		float3 direction = math::normalize(float3(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1)));
+		b.pos = a.pos + direction * reach * random_float(0.2f, 1.1f);
+		velocities[i] = math::normalize(float3(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1))) * 0.01f;
+		pairs[i] = collision_pair{ i * 2, i * 2 + 1 };
+	}
+
+	std::vector<uint32_t> worker_counts = { 1, 2, 4, std::max(1U, std::thread::hardware_concurrency()) };
+	std::sort(worker_counts.begin(), worker_counts.end());
+	worker_counts.erase(std::unique(worker_counts.begin(), worker_counts.end()), worker_counts.end());
+
+	printf("%d pairs, %d frames, %u hardware threads\n", count, frames, std::thread::hardware_concurrency());
+	printf("%8s %10s %12s %8s %8s\n", "workers", "ms/frame", "pairs/s", "speedup", "contacts");
+	double single_ms = 0.0;
+	for (uint32_t workers : worker_counts)
+	{
+		//every worker count starts from the same positions and a cold cache
+		std::vector<support_data> moving = shapes;
+		job_system jobs;
+		jobs.initialize(workers);
+		narrowphase phase;
+		phase.initialize(&jobs);
+		phase.run(pairs, moving.data());
+
+		double total_ms = 0.0;
+		for (int frame = 0; frame < frames; frame++)
+		{
+			for (int i = 0; i < count; i++)
+			{
+				moving[i * 2 + 1].pos = moving[i * 2 + 1].pos + velocities[i];
+			}
+			auto start = std::chrono::high_resolution_clock::now();
+			phase.run(pairs, moving.data());
+			total_ms += elapsed_ms(start);
+		}
+		jobs.dispose();
+
+		const double ms = total_ms / frames;
+		if (workers == 1)
+		{
+			single_ms = ms;
+		}
+		printf("%8u %10.3f %12.0f %8.2f %8zu\n", workers, ms, pairs_per_second(count, ms), single_ms / ms, phase.contacts.size());
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const char* mode = argc > 1 ? argv[1] : "all";
+	const int frames = argc > 2 ? atoi(argv[2]) : 300;
+	const int count = argc > 3 ? atoi(argv[3]) : 50000;
+	const int pairs = argc > 4 ? atoi(argv[4]) : 20000;
+	const bool all = strcmp(mode, "all") == 0;
+	if (all || strcmp(mode, "tree") == 0)
+	{
+		tree_benchmark(frames, count);
+	}
+	if (all || strcmp(mode, "gjk") == 0)
+	{
+		gjk_benchmark(pairs);
+	}
+	if (all || strcmp(mode, "narrowphase") == 0)
+	{
+		narrowphase_benchmark(frames, pairs);
+	}
+	return 0;
+}
@@ -0,0 +1,334 @@
+#include "test_common.h"
+#include "collision.h"
+#include <string.h>
+#include <algorithm>
+#include <random>
+
+//gjk::intersect and epa::calculate against closed forms. Overlapping spheres have to converge to the analytic depth:
+//the old epa grew its polytope without bound on them and skipped faces when removing, gjk went round in circles when
+//the origin was on an edge of its simplex, and a pair epa ran out of iterations on was reported as not touching.
+//The narrowphase's closed forms for spheres, capsules and boxes have to agree with gjk and epa on the whole contact.
+
+static std::mt19937 rng(17);
+
+static float random_float(float lower, float upper)
+{
+	return std::uniform_real_distribution<float>(lower, upper)(rng);
+}
+
+static float3 random_direction()
+{
+	return math::normalize(float3(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1)));
+}
+
+static support_data make_shape(collider_type type, const float3& pos, const quaternion& rotation)
+{
+	support_data s;
+	memset(&s, 0, sizeof(s));
+	s.col.type = type;
+	math::to_float4x4(rotation, s.col.local_to_world);
+	s.pos = pos;
+	return s;
+}
+
+static quaternion random_rotation()
+{
+	return math::normalize(quaternion(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1), random_float(-1, 1)));
+}
+
+static support_data make_sphere(const float3& pos, float radius)
+{
+	support_data s = make_shape(collider_type::sphere, pos, quaternion());
+	s.col.radius = radius;
+	return s;
+}
+
+static void spheres_converge_to_analytic_depth()
+{
+	epa::polytope polytope;
+	int missed = 0;
+	int wrong_depth = 0;
+	int wrong_normal = 0;
+	int unstable = 0;
+	float worst = 0.0f;
+	for (int i = 0; i < 3000; i++)
+	{
+		const float ra = random_float(0.2f, 2.0f);
+		const float rb = random_float(0.2f, 2.0f);
+		//from barely touching to the centres 30% of the radii apart, deeper overlaps are checked below
+		const float distance = (ra + rb) * random_float(0.3f, 0.999f);
+		support_data a = make_sphere(float3(random_float(-5, 5), random_float(-5, 5), random_float(-5, 5)), ra);
+		support_data b = make_sphere(a.pos + random_direction() * distance, rb);
+
+		contact_data expected;
+		CHECK(analytic::sphere_sphere(a, b, expected));
+		contact_data c;
+		if (!gjk::intersect(a, b, c, polytope))
+		{
+			missed++;
+			continue;
+		}
+		const float error = fabsf(c.depth - expected.depth);
+		worst = std::max(worst, error);
+		//epa stops once a support point adds less than GROWTH_TOLERANCE
+		wrong_depth += error > 2.0f * epa::GROWTH_TOLERANCE + 1e-4f * (ra + rb);
+		wrong_normal += math::dot(c.normal, expected.normal) < 0.999f;
+
+		//the same pair again on the scratch polytope the last call left behind
+		contact_data again;
+		gjk::intersect(a, b, again, polytope);
+		unstable += again.depth != c.depth;
+	}
+	printf("spheres: worst depth error %.3g\n", worst);
+	CHECK(missed == 0);
+	CHECK(wrong_depth == 0);
+	CHECK(wrong_normal == 0);
+	CHECK(unstable == 0);
+
+	//nearly concentric, and small spheres deep inside big ones. epa runs out of vertices before it gets within its
+	//tolerance of the round surface, but the contact has to be there with a depth short of the real one by little
+	missed = 0;
+	wrong_depth = 0;
+	for (int i = 0; i < 1000; i++)
+	{
+		const float ra = random_float(0.2f, 2.0f);
+		const float rb = i % 2 == 0 ? random_float(0.2f, 2.0f) : ra * random_float(0.02f, 0.1f);
+		const float distance = (ra + rb) * random_float(0.0f, 0.3f);
+		support_data a = make_sphere(float3(0, 0, 0), ra);
+		support_data b = make_sphere(random_direction() * distance, rb);
+		const float expected = ra + rb - distance;
+		contact_data c;
+		if (!gjk::intersect(a, b, c, polytope))
+		{
+			missed++;
+			continue;
+		}
+		wrong_depth += c.depth > expected + 2.0f * epa::GROWTH_TOLERANCE || c.depth < 0.9f * expected;
+	}
+	CHECK(missed == 0);
+	CHECK(wrong_depth == 0);
+
+	//apart, and just short of touching
+	contact_data c;
+	CHECK(!gjk::intersect(make_sphere(float3(0, 0, 0), 1.0f), make_sphere(float3(2.5f, 0, 0), 1.0f), c, polytope));
+	CHECK(!gjk::intersect(make_sphere(float3(0, 0, 0), 1.0f), make_sphere(float3(0, 2.01f, 0), 1.0f), c, polytope));
+}
+
+//warm starting changes how many support points it takes, not the answer
+static void warm_start_matches_cold()
+{
+	epa::polytope polytope;
+	int differ = 0;
+	for (int pair = 0; pair < 200; pair++)
+	{
+		const float ra = random_float(0.5f, 1.5f);
+		const float rb = random_float(0.5f, 1.5f);
+		support_data a = make_sphere(float3(0, 0, 0), ra);
+		support_data b = make_sphere(random_direction() * random_float(0.5f, 4.0f), rb);
+		const float3 velocity = random_direction() * 0.05f;
+		gjk::warm_start warm = gjk::warm_start();
+		for (int frame = 0; frame < 30; frame++)
+		{
+			b.pos = b.pos + velocity;
+			const float distance = math::length(b.pos);
+			contact_data cold_contact;
+			contact_data warm_contact;
+			const bool cold_hit = gjk::intersect(a, b, cold_contact, polytope);
+			const bool warm_hit = gjk::intersect(a, b, warm_contact, polytope, warm);
+			//the last bit of a grazing contact may go either way
+			if (fabsf(distance - ra - rb) < 1e-4f)
+			{
+				continue;
+			}
+			//within where epa converges, see above
+			const bool converges = distance > 0.3f * (ra + rb);
+			if (cold_hit != warm_hit || (cold_hit && converges && fabsf(cold_contact.depth - warm_contact.depth) > 2.0f * epa::GROWTH_TOLERANCE))
+			{
+				differ++;
+			}
+		}
+	}
+	CHECK(differ == 0);
+}
+
+//rotated boxes against the separating axis test, which only shares the support function's box layout
+static void boxes_match_sat()
+{
+	epa::polytope polytope;
+	int compared = 0;
+	int wrong_depth = 0;
+	int missed = 0;
+	for (int i = 0; i < 2000; i++)
+	{
+		quaternion ra = math::normalize(quaternion(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1), random_float(-1, 1)));
+		quaternion rb = math::normalize(quaternion(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1), random_float(-1, 1)));
+		support_data a = make_shape(collider_type::box, float3(0, 0, 0), ra);
+		support_data b = make_shape(collider_type::box, float3(random_float(-1.5f, 1.5f), random_float(-1.5f, 1.5f), random_float(-1.5f, 1.5f)), rb);
+		a.col.x_size = random_float(0.3f, 0.8f);
+		a.col.y_size = random_float(0.3f, 0.8f);
+		a.col.z_size = random_float(0.3f, 0.8f);
+		b.col.x_size = random_float(0.3f, 0.8f);
+		b.col.y_size = random_float(0.3f, 0.8f);
+		b.col.z_size = random_float(0.3f, 0.8f);
+
+		contact_data expected;
+		contact_data c;
+		const bool sat = analytic::box_box(a, b, expected);
+		const bool hit = gjk::intersect(a, b, c, polytope);
+		//grazing contacts may go either way
+		if (!sat || expected.depth < 0.02f)
+		{
+			continue;
+		}
+		compared++;
+		if (!hit)
+		{
+			missed++;
+			continue;
+		}
+		//box_box prefers face axes by a small bias, epa takes the true minimum
+		wrong_depth += fabsf(c.depth - expected.depth) > 0.05f;
+	}
+	CHECK(compared > 500);
+	CHECK(missed == 0);
+	CHECK(wrong_depth == 0);
+}
+
+static support_data make_capsule(const float3& pos, float radius)
+{
+	support_data s = make_shape(collider_type::capsule, pos, random_rotation());
+	s.col.radius = radius;
+	s.col.y_base = -random_float(0.2f, 1.0f);
+	s.col.y_cap = random_float(0.2f, 1.0f);
+	return s;
+}
+
+static support_data make_box(const float3& pos)
+{
+	support_data s = make_shape(collider_type::box, pos, random_rotation());
+	s.col.x_size = random_float(0.3f, 1.0f);
+	s.col.y_size = random_float(0.3f, 1.0f);
+	s.col.z_size = random_float(0.3f, 1.0f);
+	return s;
+}
+
+//how much nearer the sphere's center is to the box's nearest face than to the next one
+static float second_face_margin(const support_data& sphere, const support_data& box)
+{
+	const float size[] = { box.col.x_size, box.col.y_size, box.col.z_size };
+	float distances[3];
+	for (int i = 0; i < 3; i++)
+	{
+		distances[i] = size[i] - math::abs(math::dot(sphere.pos - box.pos, local_axis(box.col, i)));
+	}
+	std::sort(distances, distances + 3);
+	return distances[1] - distances[0];
+}
+
+//how far gjk and epa are from a closed form over a run of pairs
+struct agreement
+{
+	int compared = 0;
+	int missed = 0;
+	int wrong_depth = 0;
+	int wrong_normal = 0;
+	int wrong_points = 0;
+	float worst_depth = 0.0f;
+	float worst_point = 0.0f;
+};
+
+static float distance(const float3& a, const float3& b)
+{
+	return sqrtf(math::sqr_length(a - b));
+}
+
+static void compare(const support_data& a, const support_data& b, const contact_data& expected, epa::polytope& polytope, agreement& result)
+{
+	result.compared++;
+	contact_data c;
+	if (!gjk::intersect(a, b, c, polytope))
+	{
+		result.missed++;
+		return;
+	}
+	const float depth_error = fabsf(c.depth - expected.depth);
+	const float point_error = std::max(distance(c.world_space_point_a, expected.world_space_point_a),
+		distance(c.world_space_point_b, expected.world_space_point_b));
+	result.worst_depth = std::max(result.worst_depth, depth_error);
+	result.worst_point = std::max(result.worst_point, point_error);
+	result.wrong_depth += depth_error > 2.0f * epa::GROWTH_TOLERANCE + 1e-4f;
+	result.wrong_normal += math::dot(c.normal, expected.normal) < 0.999f;
+	//the points come from the barycentric coordinates of the closest face, which is off the round surface by the
+	//angle the face spans
+	result.wrong_points += point_error > 0.03f;
+}
+
+static void check(const char* name, const agreement& result, int least_compared)
+{
+	printf("%s: %d compared, worst depth error %.3g, worst point error %.3g\n", name, result.compared, result.worst_depth, result.worst_point);
+	CHECK(result.compared >= least_compared);
+	CHECK(result.missed == 0);
+	CHECK(result.wrong_depth == 0);
+	CHECK(result.wrong_normal == 0);
+	CHECK(result.wrong_points == 0);
+}
+
+//sphere_capsule, capsule_capsule and sphere_box against gjk and epa on normal, depth and both points. Like the
+//spheres above, only overlaps where the round parts stay 30% of their radii apart are compared, deeper than that
+//epa runs out of vertices first
+static void closed_forms_match_gjk()
+{
+	epa::polytope polytope;
+	agreement sphere_capsule;
+	agreement capsule_capsule;
+	agreement sphere_box_outside;
+	agreement sphere_box_inside;
+	for (int i = 0; i < 3000; i++)
+	{
+		const float ra = random_float(0.2f, 1.0f);
+		const float rb = random_float(0.2f, 1.0f);
+		contact_data expected;
+
+		support_data sphere = make_sphere(float3(random_float(-2, 2), random_float(-2, 2), random_float(-2, 2)), ra);
+		support_data capsule = make_capsule(float3(0, 0, 0), rb);
+		if (analytic::sphere_capsule(sphere, capsule, expected) && expected.depth < 0.7f * (ra + rb))
+		{
+			compare(sphere, capsule, expected, polytope, sphere_capsule);
+		}
+
+		//about parallel capsules touch along a line and either end of it is right
+		support_data other = make_capsule(float3(random_float(-2, 2), random_float(-2, 2), random_float(-2, 2)), ra);
+		if (math::abs(math::dot(local_axis(other.col, 1), local_axis(capsule.col, 1))) < 0.95f &&
+			analytic::capsule_capsule(other, capsule, expected) && expected.depth < 0.7f * (ra + rb))
+		{
+			compare(other, capsule, expected, polytope, capsule_capsule);
+		}
+
+		support_data box = make_box(float3(0, 0, 0));
+		sphere.pos = float3(random_float(-1.5f, 1.5f), random_float(-1.5f, 1.5f), random_float(-1.5f, 1.5f));
+		if (analytic::sphere_box(sphere, box, expected))
+		{
+			//the center is inside when the contact reaches past a whole radius
+			const bool inside = expected.depth >= ra;
+			//a center on about equally near faces may go out through either
+			const float margin = inside ? second_face_margin(sphere, box) : 1.0f;
+			if (margin > 0.02f && (inside || expected.depth < 0.7f * ra))
+			{
+				compare(sphere, box, expected, polytope, inside ? sphere_box_inside : sphere_box_outside);
+			}
+		}
+	}
+	check("sphere capsule", sphere_capsule, 500);
+	check("capsule capsule", capsule_capsule, 500);
+	check("sphere box, center outside", sphere_box_outside, 500);
+	check("sphere box, center inside", sphere_box_inside, 100);
+}
+
+int main()
+{
+	spheres_converge_to_analytic_depth();
+	warm_start_matches_cold();
+	boxes_match_sat();
+	closed_forms_match_gjk();
+	return test_result("gjk_test");
+}
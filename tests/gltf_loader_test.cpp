@@ -0,0 +1,355 @@
+#include "test_common.h"
+#include "gltf_loader.h"
+#include <random>
+#include <string>
+#include <algorithm>
+
+//get_joint_remap against random hierarchies written in shuffled node order: the loaded rig has every parent
+//before its children, and what a vertex ends up skinned with is what the file asked for in its own node order.
+
+static std::mt19937 rng(40);
+
+static float random_float(float lower, float upper)
+{
+	return std::uniform_real_distribution<float>(lower, upper)(rng);
+}
+
+static int random_int(int lower, int upper)
+{
+	return std::uniform_int_distribution<int>(lower, upper)(rng);
+}
+
+static transform random_transform()
+{
+	transform t;
+	t.position = float3(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1));
+	t.rotation = math::normalize(quaternion(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1), random_float(-1, 1)));
+	t.scale = float3(1, 1, 1) * random_float(0.8f, 1.2f);
+	return t;
+}
+
+static std::string base64(const std::vector<uint8_t>& bytes)
+{
+	const char* digits = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	std::string result;
+	for (size_t i = 0; i < bytes.size(); i += 3)
+	{
+		uint32_t group = bytes[i] << 16;
+		group |= i + 1 < bytes.size() ? bytes[i + 1] << 8 : 0;
+		group |= i + 2 < bytes.size() ? bytes[i + 2] : 0;
+		result += digits[(group >> 18) & 63];
+		result += digits[(group >> 12) & 63];
+		result += i + 1 < bytes.size() ? digits[(group >> 6) & 63] : '=';
+		result += i + 2 < bytes.size() ? digits[group & 63] : '=';
+	}
+	return result;
+}
+
+static std::string floats(const float* values, int count)
+{
+	std::string result;
+	for (int i = 0; i < count; i++)
+	{
+		char number[32];
+		snprintf(number, sizeof(number), "%s%.9g", i ? "," : "", values[i]);
+		result += number;
+	}
+	return result;
+}
+
+//a hierarchy as the file stores it, everything indexed by node
+struct scene_file
+{
+	std::vector<int> parents;
+	std::vector<transform> rest;
+	//world bind transform of every skin joint
+	std::vector<int> skin_joints;
+	std::vector<transform> bind;
+	std::vector<float4x4> inverse_bind;
+	//JOINTS_0 of every vertex, indices into skin_joints
+	std::vector<uint16_t> vertex_joints;
+	std::string json;
+
+	transform world_rest(int node) const
+	{
+		transform result = rest[node];
+		for (int p = parents[node]; p >= 0; p = parents[p])
+		{
+			result = math::combine(rest[p], result);
+		}
+		return result;
+	}
+};
+
+//joint_count joints in one or two trees, stored so children often come before their parents. The skin lists a
+//shuffled subset of the nodes, the mesh has one vertex per skin joint
+static scene_file make_scene(int joint_count)
+{
+	scene_file file;
+	//parents in creation order, then a random permutation picks where each joint is stored
+	std::vector<int> created_parents(joint_count);
+	const int roots = random_int(1, 2);
+	for (int j = 0; j < joint_count; j++)
+	{
+		created_parents[j] = j < roots ? -1 : random_int(0, j - 1);
+	}
+	std::vector<int> node_of(joint_count);
+	for (int j = 0; j < joint_count; j++)
+	{
+		node_of[j] = j;
+	}
+	std::shuffle(node_of.begin(), node_of.end(), rng);
+	file.parents.resize(joint_count);
+	file.rest.resize(joint_count);
+	for (int j = 0; j < joint_count; j++)
+	{
+		file.parents[node_of[j]] = created_parents[j] < 0 ? -1 : node_of[created_parents[j]];
+		file.rest[node_of[j]] = random_transform();
+	}
+
+	for (int n = 0; n < joint_count; n++)
+	{
+		if (random_int(0, 3) != 0)
+		{
+			file.skin_joints.push_back(n);
+		}
+	}
+	std::shuffle(file.skin_joints.begin(), file.skin_joints.end(), rng);
+	for (size_t k = 0; k < file.skin_joints.size(); k++)
+	{
+		//bound in a pose other than the rest pose, so the two can't be mixed up
+		transform world = math::combine(file.world_rest(file.skin_joints[k]), random_transform());
+		file.bind.push_back(world);
+		float4x4 inverse;
+		math::to_float4x4(math::inverse(world), inverse);
+		file.inverse_bind.push_back(inverse);
+	}
+	const size_t skin_size = file.skin_joints.size();
+	for (size_t v = 0; v < skin_size; v++)
+	{
+		for (size_t c = 0; c < 4; c++)
+		{
+			file.vertex_joints.push_back((uint16_t)((v + c * 3) % skin_size));
+		}
+	}
+
+	std::vector<uint8_t> buffer(skin_size * sizeof(float4x4) + file.vertex_joints.size() * sizeof(uint16_t));
+	for (size_t k = 0; k < skin_size; k++)
+	{
+		memcpy(&buffer[k * sizeof(float4x4)], file.inverse_bind[k].data(), sizeof(float4x4));
+	}
+	memcpy(&buffer[skin_size * sizeof(float4x4)], file.vertex_joints.data(), file.vertex_joints.size() * sizeof(uint16_t));
+
+	std::string& json = file.json;
+	json = "{\"asset\":{\"version\":\"2.0\"},\"nodes\":[";
+	for (int n = 0; n < joint_count; n++)
+	{
+		const transform& t = file.rest[n];
+		json += n ? "," : "";
+		json += "{\"name\":\"node" + std::to_string(n) + "\"";
+		json += ",\"translation\":[" + floats(&t.position.x, 3) + "]";
+		json += ",\"rotation\":[" + floats(t.rotation.v, 4) + "]";
+		json += ",\"scale\":[" + floats(&t.scale.x, 3) + "]";
+		std::string children;
+		for (int c = 0; c < joint_count; c++)
+		{
+			if (file.parents[c] == n)
+			{
+				children += (children.empty() ? "" : ",") + std::to_string(c);
+			}
+		}
+		if (!children.empty())
+		{
+			json += ",\"children\":[" + children + "]";
+		}
+		if (n == file.skin_joints[0])
+		{
+			json += ",\"mesh\":0,\"skin\":0";
+		}
+		json += "}";
+	}
+	json += "],\"skins\":[{\"inverseBindMatrices\":0,\"joints\":[";
+	for (size_t k = 0; k < skin_size; k++)
+	{
+		json += (k ? "," : "") + std::to_string(file.skin_joints[k]);
+	}
+	json += "]}],\"meshes\":[{\"primitives\":[{\"attributes\":{\"JOINTS_0\":1}}]}]";
+	json += ",\"accessors\":[{\"bufferView\":0,\"componentType\":5126,\"count\":" + std::to_string(skin_size) + ",\"type\":\"MAT4\"}";
+	json += ",{\"bufferView\":1,\"componentType\":5123,\"count\":" + std::to_string(skin_size) + ",\"type\":\"VEC4\"}]";
+	json += ",\"bufferViews\":[{\"buffer\":0,\"byteLength\":" + std::to_string(skin_size * sizeof(float4x4)) + "}";
+	json += ",{\"buffer\":0,\"byteOffset\":" + std::to_string(skin_size * sizeof(float4x4));
+	json += ",\"byteLength\":" + std::to_string(file.vertex_joints.size() * sizeof(uint16_t)) + "}]";
+	json += ",\"buffers\":[{\"byteLength\":" + std::to_string(buffer.size());
+	json += ",\"uri\":\"data:application/octet-stream;base64," + base64(buffer) + "\"}]}";
+	return file;
+}
+
+static cgltf_data* parse(const std::string& json)
+{
+	cgltf_options options;
+	memset(&options, 0, sizeof(cgltf_options));
+	cgltf_data* data = nullptr;
+	if (cgltf_parse(&options, json.data(), json.size(), &data) != cgltf_result_success)
+	{
+		return nullptr;
+	}
+	if (cgltf_load_buffers(&options, data, nullptr) != cgltf_result_success || cgltf_validate(data) != cgltf_result_success)
+	{
+		cgltf_free(data);
+		return nullptr;
+	}
+	return data;
+}
+
+//relative to the largest element, translations grow down long chains
+static bool near(const float4x4& a, const float4x4& b, float tolerance)
+{
+	float largest = 1.0f;
+	for (int i = 0; i < 16; i++)
+	{
+		largest = std::max(largest, fabsf(b[i]));
+	}
+	for (int i = 0; i < 16; i++)
+	{
+		if (fabsf(a[i] - b[i]) > tolerance * largest)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool near(const transform& a, const transform& b, float tolerance)
+{
+	float4x4 ma, mb;
+	math::to_float4x4(a, ma);
+	math::to_float4x4(b, mb);
+	return near(ma, mb, tolerance);
+}
+
+//every joint comes after its parent, and the remap keeps the hierarchy, names and rest transforms of the nodes
+static void parents_precede_children()
+{
+	int unordered = 0;
+	int wrong_hierarchy = 0;
+	int wrong_rest = 0;
+	int slow_matrices = 0;
+	for (int n = 0; n < 50; n++)
+	{
+		const int joint_count = random_int(2, 40);
+		scene_file file = make_scene(joint_count);
+		cgltf_data* data = parse(file.json);
+		CHECK(data != nullptr);
+		if (data == nullptr)
+		{
+			continue;
+		}
+		rig r = load_skeleton(data);
+		const std::vector<int>& remap = r.joint_remap;
+		CHECK((int)r.rest_pose.size() == joint_count);
+		CHECK((int)remap.size() == joint_count);
+		std::vector<int> sorted = remap;
+		std::sort(sorted.begin(), sorted.end());
+		for (int j = 0; j < joint_count; j++)
+		{
+			CHECK(sorted[j] == j);
+		}
+
+		for (int j = 0; j < joint_count; j++)
+		{
+			unordered += r.rest_pose.get_parent(j) >= j;
+			unordered += r.bind_pose.get_parent(j) >= j;
+		}
+		for (int node = 0; node < joint_count; node++)
+		{
+			const int joint = remap[node];
+			const int parent = file.parents[node] < 0 ? -1 : remap[file.parents[node]];
+			wrong_hierarchy += r.rest_pose.get_parent(joint) != parent;
+			wrong_hierarchy += r.joint_names[joint] != "node" + std::to_string(node);
+			wrong_rest += !near(r.rest_pose.get_local_transform(joint), file.rest[node], 1e-5f);
+			wrong_rest += !near(r.rest_pose.get_global_transform(joint), file.world_rest(node), 1e-4f);
+		}
+
+		//the single pass in get_matrices gives what walking up to the root does
+		std::vector<float4x4> matrices;
+		r.rest_pose.get_matrices(matrices);
+		for (int j = 0; j < joint_count; j++)
+		{
+			float4x4 walked;
+			math::to_float4x4(r.rest_pose.get_global_transform(j), walked);
+			slow_matrices += !near(matrices[j], walked, 1e-4f);
+		}
+		cgltf_free(data);
+	}
+	CHECK(unordered == 0);
+	CHECK(wrong_hierarchy == 0);
+	CHECK(wrong_rest == 0);
+	CHECK(slow_matrices == 0);
+}
+
+//a vertex bound to skin joint k is skinned with world(node) * inverse_bind[k], whatever joint the node became
+static void skin_matrices_are_unchanged()
+{
+	int wrong_joint = 0;
+	int wrong_bind = 0;
+	int wrong_palette = 0;
+	int wrong_vertex = 0;
+	for (int n = 0; n < 50; n++)
+	{
+		const int joint_count = random_int(2, 40);
+		scene_file file = make_scene(joint_count);
+		cgltf_data* data = parse(file.json);
+		CHECK(data != nullptr);
+		if (data == nullptr)
+		{
+			continue;
+		}
+		rig r = load_skeleton(data);
+		std::vector<int> skin_joints = get_skin_joints(&data->skins[0], data->nodes, r.joint_remap);
+		CHECK(skin_joints.size() == file.skin_joints.size());
+
+		std::vector<float4x4> matrices;
+		r.rest_pose.get_matrices(matrices);
+		for (size_t k = 0; k < skin_joints.size(); k++)
+		{
+			const int node = file.skin_joints[k];
+			const int joint = skin_joints[k];
+			wrong_joint += joint != r.joint_remap[node];
+			//the loader inverts the matrices and splits them into transforms and back, scales a few joints down
+			//a chain lose a few bits on the way
+			wrong_bind += !near(r.bind_pose.get_global_transform(joint), file.bind[k], 1e-3f);
+			wrong_bind += !near(r.inv_bind_pose[joint], file.inverse_bind[k], 1e-3f);
+
+			float4x4 world, expected, palette;
+			math::to_float4x4(file.world_rest(node), world);
+			math::simd::mul(world, file.inverse_bind[k], expected);
+			math::simd::mul(matrices[joint], r.inv_bind_pose[joint], palette);
+			wrong_palette += !near(palette, expected, 1e-3f);
+		}
+
+		//the joints attribute is mapped through the skin to rig joints
+		std::vector<skinned_vertex> vertices;
+		mesh_from_attribute(vertices, data->meshes[0].primitives[0].attributes[0], skin_joints);
+		CHECK(vertices.size() == file.skin_joints.size());
+		for (size_t v = 0; v < vertices.size(); v++)
+		{
+			const int bones[4] = { vertices[v].bones.x, vertices[v].bones.y, vertices[v].bones.z, vertices[v].bones.w };
+			for (int c = 0; c < 4; c++)
+			{
+				wrong_vertex += bones[c] != r.joint_remap[file.skin_joints[file.vertex_joints[v * 4 + c]]];
+			}
+		}
+		cgltf_free(data);
+	}
+	CHECK(wrong_joint == 0);
+	CHECK(wrong_bind == 0);
+	CHECK(wrong_palette == 0);
+	CHECK(wrong_vertex == 0);
+}
+
+int main()
+{
+	parents_precede_children();
+	skin_matrices_are_unchanged();
+	return test_result("gltf_loader_test");
+}
@@ -0,0 +1,109 @@
+#include "test_common.h"
+#include "job_system.h"
+#include <random>
+
+//Many short parallel_for calls back to back. A worker that wakes up late for a loop that already finished must not
+//run any chunk of the next one, every element of every loop has to be visited exactly once by its own loop body.
+
+struct loop_body
+{
+	std::vector<std::atomic<uint32_t>> visits;
+
+	explicit loop_body(size_t capacity) : visits(capacity) {}
+
+	void operator()(size_t begin, size_t end, uint32_t)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			visits[i].fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	bool visited_once(size_t count) const
+	{
+		for (size_t i = 0; i < visits.size(); i++)
+		{
+			if (visits[i].load() != (i < count ? 1u : 0u))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void reset()
+	{
+		for (std::atomic<uint32_t>& v : visits)
+		{
+			v.store(0);
+		}
+	}
+};
+
+static void back_to_back_loops(uint32_t threads, int loops)
+{
+	job_system jobs;
+	jobs.initialize(threads);
+	std::mt19937 rng(3);
+	const size_t capacity = 64;
+	//bodies alternate, a chunk run by the previous loop's body shows up as a double visit there and a missed one here
+	loop_body bodies[2] = { loop_body(capacity), loop_body(capacity) };
+	size_t counts[2] = { 0, 0 };
+	int failed_loops = 0;
+	for (int l = 0; l < loops; l++)
+	{
+		loop_body& body = bodies[l & 1];
+		loop_body& previous = bodies[(l & 1) ^ 1];
+		size_t& count = counts[l & 1];
+		body.reset();
+		count = 2 + rng() % (capacity - 1);
+		jobs.parallel_for(count, 1 + rng() % 3, body);
+		if (!body.visited_once(count) || (l > 0 && !previous.visited_once(counts[(l & 1) ^ 1])))
+		{
+			failed_loops++;
+		}
+	}
+	jobs.dispose();
+	CHECK(failed_loops == 0);
+}
+
+//worker indices in range, and the result doesn't depend on how chunks were spread
+static void sums(uint32_t threads)
+{
+	job_system jobs;
+	jobs.initialize(threads);
+	const size_t count = 100003;
+	std::vector<uint64_t> partial(jobs.worker_count(), 0);
+	bool indices_valid = true;
+	auto sum = [&](size_t begin, size_t end, uint32_t worker)
+	{
+		if (worker >= partial.size())
+		{
+			indices_valid = false;
+			return;
+		}
+		for (size_t i = begin; i < end; i++)
+		{
+			partial[worker] += i;
+		}
+	};
+	jobs.parallel_for(count, 1000, sum);
+	uint64_t total = 0;
+	for (uint64_t p : partial)
+	{
+		total += p;
+	}
+	jobs.dispose();
+	CHECK(indices_valid);
+	CHECK(total == (uint64_t)count * (count - 1) / 2);
+}
+
+int main()
+{
+	sums(1);
+	sums(4);
+	back_to_back_loops(2, 100000);
+	back_to_back_loops(4, 100000);
+	back_to_back_loops(8, 50000);
+	return test_result("job_system_test");
+}
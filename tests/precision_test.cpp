@@ -0,0 +1,115 @@
+#include "test_common.h"
+#include "mmath.h"
+#include <random>
+
+//precision_fast against double precision, held to the max errors documented next to the policy,
+//and the functions taking a policy against their precision_exact results.
+
+static std::mt19937 rng(11);
+
+static float random_float(float lower, float upper)
+{
+	return std::uniform_real_distribution<float>(lower, upper)(rng);
+}
+
+static void fast_policy_error_bounds()
+{
+	typedef math::precision_fast fast;
+	const int samples = 1000000;
+
+	double rsqrt_error = 0;
+	double sqrt_error = 0;
+	for (int i = 0; i < samples; i++)
+	{
+		//log uniform over [1e-12, 1e12]
+		float x = powf(10.0f, random_float(-12, 12));
+		double r = 1.0 / std::sqrt((double)x);
+		rsqrt_error = std::max(rsqrt_error, fabs(fast::rsqrt(x) - r) / r);
+		double s = std::sqrt((double)x);
+		sqrt_error = std::max(sqrt_error, fabs(fast::sqrt(x) - s) / s);
+	}
+	CHECK(fast::sqrt(0.0f) == 0.0f);
+	CHECK(fast::sqrt(-1.0f) == 0.0f);
+
+	double sin_error = 0;
+	double cos_error = 0;
+	for (int i = 0; i < samples; i++)
+	{
+		//the small range on every other sample, where animation and camera angles live
+		float x = (i & 1) ? random_float(-8192, 8192) : random_float(-2 * math::pi, 2 * math::pi);
+		sin_error = std::max(sin_error, fabs(fast::sin(x) - std::sin((double)x)));
+		cos_error = std::max(cos_error, fabs(fast::cos(x) - std::cos((double)x)));
+	}
+
+	double acos_error = 0;
+	for (int i = 0; i <= samples; i++)
+	{
+		float x = -1.0f + 2.0f * i / samples;
+		acos_error = std::max(acos_error, fabs(fast::acos(x) - std::acos((double)x)));
+	}
+	//dot products of unit vectors overshoot 1 a little
+	CHECK(fast::acos(1.0000001f) == 0.0f);
+	CHECK(fast::acos(-1.0000001f) == 3.14159265f);
+
+	printf("rsqrt %.3g sqrt %.3g sin %.3g cos %.3g acos %.3g\n", rsqrt_error, sqrt_error, sin_error, cos_error, acos_error);
+	CHECK(rsqrt_error <= 3e-7);
+	CHECK(sqrt_error <= 3e-7);
+	CHECK(sin_error <= 2.5e-7);
+	CHECK(cos_error <= 2.5e-7);
+	CHECK(acos_error <= 6e-7);
+}
+
+//the policy functions, fast against exact, within a few ulp of the results they are built from
+static void fast_functions_match_exact()
+{
+	typedef math::precision_fast fast;
+	typedef math::precision_exact exact;
+	float length_error = 0;
+	float normalize_error = 0;
+	float angle_error = 0;
+	float rotation_error = 0;
+	float slerp_error = 0;
+	for (int i = 0; i < 100000; i++)
+	{
+		float3 v(random_float(-100, 100), random_float(-100, 100), random_float(-100, 100));
+		float3 w(random_float(-100, 100), random_float(-100, 100), random_float(-100, 100));
+		length_error = std::max(length_error, fabsf(math::length<fast>(v) - math::length<exact>(v)) / math::length<exact>(v));
+		//not through length, that returns 0 below epsilon
+		float3 n = math::normalize<fast>(v) - math::normalize<exact>(v);
+		normalize_error = std::max(normalize_error, std::max(fabsf(n.x), std::max(fabsf(n.y), fabsf(n.z))));
+		angle_error = std::max(angle_error, fabsf(math::angle_between<fast>(v, w) - math::angle_between<exact>(v, w)));
+
+		float angle = random_float(-math::pi, math::pi);
+		quaternion a = math::angle_axis<fast>(angle, v);
+		quaternion b = math::angle_axis<exact>(angle, v);
+		for (int c = 0; c < 4; c++)
+		{
+			rotation_error = std::max(rotation_error, fabsf(a.v[c] - b.v[c]));
+		}
+
+		quaternion from = math::angle_axis<exact>(random_float(-math::pi, math::pi), v);
+		quaternion to = math::angle_axis<exact>(random_float(-math::pi, math::pi), w);
+		float t = random_float(0, 1);
+		a = math::slerp<fast>(from, to, t);
+		b = math::slerp<exact>(from, to, t);
+		for (int c = 0; c < 4; c++)
+		{
+			slerp_error = std::max(slerp_error, fabsf(a.v[c] - b.v[c]));
+		}
+	}
+	printf("length %.3g normalize %.3g angle_between %.3g angle_axis %.3g slerp %.3g\n",
+		length_error, normalize_error, angle_error, rotation_error, slerp_error);
+	CHECK(length_error <= 1e-6f);
+	CHECK(normalize_error <= 1e-6f);
+	//acos is ill conditioned next to +-1, small input differences grow there
+	CHECK(angle_error <= 1e-4f);
+	CHECK(rotation_error <= 1e-6f);
+	CHECK(slerp_error <= 1e-4f);
+}
+
+int main()
+{
+	fast_policy_error_bounds();
+	fast_functions_match_exact();
+	return test_result("precision_test");
+}
@@ -0,0 +1,103 @@
+#include "test_common.h"
+#include "mmath_simd.h"
+#include <random>
+#include <vector>
+
+//Kernel throughput per instruction set, scalar is the reference the speedups are against.
+
+using namespace math::simd;
+
+static std::mt19937 rng(7);
+
+static float random_float(float lower, float upper)
+{
+	return std::uniform_real_distribution<float>(lower, upper)(rng);
+}
+
+//keeps results alive without the optimizer seeing through them
+static volatile float sink;
+
+//ns per call of f, best of a few rounds
+template<class FUNC>
+static double measure(size_t calls, FUNC&& f)
+{
+	double best = 1e30;
+	for (int round = 0; round < 5; round++)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		f();
+		best = std::min(best, elapsed_ms(start) * 1e6 / calls);
+	}
+	return best;
+}
+
+static void float4x4_bench()
+{
+	//a working set that stays in l2, like a pose's palette
+	const size_t count = 1024;
+	const int repeats = 200;
+	std::vector<float4x4> left(count);
+	std::vector<float4x4> right(count);
+	std::vector<float4x4> out(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		for (int e = 0; e < 16; e++)
+		{
+			left[i][e] = random_float(-1, 1);
+			right[i][e] = random_float(-1, 1);
+		}
+	}
+
+	printf("float4x4, ns per matrix\n%-8s %8s %8s %8s %8s\n", "", "mul", "batch", "transp", "inverse");
+	const instruction_set detected = detect_instruction_set();
+	for (int isa = (int)instruction_set::scalar; isa <= (int)detected; isa++)
+	{
+		const float4x4_kernels& k = get_kernels((instruction_set)isa);
+		const size_t calls = count * repeats;
+		double mul = measure(calls, [&]()
+		{
+			for (int r = 0; r < repeats; r++)
+			{
+				for (size_t i = 0; i < count; i++)
+				{
+					k.mul(left[i], right[i], out[i]);
+				}
+			}
+		});
+		double batch = measure(calls, [&]()
+		{
+			for (int r = 0; r < repeats; r++)
+			{
+				k.mul_batch(left.data(), right.data(), out.data(), count);
+			}
+		});
+		double transpose = measure(calls, [&]()
+		{
+			for (int r = 0; r < repeats; r++)
+			{
+				for (size_t i = 0; i < count; i++)
+				{
+					k.transpose(left[i], out[i]);
+				}
+			}
+		});
+		double inverse = measure(calls, [&]()
+		{
+			for (int r = 0; r < repeats; r++)
+			{
+				for (size_t i = 0; i < count; i++)
+				{
+					k.inverse(left[i], out[i]);
+				}
+			}
+		});
+		sink = out[count / 2][5];
+		printf("%-8s %8.2f %8.2f %8.2f %8.2f\n", to_string((instruction_set)isa), mul, batch, transpose, inverse);
+	}
+}
+
+int main()
+{
+	float4x4_bench();
+	return 0;
+}
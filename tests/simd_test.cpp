@@ -0,0 +1,911 @@
+#include "test_common.h"
+#include "mmath_simd.h"
+#include "animation.h"
+#include <random>
+#include <vector>
+#include <cfloat>
+
+//Every kernel of every instruction set the cpu supports against the scalar functions in mmath.h,
+//with counts that leave remainders for the narrower sets to pick up.
+
+using namespace math::simd;
+
+static std::mt19937 rng(7);
+
+static float random_float(float lower, float upper)
+{
+	return std::uniform_real_distribution<float>(lower, upper)(rng);
+}
+
+static quaternion random_rotation()
+{
+	return math::normalize(quaternion(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1), random_float(-1, 1)));
+}
+
+static transform random_transform()
+{
+	transform t;
+	t.position = float3(random_float(-10, 10), random_float(-10, 10), random_float(-10, 10));
+	t.rotation = random_rotation();
+	t.scale = float3(random_float(0.5f, 2), random_float(0.5f, 2), random_float(0.5f, 2));
+	return t;
+}
+
+//relative to the larger magnitude, absolute below 1
+static bool near(float a, float b, float tolerance)
+{
+	return fabsf(a - b) <= tolerance * std::max(1.0f, std::max(fabsf(a), fabsf(b)));
+}
+
+static bool near(const float4x4& a, const float4x4& b, float tolerance)
+{
+	for (int i = 0; i < 16; i++)
+	{
+		if (!near(a[i], b[i], tolerance))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+//scalar first, so a broken reference shows up before the sets compared against it
+template<class FUNC>
+static void for_each_isa(FUNC&& f)
+{
+	const instruction_set detected = detect_instruction_set();
+	for (int isa = (int)instruction_set::scalar; isa <= (int)detected; isa++)
+	{
+		const int failures = test_failures;
+		f((instruction_set)isa);
+		if (test_failures != failures)
+		{
+			printf("  in %s\n", to_string((instruction_set)isa));
+		}
+	}
+}
+
+static void float4x4_kernels_match_scalar()
+{
+	const size_t count = 37;
+	std::vector<float4x4> left(count);
+	std::vector<float4x4> right(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		math::to_float4x4(random_transform(), left[i]);
+		math::to_float4x4(random_transform(), right[i]);
+	}
+	//not affine, the projection row has to go through the kernels as well
+	math::perspective(1.2f, 1.5f, 0.1f, 100.0f, left[0]);
+
+	for_each_isa([&](instruction_set isa)
+	{
+		const float4x4_kernels& k = get_kernels(isa);
+		for (size_t i = 0; i < count; i++)
+		{
+			float4x4 expected;
+			float4x4 out;
+			math::mul(left[i], right[i], expected);
+			k.mul(left[i], right[i], out);
+			CHECK(near(out, expected, 1e-5f));
+
+			math::transpose(left[i], expected);
+			k.transpose(left[i], out);
+			CHECK(out == expected);
+
+			CHECK(math::inverse_matrix(right[i], expected));
+			CHECK(k.inverse(right[i], out));
+			CHECK(near(out, expected, 1e-4f));
+		}
+
+		float4x4 singular = {};
+		float4x4 out;
+		CHECK(!k.inverse(singular, out));
+
+		//every length up to count so each remainder path runs, and in place on left
+		for (size_t n = 0; n <= count; n++)
+		{
+			std::vector<float4x4> out_batch(n);
+			k.mul_batch(left.data(), right.data(), out_batch.data(), n);
+			std::vector<float4x4> aliased(left.begin(), left.begin() + n);
+			k.mul_batch(aliased.data(), right.data(), aliased.data(), n);
+			for (size_t i = 0; i < n; i++)
+			{
+				float4x4 expected;
+				math::mul(left[i], right[i], expected);
+				CHECK(near(out_batch[i], expected, 1e-5f));
+				CHECK(near(aliased[i], expected, 1e-5f));
+			}
+		}
+	});
+}
+
+//quaternion_soa columns with the quaternions to fill them from
+struct quaternion_streams
+{
+	std::vector<float> x, y, z, w;
+
+	explicit quaternion_streams(size_t count) : x(count), y(count), z(count), w(count) {}
+
+	quaternion_soa soa() { return quaternion_soa{ x.data(), y.data(), z.data(), w.data() }; }
+	quaternion get(size_t i) const { return quaternion(x[i], y[i], z[i], w[i]); }
+	void set(size_t i, const quaternion& q) { x[i] = q.x; y[i] = q.y; z[i] = q.z; w[i] = q.w; }
+};
+
+static bool near(const quaternion& a, const quaternion& b, float tolerance)
+{
+	return near(a.x, b.x, tolerance) && near(a.y, b.y, tolerance) && near(a.z, b.z, tolerance) && near(a.w, b.w, tolerance);
+}
+
+//the scalar hermite of the track sampler is what the kernel vectorizes
+struct hermite_reference : quaternion_track
+{
+	using quaternion_track::hermite;
+};
+
+static void quaternion_kernels_match_scalar()
+{
+	const size_t count = 203;
+	quaternion_streams a(count);
+	quaternion_streams b(count);
+	quaternion_streams s1(count);
+	quaternion_streams s2(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		quaternion q = random_rotation();
+		a.set(i, q);
+		switch (i % 6)
+		{
+		//the same rotation, slerp has to take the nlerp weights
+		case 0: b.set(i, q); break;
+		//the other hemisphere, both interpolations flip it
+		case 1: b.set(i, -random_rotation()); break;
+		//a few thousandths of a radian apart
+		case 2: b.set(i, math::normalize(q + quaternion(1e-3f, -1e-3f, 0, 0))); break;
+		default: b.set(i, random_rotation()); break;
+		}
+		s1.set(i, random_rotation() * random_float(-0.2f, 0.2f));
+		s2.set(i, random_rotation() * random_float(-0.2f, 0.2f));
+	}
+	//unnormalized and degenerate inputs for normalize
+	quaternion_streams raw(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		raw.set(i, a.get(i) * random_float(0.01f, 100.0f));
+	}
+	raw.set(0, quaternion(0, 0, 0, 0));
+	raw.set(1, quaternion(1e-4f, 0, 0, 0));
+
+	hermite_reference track;
+	const float times[] = { 0.0f, 0.3f, 0.5f, 1.0f };
+	for_each_isa([&](instruction_set isa)
+	{
+		const batch_kernels& k = get_batch_kernels(isa);
+		quaternion_streams out(count);
+
+		k.normalize_quaternion(raw.soa(), out.soa(), count);
+		for (size_t i = 0; i < count; i++)
+		{
+			CHECK(near(out.get(i), math::normalize(raw.get(i)), 1e-6f));
+		}
+
+		k.mul_quaternion(a.soa(), b.soa(), out.soa(), count);
+		for (size_t i = 0; i < count; i++)
+		{
+			CHECK(near(out.get(i), a.get(i) * b.get(i), 1e-6f));
+		}
+
+		for (float t : times)
+		{
+			k.nlerp(a.soa(), b.soa(), t, out.soa(), count);
+			for (size_t i = 0; i < count; i++)
+			{
+				CHECK(near(out.get(i), math::nlerp(a.get(i), b.get(i), t), 1e-6f));
+			}
+
+			k.slerp(a.soa(), b.soa(), t, out.soa(), count);
+			for (size_t i = 0; i < count; i++)
+			{
+				CHECK(near(out.get(i), math::slerp<math::precision_fast>(a.get(i), b.get(i), t), 1e-6f));
+				//and within the fast policy's error of the exact one
+				CHECK(near(out.get(i), math::slerp<math::precision_exact>(a.get(i), b.get(i), t), 1e-5f));
+			}
+
+			k.hermite(a.soa(), s1.soa(), b.soa(), s2.soa(), t, out.soa(), count);
+			for (size_t i = 0; i < count; i++)
+			{
+				quaternion slope = s1.get(i);
+				CHECK(near(out.get(i), track.hermite(t, a.get(i), slope, b.get(i), s2.get(i)), 1e-6f));
+			}
+		}
+
+		//in place, as the pose sampler calls it
+		quaternion_streams in_place = a;
+		k.mul_quaternion(in_place.soa(), b.soa(), in_place.soa(), count);
+		for (size_t i = 0; i < count; i++)
+		{
+			CHECK(near(in_place.get(i), a.get(i) * b.get(i), 1e-6f));
+		}
+	});
+}
+
+//float3_soa columns
+struct float3_streams
+{
+	std::vector<float> x, y, z;
+
+	explicit float3_streams(size_t count) : x(count), y(count), z(count) {}
+
+	float3_soa soa() { return float3_soa{ x.data(), y.data(), z.data() }; }
+	float3 get(size_t i) const { return float3(x[i], y[i], z[i]); }
+	void set(size_t i, const float3& v) { x[i] = v.x; y[i] = v.y; z[i] = v.z; }
+};
+
+static bool near(const float3& a, const float3& b, float tolerance)
+{
+	return near(a.x, b.x, tolerance) && near(a.y, b.y, tolerance) && near(a.z, b.z, tolerance);
+}
+
+//transform_soa columns
+struct transform_streams
+{
+	float3_streams position;
+	quaternion_streams rotation;
+	float3_streams scale;
+
+	explicit transform_streams(size_t count) : position(count), rotation(count), scale(count) {}
+
+	transform_soa soa() { return transform_soa{ position.soa(), rotation.soa(), scale.soa() }; }
+	transform get(size_t i) const
+	{
+		transform t;
+		t.position = position.get(i);
+		t.rotation = rotation.get(i);
+		t.scale = scale.get(i);
+		return t;
+	}
+	void set(size_t i, const transform& t) { position.set(i, t.position); rotation.set(i, t.rotation); scale.set(i, t.scale); }
+};
+
+static bool near(const transform& a, const transform& b, float tolerance)
+{
+	return near(a.position, b.position, tolerance) && near(a.rotation, b.rotation, tolerance) && near(a.scale, b.scale, tolerance);
+}
+
+//every count up to 37 so each set hands a remainder of every length to the narrower ones, and in place where
+//the kernel allows it
+static void transform_kernels_match_scalar()
+{
+	const size_t count = 37;
+	transform_streams parent(count);
+	transform_streams local(count);
+	float3_streams points(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		parent.set(i, random_transform());
+		local.set(i, random_transform());
+		//lengths from tiny to large for normalize
+		points.set(i, math::normalize(float3(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1))) * powf(10.0f, random_float(-3, 3)));
+	}
+	float4x4 m;
+	math::to_float4x4(random_transform(), m);
+
+	for_each_isa([&](instruction_set isa)
+	{
+		const batch_kernels& k = get_batch_kernels(isa);
+		for (size_t n = 0; n <= count; n++)
+		{
+			float3_streams out(count);
+			float3_streams in_place = points;
+			k.transform_points(m, points.soa(), out.soa(), n);
+			k.transform_points(m, in_place.soa(), in_place.soa(), n);
+			for (size_t i = 0; i < count; i++)
+			{
+				const float3 p = points.get(i);
+				const float3 expected = i < n ? float3(m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12], m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13],
+					m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14]) : float3(0, 0, 0);
+				CHECK(near(out.get(i), expected, 1e-5f));
+				//past n nothing is touched
+				CHECK(near(in_place.get(i), i < n ? expected : p, 1e-5f));
+			}
+
+			in_place = points;
+			k.normalize(points.soa(), out.soa(), n);
+			k.normalize(in_place.soa(), in_place.soa(), n);
+			for (size_t i = 0; i < n; i++)
+			{
+				CHECK(near(out.get(i), math::normalize(points.get(i)), 1e-6f));
+				CHECK(near(in_place.get(i), math::normalize(points.get(i)), 1e-6f));
+			}
+
+			transform_streams combined(count);
+			k.combine(parent.soa(), local.soa(), combined.soa(), n);
+			transform_streams combined_in_place = local;
+			k.combine(parent.soa(), combined_in_place.soa(), combined_in_place.soa(), n);
+			for (size_t i = 0; i < n; i++)
+			{
+				const transform expected = math::combine(parent.get(i), local.get(i));
+				CHECK(near(combined.get(i), expected, 1e-5f));
+				CHECK(near(combined_in_place.get(i), expected, 1e-5f));
+			}
+
+			std::vector<float4x4> matrices(count, float4x4{});
+			k.to_float4x4(parent.soa(), matrices.data(), n);
+			for (size_t i = 0; i < count; i++)
+			{
+				float4x4 expected = {};
+				if (i < n)
+				{
+					math::to_float4x4(parent.get(i), expected);
+				}
+				CHECK(near(matrices[i], expected, 1e-6f));
+			}
+		}
+	});
+}
+
+//the palette interpolation between animation updates, 16 floats a joint. Counts up to two avx512 blocks plus
+//every remainder, in place over a as animation_system doesn't do but the kernel allows
+static void lerp_kernel_matches_scalar()
+{
+	const size_t count = 37;
+	std::vector<float> a(count);
+	std::vector<float> b(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		a[i] = random_float(-100, 100);
+		b[i] = random_float(-100, 100);
+	}
+	const float times[] = { 0.0f, 0.3f, 1.0f, 1.7f };
+
+	for_each_isa([&](instruction_set isa)
+	{
+		const batch_kernels& k = get_batch_kernels(isa);
+		for (float t : times)
+		{
+			for (size_t n = 0; n <= count; n++)
+			{
+				std::vector<float> out(count, 0.0f);
+				std::vector<float> in_place = a;
+				k.lerp(a.data(), b.data(), t, out.data(), n);
+				k.lerp(in_place.data(), b.data(), t, in_place.data(), n);
+				for (size_t i = 0; i < count; i++)
+				{
+					const float expected = a[i] + (b[i] - a[i]) * t;
+					CHECK(near(out[i], i < n ? expected : 0.0f, 1e-6f));
+					CHECK(near(in_place[i], i < n ? expected : a[i], 1e-6f));
+				}
+			}
+		}
+	});
+}
+
+static transform zero_transform()
+{
+	transform t;
+	t.position = float3(0, 0, 0);
+	t.rotation = quaternion(0, 0, 0, 0);
+	t.scale = float3(0, 0, 0);
+	return t;
+}
+
+//same rotation either sign
+static bool near_rotation(const quaternion& a, const quaternion& b, float tolerance)
+{
+	return near(a, b, tolerance) || near(a, -b, tolerance);
+}
+
+//the pose blending kernels against math::lerp / nlerp / inverse, one joint per lane. Every count up to 37, weights
+//of exactly 0 and 1 among random ones, rotations in both hemispheres, in place over the first pose
+static void blending_kernels_match_scalar()
+{
+	const size_t count = 37;
+	transform_streams a(count);
+	transform_streams b(count);
+	std::vector<float> weights(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		a.set(i, random_transform());
+		transform other = random_transform();
+		//the other hemisphere, or close to a, every few joints
+		if (i % 5 == 1)
+		{
+			other.rotation = -a.get(i).rotation;
+		}
+		if (i % 5 == 2)
+		{
+			other.rotation = math::normalize(a.get(i).rotation + quaternion(1e-3f, 0, -1e-3f, 0));
+		}
+		b.set(i, other);
+		weights[i] = i % 7 == 0 ? 0.0f : i % 7 == 1 ? 1.0f : random_float(0, 1);
+	}
+
+	for_each_isa([&](instruction_set isa)
+	{
+		const batch_kernels& k = get_batch_kernels(isa);
+		for (size_t n = 0; n <= count; n++)
+		{
+			transform_streams blended(count);
+			transform_streams blended_in_place = a;
+			for (size_t i = 0; i < count; i++)
+			{
+				blended.set(i, zero_transform());
+			}
+			k.blend(a.soa(), b.soa(), weights.data(), blended.soa(), n);
+			k.blend(blended_in_place.soa(), b.soa(), weights.data(), blended_in_place.soa(), n);
+			for (size_t i = 0; i < count; i++)
+			{
+				transform expected = zero_transform();
+				if (i < n)
+				{
+					expected.position = math::lerp(a.get(i).position, b.get(i).position, weights[i]);
+					expected.rotation = math::nlerp(a.get(i).rotation, b.get(i).rotation, weights[i]);
+					expected.scale = math::lerp(a.get(i).scale, b.get(i).scale, weights[i]);
+				}
+				CHECK(near(blended.get(i), expected, 1e-5f));
+				CHECK(near(blended_in_place.get(i), i < n ? expected : a.get(i), 1e-5f));
+			}
+
+			//b as authored against the reference a
+			transform_streams difference(count);
+			transform_streams difference_in_place = b;
+			for (size_t i = 0; i < count; i++)
+			{
+				difference.set(i, zero_transform());
+			}
+			k.difference(b.soa(), a.soa(), difference.soa(), n);
+			k.difference(difference_in_place.soa(), a.soa(), difference_in_place.soa(), n);
+			for (size_t i = 0; i < count; i++)
+			{
+				transform expected = zero_transform();
+				if (i < n)
+				{
+					expected.position = b.get(i).position - a.get(i).position;
+					expected.rotation = math::inverse(a.get(i).rotation) * b.get(i).rotation;
+					expected.scale = b.get(i).scale - a.get(i).scale;
+				}
+				CHECK(near(difference.get(i), expected, 1e-5f));
+				CHECK(near(difference_in_place.get(i), i < n ? expected : b.get(i), 1e-5f));
+			}
+
+			transform_streams added(count);
+			transform_streams added_in_place = a;
+			for (size_t i = 0; i < count; i++)
+			{
+				added.set(i, zero_transform());
+			}
+			k.add(a.soa(), difference.soa(), weights.data(), added.soa(), n);
+			k.add(added_in_place.soa(), difference.soa(), weights.data(), added_in_place.soa(), n);
+			for (size_t i = 0; i < count; i++)
+			{
+				transform expected = zero_transform();
+				if (i < n)
+				{
+					const transform d = difference.get(i);
+					expected.position = a.get(i).position + d.position * weights[i];
+					expected.rotation = math::normalize(a.get(i).rotation * math::nlerp(quaternion(), d.rotation, weights[i]));
+					expected.scale = a.get(i).scale + d.scale * weights[i];
+					//the full difference added back onto its reference is the pose it came from
+					if (weights[i] == 1.0f)
+					{
+						CHECK(near(added.get(i).position, b.get(i).position, 1e-5f));
+						CHECK(near_rotation(added.get(i).rotation, b.get(i).rotation, 1e-5f));
+						CHECK(near(added.get(i).scale, b.get(i).scale, 1e-5f));
+					}
+				}
+				CHECK(near(added.get(i), expected, 1e-5f));
+				CHECK(near(added_in_place.get(i), i < n ? expected : a.get(i), 1e-5f));
+			}
+		}
+	});
+}
+
+//fractal sum as game_app computed it before the batch kernel, normalized by the sum of the amplitudes
+static float fbm_reference(const float3& p, int octaves, float frequency, float persistence)
+{
+	float total = 0.0f;
+	float max_amplitude = 0.0f;
+	float amplitude = 1.0f;
+	for (int o = 0; o < octaves; o++)
+	{
+		total += math::improved_noise::noise(p * frequency) * amplitude;
+		frequency *= 2.0f;
+		max_amplitude += amplitude;
+		amplitude *= persistence;
+	}
+	return total / max_amplitude;
+}
+
+static void noise_kernels_match_scalar()
+{
+	const size_t count = 203;
+	float3_streams points(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		switch (i % 4)
+		{
+		//on the lattice, where improved noise is 0
+		case 0: points.set(i, float3(floorf(random_float(-20, 20)), floorf(random_float(-20, 20)), floorf(random_float(-20, 20)))); break;
+		//past the 256 the permutation table wraps at, and negative
+		case 1: points.set(i, float3(random_float(200, 600), random_float(-600, -200), random_float(250, 260))); break;
+		default: points.set(i, float3(random_float(-20, 20), random_float(-20, 20), random_float(-20, 20))); break;
+		}
+	}
+
+	for_each_isa([&](instruction_set isa)
+	{
+		const batch_kernels& k = get_batch_kernels(isa);
+		std::vector<float> out(count);
+		std::vector<float> with_derivatives(count);
+		float3_streams derivatives(count);
+		k.noise(points.soa(), out.data(), count);
+		k.noise_derivatives(points.soa(), with_derivatives.data(), derivatives.soa(), count);
+		int wrong_gradient = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			const float3 p = points.get(i);
+			const float expected = math::improved_noise::noise(p);
+			CHECK(near(out[i], expected, 1e-5f));
+			CHECK(near(with_derivatives[i], expected, 1e-5f));
+			if (i % 4 == 0)
+			{
+				CHECK(out[i] == 0.0f);
+			}
+
+			//central differences of the scalar noise, away from the cell walls where they straddle two cells
+			const float h = 1e-3f;
+			float3 f = p - float3(floorf(p.x), floorf(p.y), floorf(p.z));
+			if (i % 4 != 1 && std::min(std::min(f.x, f.y), f.z) > 2 * h && std::max(std::max(f.x, f.y), f.z) < 1 - 2 * h)
+			{
+				float3 numeric(
+					(math::improved_noise::noise(p + float3(h, 0, 0)) - math::improved_noise::noise(p - float3(h, 0, 0))) / (2 * h),
+					(math::improved_noise::noise(p + float3(0, h, 0)) - math::improved_noise::noise(p - float3(0, h, 0))) / (2 * h),
+					(math::improved_noise::noise(p + float3(0, 0, h)) - math::improved_noise::noise(p - float3(0, 0, h))) / (2 * h));
+				wrong_gradient += !near(derivatives.get(i), numeric, 2e-2f);
+			}
+		}
+		CHECK(wrong_gradient == 0);
+
+		//every count up to 37 for the remainders, against the scalar set which the loop above already checked
+		const batch_kernels& scalar = get_batch_kernels(instruction_set::scalar);
+		std::vector<float> expected(count);
+		float3_streams expected_derivatives(count);
+		for (size_t n = 0; n <= 37; n++)
+		{
+			std::fill(out.begin(), out.end(), -2.0f);
+			k.noise(points.soa(), out.data(), n);
+			scalar.noise(points.soa(), expected.data(), n);
+			k.noise_derivatives(points.soa(), with_derivatives.data(), derivatives.soa(), n);
+			scalar.noise_derivatives(points.soa(), expected.data(), expected_derivatives.soa(), n);
+			for (size_t i = 0; i < n; i++)
+			{
+				CHECK(near(out[i], expected[i], 1e-5f));
+				CHECK(near(derivatives.get(i), expected_derivatives.get(i), 1e-5f));
+			}
+			CHECK(out[n] == -2.0f);
+		}
+
+		//the terrain settings of game_app and a few others
+		const float settings[][3] = { { 5, 0.07f, 0.5f }, { 1, 1.0f, 0.5f }, { 4, 0.37f, 0.8f }, { 8, 0.013f, 0.5f } };
+		for (const auto& setting : settings)
+		{
+			const int octaves = (int)setting[0];
+			k.fbm(points.soa(), out.data(), count, octaves, setting[1], setting[2]);
+			int wrong = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				wrong += !near(out[i], fbm_reference(points.get(i), octaves, setting[1], setting[2]), 1e-5f);
+				wrong += fabsf(out[i]) > 1.0f;
+			}
+			CHECK(wrong == 0);
+		}
+	});
+}
+
+//linear blend skinning written out from the palette, normals through the blended 3x3 and renormalized
+static void skin_linear_reference(const float4x4* palette, const int* joints, const float* weights, const float3& p, const float3& n,
+	float3& out_position, float3& out_normal)
+{
+	float4x4 m = {};
+	for (int k = 0; k < 4; k++)
+	{
+		for (int e = 0; e < 16; e++)
+		{
+			m[e] += palette[joints[k]][e] * weights[k];
+		}
+	}
+	out_position = float3(m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12], m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13], m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14]);
+	out_normal = float3(m[0] * n.x + m[4] * n.y + m[8] * n.z, m[1] * n.x + m[5] * n.y + m[9] * n.z, m[2] * n.x + m[6] * n.y + m[10] * n.z);
+	float len_sq = math::dot(out_normal, out_normal);
+	if (len_sq >= math::epsilon)
+	{
+		out_normal = out_normal * (1.0f / sqrtf(len_sq));
+	}
+}
+
+//dual quaternion blend in the hemisphere of the first joint, normalized, applied through math::transform_point
+static void skin_dual_quaternion_reference(const dual_quaternion* palette, const int* joints, const float* weights, const float3& p, const float3& n,
+	float3& out_position, float3& out_normal)
+{
+	quaternion real(0, 0, 0, 0);
+	quaternion dual(0, 0, 0, 0);
+	for (int k = 0; k < 4; k++)
+	{
+		const dual_quaternion& d = palette[joints[k]];
+		float w = math::dot(palette[joints[0]].real, d.real) < 0.0f ? -weights[k] : weights[k];
+		real = real + d.real * w;
+		dual = dual + d.dual * w;
+	}
+	float len_sq = math::dot(real, real);
+	if (len_sq < math::epsilon)
+	{
+		out_position = p;
+		out_normal = n;
+		return;
+	}
+	float s = 1.0f / sqrtf(len_sq);
+	dual_quaternion blended;
+	blended.real = real * s;
+	blended.dual = dual * s;
+	out_position = math::transform_point(blended, p);
+	out_normal = blended.real * n;
+}
+
+static void skinning_kernels_match_reference()
+{
+	const size_t count = 203;
+	const int joint_count = 40;
+	std::vector<transform> rigid(joint_count);
+	std::vector<float4x4> linear_palette(joint_count);
+	std::vector<float4x4> rigid_palette(joint_count);
+	std::vector<dual_quaternion> dq_palette(joint_count);
+	for (int j = 0; j < joint_count; j++)
+	{
+		//scale and all for linear blending, dual quaternions take rigid palettes only
+		math::to_float4x4(random_transform(), linear_palette[j]);
+		rigid[j] = random_transform();
+		rigid[j].scale = float3(1, 1, 1);
+		math::to_float4x4(rigid[j], rigid_palette[j]);
+		math::to_dual_quaternion(rigid_palette[j], dq_palette[j]);
+	}
+
+	float3_streams position(count);
+	float3_streams normal(count);
+	std::vector<int> joints[4];
+	std::vector<float> weights[4];
+	for (int k = 0; k < 4; k++)
+	{
+		joints[k].resize(count);
+		weights[k].resize(count);
+	}
+	for (size_t i = 0; i < count; i++)
+	{
+		position.set(i, float3(random_float(-2, 2), random_float(-2, 2), random_float(-2, 2)));
+		normal.set(i, math::normalize(float3(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1))));
+		float w[4];
+		float sum = 0;
+		for (int k = 0; k < 4; k++)
+		{
+			joints[k][i] = (int)(rng() % joint_count);
+			w[k] = random_float(0, 1);
+			sum += w[k];
+		}
+		for (int k = 0; k < 4; k++)
+		{
+			//a single influence on every fifth vertex, no influence at all on vertex 1
+			weights[k][i] = i == 1 ? 0.0f : i % 5 == 0 ? (k == 0 ? 1.0f : 0.0f) : w[k] / sum;
+		}
+	}
+	skinning_soa in{ position.soa(), normal.soa(),
+		{ joints[0].data(), joints[1].data(), joints[2].data(), joints[3].data() },
+		{ weights[0].data(), weights[1].data(), weights[2].data(), weights[3].data() } };
+
+	for_each_isa([&](instruction_set isa)
+	{
+		const batch_kernels& k = get_batch_kernels(isa);
+		float3_streams out_position(count);
+		float3_streams out_normal(count);
+
+		k.skin_linear(in, linear_palette.data(), out_position.soa(), out_normal.soa(), count);
+		for (size_t i = 0; i < count; i++)
+		{
+			const int j[4] = { joints[0][i], joints[1][i], joints[2][i], joints[3][i] };
+			const float w[4] = { weights[0][i], weights[1][i], weights[2][i], weights[3][i] };
+			float3 p;
+			float3 n;
+			skin_linear_reference(linear_palette.data(), j, w, position.get(i), normal.get(i), p, n);
+			CHECK(near(out_position.get(i), p, 1e-5f));
+			CHECK(near(out_normal.get(i), n, 1e-5f));
+		}
+
+		k.skin_dual_quaternion(in, dq_palette.data(), out_position.soa(), out_normal.soa(), count);
+		for (size_t i = 0; i < count; i++)
+		{
+			const int j[4] = { joints[0][i], joints[1][i], joints[2][i], joints[3][i] };
+			const float w[4] = { weights[0][i], weights[1][i], weights[2][i], weights[3][i] };
+			float3 p;
+			float3 n;
+			skin_dual_quaternion_reference(dq_palette.data(), j, w, position.get(i), normal.get(i), p, n);
+			CHECK(near(out_position.get(i), p, 1e-5f));
+			CHECK(near(out_normal.get(i), n, 1e-5f));
+			if (i % 5 == 0)
+			{
+				//one joint: both methods are the joint's rigid transform
+				const transform& t = rigid[j[0]];
+				float3 expected = t.position + t.rotation * position.get(i);
+				CHECK(near(out_position.get(i), expected, 1e-4f));
+				CHECK(near(out_normal.get(i), t.rotation * normal.get(i), 1e-4f));
+			}
+		}
+	});
+}
+
+//fabrik_soa streams for count chains of joint_count joints, joint j of chain i at [j * count + i]
+struct fabrik_streams
+{
+	size_t count;
+	float3_streams joints;
+	std::vector<float> lengths;
+	float3_streams hinge_axes;
+	std::vector<float> cone_cos;
+	float3_streams reference;
+	float3_streams targets;
+	std::vector<float> error;
+
+	fabrik_streams(size_t count, int joint_count) : count(count), joints(count * joint_count), lengths(count * joint_count),
+		hinge_axes(count * joint_count), cone_cos(count * joint_count), reference(count), targets(count), error(count) {}
+
+	fabrik_soa soa()
+	{
+		return fabrik_soa{ joints.soa(), lengths.data(), hinge_axes.soa(), cone_cos.data(), reference.soa(), targets.soa(), error.data(), count };
+	}
+	float3 joint(size_t chain, int j) const { return joints.get(j * count + chain); }
+};
+
+static float3 random_direction()
+{
+	return math::normalize(float3(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1)));
+}
+
+//free bones, hinges and cones mixed within and across chains. Targets in reach, at the edge and out of it
+static fabrik_streams random_chains(size_t count, int joint_count)
+{
+	fabrik_streams s(count, joint_count);
+	for (size_t i = 0; i < count; i++)
+	{
+		float3 p(random_float(-5, 5), random_float(-5, 5), random_float(-5, 5));
+		float reach = 0.0f;
+		s.joints.set(i, p);
+		s.reference.set(i, random_direction());
+		for (int j = 0; j < joint_count; j++)
+		{
+			const size_t o = j * count + i;
+			if (j > 0)
+			{
+				s.lengths[o] = random_float(0.2f, 1.0f);
+				reach += s.lengths[o];
+				p = p + random_direction() * s.lengths[o];
+				s.joints.set(o, p);
+			}
+			const int constraint = (int)((i + j) % 3);
+			s.hinge_axes.set(o, constraint == 1 ? random_direction() : float3(0, 0, 0));
+			s.cone_cos[o] = constraint == 2 ? cosf(random_float(0.3f, 1.5f)) : -1.0f;
+		}
+		const float distance = reach * (i % 4 == 0 ? random_float(1.1f, 2.0f) : random_float(0.1f, 0.95f));
+		s.targets.set(i, s.joints.get(i) + random_direction() * distance);
+		s.error[i] = -1.0f;
+	}
+	return s;
+}
+
+static float3 bone_direction(const fabrik_streams& s, size_t chain, int j)
+{
+	return math::normalize(s.joint(chain, j + 1) - s.joint(chain, j));
+}
+
+//the fabrik kernel of every set against the scalar one, one chain per lane and every count up to 37. With early
+//exit off every set runs the same iterations and has to give the scalar result. With it on a block iterates until
+//all of its chains are done, so chains can get more iterations than alone: bone lengths, root, constraints and the
+//reported error have to hold, and a chain the scalar kernel gets within tolerance has to get there as well
+static void fabrik_kernel_matches_scalar()
+{
+	const size_t count = 37;
+	const int joint_counts[] = { 2, 3, 5 };
+	const batch_kernels& scalar = get_batch_kernels(instruction_set::scalar);
+	for (int joint_count : joint_counts)
+	{
+		const fabrik_streams chains = random_chains(count, joint_count);
+		//every chain on its own
+		fabrik_streams alone = chains;
+		scalar.fabrik(alone.soa(), count, joint_count, 16, 1e-3f);
+		for (size_t i = 0; i < count; i++)
+		{
+			fabrik_streams one = chains;
+			scalar.fabrik(one.soa().offset(i), 1, joint_count, 16, 1e-3f);
+			for (int j = 0; j < joint_count; j++)
+			{
+				CHECK(math::equals(one.joint(i, j), alone.joint(i, j)));
+			}
+		}
+		//a tolerance nothing gets within, so no block stops early
+		fabrik_streams fixed = chains;
+		scalar.fabrik(fixed.soa(), count, joint_count, 4, -FLT_MAX);
+
+		for_each_isa([&](instruction_set isa)
+		{
+			const batch_kernels& k = get_batch_kernels(isa);
+			int wrong_fixed = 0;
+			int wrong_shape = 0;
+			int wrong_error = 0;
+			int not_reached = 0;
+			int touched = 0;
+			for (size_t n = 0; n <= count; n++)
+			{
+				fabrik_streams out = chains;
+				k.fabrik(out.soa(), n, joint_count, 4, -FLT_MAX);
+				for (size_t i = 0; i < n; i++)
+				{
+					for (int j = 0; j < joint_count; j++)
+					{
+						wrong_fixed += !near(out.joint(i, j), fixed.joint(i, j), 1e-4f);
+					}
+					wrong_fixed += !near(out.error[i], fixed.error[i], 1e-4f);
+				}
+
+				out = chains;
+				k.fabrik(out.soa(), n, joint_count, 16, 1e-3f);
+				for (size_t i = 0; i < count; i++)
+				{
+					if (i >= n)
+					{
+						for (int j = 0; j < joint_count; j++)
+						{
+							touched += !math::equals(out.joint(i, j), chains.joint(i, j));
+						}
+						touched += out.error[i] != chains.error[i];
+						continue;
+					}
+					wrong_shape += !near(out.joint(i, 0), chains.joint(i, 0), 1e-6f);
+					float3 before = chains.reference.get(i);
+					for (int j = 0; j + 1 < joint_count; j++)
+					{
+						const size_t bone = j * count + i;
+						const float3 d = bone_direction(out, i, j);
+						wrong_shape += !near(math::length(out.joint(i, j + 1) - out.joint(i, j)), chains.lengths[bone + count], 1e-4f);
+						wrong_shape += fabsf(math::dot(d, chains.hinge_axes.get(bone))) > 1e-3f;
+						wrong_shape += math::dot(d, before) < chains.cone_cos[bone] - 1e-3f;
+						before = d;
+					}
+					const float3 tip = out.joint(i, joint_count - 1);
+					//math::length rounds short vectors to 0
+					wrong_error += !near(out.error[i], sqrtf(math::sqr_length(tip - chains.targets.get(i))), 1e-4f);
+					not_reached += alone.error[i] <= 1e-3f && out.error[i] > 1e-3f;
+				}
+			}
+			if (wrong_fixed + wrong_shape + wrong_error + not_reached + touched != 0)
+			{
+				printf("fabrik, %d joints: %d fixed iterations off, %d shapes, %d errors, %d not reached, %d touched past count\n",
+					joint_count, wrong_fixed, wrong_shape, wrong_error, not_reached, touched);
+			}
+			CHECK(wrong_fixed == 0);
+			CHECK(wrong_shape == 0);
+			CHECK(wrong_error == 0);
+			CHECK(not_reached == 0);
+			CHECK(touched == 0);
+		});
+	}
+}
+
+int main()
+{
+	printf("detected %s\n", to_string(detect_instruction_set()));
+	float4x4_kernels_match_scalar();
+	quaternion_kernels_match_scalar();
+	transform_kernels_match_scalar();
+	lerp_kernel_matches_scalar();
+	blending_kernels_match_scalar();
+	noise_kernels_match_scalar();
+	skinning_kernels_match_reference();
+	fabrik_kernel_matches_scalar();
+	return test_result("simd_test");
+}
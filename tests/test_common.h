@@ -0,0 +1,36 @@
+#pragma once
+#include <stdio.h>
+#include <chrono>
+
+//components.h expects the vulkan headers to be included before it, the tests don't use vulkan
+typedef void* VkBuffer;
+#define VK_NULL_HANDLE nullptr
+
+//every test file is its own executable, main returns test_result()
+static int test_failures = 0;
+
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			test_failures++; \
+		} \
+	} while (0)
+
+inline int test_result(const char* name)
+{
+	if (test_failures == 0)
+	{
+		printf("%s: passed\n", name);
+		return 0;
+	}
+	printf("%s: %d checks failed\n", name, test_failures);
+	return 1;
+}
+
+inline double elapsed_ms(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
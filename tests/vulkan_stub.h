@@ -0,0 +1,34 @@
+#pragma once
+#include <stdint.h>
+
+//the parts of vulkan.h skinned_vertex.h uses, so gltf_loader.cpp builds without the vulkan sdk.
+//CMakeLists.txt forwards "vulkan\vulkan.h" here, the values match vulkan_core.h
+
+typedef enum VkVertexInputRate
+{
+	VK_VERTEX_INPUT_RATE_VERTEX = 0,
+	VK_VERTEX_INPUT_RATE_INSTANCE = 1
+} VkVertexInputRate;
+
+typedef enum VkFormat
+{
+	VK_FORMAT_R32G32_SFLOAT = 103,
+	VK_FORMAT_R32G32B32_SFLOAT = 106,
+	VK_FORMAT_R32G32B32A32_SINT = 108,
+	VK_FORMAT_R32G32B32A32_SFLOAT = 109
+} VkFormat;
+
+typedef struct VkVertexInputBindingDescription
+{
+	uint32_t binding;
+	uint32_t stride;
+	VkVertexInputRate inputRate;
+} VkVertexInputBindingDescription;
+
+typedef struct VkVertexInputAttributeDescription
+{
+	uint32_t location;
+	uint32_t binding;
+	VkFormat format;
+	uint32_t offset;
+} VkVertexInputAttributeDescription;